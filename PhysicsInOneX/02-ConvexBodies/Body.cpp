@@ -8,7 +8,7 @@ void Body::Update(const float dt_sec)
     // We have an angular velocity around the center of mass, this needs to be converted
     // to relative to model position. This way we can properly update the orientation
     // of the model
-    Vec3 positionCM = GetCenterOfMassWorldSpace();
+    Vec3 positionCM = centerOfMassWorldSpace + linearVelocity * dt_sec;
     Vec3 CMToPositon = position - positionCM;
 
     // Total torques is equal to external applied torques + internal torque (precession)
@@ -16,10 +16,11 @@ void Body::Update(const float dt_sec)
     // Texternal = 0 because it was applied in the collision response function
     // T = Ia = w x I * w
     // a = I^-1 (w x I * w)
-    Mat3 orientationMat = orientation.ToMat3();
-    Mat3 inertiaTensor = orientationMat * shape->InertiaTensor() * orientationMat.Transpose();
-    Vec3 alpha = inertiaTensor.Inverse() * (angularVelocity.Cross(inertiaTensor * angularVelocity));
-    angularVelocity += alpha * dt_sec;
+    // Worked out in body space, where the shape keeps both tensors
+    Vec3 localAngularVelocity = orientationMatrix.Transpose() * angularVelocity;
+    const Mat3 inertiaTensor = VisitShape(shape, [](const auto& concrete) { return concrete.InertiaTensor(); });
+    Vec3 localAlpha = shape->InverseInertiaTensor() * (localAngularVelocity.Cross(inertiaTensor * localAngularVelocity));
+    angularVelocity += orientationMatrix * localAlpha * dt_sec;
 
     // Update orientation
     Vec3 dAngle = angularVelocity * dt_sec;
@@ -29,13 +30,13 @@ void Body::Update(const float dt_sec)
 
     // Get the new model position
     position = positionCM + dq.RotatePoint(CMToPositon);
+
+    UpdateDerivedState();
 }
 
-Vec3 Body::GetCenterOfMassWorldSpace() const
+void Body::UpdateDerivedState()
 {
-    const Vec3 centerOfMass = shape->GetCenterOfMass();
-    const Vec3 pos = position + orientation.RotatePoint(centerOfMass);
-    return pos;
+    DeriveBodyState(position, orientation, inverseMass, shape->InverseInertiaTensor(), shape->GetCenterOfMass(), orientationMatrix, inverseInertiaWorldSpace, centerOfMassWorldSpace);
 }
 
 Vec3 Body::GetCenterOfMassBodySpace() const
@@ -43,69 +44,34 @@ Vec3 Body::GetCenterOfMassBodySpace() const
     return shape->GetCenterOfMass();
 }
 
-Vec3 Body::WorldSpaceToBodySpace(const Vec3& worldPoint)
+Vec3 Body::WorldSpaceToBodySpace(const Vec3& worldPoint) const
 {
-    const Vec3 tmp = worldPoint - GetCenterOfMassWorldSpace();
-    const Quat invertOrient = orientation.Inverse();
-    Vec3 bodySpace = invertOrient.RotatePoint(tmp);
+    const Vec3 tmp = worldPoint - centerOfMassWorldSpace;
+    Vec3 bodySpace = orientationMatrix * tmp;
     return bodySpace;
 }
 
-Vec3 Body::BodySpaceToWorldSpace(const Vec3& bodyPoint)
+Vec3 Body::BodySpaceToWorldSpace(const Vec3& bodyPoint) const
 {
-    Vec3 worldSpace = GetCenterOfMassWorldSpace() + orientation.RotatePoint(bodyPoint);
+    Vec3 worldSpace = centerOfMassWorldSpace + RotateToWorld(bodyPoint);
     return worldSpace;
 }
 
 Mat3 Body::GetInverseInertiaTensorBodySpace() const
 {
-    Mat3 inertiaTensor = shape->InertiaTensor();
-    Mat3 inverseInertiaTensor = inertiaTensor.Inverse() * inverseMass;
-    return inverseInertiaTensor;
-}
-
-Mat3 Body::GetInverseInertiaTensorWorldSpace() const
-{
-    Mat3 inertiaTensor = shape->InertiaTensor();
-    Mat3 inverseInertiaTensor = inertiaTensor.Inverse() * inverseMass;
-    Mat3 orient = orientation.ToMat3();
-    inverseInertiaTensor = orient * inverseInertiaTensor * orient.Transpose();
-    return inverseInertiaTensor;
-}
-
-void Body::ApplyImpulseLinear(const Vec3& impulse)
-{
-    if (inverseMass == 0.0f) return;
-    // dv = J / m
-    linearVelocity += impulse * inverseMass;
+    return shape->InverseInertiaTensor() * inverseMass;
 }
 
-void Body::ApplyImpulseAngular(const Vec3& impulse)
+void DeriveBodyState(const Vec3& position, const Quat& orientation, const float inverseMass, const Mat3& shapeInverseInertia, const Vec3& shapeCenterOfMass,
+    Mat3& orientationMatrix, Mat3& inverseInertiaWorldSpace, Vec3& centerOfMassWorldSpace)
 {
-    if (inverseMass == 0.0f) return;
-
-    // L = I w = r x p
-    // dL = I dw = r x J
-    // dw = I^-1 * ( r x J )
-    angularVelocity += GetInverseInertiaTensorWorldSpace() * impulse;
+    orientationMatrix = orientation.ToMat3();
+    centerOfMassWorldSpace = position + (orientationMatrix.rows[0] * shapeCenterOfMass.x + orientationMatrix.rows[1] * shapeCenterOfMass.y + orientationMatrix.rows[2] * shapeCenterOfMass.z);
 
-    // Clamp angular velocity
-    const float maxAngularSpeed = 30.0f; // 30 rad per seconds, sufficient for now
-    if (angularVelocity.GetLengthSqr() > maxAngularSpeed * maxAngularSpeed)
-    {
-        angularVelocity.Normalize();
-        angularVelocity *= maxAngularSpeed;
+    // Bodies without mass never turn, whatever their shape
+    if (inverseMass == 0.0f) {
+        inverseInertiaWorldSpace.Zero();
+        return;
     }
-
-}
-
-void Body::ApplyImpulse(const Vec3& impulsePoint, const Vec3& impulse)
-{
-    if (inverseMass == 0.0f) return;
-    ApplyImpulseLinear(impulse);
-    
-    Vec3 position = GetCenterOfMassWorldSpace(); // Applying impulse must produce torques through the center of mass
-    Vec3 r = impulsePoint - position;
-    Vec3 dL = r.Cross(impulse); // World space
-    ApplyImpulseAngular(dL);
+    inverseInertiaWorldSpace = orientationMatrix * shapeInverseInertia * orientationMatrix.Transpose() * inverseMass;
 }
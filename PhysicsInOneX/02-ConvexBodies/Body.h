@@ -3,6 +3,8 @@
 #include "code/Renderer/model.h"
 #include "code/Math/Quat.h"
 
+// A body as it is handed to the store, and the copies of stored bodies the narrowphase
+// moves to the time of impact and back. The store keeps its bodies field by field.
 class Body
 {
 public:
@@ -17,25 +19,29 @@ public:
 
 	Shape* shape;
 
+	// Derived from the pose, read by the narrowphase. Update refreshes them,
+	// anything else moving the body or changing its shape calls UpdateDerivedState.
+	Mat3 orientationMatrix;			// From ToMat3, its rows are the body axes in world space
+	Mat3 inverseInertiaWorldSpace;
+	Vec3 centerOfMassWorldSpace;
+
 	void Update(const float dt_sec);
+	void UpdateDerivedState();
 
-	Vec3 GetCenterOfMassWorldSpace() const;
+	const Vec3& GetCenterOfMassWorldSpace() const { return centerOfMassWorldSpace; }
 	Vec3 GetCenterOfMassBodySpace() const;
 
-	Vec3 WorldSpaceToBodySpace(const Vec3& worldPoint);
-	Vec3 BodySpaceToWorldSpace(const Vec3& bodyPoint);
-
-	Mat3 GetInverseInertiaTensorBodySpace() const;
-	Mat3 GetInverseInertiaTensorWorldSpace() const;
+	Vec3 WorldSpaceToBodySpace(const Vec3& worldPoint) const;
+	Vec3 BodySpaceToWorldSpace(const Vec3& bodyPoint) const;
 
-	void ApplyImpulseLinear(const Vec3& impulse);
-	void ApplyImpulseAngular(const Vec3& impulse);
+	// Same as orientation.RotatePoint, through the cached matrix
+	Vec3 RotateToWorld(const Vec3& v) const { return orientationMatrix.rows[0] * v.x + orientationMatrix.rows[1] * v.y + orientationMatrix.rows[2] * v.z; }
 
-	/// <summary>
-	/// Apply impulse on a specific world space
-	/// </summary>
-	/// <param name="impulsePoint">The world space location of the application of the impulse</param>
-	/// <param name="impulse">The world space direction and magnitude of the impulse</param>
-	void ApplyImpulse(const Vec3& impulsePoint, const Vec3& impulse);
+	Mat3 GetInverseInertiaTensorBodySpace() const;
+	const Mat3& GetInverseInertiaTensorWorldSpace() const { return inverseInertiaWorldSpace; }
 };
 
+// State derived from a pose, for Body and the store alike. The inverse inertia is the one
+// of the shape, before scaling by the inverse mass.
+void DeriveBodyState(const Vec3& position, const Quat& orientation, const float inverseMass, const Mat3& shapeInverseInertia, const Vec3& shapeCenterOfMass,
+	Mat3& orientationMatrix, Mat3& inverseInertiaWorldSpace, Vec3& centerOfMassWorldSpace);
@@ -0,0 +1,265 @@
+#include "BodyStore.h"
+#include <utility>
+#include "Shape.h"
+
+void BodyStore::Reserve(const int num)
+{
+	positions.reserve(num);
+	orientations.reserve(num);
+	linearVelocities.reserve(num);
+	angularVelocities.reserve(num);
+	inverseMasses.reserve(num);
+	orientationMatrices.reserve(num);
+	inverseInertiasWorldSpace.reserve(num);
+	centersOfMassWorldSpace.reserve(num);
+	inertiasBodySpace.reserve(num);
+	inverseInertiasBodySpace.reserve(num);
+	centersOfMassBodySpace.reserve(num);
+	coldStates.reserve(num);
+	bodySlots.reserve(num);
+	slots.reserve(num);
+}
+
+BodyHandle BodyStore::Add(const Body& body)
+{
+	int slot = firstFreeSlot;
+	if (slot != -1) {
+		firstFreeSlot = slots[slot].index;
+	} else {
+		slot = (int)slots.size();
+		slots.push_back({ 0, 1 });
+	}
+	slots[slot].index = Size();
+
+	positions.push_back(body.position);
+	orientations.push_back(body.orientation);
+	linearVelocities.push_back(body.linearVelocity);
+	angularVelocities.push_back(body.angularVelocity);
+	inverseMasses.push_back(body.inverseMass);
+	orientationMatrices.emplace_back();
+	inverseInertiasWorldSpace.emplace_back();
+	centersOfMassWorldSpace.emplace_back();
+	inertiasBodySpace.emplace_back();
+	inverseInertiasBodySpace.emplace_back();
+	centersOfMassBodySpace.emplace_back();
+
+	BodyColdState coldState;
+	coldState.shape = nullptr;
+	coldState.elasticity = body.elasticity;
+	coldState.friction = body.friction;
+	coldState.isSleeping = false;
+	coldState.sleepTime = 0.0f;
+	coldState.islandId = -1;
+	coldState.isIslandWakePending = false;
+	coldStates.push_back(coldState);
+	bodySlots.push_back(slot);
+
+	SetShape(Size() - 1, body.shape);
+
+	BodyHandle handle;
+	handle.slot = slot;
+	handle.generation = slots[slot].generation;
+	return handle;
+}
+
+void BodyStore::Remove(const BodyHandle handle)
+{
+	const int index = IndexOf(handle);
+	if (index == -1) {
+		return;
+	}
+
+	// The last body fills the hole
+	const int last = Size() - 1;
+	if (index != last) {
+		SwapBodies(index, last);
+		slots[bodySlots[index]].index = index;
+	}
+	positions.pop_back();
+	orientations.pop_back();
+	linearVelocities.pop_back();
+	angularVelocities.pop_back();
+	inverseMasses.pop_back();
+	orientationMatrices.pop_back();
+	inverseInertiasWorldSpace.pop_back();
+	centersOfMassWorldSpace.pop_back();
+	inertiasBodySpace.pop_back();
+	inverseInertiasBodySpace.pop_back();
+	centersOfMassBodySpace.pop_back();
+	coldStates.pop_back();
+	bodySlots.pop_back();
+
+	Slot& slot = slots[handle.slot];
+	slot.generation++;
+	slot.index = firstFreeSlot;
+	firstFreeSlot = handle.slot;
+}
+
+void BodyStore::Clear()
+{
+	// Slots keep their generation, handles from before the clear stay stale
+	for (int i = 0; i < (int)bodySlots.size(); i++) {
+		Slot& slot = slots[bodySlots[i]];
+		slot.generation++;
+		slot.index = firstFreeSlot;
+		firstFreeSlot = bodySlots[i];
+	}
+	positions.clear();
+	orientations.clear();
+	linearVelocities.clear();
+	angularVelocities.clear();
+	inverseMasses.clear();
+	orientationMatrices.clear();
+	inverseInertiasWorldSpace.clear();
+	centersOfMassWorldSpace.clear();
+	inertiasBodySpace.clear();
+	inverseInertiasBodySpace.clear();
+	centersOfMassBodySpace.clear();
+	coldStates.clear();
+	bodySlots.clear();
+}
+
+void BodyStore::Reorder(const int* order)
+{
+	// Slots learn where their body goes first. Then the body at i is swapped to its place
+	// until the one left at i belongs there, each swap settles a body and nothing is copied
+	// aside.
+	const int num = Size();
+	for (int i = 0; i < num; i++) {
+		slots[bodySlots[order[i]]].index = i;
+	}
+	for (int i = 0; i < num; i++) {
+		for (int target = slots[bodySlots[i]].index; target != i; target = slots[bodySlots[i]].index) {
+			SwapBodies(i, target);
+		}
+	}
+}
+
+void BodyStore::SwapBodies(const int i, const int j)
+{
+	std::swap(positions[i], positions[j]);
+	std::swap(orientations[i], orientations[j]);
+	std::swap(linearVelocities[i], linearVelocities[j]);
+	std::swap(angularVelocities[i], angularVelocities[j]);
+	std::swap(inverseMasses[i], inverseMasses[j]);
+	std::swap(orientationMatrices[i], orientationMatrices[j]);
+	std::swap(inverseInertiasWorldSpace[i], inverseInertiasWorldSpace[j]);
+	std::swap(centersOfMassWorldSpace[i], centersOfMassWorldSpace[j]);
+	std::swap(inertiasBodySpace[i], inertiasBodySpace[j]);
+	std::swap(inverseInertiasBodySpace[i], inverseInertiasBodySpace[j]);
+	std::swap(centersOfMassBodySpace[i], centersOfMassBodySpace[j]);
+	std::swap(coldStates[i], coldStates[j]);
+	std::swap(bodySlots[i], bodySlots[j]);
+}
+
+bool BodyStore::IsValid(const BodyHandle handle) const
+{
+	return handle.slot >= 0 && handle.slot < (int)slots.size() && slots[handle.slot].generation == handle.generation;
+}
+
+int BodyStore::IndexOf(const BodyHandle handle) const
+{
+	return IsValid(handle) ? slots[handle.slot].index : -1;
+}
+
+BodyHandle BodyStore::HandleAt(const int index) const
+{
+	BodyHandle handle;
+	handle.slot = bodySlots[index];
+	handle.generation = slots[handle.slot].generation;
+	return handle;
+}
+
+Body BodyStore::GetBody(const int index) const
+{
+	Body body;
+	body.position = positions[index];
+	body.orientation = orientations[index];
+	body.linearVelocity = linearVelocities[index];
+	body.angularVelocity = angularVelocities[index];
+	body.inverseMass = inverseMasses[index];
+	body.elasticity = coldStates[index].elasticity;
+	body.friction = coldStates[index].friction;
+	body.shape = coldStates[index].shape;
+	body.orientationMatrix = orientationMatrices[index];
+	body.inverseInertiaWorldSpace = inverseInertiasWorldSpace[index];
+	body.centerOfMassWorldSpace = centersOfMassWorldSpace[index];
+	return body;
+}
+
+void BodyStore::SetShape(const int index, Shape* shape)
+{
+	coldStates[index].shape = shape;
+	inertiasBodySpace[index] = shape->InertiaTensor();
+	inverseInertiasBodySpace[index] = shape->InverseInertiaTensor();
+	centersOfMassBodySpace[index] = shape->GetCenterOfMass();
+	UpdateDerivedState(index);
+}
+
+void BodyStore::UpdateDerivedState(const int index)
+{
+	DeriveBodyState(positions[index], orientations[index], inverseMasses[index], inverseInertiasBodySpace[index], centersOfMassBodySpace[index],
+		orientationMatrices[index], inverseInertiasWorldSpace[index], centersOfMassWorldSpace[index]);
+}
+
+Vec3 BodyStore::WorldSpaceToBodySpace(const int index, const Vec3& worldPoint) const
+{
+	return orientationMatrices[index] * (worldPoint - centersOfMassWorldSpace[index]);
+}
+
+Vec3 BodyStore::BodySpaceToWorldSpace(const int index, const Vec3& bodyPoint) const
+{
+	const Mat3& m = orientationMatrices[index];
+	return centersOfMassWorldSpace[index] + (m.rows[0] * bodyPoint.x + m.rows[1] * bodyPoint.y + m.rows[2] * bodyPoint.z);
+}
+
+void BodyStore::Wake(const int index)
+{
+	coldStates[index].isSleeping = false;
+	coldStates[index].sleepTime = 0.0f;
+}
+
+void BodyStore::WakeFromImpulse(const int index)
+{
+	// Its island stays asleep, the scene wakes it before the next step
+	Wake(index);
+	coldStates[index].isIslandWakePending = true;
+}
+
+void BodyStore::ApplyImpulseLinear(const int index, const Vec3& impulse)
+{
+	if (inverseMasses[index] == 0.0f) return;
+	if (coldStates[index].isSleeping) WakeFromImpulse(index);
+	// dv = J / m
+	linearVelocities[index] += impulse * inverseMasses[index];
+}
+
+void BodyStore::ApplyImpulseAngular(const int index, const Vec3& impulse)
+{
+	if (inverseMasses[index] == 0.0f) return;
+	if (coldStates[index].isSleeping) WakeFromImpulse(index);
+
+	// L = I w = r x p
+	// dL = I dw = r x J
+	// dw = I^-1 * ( r x J )
+	Vec3& angularVelocity = angularVelocities[index];
+	angularVelocity += inverseInertiasWorldSpace[index] * impulse;
+
+	// Clamp angular velocity
+	const float maxAngularSpeed = 30.0f; // 30 rad per seconds, sufficient for now
+	if (angularVelocity.GetLengthSqr() > maxAngularSpeed * maxAngularSpeed)
+	{
+		angularVelocity.Normalize();
+		angularVelocity *= maxAngularSpeed;
+	}
+}
+
+void BodyStore::ApplyImpulse(const int index, const Vec3& impulsePoint, const Vec3& impulse)
+{
+	if (inverseMasses[index] == 0.0f) return;
+	ApplyImpulseLinear(index, impulse);
+
+	Vec3 r = impulsePoint - centersOfMassWorldSpace[index]; // Applying impulse must produce torques through the center of mass
+	Vec3 dL = r.Cross(impulse); // World space
+	ApplyImpulseAngular(index, dL);
+}
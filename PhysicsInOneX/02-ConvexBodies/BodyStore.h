@@ -0,0 +1,137 @@
+#pragma once
+#include <vector>
+#include "Body.h"
+
+// Names a body for as long as it lives. Removing the body bumps the generation of its
+// slot, so old handles are told apart from the body that takes the slot next.
+struct BodyHandle
+{
+	int slot{ -1 };
+	unsigned int generation{ 0 };
+};
+
+// What the solvers read once per contact or island at most, kept out of the arrays they
+// stream through
+struct BodyColdState
+{
+	Shape* shape;				// Set through SetShape, the store keeps what it needs of it
+	float elasticity;
+	float friction;
+
+	// Sleeping bodies are skipped by integration and narrowphase until something touches them
+	bool isSleeping;
+	float sleepTime;			// How long the body has been below the sleep thresholds
+	int islandId;				// Bodies of the same island wake together
+	bool isIslandWakePending;	// Woken alone by an impulse, the scene wakes the rest of its island
+};
+
+// Bodies packed at the front of the arrays, in no particular order, so the passes over
+// them stream through memory without holes. Each field the solvers use every step has an
+// array of its own, a body sits at the same index in all of them. Handles go through a slot
+// that knows where the body sits now, removing swaps the last body into the hole.
+//
+// The solvers name bodies by their index, which stays valid until the next Add, Remove or
+// Reorder. The scene only does those between updates.
+class BodyStore
+{
+public:
+	BodyStore() {}
+
+	void Reserve(const int num);
+
+	// The body is stored awake, with its derived state up to date
+	BodyHandle Add(const Body& body);
+	void Remove(const BodyHandle handle);
+	void Clear();
+
+	// Moves the body at order[i] to i, order being a permutation of the indices. Handles
+	// follow their bodies.
+	void Reorder(const int* order);
+
+	bool IsValid(const BodyHandle handle) const;
+
+	// Current position of the body in the arrays, -1 for a stale handle
+	int IndexOf(const BodyHandle handle) const;
+	BodyHandle HandleAt(const int index) const;
+
+	int Size() const { return (int)positions.size(); }
+
+	// A copy of the body, for the narrowphase to move around
+	Body GetBody(const int index) const;
+
+	// Moving a body means updating its derived state after
+	Vec3& Position(const int index) { return positions[index]; }
+	const Vec3& Position(const int index) const { return positions[index]; }
+	Quat& Orientation(const int index) { return orientations[index]; }
+	const Quat& Orientation(const int index) const { return orientations[index]; }
+	Vec3& LinearVelocity(const int index) { return linearVelocities[index]; }
+	const Vec3& LinearVelocity(const int index) const { return linearVelocities[index]; }
+	Vec3& AngularVelocity(const int index) { return angularVelocities[index]; }
+	const Vec3& AngularVelocity(const int index) const { return angularVelocities[index]; }
+	float InverseMass(const int index) const { return inverseMasses[index]; }
+
+	// Derived from the pose by UpdateDerivedState, the integrator writes its own
+	Mat3& OrientationMatrix(const int index) { return orientationMatrices[index]; }
+	const Mat3& OrientationMatrix(const int index) const { return orientationMatrices[index]; }
+	Mat3& InverseInertiaWorldSpace(const int index) { return inverseInertiasWorldSpace[index]; }
+	const Mat3& InverseInertiaWorldSpace(const int index) const { return inverseInertiasWorldSpace[index]; }
+	Vec3& CenterOfMassWorldSpace(const int index) { return centersOfMassWorldSpace[index]; }
+	const Vec3& CenterOfMassWorldSpace(const int index) const { return centersOfMassWorldSpace[index]; }
+
+	// Of the shape for a unit mass, kept from SetShape so the solvers don't go through it
+	const Mat3& InertiaBodySpace(const int index) const { return inertiasBodySpace[index]; }
+	const Mat3& InverseInertiaBodySpace(const int index) const { return inverseInertiasBodySpace[index]; }
+	const Vec3& CenterOfMassBodySpace(const int index) const { return centersOfMassBodySpace[index]; }
+
+	BodyColdState& ColdState(const int index) { return coldStates[index]; }
+	const BodyColdState& ColdState(const int index) const { return coldStates[index]; }
+
+	// Also updates the derived state, the center of mass may have moved
+	void SetShape(const int index, Shape* shape);
+	void UpdateDerivedState(const int index);
+
+	Vec3 WorldSpaceToBodySpace(const int index, const Vec3& worldPoint) const;
+	Vec3 BodySpaceToWorldSpace(const int index, const Vec3& bodyPoint) const;
+
+	void Wake(const int index);
+	void WakeFromImpulse(const int index);
+
+	void ApplyImpulseLinear(const int index, const Vec3& impulse);
+	void ApplyImpulseAngular(const int index, const Vec3& impulse);
+
+	/// <summary>
+	/// Apply impulse on a specific world space
+	/// </summary>
+	/// <param name="index">The body receiving the impulse</param>
+	/// <param name="impulsePoint">The world space location of the application of the impulse</param>
+	/// <param name="impulse">The world space direction and magnitude of the impulse</param>
+	void ApplyImpulse(const int index, const Vec3& impulsePoint, const Vec3& impulse);
+
+private:
+	void SwapBodies(const int i, const int j);
+
+	struct Slot
+	{
+		int index;					// Into the arrays, or the next free slot once removed
+		unsigned int generation;
+	};
+
+	// Hot state
+	std::vector<Vec3> positions;
+	std::vector<Quat> orientations;
+	std::vector<Vec3> linearVelocities;
+	std::vector<Vec3> angularVelocities;
+	std::vector<float> inverseMasses;
+	std::vector<Mat3> orientationMatrices;
+	std::vector<Mat3> inverseInertiasWorldSpace;
+	std::vector<Vec3> centersOfMassWorldSpace;
+	std::vector<Mat3> inertiasBodySpace;
+	std::vector<Mat3> inverseInertiasBodySpace;
+	std::vector<Vec3> centersOfMassBodySpace;
+
+	std::vector<BodyColdState> coldStates;
+
+	std::vector<int> bodySlots;		// Slot of each body, to fix it up when the body moves
+	std::vector<Slot> slots;
+	int firstFreeSlot{ -1 };
+};
@@ -12,19 +12,21 @@ int CompareSAP(const void* a, const void* b) {
 	return 1;
 }
 
-void SortBodiesBounds(const Body* bodies, const size_t num, PseudoBody* sortedArray, const float dt_sec)
+void SortBodiesBounds(const BodyStore& bodies, const size_t num, PseudoBody* sortedArray, const float dt_sec)
 {
 	Vec3 axis = Vec3(1, 1, 1);
 	axis.Normalize();
 
 	for (int i = 0; i < num; i++) 
 	{
-		const Body& body = bodies[i];
-		Bounds bounds = body.shape->GetBounds(body.position, body.orientation);
+		const Vec3& position = bodies.Position(i);
+		const Quat& orientation = bodies.Orientation(i);
+		Bounds bounds = VisitShape(bodies.ColdState(i).shape, [&](const auto& shape) { return shape.GetBounds(position, orientation); });
 
 		// Expand the bounds by the linear velocity
-		bounds.Expand(bounds.mins + body.linearVelocity * dt_sec);
-		bounds.Expand(bounds.maxs + body.linearVelocity * dt_sec);
+		const Vec3& linearVelocity = bodies.LinearVelocity(i);
+		bounds.Expand(bounds.mins + linearVelocity * dt_sec);
+		bounds.Expand(bounds.maxs + linearVelocity * dt_sec);
 
 		const float epsilon = 0.01f;
 		bounds.Expand(bounds.mins + Vec3(-1, -1, -1) * epsilon);
@@ -42,7 +44,7 @@ void SortBodiesBounds(const Body* bodies, const size_t num, PseudoBody* sortedAr
 	qsort(sortedArray, num * 2, sizeof(PseudoBody), CompareSAP);
 }
 
-void BuildPairs(std::vector< CollisionPair >& collisionPairs, const PseudoBody* sortedBodies, const int num)
+void BuildPairs(FrameVector< CollisionPair >& collisionPairs, const PseudoBody* sortedBodies, const int num)
 {
 	collisionPairs.clear();
 
@@ -73,17 +75,17 @@ void BuildPairs(std::vector< CollisionPair >& collisionPairs, const PseudoBody*
 	}
 }
 
-void SweepAndPrune1D(const Body* bodies, const size_t num, std::vector< CollisionPair >& finalPairs, const float dt_sec)
+void SweepAndPrune1D(const BodyStore& bodies, const size_t num, FrameVector< CollisionPair >& finalPairs, const float dt_sec)
 {
-	PseudoBody* sortedBodies = (PseudoBody*)alloca(sizeof(PseudoBody) * num * 2);
+	PseudoBody* sortedBodies = GetFrameArena().Allocate<PseudoBody>((int)num * 2);
 
 	SortBodiesBounds(bodies, num, sortedBodies, dt_sec);
 	BuildPairs(finalPairs, sortedBodies, num);
 }
 
-void BroadPhase(const Body* bodies, const int num, std::vector< CollisionPair >& finalPairs, const float dt_sec)
+void BroadPhase(const BodyStore& bodies, FrameVector< CollisionPair >& finalPairs, const float dt_sec)
 {
 	finalPairs.clear();
 
-	SweepAndPrune1D(bodies, num, finalPairs, dt_sec);
+	SweepAndPrune1D(bodies, bodies.Size(), finalPairs, dt_sec);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
-#include "Body.h"
+#include "BodyStore.h"
+#include "code/FrameArena.h"
 
 struct CollisionPair
 {
@@ -22,5 +23,12 @@ struct PseudoBody
 	bool ismin;
 };
 
-void BroadPhase(const Body* bodies, const int num, std::vector<CollisionPair>& finalPairs, const float dt_sec);
+// The pairs are drawn from the frame arena, they last for the step
+void BroadPhase(const BodyStore& bodies, FrameVector<CollisionPair>& finalPairs, const float dt_sec);
+
+// Most BroadPhase draws from the frame arena for numBodies bodies making numPairs pairs. The
+// pairs grow by doubling and the arena keeps the buffers they outgrew, up to four per pair.
+constexpr size_t BroadPhaseArenaBytes(const int numBodies, const int numPairs) {
+	return (size_t)numBodies * 2 * sizeof(PseudoBody) + (size_t)numPairs * 4 * sizeof(CollisionPair);
+}
 
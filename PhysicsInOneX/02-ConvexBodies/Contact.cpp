@@ -1,45 +1,43 @@
 #include "Contact.h"
+#include "BodyStore.h"
 
-void Contact::ResolveContact(Contact& contact)
+void Contact::ResolveContact(BodyStore& bodies, Contact& contact)
 {
-	Body* a = contact.a;
-	Body* b = contact.b;
+	const int a = contact.a;
+	const int b = contact.b;
 
-	const float invMassA = a->inverseMass;
-	const float invMassB = b->inverseMass;
+	const float invMassA = bodies.InverseMass(a);
+	const float invMassB = bodies.InverseMass(b);
 
-	const float elasticityA = a->elasticity;
-	const float elasticityB = b->elasticity;
+	const float elasticityA = bodies.ColdState(a).elasticity;
+	const float elasticityB = bodies.ColdState(b).elasticity;
 	const float elasticity = elasticityA * elasticityB;
 
 	const Vec3 ptOnA = contact.ptOnAWorldSpace;
 	const Vec3 ptOnB = contact.ptOnBWorldSpace;
 
-	const Mat3 inverseWorldInertiaA = a->GetInverseInertiaTensorWorldSpace();
-	const Mat3 inverseWorldInertiaB = b->GetInverseInertiaTensorWorldSpace();
+	const Mat3 inverseWorldInertiaA = bodies.InverseInertiaWorldSpace(a);
+	const Mat3 inverseWorldInertiaB = bodies.InverseInertiaWorldSpace(b);
 	const Vec3 n = contact.normal;
-	const Vec3 rA = ptOnA - a->GetCenterOfMassWorldSpace();
-	const Vec3 rB = ptOnB - b->GetCenterOfMassWorldSpace();
+	const Vec3 rA = ptOnA - bodies.CenterOfMassWorldSpace(a);
+	const Vec3 rB = ptOnB - bodies.CenterOfMassWorldSpace(b);
 
 	const Vec3 angularJA = (inverseWorldInertiaA * rA.Cross(n)).Cross(rA);
 	const Vec3 angularJB = (inverseWorldInertiaB * rB.Cross(n)).Cross(rB);
 	const float angularFactor = (angularJA + angularJB).Dot(n);
 
 	// Get world space velocity of the motion and rotation
-	const Vec3 velA = a->linearVelocity + a->angularVelocity.Cross(rA);
-	const Vec3 velB = b->linearVelocity + b->angularVelocity.Cross(rB);
+	const Vec3 velA = bodies.LinearVelocity(a) + bodies.AngularVelocity(a).Cross(rA);
+	const Vec3 velB = bodies.LinearVelocity(b) + bodies.AngularVelocity(b).Cross(rB);
 
 	// Collision impulse
 	const Vec3& velAb = velA - velB;
 	const float impulseValueJ = (1.0f + elasticity) * velAb.Dot(n) / (invMassA + invMassB + angularFactor); // Sign is changed here
 	const Vec3 impulse = n * impulseValueJ;
 
-	a->ApplyImpulse(ptOnA, impulse * -1.0f); // ...And here
-	b->ApplyImpulse(ptOnB, impulse * 1.0f);  // ...And here
-
 	// Friction-caused impulse
-	const float frictionA = a->friction;
-	const float frictionB = b->friction;
+	const float frictionA = bodies.ColdState(a).friction;
+	const float frictionB = bodies.ColdState(b).friction;
 	const float friction = frictionA * frictionB;
 
 	// -- Find the normal direction of the velocity with respect to the normal of the collision
@@ -54,34 +52,57 @@ void Contact::ResolveContact(Contact& contact)
 	const float inverseInertia = (inertiaA + inertiaB).Dot(relativVelTengent);
 
 	// -- Tengential impulse for friction
-	const float reducedMass = 1.0f / (a->inverseMass + b->inverseMass + inverseInertia);
+	const float reducedMass = 1.0f / (invMassA + invMassB + inverseInertia);
 	const Vec3 impulseFriction = velTengent * reducedMass * friction;
-	// -- Apply kinetic friction
-	a->ApplyImpulse(ptOnA, impulseFriction * -1.0f);
-	b->ApplyImpulse(ptOnB, impulseFriction * 1.0f);
 
+	ApplyImpulses(bodies, contact, impulse, impulseFriction);
+}
+
+void Contact::ApplyImpulses(BodyStore& bodies, Contact& contact, const Vec3& impulse, const Vec3& impulseFriction)
+{
+	const int a = contact.a;
+	const int b = contact.b;
+
+	const Vec3 ptOnA = contact.ptOnAWorldSpace;
+	const Vec3 ptOnB = contact.ptOnBWorldSpace;
+
+	bodies.ApplyImpulse(a, ptOnA, impulse * -1.0f); // ...And here
+	bodies.ApplyImpulse(b, ptOnB, impulse * 1.0f);  // ...And here
+
+	// -- Apply kinetic friction
+	bodies.ApplyImpulse(a, ptOnA, impulseFriction * -1.0f);
+	bodies.ApplyImpulse(b, ptOnB, impulseFriction * 1.0f);
 
-	// If object are interpenetrating, use this to set them on contact
+	// If object are interpenetrating, use this to set them on contact.
+	// Static bodies are never written, they can be shared by contacts solved in parallel.
 	if (contact.timeOfImpact == 0.0f) 
 	{
+		const float invMassA = bodies.InverseMass(a);
+		const float invMassB = bodies.InverseMass(b);
 		const float tA = invMassA / (invMassA + invMassB);
 		const float tB = invMassB / (invMassA + invMassB);
 		const Vec3 d = ptOnB - ptOnA;
 
-		a->position += d * tA;
-		b->position -= d * tB;
+		if (invMassA != 0.0f) {
+			bodies.Position(a) += d * tA;
+			bodies.UpdateDerivedState(a);
+		}
+		if (invMassB != 0.0f) {
+			bodies.Position(b) -= d * tB;
+			bodies.UpdateDerivedState(b);
+		}
 	}
 }
 
 int Contact::CompareContact(const void* p1, const void* p2)
 {
 	const Contact& a = *(Contact*)p1;
-	const Contact& b = *(Contact*)p1;
+	const Contact& b = *(Contact*)p2;
 	if (a.timeOfImpact < b.timeOfImpact) {
 		return -1;
 	}
 	else if (a.timeOfImpact == b.timeOfImpact) {
-		return -0;
+		return 0;
 	}
 	return 1;
 }
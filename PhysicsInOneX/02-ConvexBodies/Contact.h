@@ -1,6 +1,9 @@
 #pragma once
 #include "code/Math/Vector.h"
 #include "Body.h"
+
+class BodyStore;
+
 class Contact
 {
 public:
@@ -13,9 +16,11 @@ public:
 	float separationDistance;
 	float timeOfImpact;
 
-	Body* a{ nullptr };
-	Body* b{ nullptr };
+	// Indices of the bodies in the store, set by the scene once the contact is found
+	int a{ -1 };
+	int b{ -1 };
 
-	static void ResolveContact(Contact& contact);
+	static void ResolveContact(BodyStore& bodies, Contact& contact);
+	static void ApplyImpulses(BodyStore& bodies, Contact& contact, const Vec3& impulse, const Vec3& impulseFriction);
 	static int CompareContact(const void* p1, const void* p2);
 };
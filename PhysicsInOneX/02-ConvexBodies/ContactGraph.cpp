@@ -0,0 +1,241 @@
+#include "ContactGraph.h"
+#include "code/ThreadPool.h"
+#include "code/Math/Lanes.h"
+
+/*
+ * Contact rows in structure of arrays layout, one lane per contact
+ */
+struct alignas(32) ContactRows
+{
+	float n[3][numLanes];
+	float rA[3][numLanes];
+	float rB[3][numLanes];
+	float linVelA[3][numLanes];
+	float angVelA[3][numLanes];
+	float linVelB[3][numLanes];
+	float angVelB[3][numLanes];
+	float invInertiaA[9][numLanes];
+	float invInertiaB[9][numLanes];
+	float invMassA[numLanes];
+	float invMassB[numLanes];
+	float elasticity[numLanes];
+	float friction[numLanes];
+
+	float impulse[3][numLanes];
+	float impulseFriction[3][numLanes];
+};
+
+static void GatherContact(ContactRows& rows, const int lane, const BodyStore& bodies, const Contact& contact)
+{
+	const int a = contact.a;
+	const int b = contact.b;
+
+	StoreVec3(rows.n, lane, contact.normal);
+	StoreVec3(rows.rA, lane, contact.ptOnAWorldSpace - bodies.CenterOfMassWorldSpace(a));
+	StoreVec3(rows.rB, lane, contact.ptOnBWorldSpace - bodies.CenterOfMassWorldSpace(b));
+	StoreVec3(rows.linVelA, lane, bodies.LinearVelocity(a));
+	StoreVec3(rows.angVelA, lane, bodies.AngularVelocity(a));
+	StoreVec3(rows.linVelB, lane, bodies.LinearVelocity(b));
+	StoreVec3(rows.angVelB, lane, bodies.AngularVelocity(b));
+
+	const Mat3& invInertiaA = bodies.InverseInertiaWorldSpace(a);
+	const Mat3& invInertiaB = bodies.InverseInertiaWorldSpace(b);
+	for (int i = 0; i < 9; i++) {
+		rows.invInertiaA[i][lane] = invInertiaA.rows[i / 3][i % 3];
+		rows.invInertiaB[i][lane] = invInertiaB.rows[i / 3][i % 3];
+	}
+
+	const BodyColdState& coldA = bodies.ColdState(a);
+	const BodyColdState& coldB = bodies.ColdState(b);
+	rows.invMassA[lane] = bodies.InverseMass(a);
+	rows.invMassB[lane] = bodies.InverseMass(b);
+	rows.elasticity[lane] = coldA.elasticity * coldB.elasticity;
+	rows.friction[lane] = coldA.friction * coldB.friction;
+}
+
+/*
+ * Same impulse math as Contact::ResolveContact, for numLanes contacts at once
+ */
+static void SolveContactRows(ContactRows& rows)
+{
+	const Vec3Lanes n = LoadVec3(rows.n);
+	const Vec3Lanes rA = LoadVec3(rows.rA);
+	const Vec3Lanes rB = LoadVec3(rows.rB);
+	const Mat3Lanes inverseWorldInertiaA = LoadMat3(rows.invInertiaA);
+	const Mat3Lanes inverseWorldInertiaB = LoadMat3(rows.invInertiaB);
+	const lane_t invMassA = LaneLoad(rows.invMassA);
+	const lane_t invMassB = LaneLoad(rows.invMassB);
+	const lane_t one = LaneSet(1.0f);
+
+	const Vec3Lanes angularJA = Cross(Mul(inverseWorldInertiaA, Cross(rA, n)), rA);
+	const Vec3Lanes angularJB = Cross(Mul(inverseWorldInertiaB, Cross(rB, n)), rB);
+	const lane_t angularFactor = Dot(Add(angularJA, angularJB), n);
+
+	const Vec3Lanes velA = Add(LoadVec3(rows.linVelA), Cross(LoadVec3(rows.angVelA), rA));
+	const Vec3Lanes velB = Add(LoadVec3(rows.linVelB), Cross(LoadVec3(rows.angVelB), rB));
+	const Vec3Lanes velAb = Sub(velA, velB);
+
+	// Collision impulse
+	const lane_t elasticity = LaneLoad(rows.elasticity);
+	const lane_t impulseValueJ = LaneDiv(LaneMul(LaneAdd(one, elasticity), Dot(velAb, n)), LaneAdd(LaneAdd(invMassA, invMassB), angularFactor));
+	const Vec3Lanes impulse = Scale(n, impulseValueJ);
+
+	// Friction impulse, from the tangential part of the relative velocity
+	const Vec3Lanes velNormal = Scale(n, Dot(n, velAb));
+	const Vec3Lanes velTengent = Sub(velAb, velNormal);
+	const lane_t invMag = LaneDiv(one, LaneSqrt(Dot(velTengent, velTengent)));
+	const Vec3Lanes relativVelTengent = Vec3Lanes{
+		LaneIfFinite(invMag, LaneMul(velTengent.x, invMag)),
+		LaneIfFinite(invMag, LaneMul(velTengent.y, invMag)),
+		LaneIfFinite(invMag, LaneMul(velTengent.z, invMag))
+	};
+	const Vec3Lanes inertiaA = Cross(Mul(inverseWorldInertiaA, Cross(rA, relativVelTengent)), rA);
+	const Vec3Lanes inertiaB = Cross(Mul(inverseWorldInertiaB, Cross(rB, relativVelTengent)), rB);
+	const lane_t inverseInertia = Dot(Add(inertiaA, inertiaB), relativVelTengent);
+
+	const lane_t reducedMass = LaneDiv(one, LaneAdd(LaneAdd(invMassA, invMassB), inverseInertia));
+	const Vec3Lanes impulseFriction = Scale(velTengent, LaneMul(reducedMass, LaneLoad(rows.friction)));
+
+	LaneStore(rows.impulse[0], impulse.x);
+	LaneStore(rows.impulse[1], impulse.y);
+	LaneStore(rows.impulse[2], impulse.z);
+	LaneStore(rows.impulseFriction[0], impulseFriction.x);
+	LaneStore(rows.impulseFriction[1], impulseFriction.y);
+	LaneStore(rows.impulseFriction[2], impulseFriction.z);
+}
+
+void ResolveContactsWide(BodyStore& bodies, Contact* contacts, const int num)
+{
+	ContactRows rows;
+	for (int first = 0; first < num; first += numLanes) {
+		const int count = (num - first < numLanes) ? (num - first) : numLanes;
+
+		// Unused lanes repeat the first contact, their results are dropped
+		for (int lane = 0; lane < numLanes; lane++) {
+			GatherContact(rows, lane, bodies, contacts[first + ((lane < count) ? lane : 0)]);
+		}
+
+		SolveContactRows(rows);
+
+		for (int lane = 0; lane < count; lane++) {
+			const Vec3 impulse(rows.impulse[0][lane], rows.impulse[1][lane], rows.impulse[2][lane]);
+			const Vec3 impulseFriction(rows.impulseFriction[0][lane], rows.impulseFriction[1][lane], rows.impulseFriction[2][lane]);
+			Contact::ApplyImpulses(bodies, contacts[first + lane], impulse, impulseFriction);
+		}
+	}
+}
+
+// Bit c is set when the body already has a contact of color c. Kept per thread, as islands
+// are colored on several threads at once, and zeroed between calls.
+static thread_local std::vector<unsigned long long> bodyColors;
+
+void ReserveColorContacts(const int numBodies)
+{
+	if ((int)bodyColors.size() < numBodies) {
+		bodyColors.resize(numBodies, 0);
+	}
+}
+
+void ColorContacts(const BodyStore& bodies, Contact* contacts, const int numContacts, FrameVector<ContactColor>& colors)
+{
+	colors.clear();
+	ReserveColorContacts(bodies.Size());
+	int* contactColors = GetFrameArena().Allocate<int>(numContacts);
+	Contact* sorted = GetFrameArena().Allocate<Contact>(numContacts);
+
+	int counts[maxContactColors + 1] = { 0 };
+	for (int i = 0; i < numContacts; i++) {
+		const int a = contacts[i].a;
+		const int b = contacts[i].b;
+		const bool isDynamicA = (bodies.InverseMass(a) != 0.0f);
+		const bool isDynamicB = (bodies.InverseMass(b) != 0.0f);
+
+		unsigned long long used = 0;
+		if (isDynamicA) {
+			used |= bodyColors[a];
+		}
+		if (isDynamicB) {
+			used |= bodyColors[b];
+		}
+
+		// First free color, or the serial batch when all of them are taken
+		int color = maxContactColors;
+		for (int c = 0; c < maxContactColors; c++) {
+			if (0 == (used & (1ull << c))) {
+				color = c;
+				break;
+			}
+		}
+
+		if (color < maxContactColors) {
+			if (isDynamicA) {
+				bodyColors[a] |= (1ull << color);
+			}
+			if (isDynamicB) {
+				bodyColors[b] |= (1ull << color);
+			}
+		}
+
+		contactColors[i] = color;
+		counts[color]++;
+	}
+
+	// Stable counting sort by color, so the order is the same every run
+	int offsets[maxContactColors + 1];
+	int offset = 0;
+	for (int c = 0; c <= maxContactColors; c++) {
+		offsets[c] = offset;
+		if (counts[c] > 0) {
+			ContactColor batch;
+			batch.first = offset;
+			batch.num = counts[c];
+			batch.isSerial = (maxContactColors == c);
+			colors.push_back(batch);
+		}
+		offset += counts[c];
+	}
+
+	for (int i = 0; i < numContacts; i++) {
+		sorted[offsets[contactColors[i]]++] = contacts[i];
+	}
+	for (int i = 0; i < numContacts; i++) {
+		contacts[i] = sorted[i];
+	}
+
+	// Only clear what was touched, so the cost follows the contacts and not the world size
+	for (int i = 0; i < numContacts; i++) {
+		bodyColors[contacts[i].a] = 0;
+		bodyColors[contacts[i].b] = 0;
+	}
+}
+
+void ResolveContacts(BodyStore& bodies, Contact* contacts, const int num)
+{
+	if (num < minColoredContacts) {
+		for (int i = 0; i < num; i++) {
+			Contact::ResolveContact(bodies, contacts[i]);
+		}
+		return;
+	}
+
+	FrameArenaScope scope;
+	FrameVector<ContactColor> colors;
+	ColorContacts(bodies, contacts, num, colors);
+
+	// Each color depends on the velocities left by the previous one
+	for (int c = 0; c < (int)colors.size(); c++) {
+		Contact* batch = contacts + colors[c].first;
+		const int batchSize = colors[c].num;
+
+		if (colors[c].isSerial) {
+			for (int i = 0; i < batchSize; i++) {
+				Contact::ResolveContact(bodies, batch[i]);
+			}
+			continue;
+		}
+
+		GetThreadPool().ParallelFor(batchSize, numLanes * 16, [&bodies, batch](int begin, int end) {
+			ResolveContactsWide(bodies, batch + begin, end - begin);
+		});
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include "BodyStore.h"
+#include "Contact.h"
+#include "code/FrameArena.h"
+
+// Contacts of one color share no dynamic body, so they can be resolved at the same time.
+// Static bodies (inverseMass == 0) never receive impulses and don't link contacts.
+struct ContactColor
+{
+	int first;
+	int num;
+	bool isSerial; // Contacts left over once all colors are used, resolved one by one
+};
+
+static const int maxContactColors = 64;
+
+// Below this many contacts, coloring costs more than it saves
+static const int minColoredContacts = 32;
+
+void ColorContacts(const BodyStore& bodies, Contact* contacts, const int numContacts, FrameVector<ContactColor>& colors);
+
+// Most ColorContacts draws from the frame arena. The colors grow by doubling like the pairs.
+constexpr size_t ColorContactsArenaBytes(const int numContacts) {
+	return (size_t)numContacts * (sizeof(int) + sizeof(Contact)) + 4 * (maxContactColors + 1) * sizeof(ContactColor);
+}
+
+// Sizes the colors the calling thread keeps per body, otherwise grown by the first coloring
+// that needs them
+void ReserveColorContacts(const int numBodies);
+
+// Resolves contacts of the same color, several at once in SIMD lanes
+void ResolveContactsWide(BodyStore& bodies, Contact* contacts, const int num);
+
+// Resolves contacts that share a time of impact, in parallel batches when there are enough of them
+void ResolveContacts(BodyStore& bodies, Contact* contacts, const int num);
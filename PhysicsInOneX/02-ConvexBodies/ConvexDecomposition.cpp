@@ -0,0 +1,408 @@
+#include "ConvexDecomposition.h"
+#include <algorithm>
+#include <cmath>
+#include "code/Math/Bounds.h"
+
+enum VoxelState : unsigned char
+{
+	VOXEL_OUTSIDE,
+	VOXEL_SURFACE,
+	VOXEL_INSIDE,
+	VOXEL_EXTERIOR,		// Reached by the flood fill, only while filling
+};
+
+struct VoxelGrid
+{
+	int dims[3];
+	Vec3 origin;
+	float voxelSize;
+	std::vector<unsigned char> states;
+	std::vector<int> owners;			// Part of each solid voxel
+
+	int Index(const int x, const int y, const int z) const { return (z * dims[1] + y) * dims[0] + x; }
+	void Coords(const int idx, int* coords) const {
+		coords[0] = idx % dims[0];
+		coords[1] = (idx / dims[0]) % dims[1];
+		coords[2] = idx / (dims[0] * dims[1]);
+	}
+};
+
+struct DecompositionPart
+{
+	std::vector<int> voxels;
+	int mins[3];
+	int maxs[3];
+	float concavity;
+};
+
+// Which side of a cut a part voxel goes to, every voxel of the part without a cut
+struct PartSide
+{
+	int id;
+	int axis;		// -1 for the whole part
+	int cut;
+	bool isBelow;
+};
+
+static const int cutsPerAxis = 16;
+
+static void Voxelize(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, const int resolution, VoxelGrid& grid)
+{
+	Bounds bounds;
+	bounds.Expand(verts, numVerts);
+	const Vec3 extents = bounds.maxs - bounds.mins;
+	const float longest = std::max(extents.x, std::max(extents.y, extents.z));
+	grid.voxelSize = (longest > 0.0f) ? longest / (float)std::max(resolution, 1) : 1.0f;
+
+	// One empty voxel of padding all around, the flood fill starts from there
+	for (int axis = 0; axis < 3; axis++) {
+		grid.dims[axis] = (int)ceilf(extents[axis] / grid.voxelSize) + 3;
+	}
+	grid.origin = bounds.mins - Vec3(grid.voxelSize);
+	grid.states.assign(grid.dims[0] * grid.dims[1] * grid.dims[2], VOXEL_OUTSIDE);
+	grid.owners.assign(grid.states.size(), -1);
+
+	// Mark the surface by sampling the triangles finer than the voxels
+	for (int t = 0; t < numTris; t++) {
+		const Vec3& a = verts[tris[t].a];
+		const Vec3& b = verts[tris[t].b];
+		const Vec3& c = verts[tris[t].c];
+		const float longestEdge = sqrtf(std::max((b - a).GetLengthSqr(), std::max((c - a).GetLengthSqr(), (c - b).GetLengthSqr())));
+		const int steps = (int)ceilf(longestEdge / (0.5f * grid.voxelSize)) + 1;
+
+		for (int i = 0; i <= steps; i++) {
+			for (int j = 0; j <= steps - i; j++) {
+				const Vec3 pt = a + (b - a) * ((float)i / steps) + (c - a) * ((float)j / steps);
+				int coords[3];
+				for (int axis = 0; axis < 3; axis++) {
+					coords[axis] = std::min(std::max((int)((pt[axis] - grid.origin[axis]) / grid.voxelSize), 1), grid.dims[axis] - 2);
+				}
+				grid.states[grid.Index(coords[0], coords[1], coords[2])] = VOXEL_SURFACE;
+			}
+		}
+	}
+
+	// Whatever the outside can't reach is inside
+	std::vector<int> stack;
+	stack.push_back(0);
+	grid.states[0] = VOXEL_EXTERIOR;
+	while (!stack.empty()) {
+		const int idx = stack.back();
+		stack.pop_back();
+
+		int coords[3];
+		grid.Coords(idx, coords);
+		for (int axis = 0; axis < 3; axis++) {
+			for (int dir = -1; dir <= 1; dir += 2) {
+				int next[3] = { coords[0], coords[1], coords[2] };
+				next[axis] += dir;
+				if (next[axis] < 0 || next[axis] >= grid.dims[axis]) {
+					continue;
+				}
+
+				const int nextIdx = grid.Index(next[0], next[1], next[2]);
+				if (grid.states[nextIdx] == VOXEL_OUTSIDE) {
+					grid.states[nextIdx] = VOXEL_EXTERIOR;
+					stack.push_back(nextIdx);
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < (int)grid.states.size(); i++) {
+		if (grid.states[i] == VOXEL_EXTERIOR) {
+			grid.states[i] = VOXEL_OUTSIDE;
+		} else if (grid.states[i] == VOXEL_OUTSIDE) {
+			grid.states[i] = VOXEL_INSIDE;
+		}
+	}
+}
+
+static bool IsInSide(const VoxelGrid& grid, const PartSide& side, const int* coords)
+{
+	for (int axis = 0; axis < 3; axis++) {
+		if (coords[axis] < 0 || coords[axis] >= grid.dims[axis]) {
+			return false;
+		}
+	}
+	if (grid.owners[grid.Index(coords[0], coords[1], coords[2])] != side.id) {
+		return false;
+	}
+	return side.axis < 0 || (coords[side.axis] < side.cut) == side.isBelow;
+}
+
+// Points of the voxels on the boundary of the side, their centers or their corners.
+// Inner voxels can't be on the hull. Corners are stamped to add each one once.
+// Returns the volume of the side in voxels, the mesh surface cuts its voxels about in half.
+static float CollectSidePoints(const VoxelGrid& grid, const DecompositionPart& part, const PartSide& side, const bool useCorners, std::vector<int>& cornerStamps, int& stamp, std::vector<Vec3>& pts, int& numVoxels)
+{
+	pts.clear();
+	stamp++;
+	numVoxels = 0;
+
+	float count = 0.0f;
+	for (int i = 0; i < (int)part.voxels.size(); i++) {
+		int coords[3];
+		grid.Coords(part.voxels[i], coords);
+		if (!IsInSide(grid, side, coords)) {
+			continue;
+		}
+		count += (grid.states[part.voxels[i]] == VOXEL_SURFACE) ? 0.5f : 1.0f;
+		numVoxels++;
+
+		bool isBoundary = false;
+		for (int axis = 0; axis < 3 && !isBoundary; axis++) {
+			for (int dir = -1; dir <= 1 && !isBoundary; dir += 2) {
+				int next[3] = { coords[0], coords[1], coords[2] };
+				next[axis] += dir;
+				isBoundary = !IsInSide(grid, side, next);
+			}
+		}
+		if (!isBoundary) {
+			continue;
+		}
+
+		if (!useCorners) {
+			pts.push_back(grid.origin + Vec3(coords[0] + 0.5f, coords[1] + 0.5f, coords[2] + 0.5f) * grid.voxelSize);
+			continue;
+		}
+
+		for (int corner = 0; corner < 8; corner++) {
+			const int x = coords[0] + (corner & 1);
+			const int y = coords[1] + ((corner >> 1) & 1);
+			const int z = coords[2] + ((corner >> 2) & 1);
+			const int cornerIdx = (z * (grid.dims[1] + 1) + y) * (grid.dims[0] + 1) + x;
+			if (cornerStamps[cornerIdx] != stamp) {
+				cornerStamps[cornerIdx] = stamp;
+				pts.push_back(grid.origin + Vec3((float)x, (float)y, (float)z) * grid.voxelSize);
+			}
+		}
+	}
+	return count;
+}
+
+float ConvexHullVolume(const std::vector<Vec3>& pts, const std::vector<Tri>& tris)
+{
+	if (pts.empty()) {
+		return 0.0f;
+	}
+
+	// Tetrahedrons from the first point to every face
+	float volume = 0.0f;
+	for (int i = 0; i < (int)tris.size(); i++) {
+		const Vec3 a = pts[tris[i].a] - pts[0];
+		const Vec3 b = pts[tris[i].b] - pts[0];
+		const Vec3 c = pts[tris[i].c] - pts[0];
+		volume += a.Dot(b.Cross(c));
+	}
+	return volume / 6.0f;
+}
+
+// Volume of the voxels inside the hull of the side that aren't part of the side. The hull
+// of the voxel centers keeps a convex part at zero, the corners would count the staircase
+// of its surface. Centers of a side one voxel thin are flat though, those use the corners.
+static float SideConcavity(const VoxelGrid& grid, const DecompositionPart& part, const PartSide& side, const float totalVolume, std::vector<int>& cornerStamps, int& stamp, std::vector<Vec3>& pts, float& count)
+{
+	int numVoxels = 0;
+	count = CollectSidePoints(grid, part, side, false, cornerStamps, stamp, pts, numVoxels);
+	if (numVoxels == 0) {
+		return 0.0f;
+	}
+
+	Bounds bounds;
+	bounds.Expand(pts.data(), (int)pts.size());
+	const Vec3 extents = bounds.maxs - bounds.mins;
+	if (std::min(extents.x, std::min(extents.y, extents.z)) < 0.5f * grid.voxelSize) {
+		CollectSidePoints(grid, part, side, true, cornerStamps, stamp, pts, numVoxels);
+	}
+
+	std::vector<Vec3> hullPts;
+	std::vector<Tri> hullTris;
+	BuildConvexHull(pts, hullPts, hullTris);
+
+	std::vector<Vec3> normals;
+	std::vector<float> dists;
+	for (int i = 0; i < (int)hullTris.size(); i++) {
+		const Vec3& a = hullPts[hullTris[i].a];
+		Vec3 normal = (hullPts[hullTris[i].b] - a).Cross(hullPts[hullTris[i].c] - a);
+		if (normal.GetLengthSqr() < 1e-12f) {
+			continue;
+		}
+		normal.Normalize();
+		normals.push_back(normal);
+		dists.push_back(normal.Dot(a));
+	}
+
+	// Voxel centers on the hull faces count, holes between two layers lie right on them
+	const float slack = 1e-3f * grid.voxelSize;
+	int mins[3];
+	int maxs[3];
+	bounds.Clear();
+	bounds.Expand(hullPts.data(), (int)hullPts.size());
+	for (int axis = 0; axis < 3; axis++) {
+		mins[axis] = std::max((int)floorf((bounds.mins[axis] - grid.origin[axis]) / grid.voxelSize - 0.5f), 0);
+		maxs[axis] = std::min((int)ceilf((bounds.maxs[axis] - grid.origin[axis]) / grid.voxelSize - 0.5f), grid.dims[axis] - 1);
+	}
+
+	int numMissing = 0;
+	for (int z = mins[2]; z <= maxs[2]; z++) {
+		for (int y = mins[1]; y <= maxs[1]; y++) {
+			for (int x = mins[0]; x <= maxs[0]; x++) {
+				const int coords[3] = { x, y, z };
+				if (IsInSide(grid, side, coords)) {
+					continue;
+				}
+
+				const Vec3 center = grid.origin + Vec3(x + 0.5f, y + 0.5f, z + 0.5f) * grid.voxelSize;
+				bool isInside = true;
+				for (int i = 0; i < (int)normals.size() && isInside; i++) {
+					isInside = normals[i].Dot(center) - dists[i] <= slack;
+				}
+				if (isInside) {
+					numMissing++;
+				}
+			}
+		}
+	}
+
+	const float voxelVolume = grid.voxelSize * grid.voxelSize * grid.voxelSize;
+	return numMissing * voxelVolume / totalVolume;
+}
+
+static void UpdatePartBounds(const VoxelGrid& grid, DecompositionPart& part)
+{
+	for (int axis = 0; axis < 3; axis++) {
+		part.mins[axis] = grid.dims[axis];
+		part.maxs[axis] = -1;
+	}
+	for (int i = 0; i < (int)part.voxels.size(); i++) {
+		int coords[3];
+		grid.Coords(part.voxels[i], coords);
+		for (int axis = 0; axis < 3; axis++) {
+			part.mins[axis] = std::min(part.mins[axis], coords[axis]);
+			part.maxs[axis] = std::max(part.maxs[axis], coords[axis]);
+		}
+	}
+}
+
+float DecomposeMesh(
+	const Vec3* verts,
+	const int numVerts,
+	const Tri* tris,
+	const int numTris,
+	const DecompositionSettings& settings,
+	std::vector<std::vector<Vec3>>& parts
+) {
+	parts.clear();
+	if (numVerts < 4 || numTris < 1) {
+		return 0.0f;
+	}
+
+	VoxelGrid grid;
+	Voxelize(verts, numVerts, tris, numTris, settings.resolution, grid);
+
+	std::vector<DecompositionPart> decomposition(1);
+	for (int i = 0; i < (int)grid.states.size(); i++) {
+		if (grid.states[i] != VOXEL_OUTSIDE) {
+			decomposition[0].voxels.push_back(i);
+			grid.owners[i] = 0;
+		}
+	}
+	UpdatePartBounds(grid, decomposition[0]);
+
+	const float voxelVolume = grid.voxelSize * grid.voxelSize * grid.voxelSize;
+	std::vector<int> cornerStamps((grid.dims[0] + 1) * (grid.dims[1] + 1) * (grid.dims[2] + 1), 0);
+	int stamp = 0;
+	std::vector<Vec3> pts;
+	int numVoxels = 0;
+	const float totalVolume = std::max(CollectSidePoints(grid, decomposition[0], PartSide{ 0, -1, 0, true }, false, cornerStamps, stamp, pts, numVoxels) * voxelVolume, 1e-12f);
+
+	float count = 0.0f;
+	decomposition[0].concavity = SideConcavity(grid, decomposition[0], PartSide{ 0, -1, 0, true }, totalVolume, cornerStamps, stamp, pts, count);
+
+	const int maxHulls = std::max(settings.maxHulls, 1);
+	while ((int)decomposition.size() < maxHulls) {
+		// The part the furthest from convex goes first
+		int worst = -1;
+		for (int i = 0; i < (int)decomposition.size(); i++) {
+			if (decomposition[i].concavity > settings.maxConcavity && (worst < 0 || decomposition[i].concavity > decomposition[worst].concavity)) {
+				worst = i;
+			}
+		}
+		if (worst < 0) {
+			break;
+		}
+
+		// Try evenly spaced cuts along each axis, keep the one leaving the least concavity.
+		// Balanced cuts win ties, they leave more room for the next splits.
+		DecompositionPart& part = decomposition[worst];
+		int bestAxis = -1;
+		int bestCut = 0;
+		float bestCost = 0.0f;
+		float bestConcavities[2] = { 0.0f, 0.0f };
+		for (int axis = 0; axis < 3; axis++) {
+			const int extent = part.maxs[axis] - part.mins[axis] + 1;
+			if (extent < 2) {
+				continue;
+			}
+
+			const int step = std::max(extent / cutsPerAxis, 1);
+			for (int cut = part.mins[axis] + step; cut <= part.maxs[axis]; cut += step) {
+				float counts[2];
+				float concavities[2];
+				for (int side = 0; side < 2; side++) {
+					concavities[side] = SideConcavity(grid, part, PartSide{ worst, axis, cut, side == 0 }, totalVolume, cornerStamps, stamp, pts, counts[side]);
+				}
+				if (counts[0] == 0.0f || counts[1] == 0.0f) {
+					continue;
+				}
+
+				const float balance = fabsf(counts[0] - counts[1]) / (counts[0] + counts[1]);
+				const float cost = concavities[0] + concavities[1] + 1e-3f * balance;
+				if (bestAxis < 0 || cost < bestCost) {
+					bestAxis = axis;
+					bestCut = cut;
+					bestCost = cost;
+					bestConcavities[0] = concavities[0];
+					bestConcavities[1] = concavities[1];
+				}
+			}
+		}
+
+		// A single voxel thick part can't be split any further
+		if (bestAxis < 0) {
+			part.concavity = 0.0f;
+			continue;
+		}
+
+		DecompositionPart above;
+		const int aboveId = (int)decomposition.size();
+		std::vector<int> below;
+		for (int i = 0; i < (int)part.voxels.size(); i++) {
+			int coords[3];
+			grid.Coords(part.voxels[i], coords);
+			if (coords[bestAxis] < bestCut) {
+				below.push_back(part.voxels[i]);
+			} else {
+				above.voxels.push_back(part.voxels[i]);
+				grid.owners[part.voxels[i]] = aboveId;
+			}
+		}
+
+		part.voxels.swap(below);
+		part.concavity = bestConcavities[0];
+		UpdatePartBounds(grid, part);
+		above.concavity = bestConcavities[1];
+		UpdatePartBounds(grid, above);
+		decomposition.push_back(above);
+	}
+
+	// The corners of the boundary voxels, so each hull contains its voxels
+	float concavity = 0.0f;
+	parts.resize(decomposition.size());
+	for (int i = 0; i < (int)decomposition.size(); i++) {
+		CollectSidePoints(grid, decomposition[i], PartSide{ i, -1, 0, true }, true, cornerStamps, stamp, parts[i], numVoxels);
+		concavity = std::max(concavity, decomposition[i].concavity);
+	}
+	return concavity;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+#include "code/Math/Vector.h"
+#include "ShapeUtils.h"
+
+// Approximate convex decomposition of a triangle mesh, in the V-HACD style. The mesh is
+// voxelized and filled, then the voxels are split by axis aligned planes, always the part
+// the furthest from convex first, until the budget is spent or every part is convex enough.
+struct DecompositionSettings
+{
+	int resolution{ 32 };			// Voxels along the longest side of the mesh
+	int maxHulls{ 16 };
+	int maxPointsPerHull{ 32 };		// Hulls are simplified down to this, zero keeps them whole
+	float maxConcavity{ 0.02f };	// Hull volume missing from the voxels, over the mesh volume
+};
+
+// Point clouds of the convex parts, their hulls contain the voxels of the part.
+// Returns the concavity left, the worst part.
+float DecomposeMesh(
+	const Vec3* verts,
+	const int numVerts,
+	const Tri* tris,
+	const int numTris,
+	const DecompositionSettings& settings,
+	std::vector<std::vector<Vec3>>& parts
+);
+
+float ConvexHullVolume(const std::vector<Vec3>& pts, const std::vector<Tri>& tris);
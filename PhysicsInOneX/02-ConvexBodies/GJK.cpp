@@ -3,6 +3,7 @@
 #include "Body.h"
 #include "Shape.h"
 #include "ShapeUtils.h"
+#include <type_traits>
 
 
 int CompareSigns(float a, float b) 
@@ -293,6 +294,41 @@ Point Support(const Body* bodyA, const Body* bodyB, Vec3 dir, const float bias)
 	return point;
 }
 
+// Support of the pair, with the shapes as their concrete types. The kernels below are
+// instantiated for each pair of them, so the Support of both shapes is inlined into
+// their loops.
+template<typename ShapeA, typename ShapeB>
+struct SupportPair
+{
+	const Body* bodyA;
+	const ShapeA& shapeA;
+	const Body* bodyB;
+	const ShapeB& shapeB;
+
+	Point operator()(Vec3 dir, const float bias) const
+	{
+		dir.Normalize();
+
+		Point point;
+		point.ptA = shapeA.Support(dir, bodyA->position, bodyA->orientation, bias);
+		point.ptB = shapeB.Support(dir * -1.0f, bodyB->position, bodyB->orientation, bias);
+		point.xyz = point.ptA - point.ptB;
+		return point;
+	}
+};
+
+// Calls kernel with the SupportPair of the bodies
+template<typename Kernel>
+static auto VisitSupportPair(const Body* bodyA, const Body* bodyB, Kernel&& kernel)
+{
+	return VisitSupportShape(bodyA->shape, [&](const auto& shapeA) {
+		return VisitSupportShape(bodyB->shape, [&](const auto& shapeB) {
+			using Pair = SupportPair<std::decay_t<decltype(shapeA)>, std::decay_t<decltype(shapeB)>>;
+			return kernel(Pair{ bodyA, shapeA, bodyB, shapeB });
+		});
+	});
+}
+
 
 bool SimplexSignedVolumes(Point* pts, const int num, Vec3& newDir, Vec4& lambdasOut)
 {
@@ -401,20 +437,21 @@ static int NumValids(const Vec4& lambdas) {
 }
 
 
-bool GJK_DoesIntersect(const Body* bodyA, const Body* bodyB) 
+template<typename ShapeA, typename ShapeB>
+static bool GJK_DoesIntersect(const SupportPair<ShapeA, ShapeB>& support)
 {
 	const Vec3 origin(0.0f);
 
 	int numPts = 1;
 	Point simplexPoints[4];
-	simplexPoints[0] = Support(bodyA, bodyB, Vec3(1, 1, 1), 0.0f);
+	simplexPoints[0] = support(Vec3(1, 1, 1), 0.0f);
 
 	float closestDist = 1e10f;
 	bool doesContainOrigin = false;
 	Vec3 newDir = simplexPoints[0].xyz * -1.0f;
 	do {
 		// Get the new point to check on
-		Point newPt = Support(bodyA, bodyB, newDir, 0.0f);
+		Point newPt = support(newDir, 0.0f);
 
 		// If the new point is the same as a previous point, then we can't expand any further
 		if (HasPoint(simplexPoints, newPt)) {
@@ -454,20 +491,21 @@ bool GJK_DoesIntersect(const Body* bodyA, const Body* bodyB)
 }
 
 
-bool GJK_DoesIntersect(const Body* bodyA, const Body* bodyB, const float bias, Vec3& ptOnA, Vec3& ptOnB) 
+template<typename ShapeA, typename ShapeB>
+static bool GJK_DoesIntersect(const SupportPair<ShapeA, ShapeB>& support, const float bias, Vec3& ptOnA, Vec3& ptOnB)
 {
 	const Vec3 origin(0.0f);
 
 	int numPts = 1;
 	Point simplexPoints[4];
-	simplexPoints[0] = Support(bodyA, bodyB, Vec3(1, 1, 1), 0.0f);
+	simplexPoints[0] = support(Vec3(1, 1, 1), 0.0f);
 
 	float closestDist = 1e10f;
 	bool doesContainOrigin = false;
 	Vec3 newDir = simplexPoints[0].xyz * -1.0f;
 	do {
 		// Get the new point to check on
-		Point newPt = Support(bodyA, bodyB, newDir, 0.0f);
+		Point newPt = support(newDir, 0.0f);
 
 		// If the new point is the same as a previous point, then we can't expand any further
 		if (HasPoint(simplexPoints, newPt)) {
@@ -512,7 +550,7 @@ bool GJK_DoesIntersect(const Body* bodyA, const Body* bodyB, const float bias, V
 	//
 	if (1 == numPts) {
 		Vec3 searchDir = simplexPoints[0].xyz * -1.0f;
-		Point newPt = Support(bodyA, bodyB, searchDir, 0.0f);
+		Point newPt = support(searchDir, 0.0f);
 		simplexPoints[numPts] = newPt;
 		numPts++;
 	}
@@ -522,7 +560,7 @@ bool GJK_DoesIntersect(const Body* bodyA, const Body* bodyB, const float bias, V
 		ab.GetOrtho(u, v);
 
 		Vec3 newDir = u;
-		Point newPt = Support(bodyA, bodyB, newDir, 0.0f);
+		Point newPt = support(newDir, 0.0f);
 		simplexPoints[numPts] = newPt;
 		numPts++;
 	}
@@ -532,7 +570,7 @@ bool GJK_DoesIntersect(const Body* bodyA, const Body* bodyB, const float bias, V
 		Vec3 norm = ab.Cross(ac);
 
 		Vec3 newDir = norm;
-		Point newPt = Support(bodyA, bodyB, newDir, 0.0f);
+		Point newPt = support(newDir, 0.0f);
 		simplexPoints[numPts] = newPt;
 		numPts++;
 	}
@@ -562,12 +600,14 @@ bool GJK_DoesIntersect(const Body* bodyA, const Body* bodyB, const float bias, V
 	//
 	// Perform EPA expansion of the simplex to find the closest face on the CSO
 	//
-	EPA_Expand(bodyA, bodyB, bias, simplexPoints, ptOnA, ptOnB);
+	// Left to the support through Shape, its time goes to the polytope rather than the support
+	EPA_Expand(support.bodyA, support.bodyB, bias, simplexPoints, ptOnA, ptOnB);
 	return true;
 }
 
 
-void GJK_ClosestPoints(const Body* bodyA, const Body* bodyB, Vec3& ptOnA, Vec3& ptOnB) 
+template<typename ShapeA, typename ShapeB>
+static void GJK_ClosestPoints(const SupportPair<ShapeA, ShapeB>& support, Vec3& ptOnA, Vec3& ptOnB)
 {
 	const Vec3 origin(0.0f);
 
@@ -576,13 +616,13 @@ void GJK_ClosestPoints(const Body* bodyA, const Body* bodyB, Vec3& ptOnA, Vec3&
 
 	int numPts = 1;
 	Point simplexPoints[4];
-	simplexPoints[0] = Support(bodyA, bodyB, Vec3(1, 1, 1), bias);
+	simplexPoints[0] = support(Vec3(1, 1, 1), bias);
 
 	Vec4 lambdas = Vec4(1, 0, 0, 0);
 	Vec3 newDir = simplexPoints[0].xyz * -1.0f;
 	do {
 		// Get the new point to check on
-		Point newPt = Support(bodyA, bodyB, newDir, bias);
+		Point newPt = support(newDir, bias);
 
 		// If the new point is the same as a previous point, then we can't expand any further
 		if (HasPoint(simplexPoints, newPt)) {
@@ -613,6 +653,30 @@ void GJK_ClosestPoints(const Body* bodyA, const Body* bodyB, Vec3& ptOnA, Vec3&
 	}
 }
 
+
+bool GJK_DoesIntersect(const Body* bodyA, const Body* bodyB)
+{
+	return VisitSupportPair(bodyA, bodyB, [&](const auto& support) {
+		return GJK_DoesIntersect(support);
+	});
+}
+
+
+bool GJK_DoesIntersect(const Body* bodyA, const Body* bodyB, const float bias, Vec3& ptOnA, Vec3& ptOnB)
+{
+	return VisitSupportPair(bodyA, bodyB, [&](const auto& support) {
+		return GJK_DoesIntersect(support, bias, ptOnA, ptOnB);
+	});
+}
+
+
+void GJK_ClosestPoints(const Body* bodyA, const Body* bodyB, Vec3& ptOnA, Vec3& ptOnB)
+{
+	VisitSupportPair(bodyA, bodyB, [&](const auto& support) {
+		GJK_ClosestPoints(support, ptOnA, ptOnB);
+	});
+}
+
 /*
 ================================================================================================
 
@@ -681,7 +745,7 @@ Vec3 BarycentricCoordinates(Vec3 s1, Vec3 s2, Vec3 s3, const Vec3& pt) {
 }
 
 
-Vec3 NormalDirection(const Tri& tri, const std::vector< Point >& points) {
+Vec3 NormalDirection(const Tri& tri, const FrameVector< Point >& points) {
 	const Vec3& a = points[tri.a].xyz;
 	const Vec3& b = points[tri.b].xyz;
 	const Vec3& c = points[tri.c].xyz;
@@ -694,7 +758,7 @@ Vec3 NormalDirection(const Tri& tri, const std::vector< Point >& points) {
 }
 
 
-float SignedDistanceToTriangle(const Tri& tri, const Vec3& pt, const std::vector<Point>& points) 
+float SignedDistanceToTriangle(const Tri& tri, const Vec3& pt, const FrameVector<Point>& points) 
 {
 	const Vec3 normal = NormalDirection(tri, points);
 	const Vec3& a = points[tri.a].xyz;
@@ -704,7 +768,7 @@ float SignedDistanceToTriangle(const Tri& tri, const Vec3& pt, const std::vector
 }
 
 
-int ClosestTriangle(const std::vector<Tri>& triangles, const std::vector<Point>& points) 
+int ClosestTriangle(const FrameVector<Tri>& triangles, const FrameVector<Point>& points) 
 {
 	float minDistSqr = 1e10;
 
@@ -724,7 +788,7 @@ int ClosestTriangle(const std::vector<Tri>& triangles, const std::vector<Point>&
 }
 
 
-bool HasPoint(const Vec3& w, const std::vector< Tri > triangles, const std::vector< Point >& points) {
+bool HasPoint(const Vec3& w, const FrameVector< Tri >& triangles, const FrameVector< Point >& points) {
 	const float epsilons = 0.001f * 0.001f;
 	Vec3 delta;
 
@@ -748,7 +812,7 @@ bool HasPoint(const Vec3& w, const std::vector< Tri > triangles, const std::vect
 }
 
 
-int RemoveTrianglesFacingPoint(const Vec3& pt, std::vector<Tri>& triangles, const std::vector<Point>& points) 
+int RemoveTrianglesFacingPoint(const Vec3& pt, FrameVector<Tri>& triangles, const FrameVector<Point>& points) 
 {
 	int numRemoved = 0;
 	for (int i = 0; i < triangles.size(); i++) {
@@ -766,7 +830,7 @@ int RemoveTrianglesFacingPoint(const Vec3& pt, std::vector<Tri>& triangles, cons
 }
 
 
-void FindDanglingEdges(std::vector<Edge>& danglingEdges, const std::vector<Tri>& triangles) 
+void FindDanglingEdges(FrameVector<Edge>& danglingEdges, const FrameVector<Tri>& triangles) 
 {
 	danglingEdges.clear();
 
@@ -829,9 +893,15 @@ void FindDanglingEdges(std::vector<Edge>& danglingEdges, const std::vector<Tri>&
 
 
 float EPA_Expand(const Body* bodyA, const Body* bodyB, const float bias, const Point simplexPoints[4], Vec3& ptOnA, Vec3& ptOnB) {
-	std::vector< Point > points;
-	std::vector< Tri > triangles;
-	std::vector< Edge > danglingEdges;
+	// The polytope is scratch, given back to the arena on return
+	FrameArenaScope scope;
+
+	FrameVector< Point > points;
+	FrameVector< Tri > triangles;
+	FrameVector< Edge > danglingEdges;
+	points.reserve(EPA_MAX_POINTS);
+	triangles.reserve(EPA_MAX_TRIANGLES);
+	danglingEdges.reserve(EPA_MAX_EDGES);
 
 	Vec3 center(0.0f);
 	for (int i = 0; i < 4; i++) {
@@ -880,6 +950,11 @@ float EPA_Expand(const Body* bodyA, const Body* bodyB, const float bias, const P
 			break;	// can't expand
 		}
 
+		// The polytope is as large as its scratch, the closest face found so far will do
+		if (EPA_MAX_POINTS == points.size()) {
+			break;
+		}
+
 		const int newIdx = (int)points.size();
 		points.push_back(newPt);
 
@@ -895,6 +970,9 @@ float EPA_Expand(const Body* bodyA, const Body* bodyB, const float bias, const P
 		if (0 == danglingEdges.size()) {
 			break;
 		}
+		if (triangles.size() + danglingEdges.size() > EPA_MAX_TRIANGLES) {
+			break;
+		}
 
 		// In theory the edges should be a proper CCW order
 		// So we only need to add the new point as 'a' in order
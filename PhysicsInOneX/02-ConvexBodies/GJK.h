@@ -1,10 +1,10 @@
 #pragma once
 #include "code/Math/Vector.h"
 #include <vector>
+#include "code/FrameArena.h"
+#include "ShapeUtils.h"
 
 class Body;
-class Tri;
-class Edge;
 
 struct Point
 {
@@ -68,16 +68,23 @@ void GJK_ClosestPoints(const Body* bodyA, const Body* bodyB, Vec3& ptOnA, Vec3&
 // This borrows our signed volume code to perform the barycentric coordinates.
 Vec3 BarycentricCoordinates(Vec3 s1, Vec3 s2, Vec3 s3, const Vec3& pt);
 
-Vec3 NormalDirection(const Tri& tri, const std::vector< Point >& points);
+Vec3 NormalDirection(const Tri& tri, const FrameVector< Point >& points);
 
-float SignedDistanceToTriangle(const Tri& tri, const Vec3& pt, const std::vector<Point>& points);
+float SignedDistanceToTriangle(const Tri& tri, const Vec3& pt, const FrameVector<Point>& points);
 
-int ClosestTriangle(const std::vector<Tri>& triangles, const std::vector<Point>& points);
+int ClosestTriangle(const FrameVector<Tri>& triangles, const FrameVector<Point>& points);
 
-bool HasPoint(const Vec3& w, const std::vector<Tri> triangles, const std::vector<Point>& points);
+bool HasPoint(const Vec3& w, const FrameVector<Tri>& triangles, const FrameVector<Point>& points);
 
-int RemoveTrianglesFacingPoint(const Vec3& pt, std::vector<Tri>& triangles, const std::vector<Point>& points);
+int RemoveTrianglesFacingPoint(const Vec3& pt, FrameVector<Tri>& triangles, const FrameVector<Point>& points);
 
-void FindDanglingEdges(std::vector<Edge>& danglingEdges, const std::vector< Tri >& triangles);
+void FindDanglingEdges(FrameVector<Edge>& danglingEdges, const FrameVector< Tri >& triangles);
+
+// The EPA polytope stops growing at EPA_MAX_POINTS. Its scratch is reserved whole from the
+// frame arena, so a world of fixed size knows up front what EPA needs.
+static const int EPA_MAX_POINTS = 128;
+static const int EPA_MAX_TRIANGLES = 2 * EPA_MAX_POINTS;
+static const int EPA_MAX_EDGES = 3 * EPA_MAX_TRIANGLES;
+static const size_t EPA_ARENA_BYTES = EPA_MAX_POINTS * sizeof(Point) + EPA_MAX_TRIANGLES * sizeof(Tri) + EPA_MAX_EDGES * sizeof(Edge);
 
 float EPA_Expand(const Body* bodyA, const Body* bodyB, const float bias, const Point simplexPoints[4], Vec3& ptOnA, Vec3& ptOnB);
\ No newline at end of file
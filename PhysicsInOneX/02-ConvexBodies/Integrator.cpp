@@ -0,0 +1,252 @@
+#include "Integrator.h"
+#include "code/ThreadPool.h"
+#include "code/Math/Lanes.h"
+
+/*
+ * Quaternions in lanes, each operation in the same order as Quat so the lanes round alike
+ */
+struct QuatLanes
+{
+	lane_t x;
+	lane_t y;
+	lane_t z;
+	lane_t w;
+};
+
+static inline QuatLanes QuatMul(const QuatLanes& a, const QuatLanes& b) {
+	QuatLanes q;
+	q.w = LaneSub(LaneSub(LaneSub(LaneMul(a.w, b.w), LaneMul(a.x, b.x)), LaneMul(a.y, b.y)), LaneMul(a.z, b.z));
+	q.x = LaneSub(LaneAdd(LaneAdd(LaneMul(a.x, b.w), LaneMul(a.w, b.x)), LaneMul(a.y, b.z)), LaneMul(a.z, b.y));
+	q.y = LaneSub(LaneAdd(LaneAdd(LaneMul(a.y, b.w), LaneMul(a.w, b.y)), LaneMul(a.z, b.x)), LaneMul(a.x, b.z));
+	q.z = LaneSub(LaneAdd(LaneAdd(LaneMul(a.z, b.w), LaneMul(a.w, b.z)), LaneMul(a.x, b.y)), LaneMul(a.y, b.x));
+	return q;
+}
+
+static inline lane_t MagnitudeSquared(const QuatLanes& q) {
+	return LaneAdd(LaneAdd(LaneAdd(LaneMul(q.x, q.x), LaneMul(q.y, q.y)), LaneMul(q.z, q.z)), LaneMul(q.w, q.w));
+}
+
+static inline QuatLanes Inverse(const QuatLanes& q) {
+	const lane_t scale = LaneDiv(LaneSet(1.0f), MagnitudeSquared(q));
+	const lane_t negScale = LaneSet(-1.0f);
+	return QuatLanes{
+		LaneMul(LaneMul(q.x, scale), negScale),
+		LaneMul(LaneMul(q.y, scale), negScale),
+		LaneMul(LaneMul(q.z, scale), negScale),
+		LaneMul(q.w, scale)
+	};
+}
+
+static inline QuatLanes Normalized(const QuatLanes& q) {
+	const lane_t invMag = LaneDiv(LaneSet(1.0f), LaneSqrt(MagnitudeSquared(q)));
+	return QuatLanes{
+		LaneSelectFinite(invMag, LaneMul(q.x, invMag), q.x),
+		LaneSelectFinite(invMag, LaneMul(q.y, invMag), q.y),
+		LaneSelectFinite(invMag, LaneMul(q.z, invMag), q.z),
+		LaneSelectFinite(invMag, LaneMul(q.w, invMag), q.w)
+	};
+}
+
+static inline Vec3Lanes Normalized(const Vec3Lanes& v) {
+	const lane_t invMag = LaneDiv(LaneSet(1.0f), LaneSqrt(Dot(v, v)));
+	return Vec3Lanes{
+		LaneSelectFinite(invMag, LaneMul(v.x, invMag), v.x),
+		LaneSelectFinite(invMag, LaneMul(v.y, invMag), v.y),
+		LaneSelectFinite(invMag, LaneMul(v.z, invMag), v.z)
+	};
+}
+
+static inline Vec3Lanes RotatePoint(const QuatLanes& q, const Vec3Lanes& v) {
+	const QuatLanes vector{ v.x, v.y, v.z, LaneSet(0.0f) };
+	const QuatLanes rotated = QuatMul(QuatMul(q, vector), Inverse(q));
+	return Vec3Lanes{ rotated.x, rotated.y, rotated.z };
+}
+
+// Quat( n, angle ), the trig goes through the same library calls one lane at a time
+static QuatLanes AxisAngle(const Vec3Lanes& n, const lane_t angle) {
+	alignas(32) float halfAngles[numLanes];
+	alignas(32) float sines[numLanes];
+	alignas(32) float cosines[numLanes];
+	LaneStore(halfAngles, LaneMul(LaneSet(0.5f), angle));
+	for (int lane = 0; lane < numLanes; lane++) {
+		cosines[lane] = cosf(halfAngles[lane]);
+		sines[lane] = sinf(halfAngles[lane]);
+	}
+
+	const lane_t halfSine = LaneLoad(sines);
+	const Vec3Lanes axis = Normalized(n);
+	return QuatLanes{ LaneMul(axis.x, halfSine), LaneMul(axis.y, halfSine), LaneMul(axis.z, halfSine), LaneLoad(cosines) };
+}
+
+// Quat::ToMat3, the rows are the axes rotated
+static Mat3Lanes ToMat3(const QuatLanes& q) {
+	const lane_t one = LaneSet(1.0f);
+	const lane_t zero = LaneSet(0.0f);
+	Mat3Lanes m;
+	m.rows[0] = RotatePoint(q, Vec3Lanes{ one, zero, zero });
+	m.rows[1] = RotatePoint(q, Vec3Lanes{ zero, one, zero });
+	m.rows[2] = RotatePoint(q, Vec3Lanes{ zero, zero, one });
+	return m;
+}
+
+// The same rows in closed form, for a unit quaternion
+static Mat3Lanes ToMat3Fast(const QuatLanes& q) {
+	const lane_t one = LaneSet(1.0f);
+	const lane_t two = LaneSet(2.0f);
+	const lane_t xx = LaneMul(q.x, q.x);
+	const lane_t yy = LaneMul(q.y, q.y);
+	const lane_t zz = LaneMul(q.z, q.z);
+	const lane_t xy = LaneMul(q.x, q.y);
+	const lane_t xz = LaneMul(q.x, q.z);
+	const lane_t yz = LaneMul(q.y, q.z);
+	const lane_t wx = LaneMul(q.w, q.x);
+	const lane_t wy = LaneMul(q.w, q.y);
+	const lane_t wz = LaneMul(q.w, q.z);
+
+	Mat3Lanes m;
+	m.rows[0] = Vec3Lanes{ LaneSub(one, LaneMul(two, LaneAdd(yy, zz))), LaneMul(two, LaneAdd(xy, wz)), LaneMul(two, LaneSub(xz, wy)) };
+	m.rows[1] = Vec3Lanes{ LaneMul(two, LaneSub(xy, wz)), LaneSub(one, LaneMul(two, LaneAdd(xx, zz))), LaneMul(two, LaneAdd(yz, wx)) };
+	m.rows[2] = Vec3Lanes{ LaneMul(two, LaneAdd(xz, wy)), LaneMul(two, LaneSub(yz, wx)), LaneSub(one, LaneMul(two, LaneAdd(xx, yy))) };
+	return m;
+}
+
+/*
+ * One lane per body, read and written through the store accessors. The bodies are named by
+ * their store index, lanes past the last body repeat one of them and are never written.
+ */
+template<typename Get>
+static inline lane_t GatherLane(const int* lanes, const Get& get) {
+	alignas(32) float values[numLanes];
+	for (int lane = 0; lane < numLanes; lane++) {
+		values[lane] = get(lanes[lane]);
+	}
+	return LaneLoad(values);
+}
+
+template<typename Get>
+static inline Vec3Lanes GatherVec3(const int* lanes, const Get& get) {
+	return Vec3Lanes{
+		GatherLane(lanes, [&get](const int i) { return get(i).x; }),
+		GatherLane(lanes, [&get](const int i) { return get(i).y; }),
+		GatherLane(lanes, [&get](const int i) { return get(i).z; })
+	};
+}
+
+template<typename Get>
+static inline Mat3Lanes GatherMat3(const int* lanes, const Get& get) {
+	Mat3Lanes m;
+	for (int row = 0; row < 3; row++) {
+		m.rows[row] = GatherVec3(lanes, [&get, row](const int i) -> const Vec3& { return get(i).rows[row]; });
+	}
+	return m;
+}
+
+template<typename Get>
+static inline void ScatterLane(const int* lanes, const int count, const lane_t v, const Get& get) {
+	alignas(32) float values[numLanes];
+	LaneStore(values, v);
+	for (int lane = 0; lane < count; lane++) {
+		get(lanes[lane]) = values[lane];
+	}
+}
+
+template<typename Get>
+static inline void ScatterVec3(const int* lanes, const int count, const Vec3Lanes& v, const Get& get) {
+	ScatterLane(lanes, count, v.x, [&get](const int i) -> float& { return get(i).x; });
+	ScatterLane(lanes, count, v.y, [&get](const int i) -> float& { return get(i).y; });
+	ScatterLane(lanes, count, v.z, [&get](const int i) -> float& { return get(i).z; });
+}
+
+template<typename Get>
+static inline void ScatterMat3(const int* lanes, const int count, const Mat3Lanes& m, const Get& get) {
+	for (int row = 0; row < 3; row++) {
+		ScatterVec3(lanes, count, m.rows[row], [&get, row](const int i) -> Vec3& { return get(i).rows[row]; });
+	}
+}
+
+// Body::Update then Body::UpdateDerivedState, for the bodies at lanes[]. Only the first count
+// are written back.
+static void IntegrateLanes(BodyStore& bodies, const int* lanes, const int count, const float dt_sec, const bool isDeterministic)
+{
+	const BodyStore& store = bodies;
+	const lane_t dt = LaneSet(dt_sec);
+	const Vec3Lanes linearVelocity = GatherVec3(lanes, [&store](const int i) -> const Vec3& { return store.LinearVelocity(i); });
+	const Vec3Lanes angularVelocity0 = GatherVec3(lanes, [&store](const int i) -> const Vec3& { return store.AngularVelocity(i); });
+	const Mat3Lanes orientationMatrix = GatherMat3(lanes, [&store](const int i) -> const Mat3& { return store.OrientationMatrix(i); });
+	const Mat3Lanes inverseInertia = GatherMat3(lanes, [&store](const int i) -> const Mat3& { return store.InverseInertiaBodySpace(i); });
+
+	const Vec3Lanes position = Add(GatherVec3(lanes, [&store](const int i) -> const Vec3& { return store.Position(i); }), Scale(linearVelocity, dt));
+	const Vec3Lanes positionCM = Add(GatherVec3(lanes, [&store](const int i) -> const Vec3& { return store.CenterOfMassWorldSpace(i); }), Scale(linearVelocity, dt));
+	const Vec3Lanes CMToPosition = Sub(position, positionCM);
+
+	const Mat3Lanes inertia = GatherMat3(lanes, [&store](const int i) -> const Mat3& { return store.InertiaBodySpace(i); });
+	const Vec3Lanes localAngularVelocity = Mul(Transpose(orientationMatrix), angularVelocity0);
+	const Vec3Lanes localAlpha = Mul(inverseInertia, Cross(localAngularVelocity, Mul(inertia, localAngularVelocity)));
+	const Vec3Lanes angularVelocity = Add(angularVelocity0, Scale(Mul(orientationMatrix, localAlpha), dt));
+
+	const Vec3Lanes dAngle = Scale(angularVelocity, dt);
+	QuatLanes dq;
+	if (isDeterministic) {
+		dq = AxisAngle(dAngle, LaneSqrt(Dot(dAngle, dAngle)));
+	} else {
+		// Turns by 2 atan(angle / 2) instead of the angle, close enough for a step.
+		// RotatePoint divides by the squared magnitude, dq doesn't have to be unit.
+		const lane_t half = LaneSet(0.5f);
+		dq = QuatLanes{ LaneMul(dAngle.x, half), LaneMul(dAngle.y, half), LaneMul(dAngle.z, half), LaneSet(1.0f) };
+	}
+
+	const QuatLanes orientation0 = QuatLanes{
+		GatherLane(lanes, [&store](const int i) { return store.Orientation(i).x; }),
+		GatherLane(lanes, [&store](const int i) { return store.Orientation(i).y; }),
+		GatherLane(lanes, [&store](const int i) { return store.Orientation(i).z; }),
+		GatherLane(lanes, [&store](const int i) { return store.Orientation(i).w; })
+	};
+	const QuatLanes orientation = Normalized(QuatMul(dq, orientation0));
+	const Vec3Lanes newPosition = Add(positionCM, RotatePoint(dq, CMToPosition));
+
+	// Derived state
+	const Mat3Lanes newOrientationMatrix = isDeterministic ? ToMat3(orientation) : ToMat3Fast(orientation);
+	const Vec3Lanes localCenterOfMass = GatherVec3(lanes, [&store](const int i) -> const Vec3& { return store.CenterOfMassBodySpace(i); });
+	const Vec3Lanes toCenterOfMass = Add(Add(Scale(newOrientationMatrix.rows[0], localCenterOfMass.x), Scale(newOrientationMatrix.rows[1], localCenterOfMass.y)), Scale(newOrientationMatrix.rows[2], localCenterOfMass.z));
+	const lane_t inverseMass = GatherLane(lanes, [&store](const int i) { return store.InverseMass(i); });
+	const Mat3Lanes inverseInertiaWorld = Scale(Mul(Mul(newOrientationMatrix, inverseInertia), Transpose(newOrientationMatrix)), inverseMass);
+
+	ScatterVec3(lanes, count, newPosition, [&bodies](const int i) -> Vec3& { return bodies.Position(i); });
+	ScatterLane(lanes, count, orientation.x, [&bodies](const int i) -> float& { return bodies.Orientation(i).x; });
+	ScatterLane(lanes, count, orientation.y, [&bodies](const int i) -> float& { return bodies.Orientation(i).y; });
+	ScatterLane(lanes, count, orientation.z, [&bodies](const int i) -> float& { return bodies.Orientation(i).z; });
+	ScatterLane(lanes, count, orientation.w, [&bodies](const int i) -> float& { return bodies.Orientation(i).w; });
+	ScatterVec3(lanes, count, angularVelocity, [&bodies](const int i) -> Vec3& { return bodies.AngularVelocity(i); });
+	ScatterVec3(lanes, count, Add(newPosition, toCenterOfMass), [&bodies](const int i) -> Vec3& { return bodies.CenterOfMassWorldSpace(i); });
+	ScatterMat3(lanes, count, newOrientationMatrix, [&bodies](const int i) -> Mat3& { return bodies.OrientationMatrix(i); });
+	ScatterMat3(lanes, count, inverseInertiaWorld, [&bodies](const int i) -> Mat3& { return bodies.InverseInertiaWorldSpace(i); });
+
+	// Bodies without mass never turn, like in UpdateDerivedState
+	for (int lane = 0; lane < count; lane++) {
+		if (bodies.InverseMass(lanes[lane]) == 0.0f) {
+			bodies.InverseInertiaWorldSpace(lanes[lane]).Zero();
+		}
+	}
+}
+
+void IntegrateBodiesWide(BodyStore& bodies, const int* indices, const int num, const float dt_sec, const bool isDeterministic)
+{
+	for (int first = 0; first < num; first += numLanes) {
+		const int count = (num - first < numLanes) ? (num - first) : numLanes;
+
+		// Unused lanes repeat the first body, their results are dropped
+		int lanes[numLanes];
+		for (int lane = 0; lane < numLanes; lane++) {
+			lanes[lane] = indices[first + ((lane < count) ? lane : 0)];
+		}
+
+		IntegrateLanes(bodies, lanes, count, dt_sec, isDeterministic);
+	}
+}
+
+void IntegrateBodies(BodyStore& bodies, const int* indices, const int num, const float dt_sec, const bool isDeterministic)
+{
+	GetThreadPool().ParallelFor(num, 256, [&bodies, indices, dt_sec, isDeterministic](int begin, int end) {
+		IntegrateBodiesWide(bodies, indices + begin, end - begin, dt_sec, isDeterministic);
+	});
+}
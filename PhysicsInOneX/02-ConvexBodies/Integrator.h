@@ -0,0 +1,11 @@
+#pragma once
+#include "BodyStore.h"
+
+// Same as Body::Update on the stored bodies at indices[i], numLanes bodies at a time in SIMD
+// lanes and in chunks over the worker threads. Deterministic integration is bit identical to
+// Update, as long as the compiler doesn't fuse its multiply adds, and still takes the sine and
+// cosine of each rotation one lane at a time. Otherwise rotations take a first order step instead.
+void IntegrateBodies(BodyStore& bodies, const int* indices, const int num, const float dt_sec, const bool isDeterministic);
+
+// One chunk of the above, on the calling thread
+void IntegrateBodiesWide(BodyStore& bodies, const int* indices, const int num, const float dt_sec, const bool isDeterministic);
@@ -1,11 +1,15 @@
 #include "Intersections.h"
+#include <algorithm>
 #include "Contact.h"
 #include "GJK.h"
 
 bool Intersections::Intersect(Body& a, Body& b, const float dt, Contact& contact)
 {
-	contact.a = &a;
-	contact.b = &b;
+	if (HasChildren(a.shape) || HasChildren(b.shape))
+	{
+		return IntersectChildren(a, b, dt, contact);
+	}
+
 	const Vec3 ab = b.position - a.position;
 	contact.normal = ab;
 	contact.normal.Normalize();
@@ -149,9 +153,289 @@ bool Intersections::SphereSphereStatic(const ShapeSphere* sphereA, const ShapeSp
 }
 
 
+// Closest points of the segments p1 q1 and p2 q2, from Ericson's Real-Time Collision Detection
+static void SegmentsClosestPoints(const Vec3& p1, const Vec3& q1, const Vec3& p2, const Vec3& q2, Vec3& c1, Vec3& c2)
+{
+	const Vec3 d1 = q1 - p1;
+	const Vec3 d2 = q2 - p2;
+	const Vec3 r = p1 - p2;
+	const float a = d1.Dot(d1);
+	const float e = d2.Dot(d2);
+	const float f = d2.Dot(r);
+	const float epsilon = 1e-8f;
+
+	float s = 0.0f;
+	float t = 0.0f;
+	if (a <= epsilon && e <= epsilon) {
+		// Both are points
+	} else if (a <= epsilon) {
+		t = std::min(std::max(f / e, 0.0f), 1.0f);
+	} else {
+		const float c = d1.Dot(r);
+		if (e <= epsilon) {
+			s = std::min(std::max(-c / a, 0.0f), 1.0f);
+		} else {
+			// Parallel segments take any pair, here from the start of the first
+			const float b = d1.Dot(d2);
+			const float denom = a * e - b * b;
+			if (denom > epsilon * a * e) {
+				s = std::min(std::max((b * f - c * e) / denom, 0.0f), 1.0f);
+			}
+			t = (b * s + f) / e;
+			if (t < 0.0f) {
+				t = 0.0f;
+				s = std::min(std::max(-c / a, 0.0f), 1.0f);
+			} else if (t > 1.0f) {
+				t = 1.0f;
+				s = std::min(std::max((b - c) / a, 0.0f), 1.0f);
+			}
+		}
+	}
+	c1 = p1 + d1 * s;
+	c2 = p2 + d2 * t;
+}
+
+// Spheres and capsules are a segment with a radius around it
+static bool RoundedSegment(const Body& body, Vec3& start, Vec3& end, float& radius)
+{
+	if (body.shape->GetType() == Shape::ShapeType::SHAPE_SPHERE) {
+		start = body.position;
+		end = body.position;
+		radius = static_cast<const ShapeSphere*>(body.shape)->radius;
+		return true;
+	}
+	if (body.shape->GetType() == Shape::ShapeType::SHAPE_CAPSULE) {
+		const ShapeCapsule* capsule = static_cast<const ShapeCapsule*>(body.shape);
+		const Vec3 axis = body.orientation.RotatePoint(Vec3(0.0f, 0.0f, capsule->halfHeight));
+		start = body.position - axis;
+		end = body.position + axis;
+		radius = capsule->radius;
+		return true;
+	}
+	return false;
+}
+
+// The point of the other body deepest under the plane, one support query and a dot product
+static float PlaneClosestPoints(const Body& plane, const Body& other, Vec3& ptOnPlane, Vec3& ptOnOther, Vec3& normal)
+{
+	normal = plane.orientation.RotatePoint(Vec3(0.0f, 0.0f, 1.0f));
+	ptOnOther = other.shape->Support(normal * -1.0f, other.position, other.orientation, 0.0f);
+	const float separation = normal.Dot(ptOnOther - plane.position);
+	ptOnPlane = ptOnOther - normal * separation;
+	return separation;
+}
+
+bool Intersections::ClosestPointsClosedForm(const Body& a, const Body& b, Vec3& ptOnA, Vec3& ptOnB, Vec3& normal, float& separation)
+{
+	const bool isPlaneA = (a.shape->GetType() == Shape::ShapeType::SHAPE_PLANE);
+	const bool isPlaneB = (b.shape->GetType() == Shape::ShapeType::SHAPE_PLANE);
+	if (isPlaneA && isPlaneB) {
+		return false;
+	}
+	if (isPlaneB) {
+		separation = PlaneClosestPoints(b, a, ptOnB, ptOnA, normal);
+		return true;
+	}
+	if (isPlaneA) {
+		separation = PlaneClosestPoints(a, b, ptOnA, ptOnB, normal);
+		normal *= -1.0f;
+		return true;
+	}
+
+	Vec3 startA, endA, startB, endB;
+	float radiusA, radiusB;
+	if (!RoundedSegment(a, startA, endA, radiusA) || !RoundedSegment(b, startB, endB, radiusB)) {
+		return false;
+	}
+
+	Vec3 closestA, closestB;
+	SegmentsClosestPoints(startA, endA, startB, endB, closestA, closestB);
+	normal = closestA - closestB;
+	const float distance = normal.GetMagnitude();
+	if (distance > 1e-6f) {
+		normal /= distance;
+	} else {
+		// The segments cross, any direction across them will do
+		const Vec3 across = (endA - startA).Cross(endB - startB);
+		normal = (across.GetLengthSqr() > 1e-12f) ? across : Vec3(0.0f, 0.0f, 1.0f);
+		normal.Normalize();
+	}
+	ptOnA = closestA - normal * radiusA;
+	ptOnB = closestB + normal * radiusB;
+	separation = distance - radiusA - radiusB;
+	return true;
+}
+
+// Where a body is sampled against a distance field, in the frame of the field, with the
+// radius taken off the distance there: the hull vertices, the center of a sphere, the
+// segment ends of a capsule, points around the rims of a cylinder. Support points for
+// the other shapes.
+template <typename Visit>
+static void VisitSdfSamples(const Body& body, const Body& field, Visit visit)
+{
+	const Shape* shape = body.shape;
+	Vec3 scale(1.0f);
+	if (shape->GetType() == Shape::ShapeType::SHAPE_SCALED) {
+		const ShapeScaled* scaled = static_cast<const ShapeScaled*>(shape);
+		if (scaled->shape->GetType() == Shape::ShapeType::SHAPE_BOX || scaled->shape->GetType() == Shape::ShapeType::SHAPE_CONVEX) {
+			shape = scaled->shape;
+			scale = scaled->scale;
+		}
+	}
+
+	// One matrix for the points of the body straight into the field frame
+	const Quat invFieldOrient = field.orientation.Inverse();
+	const Mat3 toField = (invFieldOrient * body.orientation).ToMat3().Transpose();
+	const Vec3 offset = invFieldOrient.RotatePoint(body.position - field.position);
+	const auto visitLocal = [&](const Vec3& pt, const float radius) {
+		visit(toField * Vec3(pt.x * scale.x, pt.y * scale.y, pt.z * scale.z) + offset, radius);
+	};
+
+	if (shape->GetType() == Shape::ShapeType::SHAPE_SPHERE) {
+		visit(offset, static_cast<const ShapeSphere*>(shape)->radius);
+	} else if (shape->GetType() == Shape::ShapeType::SHAPE_CAPSULE) {
+		const ShapeCapsule* capsule = static_cast<const ShapeCapsule*>(shape);
+		visitLocal(Vec3(0.0f, 0.0f, -capsule->halfHeight), capsule->radius);
+		visitLocal(Vec3(0.0f, 0.0f, capsule->halfHeight), capsule->radius);
+	} else if (shape->GetType() == Shape::ShapeType::SHAPE_CYLINDER) {
+		const ShapeCylinder* cylinder = static_cast<const ShapeCylinder*>(shape);
+		const int numSamples = 8;
+		for (int i = 0; i < numSamples; i++) {
+			const float angle = 6.2831853f * i / numSamples;
+			const float x = cosf(angle) * cylinder->radius;
+			const float y = sinf(angle) * cylinder->radius;
+			visitLocal(Vec3(x, y, -cylinder->halfHeight), 0.0f);
+			visitLocal(Vec3(x, y, cylinder->halfHeight), 0.0f);
+		}
+	} else if (shape->GetType() == Shape::ShapeType::SHAPE_BOX) {
+		const ShapeBox* box = static_cast<const ShapeBox*>(shape);
+		for (int i = 0; i < ShapeBox::numPoints; i++) {
+			visitLocal(box->points[i], 0.0f);
+		}
+	} else if (shape->GetType() == Shape::ShapeType::SHAPE_CONVEX) {
+		const ShapeConvex* convex = static_cast<const ShapeConvex*>(shape);
+		for (int i = 0; i < convex->numPoints; i++) {
+			visitLocal(convex->points[i], 0.0f);
+		}
+	} else {
+		// The axes and the diagonals of the body frame
+		for (int x = -1; x <= 1; x++) {
+			for (int y = -1; y <= 1; y++) {
+				for (int z = -1; z <= 1; z++) {
+					if (x == 0 && y == 0 && z == 0) {
+						continue;
+					}
+					const Vec3 dir = body.orientation.RotatePoint(Vec3((float)x, (float)y, (float)z));
+					const Vec3 pt = body.shape->Support(dir, body.position, body.orientation, 0.0f);
+					visit(invFieldOrient.RotatePoint(pt - field.position), 0.0f);
+				}
+			}
+		}
+	}
+}
+
+int Intersections::SampleSdf(const Body& sdfBody, const Body& other, SdfPoint* points, const int maxPoints)
+{
+	const ShapeSdf* field = static_cast<const ShapeSdf*>(sdfBody.shape);
+	float distances[maxSdfPoints];
+	Vec3 gradients[maxSdfPoints];
+	Vec3 samples[maxSdfPoints];
+	float radii[maxSdfPoints];
+	const int maxKept = (maxPoints < maxSdfPoints) ? maxPoints : maxSdfPoints;
+	int num = 0;
+	int shallowest = 0;
+	VisitSdfSamples(other, sdfBody, [&](const Vec3& pt, const float radius) {
+		Vec3 gradient;
+		const float distance = field->Distance(pt, gradient);
+
+		// Once full, a deeper sample takes the place of the shallowest
+		int slot = num;
+		if (num == maxKept) {
+			if (distances[shallowest] - radii[shallowest] <= distance - radius) {
+				return;
+			}
+			slot = shallowest;
+		} else {
+			num++;
+		}
+		distances[slot] = distance;
+		gradients[slot] = gradient;
+		samples[slot] = pt;
+		radii[slot] = radius;
+		if (num == maxKept) {
+			shallowest = 0;
+			for (int i = 1; i < num; i++) {
+				if (distances[i] - radii[i] > distances[shallowest] - radii[shallowest]) {
+					shallowest = i;
+				}
+			}
+		}
+	});
+
+	// Back to world space for the samples kept only
+	for (int i = 0; i < num; i++) {
+		// Flat spots of the field fall back to the direction from its center
+		Vec3 normal = gradients[i];
+		if (normal.GetLengthSqr() < 1e-12f) {
+			normal = samples[i] - field->GetCenterOfMass();
+		}
+		if (normal.GetLengthSqr() < 1e-12f) {
+			normal = Vec3(0.0f, 0.0f, 1.0f);
+		}
+		normal.Normalize();
+		normal = sdfBody.orientation.RotatePoint(normal);
+		const Vec3 pt = sdfBody.orientation.RotatePoint(samples[i]) + sdfBody.position;
+
+		points[i].normal = normal;
+		points[i].ptOnOther = pt - normal * radii[i];
+		points[i].ptOnSdf = pt - normal * distances[i];
+		points[i].separation = distances[i] - radii[i];
+	}
+	return num;
+}
+
+// The deepest sample of the other body when one of the two is a distance field.
+// The normal goes from B to A like the contacts.
+static bool SdfClosestPoints(const Body& a, const Body& b, Vec3& ptOnA, Vec3& ptOnB, Vec3& normal, float& separation)
+{
+	const bool isSdfA = (a.shape->GetType() == Shape::ShapeType::SHAPE_SDF);
+	const bool isSdfB = (b.shape->GetType() == Shape::ShapeType::SHAPE_SDF);
+	if (isSdfA == isSdfB) {
+		return false;
+	}
+
+	Intersections::SdfPoint deepest;
+	if (0 == Intersections::SampleSdf(isSdfA ? a : b, isSdfA ? b : a, &deepest, 1)) {
+		return false;
+	}
+	separation = deepest.separation;
+	normal = isSdfA ? deepest.normal * -1.0f : deepest.normal;
+	ptOnA = isSdfA ? deepest.ptOnSdf : deepest.ptOnOther;
+	ptOnB = isSdfA ? deepest.ptOnOther : deepest.ptOnSdf;
+	return true;
+}
+
+// Penetrations of a mesh triangle always push back along its face. The other sides of the
+// prism lie inside the mesh, pushing out through them would snag on the shared edges.
+// The depth is the one along the face, but no more than the penetration found by EPA, so
+// a far corner of a large body over another triangle doesn't count.
+static Vec3 TriangleFacePoint(const Body& triangleBody, const Body& other, const Vec3& ptOnTriangle, const Vec3& ptOnOther)
+{
+	const ShapeTriangle* triangle = static_cast<const ShapeTriangle*>(triangleBody.shape);
+	const Vec3 faceNormal = triangleBody.orientation.RotatePoint(triangle->normal);
+	const Vec3 facePoint = triangleBody.orientation.RotatePoint(triangle->points[0]) + triangleBody.position;
+
+	const Vec3 deepest = other.shape->Support(faceNormal * -1.0f, other.position, other.orientation, 0.0f);
+	const float faceDepth = faceNormal.Dot(facePoint - deepest);
+	const float depth = std::min(faceDepth, (ptOnTriangle - ptOnOther).GetMagnitude());
+	if (depth < 1e-6f) {
+		// Only grazing the face, keep the points GJK found
+		return ptOnTriangle;
+	}
+	return ptOnOther + faceNormal * depth;
+}
+
 bool Intersections::Intersect(Body* bodyA, Body* bodyB, Contact& contact) {
-	contact.a = bodyA;
-	contact.b = bodyB;
 	contact.timeOfImpact = 0.0f;
 
 	if (bodyA->shape->GetType() == Shape::ShapeType::SHAPE_SPHERE && bodyB->shape->GetType() == Shape::ShapeType::SHAPE_SPHERE) {
@@ -178,7 +462,28 @@ bool Intersections::Intersect(Body* bodyA, Body* bodyB, Contact& contact) {
 		Vec3 ptOnA;
 		Vec3 ptOnB;
 		const float bias = 0.001f;
+
+		Vec3 normal;
+		float separation;
+		if (SdfClosestPoints(*bodyA, *bodyB, ptOnA, ptOnB, normal, separation) || ClosestPointsClosedForm(*bodyA, *bodyB, ptOnA, ptOnB, normal, separation)) {
+			contact.normal = normal;
+			contact.ptOnAWorldSpace = ptOnA;
+			contact.ptOnBWorldSpace = ptOnB;
+			contact.ptOnALocalSpace = bodyA->WorldSpaceToBodySpace(contact.ptOnAWorldSpace);
+			contact.ptOnBLocalSpace = bodyB->WorldSpaceToBodySpace(contact.ptOnBWorldSpace);
+			contact.separationDistance = separation;
+
+			// Touching within the margin GJK is given
+			return separation < bias;
+		}
+
 		if (GJK_DoesIntersect(bodyA, bodyB, bias, ptOnA, ptOnB)) {
+			if (bodyA->shape->GetType() == Shape::ShapeType::SHAPE_TRIANGLE) {
+				ptOnA = TriangleFacePoint(*bodyA, *bodyB, ptOnA, ptOnB);
+			} else if (bodyB->shape->GetType() == Shape::ShapeType::SHAPE_TRIANGLE) {
+				ptOnB = TriangleFacePoint(*bodyB, *bodyA, ptOnB, ptOnA);
+			}
+
 			// There was an intersection, so get the contact data
 			Vec3 normal = ptOnB - ptOnA;
 			normal.Normalize();
@@ -217,9 +522,6 @@ bool Intersections::Intersect(Body* bodyA, Body* bodyB, Contact& contact) {
 
 bool Intersections::ConservativeAdvance(Body& bodyA, Body& bodyB, float dt, Contact& contact) 
 {
-	contact.a = &bodyA;
-	contact.b = &bodyB;
-
 	float toi = 0.0f;
 
 	int numIters = 0;
@@ -249,8 +551,8 @@ bool Intersections::ConservativeAdvance(Body& bodyA, Body& bodyB, float dt, Cont
 		float orthoSpeed = relativeVelocity.Dot(ab);
 
 		// Add to the orthoSpeed the maximum angular speeds of the relative shapes
-		float angularSpeedA = bodyA.shape->FastestLinearSpeed(bodyA.angularVelocity, ab);
-		float angularSpeedB = bodyB.shape->FastestLinearSpeed(bodyB.angularVelocity, ab * -1.0f);
+		float angularSpeedA = VisitShape(bodyA.shape, [&](const auto& shape) { return shape.FastestLinearSpeed(bodyA.angularVelocity, ab); });
+		float angularSpeedB = VisitShape(bodyB.shape, [&](const auto& shape) { return shape.FastestLinearSpeed(bodyB.angularVelocity, ab * -1.0f); });
 		orthoSpeed += angularSpeedA + angularSpeedB;
 		if (orthoSpeed <= 0.0f) {
 			break;
@@ -271,4 +573,170 @@ bool Intersections::ConservativeAdvance(Body& bodyA, Body& bodyB, float dt, Cont
 	bodyA.Update(-toi);
 	bodyB.Update(-toi);
 	return false;
-}
\ No newline at end of file
+}
+
+// World bounds of the body over the step, the rotation can't move a point further
+// than the bounds reach from the center of mass
+static Bounds SweptBounds(const Body& body, const float dt)
+{
+	Bounds bounds = body.shape->GetBounds(body.position, body.orientation);
+	const Vec3 centerOfMass = body.GetCenterOfMassWorldSpace();
+	float reachSqr = 0.0f;
+	for (int i = 0; i < 8; i++) {
+		const Vec3 corner(
+			(i & 1) ? bounds.maxs.x : bounds.mins.x,
+			(i & 2) ? bounds.maxs.y : bounds.mins.y,
+			(i & 4) ? bounds.maxs.z : bounds.mins.z);
+		reachSqr = std::max(reachSqr, (corner - centerOfMass).GetLengthSqr());
+	}
+
+	bounds.Expand(bounds.mins + body.linearVelocity * dt);
+	bounds.Expand(bounds.maxs + body.linearVelocity * dt);
+
+	const float epsilon = 0.01f;
+	const float margin = body.angularVelocity.GetMagnitude() * sqrtf(reachSqr) * dt + epsilon;
+	bounds.Expand(bounds.mins - Vec3(margin));
+	bounds.Expand(bounds.maxs + Vec3(margin));
+	return bounds;
+}
+
+// World bounds into the frame of the body
+static Bounds LocalBounds(const Body& body, const Bounds& worldBounds)
+{
+	const Quat invOrient = body.orientation.Inverse();
+	Bounds localBounds;
+	for (int i = 0; i < 8; i++) {
+		const Vec3 corner(
+			(i & 1) ? worldBounds.maxs.x : worldBounds.mins.x,
+			(i & 2) ? worldBounds.maxs.y : worldBounds.mins.y,
+			(i & 4) ? worldBounds.maxs.z : worldBounds.mins.z);
+		localBounds.Expand(invOrient.RotatePoint(corner - body.position));
+	}
+	return localBounds;
+}
+
+// Static shapes made of triangles
+static bool HasTriangles(const Shape* shape)
+{
+	return shape->GetType() == Shape::ShapeType::SHAPE_TRIANGLE_MESH || shape->GetType() == Shape::ShapeType::SHAPE_HEIGHTFIELD;
+}
+
+bool Intersections::HasChildren(const Shape* shape)
+{
+	return shape->GetType() == Shape::ShapeType::SHAPE_COMPOUND || HasTriangles(shape);
+}
+
+// Children of the body overlapping the world bounds, -1 when it has none
+static void FindChildren(const Body& body, const Bounds& worldBounds, FrameVector<int>& found)
+{
+	if (body.shape->GetType() == Shape::ShapeType::SHAPE_COMPOUND) {
+		static_cast<const ShapeCompound*>(body.shape)->FindChildren(LocalBounds(body, worldBounds), found);
+	} else if (body.shape->GetType() == Shape::ShapeType::SHAPE_TRIANGLE_MESH) {
+		static_cast<const ShapeTriangleMesh*>(body.shape)->FindTriangles(LocalBounds(body, worldBounds), found);
+	} else if (body.shape->GetType() == Shape::ShapeType::SHAPE_HEIGHTFIELD) {
+		static_cast<const ShapeHeightfield*>(body.shape)->FindTriangles(LocalBounds(body, worldBounds), found);
+	} else {
+		found.push_back(-1);
+	}
+}
+
+void Intersections::FindChildPairs(const Body& a, const Body& b, const float dt, FrameVector<ChildPair>& pairs)
+{
+	pairs.clear();
+
+	// Meshes and heightfields are static, two of them never touch
+	if (HasTriangles(a.shape) && HasTriangles(b.shape)) {
+		return;
+	}
+
+	// Children of A near B, then for each of them the children of B near it
+	FrameVector<int> childrenA;
+	if (HasChildren(a.shape)) {
+		FindChildren(a, SweptBounds(b, dt), childrenA);
+	} else {
+		childrenA.push_back(-1);
+	}
+
+	FrameVector<int> childrenB;
+	ShapeTriangle triangle;
+	for (int i = 0; i < (int)childrenA.size(); i++) {
+		childrenB.clear();
+		const Body childA = ChildBody(a, childrenA[i], triangle);
+		FindChildren(b, SweptBounds(childA, dt), childrenB);
+		for (int j = 0; j < (int)childrenB.size(); j++) {
+			pairs.push_back(ChildPair{ childrenA[i], childrenB[j] });
+		}
+	}
+}
+
+Body Intersections::ChildBody(const Body& body, const int child, ShapeTriangle& triangle)
+{
+	if (child < 0) {
+		return body;
+	}
+
+	// Triangles stay in the mesh frame, only the shape changes
+	if (HasTriangles(body.shape)) {
+		if (body.shape->GetType() == Shape::ShapeType::SHAPE_TRIANGLE_MESH) {
+			triangle = static_cast<const ShapeTriangleMesh*>(body.shape)->GetTriangle(child);
+		} else {
+			triangle = static_cast<const ShapeHeightfield*>(body.shape)->GetTriangle(child);
+		}
+		Body childBody = body;
+		childBody.shape = &triangle;
+		childBody.UpdateDerivedState();
+		return childBody;
+	}
+
+	const ShapeCompound::Child& shapeChild = static_cast<const ShapeCompound*>(body.shape)->children[child];
+	Body childBody = body;
+	childBody.shape = const_cast<Shape*>(shapeChild.shape);
+	childBody.position = body.position + body.orientation.RotatePoint(shapeChild.position);
+	childBody.orientation = body.orientation * shapeChild.orientation;
+	childBody.UpdateDerivedState();
+
+	// The same rigid motion, told from the center of mass of the child
+	const Vec3 r = childBody.GetCenterOfMassWorldSpace() - body.GetCenterOfMassWorldSpace();
+	childBody.linearVelocity = body.linearVelocity + body.angularVelocity.Cross(r);
+	return childBody;
+}
+
+bool Intersections::IntersectChildren(Body& a, Body& b, const float dt, Contact& contact)
+{
+	FrameArenaScope scope;
+
+	FrameVector<ChildPair> pairs;
+	FindChildPairs(a, b, dt, pairs);
+
+	// The earliest impact of the children goes to the solver, the deepest of simultaneous ones
+	bool isColliding = false;
+	ShapeTriangle triangleA;
+	ShapeTriangle triangleB;
+	for (int i = 0; i < (int)pairs.size(); i++) {
+		Body childA = ChildBody(a, pairs[i].a, triangleA);
+		Body childB = ChildBody(b, pairs[i].b, triangleB);
+		Contact childContact;
+		if (!Intersect(childA, childB, dt, childContact)) {
+			continue;
+		}
+
+		const bool isEarlier = (childContact.timeOfImpact < contact.timeOfImpact);
+		const bool isDeeper = (childContact.timeOfImpact == contact.timeOfImpact && childContact.separationDistance < contact.separationDistance);
+		if (!isColliding || isEarlier || isDeeper) {
+			contact = childContact;
+			isColliding = true;
+		}
+	}
+	if (!isColliding) {
+		return false;
+	}
+
+	// Body space points of the compounds at the time of impact
+	a.Update(contact.timeOfImpact);
+	b.Update(contact.timeOfImpact);
+	contact.ptOnALocalSpace = a.WorldSpaceToBodySpace(contact.ptOnAWorldSpace);
+	contact.ptOnBLocalSpace = b.WorldSpaceToBodySpace(contact.ptOnBWorldSpace);
+	a.Update(-contact.timeOfImpact);
+	b.Update(-contact.timeOfImpact);
+	return true;
+}
@@ -1,13 +1,32 @@
 #pragma once
+#include <vector>
 #include "Body.h"
 #include "Shape.h"
 #include "Contact.h"
 
+// Children of a pair that may touch, compound children or the triangles of meshes and
+// heightfields. -1 stands for a body without children.
+struct ChildPair
+{
+	int a;
+	int b;
+};
+
 class Intersections
 {
 public:
 	static bool Intersect(Body& a, Body& b, const float dt, Contact& contact);
 
+	// Mid-phase, descends the child trees of compounds and meshes, or looks up the cells of
+	// heightfields, against the bounds the other body sweeps during dt. A pair without either gives the single pair of bodies.
+	static void FindChildPairs(const Body& a, const Body& b, const float dt, FrameVector<ChildPair>& pairs);
+
+	// Stand-in body for a child, moving with its body. The body itself for -1.
+	// A triangle is built into the given shape, which has to outlive the body.
+	static Body ChildBody(const Body& body, const int child, ShapeTriangle& triangle);
+
+	static bool HasChildren(const Shape* shape);
+
 	static bool RaySphere(const Vec3& rayStart, const Vec3& rayDir, const Vec3& sphereCenter, const float sphereRadius, float& t1, float& t2);
 
 	static bool SphereSphereDynamic(const ShapeSphere& shapeA, const ShapeSphere& shapeB,
@@ -17,8 +36,31 @@ public:
 	static bool SphereSphereStatic(const ShapeSphere* sphereA, const ShapeSphere* sphereB,
 		const Vec3& posA, const Vec3& posB, Vec3& ptOnA, Vec3& ptOnB);
 
+	// Closed form closest points, planes against anything, spheres and capsules against
+	// each other. False for the other pairs. The normal goes from B to A like the contacts,
+	// the separation is negative when the shapes overlap.
+	static bool ClosestPointsClosedForm(const Body& a, const Body& b, Vec3& ptOnA, Vec3& ptOnB, Vec3& normal, float& separation);
+
+	// A body against a static signed distance field at one of its samples, the normal
+	// from the field to the body
+	struct SdfPoint
+	{
+		Vec3 ptOnSdf;
+		Vec3 ptOnOther;
+		Vec3 normal;
+		float separation;
+	};
+
+	// Samples the field at the vertices of the other body, at the center of a sphere.
+	// Keeps the maxPoints deepest, up to maxSdfPoints, returns how many there are.
+	static const int maxSdfPoints = 64;
+	static int SampleSdf(const Body& sdfBody, const Body& other, SdfPoint* points, const int maxPoints);
+
 	static bool Intersect(Body* a, Body* b, Contact& contact);
 
 	static bool ConservativeAdvance(Body& bodyA, Body& bodyB, float dt, Contact& contact);
+
+private:
+	static bool IntersectChildren(Body& a, Body& b, const float dt, Contact& contact);
 };
 
@@ -0,0 +1,237 @@
+#include "Island.h"
+#include <algorithm>
+#include <limits.h>
+#include "ContactGraph.h"
+#include "Integrator.h"
+#include "code/FrameArena.h"
+
+static int FindRoot(FrameVector<int>& parents, int i)
+{
+	while (parents[i] != i) {
+		// Path halving
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+	return i;
+}
+
+static void Union(FrameVector<int>& parents, const int a, const int b)
+{
+	const int rootA = FindRoot(parents, a);
+	const int rootB = FindRoot(parents, b);
+	if (rootA == rootB) {
+		return;
+	}
+
+	// Smallest index is the root, so island ids don't depend on contact order
+	if (rootA < rootB) {
+		parents[rootB] = rootA;
+	} else {
+		parents[rootA] = rootB;
+	}
+}
+
+void BuildIslands(BodyStore& bodies, Contact* contacts, const int numContacts, std::vector<Island>& islands, std::vector<int>& islandBodies, int& nextIslandId)
+{
+	FrameArenaScope scope;
+
+	const int numBodies = bodies.Size();
+	FrameVector<int> parents(numBodies);
+	for (int i = 0; i < numBodies; i++) {
+		parents[i] = i;
+	}
+
+	// Static bodies don't link islands, or the whole level would be one island
+	for (int i = 0; i < numContacts; i++) {
+		const Contact& contact = contacts[i];
+		if (!IsActive(bodies, contact.a) || !IsActive(bodies, contact.b)) {
+			continue;
+		}
+		Union(parents, contact.a, contact.b);
+	}
+
+	// Once wrapped, an id can only be shared with an island asleep since before the wrap.
+	// Both then wake together, which is harmless.
+	if (nextIslandId > INT_MAX - numBodies) {
+		nextIslandId = 0;
+	}
+	const int firstIslandId = nextIslandId;
+
+	// The root is the smallest index of the island, it is met first
+	islands.clear();
+	FrameVector<int> rootIslands(numBodies, -1);
+	for (int i = 0; i < numBodies; i++) {
+		if (!IsActive(bodies, i)) {
+			continue;
+		}
+
+		const int root = FindRoot(parents, i);
+		if (-1 == rootIslands[root]) {
+			rootIslands[root] = (int)islands.size();
+			islands.push_back({ 0, 0, 0, 0 });
+		}
+		islands[rootIslands[root]].numBodies++;
+		bodies.ColdState(i).islandId = firstIslandId + rootIslands[root];
+	}
+	nextIslandId += (int)islands.size();
+
+	FrameVector<int> contactIslands(numContacts);
+	for (int i = 0; i < numContacts; i++) {
+		const int body = IsActive(bodies, contacts[i].a) ? contacts[i].a : contacts[i].b;
+		contactIslands[i] = bodies.ColdState(body).islandId - firstIslandId;
+		islands[contactIslands[i]].numContacts++;
+	}
+
+	// Most contacts first, so the long tasks don't start last and the islands large enough
+	// to split come before all the others. Ties go to the most bodies, then keep their
+	// order, so it doesn't depend on the thread count.
+	FrameVector<int> order(islands.size());
+	for (int i = 0; i < (int)order.size(); i++) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&islands](const int lhs, const int rhs) {
+		if (islands[lhs].numContacts != islands[rhs].numContacts) {
+			return islands[lhs].numContacts > islands[rhs].numContacts;
+		}
+		if (islands[lhs].numBodies != islands[rhs].numBodies) {
+			return islands[lhs].numBodies > islands[rhs].numBodies;
+		}
+		return lhs < rhs;
+	});
+
+	FrameVector<Island> sortedIslands(islands.size());
+	FrameVector<int> ranks(islands.size());
+	int firstBody = 0;
+	int firstContact = 0;
+	for (int i = 0; i < (int)order.size(); i++) {
+		Island island = islands[order[i]];
+		island.firstBody = firstBody;
+		island.firstContact = firstContact;
+		firstBody += island.numBodies;
+		firstContact += island.numContacts;
+
+		sortedIslands[i] = island;
+		ranks[order[i]] = i;
+	}
+
+	// Scatter bodies and contacts, keeping their relative order within an island
+	FrameVector<int> bodyOffsets(islands.size());
+	FrameVector<int> contactOffsets(islands.size());
+	for (int i = 0; i < (int)islands.size(); i++) {
+		bodyOffsets[i] = sortedIslands[ranks[i]].firstBody;
+		contactOffsets[i] = sortedIslands[ranks[i]].firstContact;
+	}
+
+	islandBodies.resize(firstBody);
+	for (int i = 0; i < numBodies; i++) {
+		if (IsActive(bodies, i)) {
+			islandBodies[bodyOffsets[bodies.ColdState(i).islandId - firstIslandId]++] = i;
+		}
+	}
+
+	FrameVector<Contact> sortedContacts(numContacts);
+	for (int i = 0; i < numContacts; i++) {
+		sortedContacts[contactOffsets[contactIslands[i]]++] = contacts[i];
+	}
+	for (int i = 0; i < numContacts; i++) {
+		contacts[i] = sortedContacts[i];
+	}
+
+	islands.assign(sortedIslands.begin(), sortedIslands.end());
+}
+
+void SolveIsland(BodyStore& bodies, const Island& island, const int* islandBodies, Contact* contacts, const float dt_sec, const bool isDeterministic)
+{
+	const int* indices = islandBodies + island.firstBody;
+	Contact* islandContacts = contacts + island.firstContact;
+	const int numContacts = island.numContacts;
+
+	// Sort times of impact
+	if (numContacts > 1) {
+		qsort(islandContacts, numContacts, sizeof(Contact), Contact::CompareContact);
+	}
+
+	// Contact resolve in order
+	float accumulatedTime = 0.0f;
+	for (int i = 0; i < numContacts;) {
+		// Contacts sharing a time of impact have no integration between them,
+		// so they are resolved together
+		int numSameTime = 1;
+		while (i + numSameTime < numContacts && islandContacts[i + numSameTime].timeOfImpact == islandContacts[i].timeOfImpact) {
+			++numSameTime;
+		}
+
+		const float dt = islandContacts[i].timeOfImpact - accumulatedTime;
+		IntegrateBodies(bodies, indices, island.numBodies, dt, isDeterministic);
+
+		ResolveContacts(bodies, islandContacts + i, numSameTime);
+		accumulatedTime += dt;
+		i += numSameTime;
+	}
+
+	// Update the positions for the rest of this frame's time
+	const float timeRemaining = dt_sec - accumulatedTime;
+	if (timeRemaining > 0.0f) {
+		IntegrateBodies(bodies, indices, island.numBodies, timeRemaining, isDeterministic);
+	}
+}
+
+void UpdateSleeping(BodyStore& bodies, const Island& island, const int* islandBodies, const float dt_sec, const SleepSettings& settings)
+{
+	const int* indices = islandBodies + island.firstBody;
+
+	// The island can only sleep once its most recently moving body can
+	const float linearThresholdSqr = settings.linearThreshold * settings.linearThreshold;
+	const float angularThresholdSqr = settings.angularThreshold * settings.angularThreshold;
+	float islandSleepTime = settings.timeToSleep;
+	for (int i = 0; i < island.numBodies; i++) {
+		const int index = indices[i];
+		BodyColdState& coldState = bodies.ColdState(index);
+
+		const bool isSlow = bodies.LinearVelocity(index).GetLengthSqr() < linearThresholdSqr && bodies.AngularVelocity(index).GetLengthSqr() < angularThresholdSqr;
+		coldState.sleepTime = isSlow ? (coldState.sleepTime + dt_sec) : 0.0f;
+		if (coldState.sleepTime < islandSleepTime) {
+			islandSleepTime = coldState.sleepTime;
+		}
+	}
+
+	if (islandSleepTime < settings.timeToSleep) {
+		return;
+	}
+
+	for (int i = 0; i < island.numBodies; i++) {
+		const int index = indices[i];
+		bodies.ColdState(index).isSleeping = true;
+		bodies.LinearVelocity(index).Zero();
+		bodies.AngularVelocity(index).Zero();
+	}
+}
+
+void WakeIslands(BodyStore& bodies, int* islandIds, const int numIslandIds)
+{
+	if (numIslandIds == 0) {
+		return;
+	}
+
+	std::sort(islandIds, islandIds + numIslandIds);
+	for (int i = 0; i < bodies.Size(); i++) {
+		const BodyColdState& coldState = bodies.ColdState(i);
+		if (coldState.isSleeping && std::binary_search(islandIds, islandIds + numIslandIds, coldState.islandId)) {
+			bodies.Wake(i);
+		}
+	}
+}
+
+void WakePendingIslands(BodyStore& bodies)
+{
+	FrameArenaScope scope;
+	FrameVector<int> islandIds;
+	for (int i = 0; i < bodies.Size(); i++) {
+		BodyColdState& coldState = bodies.ColdState(i);
+		if (coldState.isIslandWakePending) {
+			coldState.isIslandWakePending = false;
+			islandIds.push_back(coldState.islandId);
+		}
+	}
+	WakeIslands(bodies, islandIds.data(), (int)islandIds.size());
+}
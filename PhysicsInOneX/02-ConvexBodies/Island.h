@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include "BodyStore.h"
+#include "Contact.h"
+
+// Bodies connected through contacts form an island. Islands don't interact during
+// a step, so each one is solved on its own. An island goes to sleep when all of its
+// bodies stayed slow for long enough, and wakes as a whole.
+struct SleepSettings
+{
+	// Just above the jitter of resting contacts, a body sliding or rolling slowly stays awake
+	float linearThreshold{ 0.05f };		// m/s
+	float angularThreshold{ 0.05f };	// rad/s
+	float timeToSleep{ 1.0f };			// s
+};
+
+struct Island
+{
+	int firstBody;		// Into the island body indices
+	int numBodies;
+	int firstContact;	// Into the contacts, once grouped by island
+	int numContacts;
+};
+
+// Islands with this many contacts are split internally over the worker threads,
+// smaller ones are solved whole by a single thread.
+static const int minSplitIslandContacts = 256;
+
+// A body that can be moved by the solver this step
+inline bool IsActive(const BodyStore& bodies, const int index) {
+	return bodies.InverseMass(index) != 0.0f && !bodies.ColdState(index).isSleeping;
+}
+
+// Links awake bodies touching through this step's contacts. Contacts are grouped by island,
+// and islands are sorted by contacts, most first. Each island takes a new id from nextIslandId,
+// which is moved past them, so ids don't follow body indices. Sleeping islands keep their id
+// and are not rebuilt.
+void BuildIslands(BodyStore& bodies, Contact* contacts, const int numContacts, std::vector<Island>& islands, std::vector<int>& islandBodies, int& nextIslandId);
+
+// Most BuildIslands draws from the frame arena, given back on return
+constexpr size_t BuildIslandsArenaBytes(const int numBodies, const int numContacts, const int numIslands) {
+	return (size_t)numBodies * 2 * sizeof(int) + (size_t)numContacts * (sizeof(int) + sizeof(Contact)) + (size_t)numIslands * (sizeof(Island) + 4 * sizeof(int));
+}
+
+// Resolves the island contacts in time of impact order, integrating its bodies in between.
+// See IntegrateBodies for isDeterministic.
+void SolveIsland(BodyStore& bodies, const Island& island, const int* islandBodies, Contact* contacts, const float dt_sec, const bool isDeterministic);
+
+// Puts the island to sleep if it rested long enough
+void UpdateSleeping(BodyStore& bodies, const Island& island, const int* islandBodies, const float dt_sec, const SleepSettings& settings);
+
+// Wakes every sleeping body of the islands, in a single pass over the bodies. The ids are
+// sorted in place and may repeat.
+void WakeIslands(BodyStore& bodies, int* islandIds, const int numIslandIds);
+
+// Wakes the islands of the bodies woken alone by an impulse since the last step
+void WakePendingIslands(BodyStore& bodies);
@@ -1,6 +1,8 @@
 #include "Shape.h"
+#include <algorithm>
 #include "code/Math/Matrix.h"
 #include "ShapeUtils.h"
+#include "ShapeCache.h"
 
 
 /* Sphere */
@@ -31,15 +33,10 @@ Bounds ShapeSphere::GetBounds() const
 	return tmp;
 }
 
-Vec3 ShapeSphere::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
-{
-	return pos + dir * (radius + bias);
-}
-
 
 /* Box */
 
-Mat3 ShapeBox::InertiaTensor() const
+static Mat3 BoxInertiaTensor(const Bounds& bounds)
 {
 	// Inertia tensor for box centered around zero
 	const float dx = bounds.maxs.x - bounds.mins.x;
@@ -75,6 +72,11 @@ Mat3 ShapeBox::InertiaTensor() const
 	return tensor;
 }
 
+Mat3 ShapeBox::InertiaTensor() const
+{
+	return inertiaTensor;
+}
+
 Bounds ShapeBox::GetBounds(const Vec3& pos, const Quat& orient) const
 {
 	Vec3 corners[8];
@@ -108,45 +110,25 @@ void ShapeBox::Build(const Vec3* pts, const int num)
 		bounds.Expand(pts[i]);
 	}
 
-	points.clear();
-	points.push_back(Vec3{ bounds.mins.x, bounds.mins.y, bounds.mins.z });
-	points.push_back(Vec3{ bounds.maxs.x, bounds.mins.y, bounds.mins.z });
-	points.push_back(Vec3{ bounds.mins.x, bounds.maxs.y, bounds.mins.z });
-	points.push_back(Vec3{ bounds.mins.x, bounds.mins.y, bounds.maxs.z });
+	points[0] = Vec3{ bounds.mins.x, bounds.mins.y, bounds.mins.z };
+	points[1] = Vec3{ bounds.maxs.x, bounds.mins.y, bounds.mins.z };
+	points[2] = Vec3{ bounds.mins.x, bounds.maxs.y, bounds.mins.z };
+	points[3] = Vec3{ bounds.mins.x, bounds.mins.y, bounds.maxs.z };
 
-	points.push_back(Vec3{ bounds.maxs.x, bounds.maxs.y, bounds.maxs.z });
-	points.push_back(Vec3{ bounds.mins.x, bounds.maxs.y, bounds.maxs.z });
-	points.push_back(Vec3{ bounds.maxs.x, bounds.mins.y, bounds.maxs.z });
-	points.push_back(Vec3{ bounds.maxs.x, bounds.maxs.y, bounds.mins.z });
+	points[4] = Vec3{ bounds.maxs.x, bounds.maxs.y, bounds.maxs.z };
+	points[5] = Vec3{ bounds.mins.x, bounds.maxs.y, bounds.maxs.z };
+	points[6] = Vec3{ bounds.maxs.x, bounds.mins.y, bounds.maxs.z };
+	points[7] = Vec3{ bounds.maxs.x, bounds.maxs.y, bounds.mins.z };
 
 	centerOfMass = (bounds.maxs + bounds.mins) * 0.5f;
-}
-
-Vec3 ShapeBox::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
-{
-	// Find the point in furthest direction
-	Vec3 maxPt = orient.RotatePoint(points[0]) + pos;
-	float maxDist = dir.Dot(maxPt);
-	for (int i = 1; i < points.size(); i++) {
-		const Vec3 pt = orient.RotatePoint(points[i]) + pos;
-		const float dist = dir.Dot(pt);
-
-		if (dist > maxDist) {
-			maxDist = dist;
-			maxPt = pt;
-		}
-	}
-
-	Vec3 norm = dir;
-	norm.Normalize();
-	norm *= bias;
-	return maxPt + norm;
+	inertiaTensor = BoxInertiaTensor(bounds);
+	CacheInverseInertia();
 }
 
 float ShapeBox::FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const
 {
 	float maxSpeed{ 0 };
-	for (int i = 1; i < points.size(); i++) {
+	for (int i = 1; i < numPoints; i++) {
 		Vec3 r = points[i] - centerOfMass;
 		Vec3 linearVelocity = angularVelocity.Cross(r);
 		float speed = dir.Dot(linearVelocity);
@@ -158,6 +140,97 @@ float ShapeBox::FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir)
 }
 
 
+/* Capsule */
+
+Mat3 ShapeCapsule::InertiaTensor() const
+{
+	// A cylinder and the two halves of a sphere, the mass shared by volume
+	const float r2 = radius * radius;
+	const float height = 2.0f * halfHeight;
+	const float cylinderVolume = r2 * height;
+	const float sphereVolume = 4.0f * r2 * radius / 3.0f;
+	const float cylinderMass = cylinderVolume / (cylinderVolume + sphereVolume);
+	const float sphereMass = 1.0f - cylinderMass;
+
+	Mat3 tensor;
+	tensor.Zero();
+	tensor.rows[0][0] = cylinderMass * (height * height / 12.0f + r2 / 4.0f) + sphereMass * (2.0f * r2 / 5.0f + height * height / 4.0f + 3.0f * height * radius / 8.0f);
+	tensor.rows[1][1] = tensor.rows[0][0];
+	tensor.rows[2][2] = cylinderMass * r2 / 2.0f + sphereMass * 2.0f * r2 / 5.0f;
+	return tensor;
+}
+
+Bounds ShapeCapsule::GetBounds(const Vec3& pos, const Quat& orient) const
+{
+	const Vec3 axis = orient.RotatePoint(Vec3(0.0f, 0.0f, halfHeight));
+	Bounds tmp;
+	tmp.Expand(pos - axis);
+	tmp.Expand(pos + axis);
+	tmp.mins -= Vec3(radius);
+	tmp.maxs += Vec3(radius);
+	return tmp;
+}
+
+Bounds ShapeCapsule::GetBounds() const
+{
+	Bounds tmp;
+	tmp.mins = Vec3(-radius, -radius, -halfHeight - radius);
+	tmp.maxs = Vec3(radius, radius, halfHeight + radius);
+	return tmp;
+}
+
+float ShapeCapsule::FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const
+{
+	// No point is further than the end of the segment and the radius
+	return angularVelocity.Cross(dir).GetMagnitude() * (halfHeight + radius);
+}
+
+
+/* Cylinder */
+
+Mat3 ShapeCylinder::InertiaTensor() const
+{
+	const float r2 = radius * radius;
+	const float height = 2.0f * halfHeight;
+
+	Mat3 tensor;
+	tensor.Zero();
+	tensor.rows[0][0] = (3.0f * r2 + height * height) / 12.0f;
+	tensor.rows[1][1] = (3.0f * r2 + height * height) / 12.0f;
+	tensor.rows[2][2] = r2 / 2.0f;
+	return tensor;
+}
+
+Bounds ShapeCylinder::GetBounds(const Vec3& pos, const Quat& orient) const
+{
+	// Along each world axis, the axis of the cylinder and the rim of its caps
+	const Vec3 axis = orient.RotatePoint(Vec3(0.0f, 0.0f, 1.0f));
+	Vec3 extents;
+	for (int i = 0; i < 3; i++) {
+		extents[i] = halfHeight * fabsf(axis[i]) + radius * sqrtf(std::max(1.0f - axis[i] * axis[i], 0.0f));
+	}
+
+	Bounds tmp;
+	tmp.mins = pos - extents;
+	tmp.maxs = pos + extents;
+	return tmp;
+}
+
+Bounds ShapeCylinder::GetBounds() const
+{
+	Bounds tmp;
+	tmp.mins = Vec3(-radius, -radius, -halfHeight);
+	tmp.maxs = Vec3(radius, radius, halfHeight);
+	return tmp;
+}
+
+float ShapeCylinder::FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const
+{
+	// No point is further than the rim of the caps
+	return angularVelocity.Cross(dir).GetMagnitude() * sqrtf(halfHeight * halfHeight + radius * radius);
+}
+
+
 /* Convex */
 
 Bounds ShapeConvex::GetBounds(const Vec3& pos, const Quat& orient) const
@@ -193,10 +266,21 @@ Mat3 ShapeConvex::InertiaTensor() const
 
 Vec3 ShapeConvex::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const 
 {
+	if (quantized != nullptr) {
+		// Bring the direction to the shape instead of every point to the world
+		const Vec3 localDir = orient.Inverse().RotatePoint(dir);
+		const Vec3 localPt = SupportQuantized(quantized, numQuantized, bounds.mins, quantizedStep, localDir);
+
+		Vec3 norm = dir;
+		norm.Normalize();
+		norm *= bias;
+		return orient.RotatePoint(localPt) + pos + norm;
+	}
+
 	// Find the point in furthest in direction
 	Vec3 maxPt = orient.RotatePoint(points[0]) + pos;
 	float maxDist = dir.Dot(maxPt);
-	for (int i = 1; i < points.size(); i++) {
+	for (int i = 1; i < numPoints; i++) {
 		const Vec3 pt = orient.RotatePoint(points[i]) + pos;
 		const float dist = dir.Dot(pt);
 
@@ -216,7 +300,7 @@ Vec3 ShapeConvex::Support(const Vec3& dir, const Vec3& pos, const Quat& orient,
 float ShapeConvex::FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const
 {
 	float maxSpeed{ 0 };
-	for (int i = 1; i < points.size(); i++) {
+	for (int i = 1; i < numPoints; i++) {
 		Vec3 r = points[i] - centerOfMass;
 		Vec3 linearVelocity = angularVelocity.Cross(r);
 		float speed = dir.Dot(linearVelocity);
@@ -227,106 +311,1142 @@ float ShapeConvex::FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& d
 	return maxSpeed;
 }
 
+// Every hull triangle makes a tetrahedron with the apex, the hull is the sum of them.
+// Exact for any convex hull, thin ones included.
 Vec3 ShapeConvex::CalculateCenterOfMass(const std::vector<Vec3>& pts, const std::vector<Tri>& tris) 
 {
-	const int numSamples = 100;
-
-	Bounds bounds;
-	bounds.Expand(pts.data(), pts.size());
+	// Apex inside the hull, keeps the numbers small
+	Vec3 apex(0.0f);
+	for (int i = 0; i < (int)pts.size(); i++) {
+		apex += pts[i];
+	}
+	apex /= (float)pts.size();
 
 	Vec3 cm(0.0f);
-	const float dx = bounds.WidthX() / (float)numSamples;
-	const float dy = bounds.WidthY() / (float)numSamples;
-	const float dz = bounds.WidthZ() / (float)numSamples;
-
-	int sampleCount = 0;
-	for (float x = bounds.mins.x; x < bounds.maxs.x; x += dx) {
-		for (float y = bounds.mins.y; y < bounds.maxs.y; y += dy) {
-			for (float z = bounds.mins.z; z < bounds.maxs.z; z += dz) {
-				Vec3 pt(x, y, z);
-
-				if (IsExternal(pts, tris, pt)) {
-					continue;
-				}
+	float volume = 0.0f;
+	for (int i = 0; i < (int)tris.size(); i++) {
+		const Tri& tri = tris[i];
+		const Vec3 a = pts[tri.a] - apex;
+		const Vec3 b = pts[tri.b] - apex;
+		const Vec3 c = pts[tri.c] - apex;
+
+		// Six times the signed volume, and the centroid of the tetrahedron is at (a + b + c) / 4
+		const float det = a.Dot(b.Cross(c));
+		cm += (a + b + c) * det;
+		volume += det;
+	}
+
+	cm /= 4.0f * volume;
+	return cm + apex;
+}
 
-				cm += pt;
-				sampleCount++;
+Mat3 ShapeConvex::CalculateInertiaTensor(const std::vector<Vec3>& pts, const std::vector<Tri>& tris, const Vec3& cm)
+{
+	// Second moments of each tetrahedron with its apex on the center of mass,
+	// the covariance of a tetrahedron (0, a, b, c) is det / 120 * (aa' + bb' + cc' + (a + b + c)(a + b + c)')
+	Mat3 covariance;
+	covariance.Zero();
+	float volume = 0.0f;
+	for (int i = 0; i < (int)tris.size(); i++) {
+		const Tri& tri = tris[i];
+		const Vec3 a = pts[tri.a] - cm;
+		const Vec3 b = pts[tri.b] - cm;
+		const Vec3 c = pts[tri.c] - cm;
+		const Vec3 sum = a + b + c;
+
+		const float det = a.Dot(b.Cross(c));
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 3; col++) {
+				covariance.rows[row][col] += det * (a[row] * a[col] + b[row] * b[col] + c[row] * c[col] + sum[row] * sum[col]);
 			}
 		}
+		volume += det;
 	}
 
-	cm /= (float)sampleCount;
-	return cm;
+	// Per unit of volume, det is six times the volume
+	covariance *= 6.0f / (120.0f * volume);
+
+	// Inertia from the covariance, I = trace(C) * Id - C
+	const float trace = covariance.rows[0][0] + covariance.rows[1][1] + covariance.rows[2][2];
+	Mat3 tensor;
+	tensor.Identity();
+	tensor *= trace;
+	tensor += covariance * -1.0f;
+	return tensor;
 }
 
-Mat3 ShapeConvex::CalculateInertiaTensor(const std::vector<Vec3>& pts, const std::vector<Tri>& tris, const Vec3& cm)
+void ShapeConvex::Build(const Vec3* pts, const int num) 
+{
+	Build(pts, num, HullSimplification());
+}
+
+void ShapeConvex::Build(const Vec3* pts, const int num, const HullSimplification& simplification)
+{
+	std::vector<Vec3> input(pts, pts + num);
+
+	// Expand into a convex hull, simplified when there is a budget
+	hullError = SimplifyConvexHull(input, simplification, ownedPoints, ownedTris);
+	points = ownedPoints.data();
+	numPoints = (int)ownedPoints.size();
+	tris = ownedTris.data();
+	numTris = (int)ownedTris.size();
+
+	// Expand the bounds
+	bounds.Clear();
+	bounds.Expand(points, numPoints);
+
+	centerOfMass = CalculateCenterOfMass(ownedPoints, ownedTris);
+
+	inertiaTensor = CalculateInertiaTensor(ownedPoints, ownedTris, centerOfMass);
+	CacheInverseInertia();
+}
+
+ShapeConvex::ShapeConvex(const CookedHull& hull, const bool isCompact) : Shape(ShapeType::SHAPE_CONVEX)
+{
+	points = hull.Points();
+	numPoints = hull.numPoints;
+	tris = hull.Tris();
+	numTris = hull.numTris;
+
+	bounds.mins = Vec3(hull.boundsMins);
+	bounds.maxs = Vec3(hull.boundsMaxs);
+	centerOfMass = Vec3(hull.centerOfMass);
+	inertiaTensor = Mat3(hull.inertiaTensor);
+	CacheInverseInertia();
+	hullError = hull.hullError;
+
+	if (isCompact) {
+		quantized = hull.Quantized();
+		numQuantized = hull.numQuantized;
+		quantizedStep = Vec3(hull.quantizedStep);
+	}
+}
+
+
+/* Scaled */
+
+static Vec3 ScaleVec(const Vec3& v, const Vec3& scale)
+{
+	return Vec3(v.x * scale.x, v.y * scale.y, v.z * scale.z);
+}
+
+ShapeScaled::ShapeScaled(const Shape* shapeP, const Vec3& scaleP) : Shape(ShapeType::SHAPE_SCALED), shape(shapeP), scale(scaleP)
 {
-	const int numSamples = 100;
+	centerOfMass = ScaleVec(shape->GetCenterOfMass(), scale);
 
-	Bounds bounds;
-	bounds.Expand(pts.data(), (int)pts.size());
+	// A negative scale mirrors the shape, swapping its bounds
+	const Bounds innerBounds = shape->GetBounds();
+	const Vec3 a = ScaleVec(innerBounds.mins, scale);
+	const Vec3 b = ScaleVec(innerBounds.maxs, scale);
+	bounds.Clear();
+	bounds.Expand(a);
+	bounds.Expand(b);
+
+	// Back to the second moment about the center of mass, C = tr(I) / 2 - I. Scaling the
+	// shape turns it into S C S, the inertia is then rebuilt from that.
+	const Mat3 inertia = shape->InertiaTensor();
+	const float halfTrace = 0.5f * (inertia.rows[0][0] + inertia.rows[1][1] + inertia.rows[2][2]);
+	Mat3 covariance;
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			const float c = ((i == j) ? halfTrace : 0.0f) - inertia.rows[i][j];
+			covariance.rows[i][j] = c * scale[i] * scale[j];
+		}
+	}
+
+	const float trace = covariance.rows[0][0] + covariance.rows[1][1] + covariance.rows[2][2];
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			inertiaTensor.rows[i][j] = ((i == j) ? trace : 0.0f) - covariance.rows[i][j];
+		}
+	}
+	CacheInverseInertia();
+}
+
+Mat3 ShapeScaled::InertiaTensor() const
+{
+	return inertiaTensor;
+}
+
+Bounds ShapeScaled::GetBounds(const Vec3& pos, const Quat& orient) const
+{
+	Vec3 corners[8];
+	corners[0] = Vec3{ bounds.mins.x, bounds.mins.y, bounds.mins.z };
+	corners[1] = Vec3{ bounds.mins.x, bounds.mins.y, bounds.maxs.z };
+	corners[2] = Vec3{ bounds.mins.x, bounds.maxs.y, bounds.mins.z };
+	corners[3] = Vec3{ bounds.maxs.x, bounds.mins.y, bounds.mins.z };
+
+	corners[4] = Vec3{ bounds.maxs.x, bounds.maxs.y, bounds.maxs.z };
+	corners[5] = Vec3{ bounds.maxs.x, bounds.maxs.y, bounds.mins.z };
+	corners[6] = Vec3{ bounds.maxs.x, bounds.mins.y, bounds.maxs.z };
+	corners[7] = Vec3{ bounds.mins.x, bounds.maxs.y, bounds.maxs.z };
+
+	Bounds expandedBounds;
+	for (int i = 0; i < 8; ++i) {
+		corners[i] = orient.RotatePoint(corners[i]) + pos;
+		expandedBounds.Expand(corners[i]);
+	}
+	return expandedBounds;
+}
+
+Bounds ShapeScaled::GetBounds() const
+{
+	return bounds;
+}
+
+Vec3 ShapeScaled::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
+{
+	// Furthest point of S * X along d is S times the furthest point of X along S * d
+	Vec3 localDir = ScaleVec(orient.Inverse().RotatePoint(dir), scale);
+	localDir.Normalize();
+
+	const Vec3 innerPt = shape->Support(localDir, Vec3(0.0f), Quat(0, 0, 0, 1), 0.0f);
+	const Vec3 maxPt = orient.RotatePoint(ScaleVec(innerPt, scale)) + pos;
+
+	Vec3 norm = dir;
+	norm.Normalize();
+	norm *= bias;
+	return maxPt + norm;
+}
+
+float ShapeScaled::FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const
+{
+	// The corners of the bounds contain the shape, which is enough for an upper bound
+	float maxSpeed{ 0 };
+	for (int i = 0; i < 8; i++) {
+		const Vec3 corner(
+			(i & 1) ? bounds.maxs.x : bounds.mins.x,
+			(i & 2) ? bounds.maxs.y : bounds.mins.y,
+			(i & 4) ? bounds.maxs.z : bounds.mins.z);
+		Vec3 r = corner - centerOfMass;
+		Vec3 linearVelocity = angularVelocity.Cross(r);
+		float speed = dir.Dot(linearVelocity);
+		if (speed > maxSpeed) {
+			maxSpeed = speed;
+		}
+	}
+	return maxSpeed;
+}
+
+
+/* Compound */
+
+static const int maxLeafChildren = 2;
+
+ShapeCompound::ShapeCompound(const Child* childrenP, const int num) : Shape(ShapeType::SHAPE_COMPOUND), children(childrenP, childrenP + num)
+{
+	// Mass properties first, they don't depend on the order of the children
+	float totalMass = 0.0f;
+	std::vector<float> masses(num);
+	std::vector<Vec3> centers(num);
+	Vec3 sum(0.0f);
+	for (int i = 0; i < num; i++) {
+		const Child& child = children[i];
+		const Bounds localBounds = child.shape->GetBounds();
+		masses[i] = (child.mass > 0.0f) ? child.mass : localBounds.WidthX() * localBounds.WidthY() * localBounds.WidthZ();
+		centers[i] = child.position + child.orientation.RotatePoint(child.shape->GetCenterOfMass());
+		sum += centers[i] * masses[i];
+		totalMass += masses[i];
+	}
+	totalMass = (totalMass > 0.0f) ? totalMass : 1.0f;
+	centerOfMass = sum / totalMass;
+
+	// Each child tensor turned into the compound frame, then moved to the common center
+	inertiaTensor.Zero();
+	for (int i = 0; i < num; i++) {
+		const Mat3 orient = children[i].orientation.ToMat3();
+		Mat3 tensor = orient * children[i].shape->InertiaTensor() * orient.Transpose();
+
+		const Vec3 r = centers[i] - centerOfMass;
+		const float r2 = r.GetLengthSqr();
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 3; col++) {
+				tensor.rows[row][col] += ((row == col) ? r2 : 0.0f) - r[row] * r[col];
+			}
+		}
+		inertiaTensor += tensor * (masses[i] / totalMass);
+	}
+	CacheInverseInertia();
+
+	bounds.Clear();
+	std::vector<Bounds> unsortedBounds(num);
+	for (int i = 0; i < num; i++) {
+		unsortedBounds[i] = children[i].shape->GetBounds(children[i].position, children[i].orientation);
+		bounds.Expand(unsortedBounds[i]);
+	}
+	childBounds = unsortedBounds;
+	if (num == 0) {
+		return;
+	}
+
+	std::vector<int> order(num);
+	for (int i = 0; i < num; i++) {
+		order[i] = i;
+	}
+	nodes.resize(1);
+	BuildTree(order, 0, 0, num);
+
+	// Leaves point into runs of children, store them in that order
+	const std::vector<Child> unsorted = children;
+	for (int i = 0; i < num; i++) {
+		children[i] = unsorted[order[i]];
+		childBounds[i] = unsortedBounds[order[i]];
+	}
+}
+
+void ShapeCompound::BuildTree(std::vector<int>& order, const int nodeIdx, const int first, const int count)
+{
+	Bounds nodeBounds;
+	Bounds centers;
+	for (int i = first; i < first + count; i++) {
+		const Bounds& b = childBounds[order[i]];
+		nodeBounds.Expand(b);
+		centers.Expand((b.mins + b.maxs) * 0.5f);
+	}
+	nodes[nodeIdx].bounds = nodeBounds;
+
+	if (count <= maxLeafChildren) {
+		nodes[nodeIdx].first = first;
+		nodes[nodeIdx].count = count;
+		return;
+	}
+
+	// Half the children on each side of the median center, along the longest axis
+	const Vec3 extents = centers.maxs - centers.mins;
+	const int axis = (extents.x >= extents.y && extents.x >= extents.z) ? 0 : ((extents.y >= extents.z) ? 1 : 2);
+	const int mid = first + count / 2;
+	std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + first + count, [&](const int lhs, const int rhs) {
+		return (childBounds[lhs].mins[axis] + childBounds[lhs].maxs[axis]) < (childBounds[rhs].mins[axis] + childBounds[rhs].maxs[axis]);
+	});
+
+	const int left = (int)nodes.size();
+	nodes.resize(left + 2);
+	nodes[nodeIdx].first = left;
+	nodes[nodeIdx].count = 0;
+	BuildTree(order, left, first, mid - first);
+	BuildTree(order, left + 1, mid, first + count - mid);
+}
+
+void ShapeCompound::FindChildren(const Bounds& localBounds, FrameVector<int>& found) const
+{
+	if (nodes.empty()) {
+		return;
+	}
+
+	// Median splits keep the tree depth to the log of the child count
+	int stack[64];
+	int numStack = 0;
+	stack[numStack++] = 0;
+	while (numStack > 0) {
+		const Node& node = nodes[stack[--numStack]];
+		if (!node.bounds.DoesIntersect(localBounds)) {
+			continue;
+		}
+
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				if (childBounds[i].DoesIntersect(localBounds)) {
+					found.push_back(i);
+				}
+			}
+			continue;
+		}
+		stack[numStack++] = node.first;
+		stack[numStack++] = node.first + 1;
+	}
+}
+
+Mat3 ShapeCompound::InertiaTensor() const
+{
+	return inertiaTensor;
+}
+
+Bounds ShapeCompound::GetBounds(const Vec3& pos, const Quat& orient) const
+{
+	Bounds expandedBounds;
+	for (int i = 0; i < 8; i++) {
+		const Vec3 corner(
+			(i & 1) ? bounds.maxs.x : bounds.mins.x,
+			(i & 2) ? bounds.maxs.y : bounds.mins.y,
+			(i & 4) ? bounds.maxs.z : bounds.mins.z);
+		expandedBounds.Expand(orient.RotatePoint(corner) + pos);
+	}
+	return expandedBounds;
+}
+
+Bounds ShapeCompound::GetBounds() const
+{
+	return bounds;
+}
+
+Vec3 ShapeCompound::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
+{
+	// Support of the hull around all the children
+	Vec3 maxPt = pos;
+	float maxDist = -1e30f;
+	for (int i = 0; i < (int)children.size(); i++) {
+		const Child& child = children[i];
+		const Vec3 pt = child.shape->Support(dir, pos + orient.RotatePoint(child.position), orient * child.orientation, bias);
+		const float dist = dir.Dot(pt);
+		if (dist > maxDist) {
+			maxDist = dist;
+			maxPt = pt;
+		}
+	}
+	return maxPt;
+}
+
+float ShapeCompound::FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const
+{
+	float maxSpeed{ 0 };
+	for (int i = 0; i < 8; i++) {
+		const Vec3 corner(
+			(i & 1) ? bounds.maxs.x : bounds.mins.x,
+			(i & 2) ? bounds.maxs.y : bounds.mins.y,
+			(i & 4) ? bounds.maxs.z : bounds.mins.z);
+		Vec3 r = corner - centerOfMass;
+		Vec3 linearVelocity = angularVelocity.Cross(r);
+		float speed = dir.Dot(linearVelocity);
+		if (speed > maxSpeed) {
+			maxSpeed = speed;
+		}
+	}
+	return maxSpeed;
+}
+
+
+/* Triangle */
+
+// Solid box over the bounds, static shapes only need something invertible
+static Mat3 BoundsInertiaTensor(const Bounds& bounds)
+{
+	const float minWidth = 1e-3f;
+	const float dx = std::max(bounds.WidthX(), minWidth);
+	const float dy = std::max(bounds.WidthY(), minWidth);
+	const float dz = std::max(bounds.WidthZ(), minWidth);
 
 	Mat3 tensor;
 	tensor.Zero();
+	tensor.rows[0][0] = (dy * dy + dz * dz) / 12.0f;
+	tensor.rows[1][1] = (dx * dx + dz * dz) / 12.0f;
+	tensor.rows[2][2] = (dx * dx + dy * dy) / 12.0f;
+	return tensor;
+}
+
+ShapeTriangle::ShapeTriangle(const Vec3& a, const Vec3& b, const Vec3& c, const float thickness) : Shape(ShapeType::SHAPE_TRIANGLE)
+{
+	normal = (b - a).Cross(c - a);
+	normal.Normalize();
+
+	points[0] = a;
+	points[1] = b;
+	points[2] = c;
+	centerOfMass.Zero();
+	bounds.Clear();
+	for (int i = 0; i < 3; i++) {
+		points[3 + i] = points[i] - normal * thickness;
+		bounds.Expand(points[i]);
+		bounds.Expand(points[3 + i]);
+		centerOfMass += points[i] + points[3 + i];
+	}
+	centerOfMass /= 6.0f;
+}
+
+Mat3 ShapeTriangle::InertiaTensor() const
+{
+	return BoundsInertiaTensor(bounds);
+}
+
+Bounds ShapeTriangle::GetBounds(const Vec3& pos, const Quat& orient) const
+{
+	Bounds expandedBounds;
+	for (int i = 0; i < 6; i++) {
+		expandedBounds.Expand(orient.RotatePoint(points[i]) + pos);
+	}
+	return expandedBounds;
+}
+
+Bounds ShapeTriangle::GetBounds() const
+{
+	return bounds;
+}
+
+
+/* Triangle mesh */
+
+ShapeTriangleMesh::ShapeTriangleMesh(const CookedMesh& meshP, const float thicknessP) : Shape(ShapeType::SHAPE_TRIANGLE_MESH), mesh(meshP), thickness(thicknessP)
+{
+	bounds.mins = Vec3(mesh.boundsMins);
+	bounds.maxs = Vec3(mesh.boundsMaxs);
+	centerOfMass = (bounds.mins + bounds.maxs) * 0.5f;
+}
+
+Mat3 ShapeTriangleMesh::InertiaTensor() const
+{
+	return BoundsInertiaTensor(bounds);
+}
+
+Bounds ShapeTriangleMesh::GetBounds(const Vec3& pos, const Quat& orient) const
+{
+	Bounds expandedBounds;
+	for (int i = 0; i < 8; i++) {
+		const Vec3 corner(
+			(i & 1) ? bounds.maxs.x : bounds.mins.x,
+			(i & 2) ? bounds.maxs.y : bounds.mins.y,
+			(i & 4) ? bounds.maxs.z : bounds.mins.z);
+		expandedBounds.Expand(orient.RotatePoint(corner) + pos);
+	}
+	return expandedBounds;
+}
+
+Bounds ShapeTriangleMesh::GetBounds() const
+{
+	return bounds;
+}
 
-	const float dx = bounds.WidthX() / (float)numSamples;
-	const float dy = bounds.WidthY() / (float)numSamples;
-	const float dz = bounds.WidthZ() / (float)numSamples;
+Vec3 ShapeTriangleMesh::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
+{
+	// Every vertex, contacts go through the triangles instead
+	const Vec3* verts = mesh.Verts();
+	const Vec3 localDir = orient.Inverse().RotatePoint(dir);
+	Vec3 maxPt = bounds.mins;
+	float maxDist = -1e30f;
+	for (int i = 0; i < mesh.numVerts; i++) {
+		const float dist = localDir.Dot(verts[i]);
+		if (dist > maxDist) {
+			maxDist = dist;
+			maxPt = verts[i];
+		}
+	}
+	return orient.RotatePoint(maxPt) + pos + dir * bias;
+}
 
-	int sampleCount = 0;
-	for (float x = bounds.mins.x; x < bounds.maxs.x; x += dx) {
-		for (float y = bounds.mins.y; y < bounds.maxs.y; y += dy) {
-			for (float z = bounds.mins.z; z < bounds.maxs.z; z += dz) {
-				Vec3 pt(x, y, z);
+ShapeTriangle ShapeTriangleMesh::GetTriangle(const int tri) const
+{
+	const Vec3* verts = mesh.Verts();
+	const Tri& t = mesh.Tris()[tri];
+	return ShapeTriangle(verts[t.a], verts[t.b], verts[t.c], thickness);
+}
+
+Bounds ShapeTriangleMesh::NodeBounds(const int node) const
+{
+	const MeshNode& n = mesh.Nodes()[node];
+	Bounds nodeBounds;
+	for (int i = 0; i < 3; i++) {
+		nodeBounds.mins[i] = mesh.boundsMins[i] + n.mins[i] * mesh.quantizedStep[i];
+		nodeBounds.maxs[i] = mesh.boundsMins[i] + n.maxs[i] * mesh.quantizedStep[i];
+	}
+	return nodeBounds;
+}
+
+void ShapeTriangleMesh::FindTriangles(const Bounds& localBounds, FrameVector<int>& found) const
+{
+	if (mesh.numNodes == 0 || !bounds.DoesIntersect(localBounds)) {
+		return;
+	}
 
-				if (IsExternal(pts, tris, pt)) {
-					continue;
+	// The query goes to the node grid once, rounded outwards, then the descent only
+	// compares integers
+	unsigned short qMins[3];
+	unsigned short qMaxs[3];
+	for (int i = 0; i < 3; i++) {
+		const float invStep = (mesh.quantizedStep[i] > 0.0f) ? 1.0f / mesh.quantizedStep[i] : 0.0f;
+		const float lo = floorf((localBounds.mins[i] - mesh.boundsMins[i]) * invStep);
+		const float hi = ceilf((localBounds.maxs[i] - mesh.boundsMins[i]) * invStep);
+		qMins[i] = (unsigned short)std::min(std::max(lo, 0.0f), 65535.0f);
+		qMaxs[i] = (unsigned short)std::min(std::max(hi, 0.0f), 65535.0f);
+	}
+
+	const MeshNode* nodes = mesh.Nodes();
+	const Tri* tris = mesh.Tris();
+	const Vec3* verts = mesh.Verts();
+
+	// Median splits keep the depth to the log of the triangle count
+	int stack[64];
+	int numStack = 0;
+	stack[numStack++] = 0;
+	while (numStack > 0) {
+		const int nodeIdx = stack[--numStack];
+		const MeshNode& node = nodes[nodeIdx];
+		if (node.mins[0] > qMaxs[0] || node.maxs[0] < qMins[0] ||
+			node.mins[1] > qMaxs[1] || node.maxs[1] < qMins[1] ||
+			node.mins[2] > qMaxs[2] || node.maxs[2] < qMins[2]) {
+			continue;
+		}
+
+		if (node.IsLeaf()) {
+			const int first = node.FirstTri();
+			for (int i = first; i < first + node.NumTris(); i++) {
+				Bounds triBounds;
+				triBounds.Expand(verts[tris[i].a]);
+				triBounds.Expand(verts[tris[i].b]);
+				triBounds.Expand(verts[tris[i].c]);
+				if (triBounds.DoesIntersect(localBounds)) {
+					found.push_back(i);
 				}
+			}
+			continue;
+		}
 
-				// Get the point relative to the center of mass
-				pt -= cm;
+		// Left last, it's popped first and sits next in memory
+		stack[numStack++] = node.RightChild();
+		stack[numStack++] = nodeIdx + 1;
+	}
+}
 
-				tensor.rows[0][0] += pt.y * pt.y + pt.z * pt.z;
-				tensor.rows[1][1] += pt.z * pt.z + pt.x * pt.x;
-				tensor.rows[2][2] += pt.x * pt.x + pt.y * pt.y;
+// Slab test, where the ray enters the bounds if it does before maxT
+static bool RayBounds(const Bounds& bounds, const Vec3& start, const Vec3& invDir, const float maxT, float& tEnter)
+{
+	float t0 = 0.0f;
+	float t1 = maxT;
+	for (int i = 0; i < 3; i++) {
+		float ta = (bounds.mins[i] - start[i]) * invDir[i];
+		float tb = (bounds.maxs[i] - start[i]) * invDir[i];
+		if (ta > tb) {
+			std::swap(ta, tb);
+		}
+		t0 = std::max(t0, ta);
+		t1 = std::min(t1, tb);
+		if (t0 > t1) {
+			return false;
+		}
+	}
+	tEnter = t0;
+	return true;
+}
 
-				tensor.rows[0][1] += -1.0f * pt.x * pt.y;
-				tensor.rows[0][2] += -1.0f * pt.x * pt.z;
-				tensor.rows[1][2] += -1.0f * pt.y * pt.z;
+// Moller-Trumbore, from either side
+static bool RayTriangle(const Vec3& start, const Vec3& dir, const Vec3& a, const Vec3& b, const Vec3& c, float& t)
+{
+	const Vec3 ab = b - a;
+	const Vec3 ac = c - a;
+	const Vec3 p = dir.Cross(ac);
+	const float det = ab.Dot(p);
+	if (fabsf(det) < 1e-12f) {
+		return false;
+	}
+
+	const float invDet = 1.0f / det;
+	const Vec3 s = start - a;
+	const float u = s.Dot(p) * invDet;
+	if (u < 0.0f || u > 1.0f) {
+		return false;
+	}
+	const Vec3 q = s.Cross(ab);
+	const float v = dir.Dot(q) * invDet;
+	if (v < 0.0f || u + v > 1.0f) {
+		return false;
+	}
+	t = ac.Dot(q) * invDet;
+	return t >= 0.0f;
+}
+
+bool ShapeTriangleMesh::RayCast(const Vec3& start, const Vec3& dir, const float maxT, float& t, int& tri) const
+{
+	if (mesh.numNodes == 0) {
+		return false;
+	}
 
-				tensor.rows[1][0] += -1.0f * pt.x * pt.y;
-				tensor.rows[2][0] += -1.0f * pt.x * pt.z;
-				tensor.rows[2][1] += -1.0f * pt.y * pt.z;
+	Vec3 invDir;
+	for (int i = 0; i < 3; i++) {
+		invDir[i] = (fabsf(dir[i]) > 1e-20f) ? 1.0f / dir[i] : 1e30f;
+	}
 
-				sampleCount++;
+	struct Entry
+	{
+		int node;
+		float tEnter;
+	};
+	Entry stack[64];
+	int numStack = 0;
+	float tEnter;
+	if (!RayBounds(NodeBounds(0), start, invDir, maxT, tEnter)) {
+		return false;
+	}
+	stack[numStack++] = Entry{ 0, tEnter };
+
+	const MeshNode* nodes = mesh.Nodes();
+	const Tri* tris = mesh.Tris();
+	const Vec3* verts = mesh.Verts();
+	float closest = maxT;
+	bool isHit = false;
+	while (numStack > 0) {
+		const Entry entry = stack[--numStack];
+		if (entry.tEnter > closest) {
+			continue;
+		}
+
+		const MeshNode& node = nodes[entry.node];
+		if (node.IsLeaf()) {
+			const int first = node.FirstTri();
+			for (int i = first; i < first + node.NumTris(); i++) {
+				float tHit;
+				if (RayTriangle(start, dir, verts[tris[i].a], verts[tris[i].b], verts[tris[i].c], tHit) && tHit <= closest) {
+					closest = tHit;
+					tri = i;
+					isHit = true;
+				}
 			}
+			continue;
+		}
+
+		// Nearer child on top, the other is skipped once a hit comes before it
+		const int children[2] = { entry.node + 1, node.RightChild() };
+		float tChildren[2];
+		bool isChildHit[2];
+		for (int i = 0; i < 2; i++) {
+			isChildHit[i] = RayBounds(NodeBounds(children[i]), start, invDir, closest, tChildren[i]);
+		}
+		const int nearer = (isChildHit[1] && (!isChildHit[0] || tChildren[1] < tChildren[0])) ? 1 : 0;
+		if (isChildHit[1 - nearer]) {
+			stack[numStack++] = Entry{ children[1 - nearer], tChildren[1 - nearer] };
+		}
+		if (isChildHit[nearer]) {
+			stack[numStack++] = Entry{ children[nearer], tChildren[nearer] };
 		}
 	}
 
-	tensor *= 1.0f / (float)sampleCount;
-	return tensor;
+	t = closest;
+	return isHit;
 }
 
-void ShapeConvex::Build(const Vec3* pts, const int num) 
+
+/* Heightfield */
+
+ShapeHeightfield::ShapeHeightfield(const float* heightsP, const int numXP, const int numYP, const float spacingP, const bool isQuantized, const float thicknessP) :
+	Shape(ShapeType::SHAPE_HEIGHTFIELD), numX(numXP), numY(numYP), spacing(spacingP), thickness(thicknessP), quantizedStep(0.0f), numBlocksX(0)
 {
-	points.clear();
-	points.reserve(num);
-	for (int i = 0; i < num; i++) {
-		points.push_back(pts[i]);
+	const int num = numX * numY;
+	float minHeight = (num > 0) ? heightsP[0] : 0.0f;
+	float maxHeight = minHeight;
+	for (int i = 1; i < num; i++) {
+		minHeight = std::min(minHeight, heightsP[i]);
+		maxHeight = std::max(maxHeight, heightsP[i]);
 	}
 
-	// Expand into a convex hull
-	std::vector<Vec3> hullPoints;
-	std::vector<Tri> hullTriangles;
-	BuildConvexHull(points, hullPoints, hullTriangles);
-	points = hullPoints;
+	bounds.mins = Vec3(0.0f, 0.0f, minHeight);
+	bounds.maxs = Vec3(std::max(numX - 1, 0) * spacing, std::max(numY - 1, 0) * spacing, maxHeight);
+	if (isQuantized) {
+		quantizedStep = (maxHeight - minHeight) / 65535.0f;
+		const float invStep = (quantizedStep > 0.0f) ? 1.0f / quantizedStep : 0.0f;
+		quantizedHeights.resize(num);
+		for (int i = 0; i < num; i++) {
+			quantizedHeights[i] = (unsigned short)std::min(floorf((heightsP[i] - minHeight) * invStep + 0.5f), 65535.0f);
+		}
+	} else {
+		heights.assign(heightsP, heightsP + num);
+	}
 
-	// Expand the bounds
-	bounds.Clear();
-	bounds.Expand(points.data(), points.size());
+	// Ranges from the stored heights, quantized ones round a little
+	if (numX > 1 && numY > 1) {
+		numBlocksX = (NumCellsX() + blockSize - 1) / blockSize;
+		const int numBlocksY = (NumCellsY() + blockSize - 1) / blockSize;
+		blockMins.resize(numBlocksX * numBlocksY);
+		blockMaxs.resize(numBlocksX * numBlocksY);
+		for (int by = 0; by < numBlocksY; by++) {
+			for (int bx = 0; bx < numBlocksX; bx++) {
+				float blockMin = Height(bx * blockSize, by * blockSize);
+				float blockMax = blockMin;
+				for (int y = by * blockSize; y <= std::min((by + 1) * blockSize, numY - 1); y++) {
+					for (int x = bx * blockSize; x <= std::min((bx + 1) * blockSize, numX - 1); x++) {
+						blockMin = std::min(blockMin, Height(x, y));
+						blockMax = std::max(blockMax, Height(x, y));
+					}
+				}
+				blockMins[by * numBlocksX + bx] = blockMin;
+				blockMaxs[by * numBlocksX + bx] = blockMax;
+				bounds.mins.z = std::min(bounds.mins.z, blockMin);
+				bounds.maxs.z = std::max(bounds.maxs.z, blockMax);
+			}
+		}
+	}
+	centerOfMass = (bounds.mins + bounds.maxs) * 0.5f;
+}
+
+float ShapeHeightfield::Height(const int x, const int y) const
+{
+	if (!quantizedHeights.empty()) {
+		return bounds.mins.z + quantizedHeights[y * numX + x] * quantizedStep;
+	}
+	return heights[y * numX + x];
+}
+
+Mat3 ShapeHeightfield::InertiaTensor() const
+{
+	return BoundsInertiaTensor(bounds);
+}
+
+Bounds ShapeHeightfield::GetBounds(const Vec3& pos, const Quat& orient) const
+{
+	Bounds expandedBounds;
+	for (int i = 0; i < 8; i++) {
+		const Vec3 corner(
+			(i & 1) ? bounds.maxs.x : bounds.mins.x,
+			(i & 2) ? bounds.maxs.y : bounds.mins.y,
+			(i & 4) ? bounds.maxs.z : bounds.mins.z);
+		expandedBounds.Expand(orient.RotatePoint(corner) + pos);
+	}
+	return expandedBounds;
+}
+
+Bounds ShapeHeightfield::GetBounds() const
+{
+	return bounds;
+}
+
+Vec3 ShapeHeightfield::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
+{
+	// Every grid point, contacts go through the triangles instead
+	const Vec3 localDir = orient.Inverse().RotatePoint(dir);
+	Vec3 maxPt = bounds.mins;
+	float maxDist = -1e30f;
+	for (int y = 0; y < numY; y++) {
+		for (int x = 0; x < numX; x++) {
+			const Vec3 pt = Point(x, y);
+			const float dist = localDir.Dot(pt);
+			if (dist > maxDist) {
+				maxDist = dist;
+				maxPt = pt;
+			}
+		}
+	}
+	return orient.RotatePoint(maxPt) + pos + dir * bias;
+}
+
+// Two per cell, both counter clockwise seen from above
+static void CellCorners(const ShapeHeightfield& field, const int tri, Vec3& a, Vec3& b, Vec3& c)
+{
+	const int cell = tri / 2;
+	const int x = cell % field.NumCellsX();
+	const int y = cell / field.NumCellsX();
+	a = field.Point(x, y);
+	if (tri & 1) {
+		b = field.Point(x + 1, y + 1);
+		c = field.Point(x, y + 1);
+	} else {
+		b = field.Point(x + 1, y);
+		c = field.Point(x + 1, y + 1);
+	}
+}
+
+ShapeTriangle ShapeHeightfield::GetTriangle(const int tri) const
+{
+	Vec3 a, b, c;
+	CellCorners(*this, tri, a, b, c);
+	return ShapeTriangle(a, b, c, thickness);
+}
+
+void ShapeHeightfield::FindTriangles(const Bounds& localBounds, FrameVector<int>& found) const
+{
+	if (blockMins.empty()) {
+		return;
+	}
+
+	// Prisms reach below the surface, so does the test
+	const float minZ = localBounds.mins.z;
+	const float maxZ = localBounds.maxs.z + thickness;
+	if (localBounds.maxs.x < 0.0f || localBounds.mins.x > bounds.maxs.x ||
+		localBounds.maxs.y < 0.0f || localBounds.mins.y > bounds.maxs.y ||
+		maxZ < bounds.mins.z || minZ > bounds.maxs.z) {
+		return;
+	}
+
+	// Cells under the bounds, clamped before the conversion as bounds can be huge
+	const float invSpacing = 1.0f / spacing;
+	const int x0 = (int)std::max(floorf(localBounds.mins.x * invSpacing), 0.0f);
+	const int y0 = (int)std::max(floorf(localBounds.mins.y * invSpacing), 0.0f);
+	const int x1 = (int)std::min(floorf(localBounds.maxs.x * invSpacing), (float)(NumCellsX() - 1));
+	const int y1 = (int)std::min(floorf(localBounds.maxs.y * invSpacing), (float)(NumCellsY() - 1));
+
+	for (int by = y0 / blockSize; by <= y1 / blockSize; by++) {
+		for (int bx = x0 / blockSize; bx <= x1 / blockSize; bx++) {
+			const int block = by * numBlocksX + bx;
+			if (blockMins[block] > maxZ || blockMaxs[block] < minZ) {
+				continue;
+			}
+
+			const int cy1 = std::min((by + 1) * blockSize - 1, y1);
+			const int cx1 = std::min((bx + 1) * blockSize - 1, x1);
+			for (int y = std::max(by * blockSize, y0); y <= cy1; y++) {
+				for (int x = std::max(bx * blockSize, x0); x <= cx1; x++) {
+					const float h00 = Height(x, y);
+					const float h10 = Height(x + 1, y);
+					const float h01 = Height(x, y + 1);
+					const float h11 = Height(x + 1, y + 1);
+					const int first = (y * NumCellsX() + x) * 2;
+					if (std::min(std::min(h00, h10), h11) <= maxZ && std::max(std::max(h00, h10), h11) >= minZ) {
+						found.push_back(first);
+					}
+					if (std::min(std::min(h00, h11), h01) <= maxZ && std::max(std::max(h00, h11), h01) >= minZ) {
+						found.push_back(first + 1);
+					}
+				}
+			}
+		}
+	}
+}
+
+// Cells of a grid from the origin crossed by the ray between t0 and t1, in order,
+// within the given cell range. Stops early when visit returns true.
+template <typename Visit>
+static bool WalkGrid(const Vec3& start, const Vec3& dir, const float t0, const float t1, const float cellSize, const int minX, const int minY, const int maxX, const int maxY, const Visit& visit)
+{
+	const Vec3 pt = start + dir * t0;
+	int x = (int)std::min(std::max(floorf(pt.x / cellSize), (float)minX), (float)maxX);
+	int y = (int)std::min(std::max(floorf(pt.y / cellSize), (float)minY), (float)maxY);
+
+	const int stepX = (dir.x > 0.0f) ? 1 : -1;
+	const int stepY = (dir.y > 0.0f) ? 1 : -1;
+	const float tDeltaX = (dir.x != 0.0f) ? cellSize / fabsf(dir.x) : 1e30f;
+	const float tDeltaY = (dir.y != 0.0f) ? cellSize / fabsf(dir.y) : 1e30f;
+	float tNextX = (dir.x != 0.0f) ? ((x + (stepX > 0 ? 1 : 0)) * cellSize - start.x) / dir.x : 1e30f;
+	float tNextY = (dir.y != 0.0f) ? ((y + (stepY > 0 ? 1 : 0)) * cellSize - start.y) / dir.y : 1e30f;
+
+	float tIn = t0;
+	while (true) {
+		const float tOut = std::min(std::min(tNextX, tNextY), t1);
+		if (visit(x, y, tIn, tOut)) {
+			return true;
+		}
+		if (tOut >= t1) {
+			return false;
+		}
+
+		tIn = tOut;
+		if (tNextX < tNextY) {
+			x += stepX;
+			tNextX += tDeltaX;
+		} else {
+			y += stepY;
+			tNextY += tDeltaY;
+		}
+		if (x < minX || x > maxX || y < minY || y > maxY) {
+			return false;
+		}
+	}
+}
+
+bool ShapeHeightfield::RayCast(const Vec3& start, const Vec3& dir, const float maxT, float& t, int& tri) const
+{
+	if (blockMins.empty()) {
+		return false;
+	}
+
+	Vec3 invDir;
+	for (int i = 0; i < 3; i++) {
+		invDir[i] = (fabsf(dir[i]) > 1e-20f) ? 1.0f / dir[i] : 1e30f;
+	}
+	float tEnter;
+	if (!RayBounds(bounds, start, invDir, maxT, tEnter)) {
+		return false;
+	}
 
-	centerOfMass = CalculateCenterOfMass(hullPoints, hullTriangles);
+	// The ray stays above or below the height range over a stretch of it
+	auto isClear = [&](const float tIn, const float tOut, const float minHeight, const float maxHeight) {
+		const float zIn = start.z + dir.z * tIn;
+		const float zOut = start.z + dir.z * tOut;
+		return std::min(zIn, zOut) > maxHeight || std::max(zIn, zOut) < minHeight;
+	};
+
+	// Blocks first, then the cells of those the ray might touch. Cells come in order
+	// along the ray, so the first one with a hit has the closest.
+	const int numBlocksY = (int)blockMins.size() / numBlocksX;
+	return WalkGrid(start, dir, tEnter, maxT, spacing * blockSize, 0, 0, numBlocksX - 1, numBlocksY - 1,
+		[&](const int bx, const int by, const float tBlockIn, const float tBlockOut) {
+			const int block = by * numBlocksX + bx;
+			if (isClear(tBlockIn, tBlockOut, blockMins[block], blockMaxs[block])) {
+				return false;
+			}
 
-	inertiaTensor = CalculateInertiaTensor(hullPoints, hullTriangles, centerOfMass);
+			const int cx1 = std::min((bx + 1) * blockSize, NumCellsX()) - 1;
+			const int cy1 = std::min((by + 1) * blockSize, NumCellsY()) - 1;
+			return WalkGrid(start, dir, tBlockIn, tBlockOut, spacing, bx * blockSize, by * blockSize, cx1, cy1,
+				[&](const int x, const int y, const float tIn, const float tOut) {
+					const float h00 = Height(x, y);
+					const float h10 = Height(x + 1, y);
+					const float h01 = Height(x, y + 1);
+					const float h11 = Height(x + 1, y + 1);
+					const float minHeight = std::min(std::min(h00, h10), std::min(h01, h11));
+					const float maxHeight = std::max(std::max(h00, h10), std::max(h01, h11));
+					if (isClear(tIn, tOut, minHeight, maxHeight)) {
+						return false;
+					}
+
+					bool isHit = false;
+					const int first = (y * NumCellsX() + x) * 2;
+					for (int i = first; i < first + 2; i++) {
+						Vec3 a, b, c;
+						CellCorners(*this, i, a, b, c);
+						float tHit;
+						if (RayTriangle(start, dir, a, b, c, tHit) && tHit <= maxT && (!isHit || tHit < t)) {
+							t = tHit;
+							tri = i;
+							isHit = true;
+						}
+					}
+					return isHit;
+				});
+		});
 }
 
+
+/* Plane */
+
+Mat3 ShapePlane::InertiaTensor() const
+{
+	return BoundsInertiaTensor(GetBounds());
+}
+
+Bounds ShapePlane::GetBounds(const Vec3& pos, const Quat& orient) const
+{
+	const Bounds bounds = GetBounds();
+	Bounds expandedBounds;
+	for (int i = 0; i < 8; i++) {
+		const Vec3 corner(
+			(i & 1) ? bounds.maxs.x : bounds.mins.x,
+			(i & 2) ? bounds.maxs.y : bounds.mins.y,
+			(i & 4) ? bounds.maxs.z : bounds.mins.z);
+		expandedBounds.Expand(orient.RotatePoint(corner) + pos);
+	}
+	return expandedBounds;
+}
+
+Bounds ShapePlane::GetBounds() const
+{
+	Bounds tmp;
+	tmp.mins = Vec3(-extent, -extent, -extent);
+	tmp.maxs = Vec3(extent, extent, 0.0f);
+	return tmp;
+}
+
+Vec3 ShapePlane::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
+{
+	// Corner of the bounds, contacts with planes never go through here
+	const Vec3 localDir = orient.Inverse().RotatePoint(dir);
+	const Vec3 pt(
+		(localDir.x >= 0.0f) ? extent : -extent,
+		(localDir.y >= 0.0f) ? extent : -extent,
+		(localDir.z >= 0.0f) ? 0.0f : -extent);
+	return orient.RotatePoint(pt) + pos + dir * bias;
+}
+
+
+/* Sdf */
+
+ShapeSdf::ShapeSdf(const CookedSdf& sdfP) : Shape(ShapeType::SHAPE_SDF), sdf(sdfP)
+{
+	bounds.mins = Vec3(sdf.boundsMins);
+	bounds.maxs = Vec3(sdf.boundsMaxs);
+	centerOfMass = (bounds.mins + bounds.maxs) * 0.5f;
+}
+
+Mat3 ShapeSdf::InertiaTensor() const
+{
+	return BoundsInertiaTensor(bounds);
+}
+
+Bounds ShapeSdf::GetBounds(const Vec3& pos, const Quat& orient) const
+{
+	Bounds expandedBounds;
+	for (int i = 0; i < 8; i++) {
+		const Vec3 corner(
+			(i & 1) ? bounds.maxs.x : bounds.mins.x,
+			(i & 2) ? bounds.maxs.y : bounds.mins.y,
+			(i & 4) ? bounds.maxs.z : bounds.mins.z);
+		expandedBounds.Expand(orient.RotatePoint(corner) + pos);
+	}
+	return expandedBounds;
+}
+
+Bounds ShapeSdf::GetBounds() const
+{
+	return bounds;
+}
+
+Vec3 ShapeSdf::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
+{
+	// A corner of the bounds, contacts sample the field instead
+	const Vec3 localDir = orient.Inverse().RotatePoint(dir);
+	const Vec3 pt(
+		(localDir.x >= 0.0f) ? bounds.maxs.x : bounds.mins.x,
+		(localDir.y >= 0.0f) ? bounds.maxs.y : bounds.mins.y,
+		(localDir.z >= 0.0f) ? bounds.maxs.z : bounds.mins.z);
+	return orient.RotatePoint(pt) + pos + dir * bias;
+}
+
+float ShapeSdf::Distance(const Vec3& pt, Vec3& gradient) const
+{
+	const int brickCells = SdfGrid::brickCells;
+	const int n = SdfGrid::brickSamples;
+
+	// Points off the grid are clamped onto it, then bounded below
+	int brick[3];
+	float inBrick[3];	// In cells from the brick corner
+	Vec3 offGrid(0.0f);
+	for (int i = 0; i < 3; i++) {
+		const float cell = (pt[i] - sdf.origin[i]) / sdf.cellSize;
+		const float clamped = std::min(std::max(cell, 0.0f), (float)(sdf.numBricks[i] * brickCells));
+		offGrid[i] = (cell - clamped) * sdf.cellSize;
+		brick[i] = std::min((int)clamped / brickCells, sdf.numBricks[i] - 1);
+		inBrick[i] = clamped - (float)(brick[i] * brickCells);
+	}
+	const int brickIdx = (brick[2] * sdf.numBricks[1] + brick[1]) * sdf.numBricks[0] + brick[0];
+	const int slot = sdf.Slots()[brickIdx];
+
+	float distance;
+	if (slot < 0) {
+		// The bound of the brick, its gradient across the neighbouring bricks
+		const float* distances = sdf.BrickDistances();
+		const int strides[3] = { 1, sdf.numBricks[0], sdf.numBricks[0] * sdf.numBricks[1] };
+		distance = distances[brickIdx];
+		for (int i = 0; i < 3; i++) {
+			const int lo = std::max(brick[i] - 1, 0);
+			const int hi = std::min(brick[i] + 1, sdf.numBricks[i] - 1);
+			const float span = (float)((hi - lo) * brickCells) * sdf.cellSize;
+			const float rise = distances[brickIdx + (hi - brick[i]) * strides[i]] - distances[brickIdx + (lo - brick[i]) * strides[i]];
+			gradient[i] = (hi > lo) ? rise / span : 0.0f;
+		}
+	} else {
+		// Trilinear over the cell, corner k has x, y and z in its bits
+		int cell[3];
+		float t[3];
+		for (int i = 0; i < 3; i++) {
+			cell[i] = std::min((int)inBrick[i], brickCells - 1);
+			t[i] = inBrick[i] - (float)cell[i];
+		}
+		const short* samples = sdf.Samples() + slot * SdfGrid::samplesPerBrick + (cell[2] * n + cell[1]) * n + cell[0];
+		const float scale = sdf.band / 32767.0f;
+		float q[8];
+		for (int k = 0; k < 8; k++) {
+			q[k] = samples[((k >> 2) & 1) * n * n + ((k >> 1) & 1) * n + (k & 1)] * scale;
+		}
+
+		const float x00 = q[0] + (q[1] - q[0]) * t[0];
+		const float x10 = q[2] + (q[3] - q[2]) * t[0];
+		const float x01 = q[4] + (q[5] - q[4]) * t[0];
+		const float x11 = q[6] + (q[7] - q[6]) * t[0];
+		const float y0 = x00 + (x10 - x00) * t[1];
+		const float y1 = x01 + (x11 - x01) * t[1];
+		distance = y0 + (y1 - y0) * t[2];
+
+		const float dx0 = (q[1] - q[0]) + ((q[3] - q[2]) - (q[1] - q[0])) * t[1];
+		const float dx1 = (q[5] - q[4]) + ((q[7] - q[6]) - (q[5] - q[4])) * t[1];
+		gradient.x = dx0 + (dx1 - dx0) * t[2];
+		gradient.y = (x10 - x00) + ((x11 - x01) - (x10 - x00)) * t[2];
+		gradient.z = y1 - y0;
+		gradient /= sdf.cellSize;
+	}
+
+	// The field changes no faster than the point moves, and the mesh is within its bounds
+	const float offGridDistance = offGrid.GetMagnitude();
+	if (offGridDistance > 0.0f) {
+		Vec3 toBounds;
+		for (int i = 0; i < 3; i++) {
+			toBounds[i] = pt[i] - std::min(std::max(pt[i], bounds.mins[i]), bounds.maxs[i]);
+		}
+		const float boundsDistance = toBounds.GetMagnitude();
+		distance = std::max(distance - offGridDistance, boundsDistance);
+		gradient = toBounds / boundsDistance;
+	}
+	return distance;
+}
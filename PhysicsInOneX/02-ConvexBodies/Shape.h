@@ -1,7 +1,14 @@
 #pragma once
+#include <assert.h>
 #include "code/Math/Matrix.h"
 #include "code/Math/Bounds.h"
 #include "code/Math/Quat.h"
+#include "ShapeUtils.h"
+#include "code/FrameArena.h"
+
+struct CookedHull;
+struct CookedMesh;
+struct CookedSdf;
 
 extern Vec3 g_diamond[7 * 8];
 void FillDiamond();
@@ -13,11 +20,27 @@ public:
 	{
 		SHAPE_SPHERE,
 		SHAPE_BOX,
-		SHAPE_CONVEX
+		SHAPE_CAPSULE,
+		SHAPE_CYLINDER,
+		SHAPE_PLANE,
+		SHAPE_CONVEX,
+		SHAPE_SCALED,
+		SHAPE_COMPOUND,
+		SHAPE_TRIANGLE,
+		SHAPE_TRIANGLE_MESH,
+		SHAPE_HEIGHTFIELD,
+		SHAPE_SDF
 	};
 
-	virtual ShapeType GetType() const = 0;
+	explicit Shape(const ShapeType typeP) : type(typeP) { inverseInertiaTensor.Zero(); }
+	virtual ~Shape() {}
+
+	// Kept in the shape rather than asked of it, the dispatch below switches on it
+	ShapeType GetType() const { return type; }
 	virtual Mat3 InertiaTensor() const = 0;
+
+	// Inverted once when the shape is built, zero for the shapes only used without mass
+	const Mat3& InverseInertiaTensor() const { return inverseInertiaTensor; }
 	virtual Vec3 GetCenterOfMass() const { return centerOfMass; }
 	virtual Bounds GetBounds(const Vec3& pos, const Quat& orient) const = 0;
 	virtual Bounds GetBounds() const = 0;
@@ -27,18 +50,23 @@ public:
 	virtual float FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const { return 0; }
 
 protected:
+	// Called by the shapes with mass once their inertia is known
+	void CacheInverseInertia() { inverseInertiaTensor = InertiaTensor().Inverse(); }
+
+	ShapeType type;
 	Vec3 centerOfMass;
+	Mat3 inverseInertiaTensor;
 };
 
-class ShapeSphere : public Shape
+class ShapeSphere final : public Shape
 {
 public:
-	ShapeSphere(float radiusP) : radius(radiusP)
+	ShapeSphere(float radiusP) : Shape(ShapeType::SHAPE_SPHERE), radius(radiusP)
 	{
 		centerOfMass.Zero();
+		CacheInverseInertia();
 	}
 
-	ShapeType GetType() const override { return ShapeType::SHAPE_SPHERE; }
 	Mat3 InertiaTensor() const override;
 	Bounds GetBounds(const Vec3& pos, const Quat& orient) const override;
 	Bounds GetBounds() const override;
@@ -47,15 +75,14 @@ public:
 	float radius;
 };
 
-class ShapeBox : public Shape
+class ShapeBox final : public Shape
 {
 public:
-	ShapeBox(const Vec3* points, const int num)
+	ShapeBox(const Vec3* points, const int num) : Shape(ShapeType::SHAPE_BOX)
 	{
 		Build(points, num);
 	}
 
-	ShapeType GetType() const override { return ShapeType::SHAPE_BOX; }
 	Mat3 InertiaTensor() const override;
 	Bounds GetBounds(const Vec3& pos, const Quat& orient) const override;
 	Bounds GetBounds() const override;
@@ -63,32 +90,404 @@ public:
 	Vec3 Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const override;
 	float FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const override;
 
-	std::vector<Vec3> points;
+	// Corners of the bounds
+	static const int numPoints = 8;
+	Vec3 points[numPoints];
 	Bounds bounds;
+	Mat3 inertiaTensor;
+};
+
+// Sphere swept between the centers at -halfHeight and halfHeight along the z axis
+class ShapeCapsule final : public Shape
+{
+public:
+	ShapeCapsule(const float radiusP, const float halfHeightP) : Shape(ShapeType::SHAPE_CAPSULE), radius(radiusP), halfHeight(halfHeightP)
+	{
+		centerOfMass.Zero();
+		CacheInverseInertia();
+	}
+
+	Mat3 InertiaTensor() const override;
+	Bounds GetBounds(const Vec3& pos, const Quat& orient) const override;
+	Bounds GetBounds() const override;
+	Vec3 Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const override;
+	float FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const override;
+
+	float radius;
+	float halfHeight;
 };
 
-class ShapeConvex : public Shape 
+// Round around the z axis, with flat caps at -halfHeight and halfHeight
+class ShapeCylinder final : public Shape
 {
 public:
-	explicit ShapeConvex(const Vec3* pts, const int num) {
+	ShapeCylinder(const float radiusP, const float halfHeightP) : Shape(ShapeType::SHAPE_CYLINDER), radius(radiusP), halfHeight(halfHeightP)
+	{
+		centerOfMass.Zero();
+		CacheInverseInertia();
+	}
+
+	Mat3 InertiaTensor() const override;
+	Bounds GetBounds(const Vec3& pos, const Quat& orient) const override;
+	Bounds GetBounds() const override;
+	Vec3 Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const override;
+	float FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const override;
+
+	float radius;
+	float halfHeight;
+};
+
+// Half-space under the xy plane of the body, the z axis is its normal. Only for bodies
+// without mass. The bounds stop at extent, far enough for any scene.
+class ShapePlane final : public Shape
+{
+public:
+	ShapePlane() : Shape(ShapeType::SHAPE_PLANE)
+	{
+		centerOfMass.Zero();
+	}
+
+	Mat3 InertiaTensor() const override;
+	Bounds GetBounds(const Vec3& pos, const Quat& orient) const override;
+	Bounds GetBounds() const override;
+	Vec3 Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const override;
+
+	static constexpr float extent = 10000.0f;
+};
+
+class ShapeConvex final : public Shape 
+{
+public:
+	explicit ShapeConvex(const Vec3* pts, const int num) : Shape(ShapeType::SHAPE_CONVEX) {
 		Build(pts, num);
 	}
+
+	// Collision proxy, the hull simplified within the budget
+	ShapeConvex(const Vec3* pts, const int num, const HullSimplification& simplification) : Shape(ShapeType::SHAPE_CONVEX) {
+		Build(pts, num, simplification);
+	}
+
+	// Uses the cooked hull in place, the record has to outlive the shape. Compact shapes
+	// answer support queries from the 16 bit points, half the memory of the floats.
+	explicit ShapeConvex(const CookedHull& hull, const bool isCompact = false);
+
+	// The hull may point into its own storage
+	ShapeConvex(const ShapeConvex&) = delete;
+	ShapeConvex& operator=(const ShapeConvex&) = delete;
 	
 	void Build(const Vec3* pts, const int num) override;
+	void Build(const Vec3* pts, const int num, const HullSimplification& simplification);
 	Vec3 Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const override;
 	Mat3 InertiaTensor() const override;
 	float FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const override;
 
 	Bounds GetBounds(const Vec3& pos, const Quat& orient) const override;
 	Bounds GetBounds() const override;
-	ShapeType GetType() const override { return ShapeType::SHAPE_CONVEX; }
 
-	std::vector<Vec3> points;
+	// Hull vertices and counter clockwise triangles
+	const Vec3* points{ nullptr };
+	int numPoints{ 0 };
+	const Tri* tris{ nullptr };
+	int numTris{ 0 };
 	Bounds bounds;
 	Mat3 inertiaTensor;
+	float hullError{ 0.0f };	// How far a simplified hull reaches outside the points
+
+	// Compact points over the bounds, only set for compact shapes
+	const unsigned short* quantized{ nullptr };
+	int numQuantized{ 0 };
+	Vec3 quantizedStep;
 
 private:
-	Vec3 CalculateCenterOfMass(const std::vector< Vec3 >& pts, const std::vector<struct Tri>& tris);
-	Mat3 CalculateInertiaTensor(const std::vector< Vec3 >& pts, const std::vector<struct Tri>& tris, const Vec3& cm);
+	Vec3 CalculateCenterOfMass(const std::vector< Vec3 >& pts, const std::vector<Tri>& tris);
+	Mat3 CalculateInertiaTensor(const std::vector< Vec3 >& pts, const std::vector<Tri>& tris, const Vec3& cm);
+
+	// Storage when built from raw points
+	std::vector<Vec3> ownedPoints;
+	std::vector<Tri> ownedTris;
+};
+
+// Another shape stretched along its local axes. The scale applies around the local
+// origin, so one unit box can stand for every wall, beam and limb of a scene.
+class ShapeScaled final : public Shape
+{
+public:
+	ShapeScaled(const Shape* shapeP, const Vec3& scaleP);
+
+	Mat3 InertiaTensor() const override;
+	Bounds GetBounds(const Vec3& pos, const Quat& orient) const override;
+	Bounds GetBounds() const override;
+	Vec3 Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const override;
+	float FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const override;
 
-};
\ No newline at end of file
+	const Shape* shape;
+	Vec3 scale;
+	Bounds bounds;
+	Mat3 inertiaTensor;
+};
+
+// Several shapes moving as one body, each placed by a local transform. The children sit
+// under a static tree of bounds in the compound frame, so a contact query only visits
+// the children near the other body. A whole ragdoll pose or a prop made of parts is one
+// body and one broadphase entry.
+class ShapeCompound final : public Shape
+{
+public:
+	struct Child
+	{
+		const Shape* shape;
+		Vec3 position;			// Of the child frame in the compound frame
+		Quat orientation;
+		float mass{ 0.0f };		// Relative to the other children, zero for the volume of the bounds
+	};
+
+	ShapeCompound(const Child* childrenP, const int num);
+
+	Mat3 InertiaTensor() const override;
+	Bounds GetBounds(const Vec3& pos, const Quat& orient) const override;
+	Bounds GetBounds() const override;
+	Vec3 Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const override;
+	float FastestLinearSpeed(const Vec3& angularVelocity, const Vec3& dir) const override;
+
+	// Appends the children whose bounds overlap, bounds in the compound frame
+	void FindChildren(const Bounds& localBounds, FrameVector<int>& found) const;
+
+	// Children in tree order, each leaf of the tree holds a run of them
+	std::vector<Child> children;
+	std::vector<Bounds> childBounds;
+	Bounds bounds;
+	Mat3 inertiaTensor;
+
+private:
+	struct Node
+	{
+		Bounds bounds;
+		int first;		// First child of a leaf, left node of the others, the right one follows
+		int count;		// Children of a leaf, zero for the others
+	};
+
+	void BuildTree(std::vector<int>& order, const int nodeIdx, const int first, const int count);
+
+	std::vector<Node> nodes;
+};
+
+// One triangle of a mesh, thickened into a prism behind its face so the convex
+// kernels see a solid. Made on the fly for the triangles a query finds.
+class ShapeTriangle final : public Shape
+{
+public:
+	ShapeTriangle() : Shape(ShapeType::SHAPE_TRIANGLE) {}
+	ShapeTriangle(const Vec3& a, const Vec3& b, const Vec3& c, const float thickness);
+
+	Mat3 InertiaTensor() const override;
+	Bounds GetBounds(const Vec3& pos, const Quat& orient) const override;
+	Bounds GetBounds() const override;
+	Vec3 Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const override;
+
+	// The face first, counter clockwise, then the same corners pushed back along the normal
+	Vec3 points[6];
+	Vec3 normal;
+	Bounds bounds;
+};
+
+// Static level geometry, a triangle soup under a tree of quantized bounds. The cooked
+// mesh is used in place and has to outlive the shape. Only bodies without mass use it,
+// contacts come from the triangles near the other body, never from the whole mesh.
+class ShapeTriangleMesh final : public Shape
+{
+public:
+	explicit ShapeTriangleMesh(const CookedMesh& meshP, const float thicknessP = 0.5f);
+
+	Mat3 InertiaTensor() const override;
+	Bounds GetBounds(const Vec3& pos, const Quat& orient) const override;
+	Bounds GetBounds() const override;
+	Vec3 Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const override;
+
+	// Appends the triangles whose bounds overlap, bounds in the mesh frame
+	void FindTriangles(const Bounds& localBounds, FrameVector<int>& found) const;
+
+	// Closest hit along the ray within maxT, in the mesh frame. Triangles are hit from
+	// either side, dir doesn't have to be normalized, t is in units of it.
+	bool RayCast(const Vec3& start, const Vec3& dir, const float maxT, float& t, int& tri) const;
+
+	ShapeTriangle GetTriangle(const int tri) const;
+
+	const CookedMesh& mesh;
+	float thickness;	// Of the prisms behind the faces
+	Bounds bounds;
+
+private:
+	Bounds NodeBounds(const int node) const;
+};
+
+// Static terrain, heights on a regular grid with z up, the grid corner at the origin.
+// Heights are kept as floats or quantized to 16 bits over their range. Queries go
+// straight to the cells under the bounds or along the ray, each cell is two triangles.
+class ShapeHeightfield final : public Shape
+{
+public:
+	ShapeHeightfield(const float* heights, const int numX, const int numY, const float spacing, const bool isQuantized = false, const float thicknessP = 0.5f);
+
+	Mat3 InertiaTensor() const override;
+	Bounds GetBounds(const Vec3& pos, const Quat& orient) const override;
+	Bounds GetBounds() const override;
+	Vec3 Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const override;
+
+	// Appends the triangles whose cells overlap, bounds in the heightfield frame
+	void FindTriangles(const Bounds& localBounds, FrameVector<int>& found) const;
+
+	// Closest hit along the ray within maxT, in the heightfield frame, like the meshes
+	bool RayCast(const Vec3& start, const Vec3& dir, const float maxT, float& t, int& tri) const;
+
+	ShapeTriangle GetTriangle(const int tri) const;
+
+	float Height(const int x, const int y) const;
+	Vec3 Point(const int x, const int y) const { return Vec3(x * spacing, y * spacing, Height(x, y)); }
+	int NumCellsX() const { return numX - 1; }
+	int NumCellsY() const { return numY - 1; }
+
+	static const int blockSize = 8;	// Cells per side of a block
+
+	int numX;
+	int numY;
+	float spacing;
+	float thickness;	// Of the prisms under the faces
+	Bounds bounds;
+
+private:
+	std::vector<float> heights;
+	std::vector<unsigned short> quantizedHeights;	// Used instead when not empty
+	float quantizedStep;
+
+	// Height range of each block, over its cells and their far edges
+	int numBlocksX;
+	std::vector<float> blockMins;
+	std::vector<float> blockMaxs;
+};
+
+// Static geometry of any shape, a signed distance field baked from a closed mesh. The cooked
+// field is used in place and has to outlive the shape. Contacts sample the field at the
+// vertices of the other body, their cost doesn't depend on the triangles baked into it.
+class ShapeSdf final : public Shape
+{
+public:
+	explicit ShapeSdf(const CookedSdf& sdfP);
+
+	Mat3 InertiaTensor() const override;
+	Bounds GetBounds(const Vec3& pos, const Quat& orient) const override;
+	Bounds GetBounds() const override;
+	Vec3 Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const override;
+
+	// Signed distance at a point of the field frame, negative inside, and its gradient.
+	// Away from the surface, where the bricks keep no samples, only a bound on the distance.
+	float Distance(const Vec3& pt, Vec3& gradient) const;
+
+	const CookedSdf& sdf;
+	Bounds bounds;		// Of the baked mesh
+};
+
+// Support of the small shapes, inline so the kernels instantiated for them below
+// unroll and vectorize it
+
+inline Vec3 ShapeSphere::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
+{
+	return pos + dir * (radius + bias);
+}
+
+inline Vec3 ShapeBox::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
+{
+	// Find the point in furthest direction
+	Vec3 maxPt = orient.RotatePoint(points[0]) + pos;
+	float maxDist = dir.Dot(maxPt);
+	for (int i = 1; i < numPoints; i++) {
+		const Vec3 pt = orient.RotatePoint(points[i]) + pos;
+		const float dist = dir.Dot(pt);
+
+		if (dist > maxDist) {
+			maxDist = dist;
+			maxPt = pt;
+		}
+	}
+
+	Vec3 norm = dir;
+	norm.Normalize();
+	norm *= bias;
+	return maxPt + norm;
+}
+
+inline Vec3 ShapeCapsule::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
+{
+	const Vec3 axis = orient.RotatePoint(Vec3(0.0f, 0.0f, halfHeight));
+	const Vec3 end = (dir.Dot(axis) >= 0.0f) ? pos + axis : pos - axis;
+	return end + dir * (radius + bias);
+}
+
+inline Vec3 ShapeCylinder::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
+{
+	// The cap facing dir, then its rim
+	const Vec3 localDir = orient.Inverse().RotatePoint(dir);
+	Vec3 pt(0.0f, 0.0f, (localDir.z >= 0.0f) ? halfHeight : -halfHeight);
+	const float radialLength = sqrtf(localDir.x * localDir.x + localDir.y * localDir.y);
+	if (radialLength > 1e-6f) {
+		pt.x = localDir.x * radius / radialLength;
+		pt.y = localDir.y * radius / radialLength;
+	}
+	return orient.RotatePoint(pt) + pos + dir * bias;
+}
+
+inline Vec3 ShapeTriangle::Support(const Vec3& dir, const Vec3& pos, const Quat& orient, const float bias) const
+{
+	Vec3 maxPt = orient.RotatePoint(points[0]) + pos;
+	float maxDist = dir.Dot(maxPt);
+	for (int i = 1; i < 6; i++) {
+		const Vec3 pt = orient.RotatePoint(points[i]) + pos;
+		const float dist = dir.Dot(pt);
+		if (dist > maxDist) {
+			maxDist = dist;
+			maxPt = pt;
+		}
+	}
+	return maxPt + dir * bias;
+}
+
+// Static dispatch. The kernels called per pair, or per body in a step, visit the shape
+// with its concrete type, so the calls they make on it are direct, and inlined when the
+// body is in this header. Calls visitor with the concrete shape.
+template<typename Visitor>
+auto VisitShape(const Shape* shape, Visitor&& visitor)
+{
+	switch (shape->GetType()) {
+	case Shape::ShapeType::SHAPE_SPHERE: return visitor(static_cast<const ShapeSphere&>(*shape));
+	case Shape::ShapeType::SHAPE_BOX: return visitor(static_cast<const ShapeBox&>(*shape));
+	case Shape::ShapeType::SHAPE_CAPSULE: return visitor(static_cast<const ShapeCapsule&>(*shape));
+	case Shape::ShapeType::SHAPE_CYLINDER: return visitor(static_cast<const ShapeCylinder&>(*shape));
+	case Shape::ShapeType::SHAPE_PLANE: return visitor(static_cast<const ShapePlane&>(*shape));
+	case Shape::ShapeType::SHAPE_CONVEX: return visitor(static_cast<const ShapeConvex&>(*shape));
+	case Shape::ShapeType::SHAPE_SCALED: return visitor(static_cast<const ShapeScaled&>(*shape));
+	case Shape::ShapeType::SHAPE_COMPOUND: return visitor(static_cast<const ShapeCompound&>(*shape));
+	case Shape::ShapeType::SHAPE_TRIANGLE: return visitor(static_cast<const ShapeTriangle&>(*shape));
+	case Shape::ShapeType::SHAPE_TRIANGLE_MESH: return visitor(static_cast<const ShapeTriangleMesh&>(*shape));
+	case Shape::ShapeType::SHAPE_HEIGHTFIELD: return visitor(static_cast<const ShapeHeightfield&>(*shape));
+	case Shape::ShapeType::SHAPE_SDF: return visitor(static_cast<const ShapeSdf&>(*shape));
+	default:
+		// Every type is listed above
+		assert(false);
+		return decltype(visitor(static_cast<const ShapeSphere&>(*shape)))();
+	}
+}
+
+// For the kernels asking only for support points, instantiated per pair of shapes. The
+// shapes with an inline Support get their own, the others share the one through Shape,
+// which keeps the pairs, and the code, down.
+template<typename Visitor>
+auto VisitSupportShape(const Shape* shape, Visitor&& visitor)
+{
+	switch (shape->GetType()) {
+	case Shape::ShapeType::SHAPE_SPHERE: return visitor(static_cast<const ShapeSphere&>(*shape));
+	case Shape::ShapeType::SHAPE_BOX: return visitor(static_cast<const ShapeBox&>(*shape));
+	case Shape::ShapeType::SHAPE_CAPSULE: return visitor(static_cast<const ShapeCapsule&>(*shape));
+	case Shape::ShapeType::SHAPE_CYLINDER: return visitor(static_cast<const ShapeCylinder&>(*shape));
+	case Shape::ShapeType::SHAPE_TRIANGLE: return visitor(static_cast<const ShapeTriangle&>(*shape));
+	default: return visitor(*shape);
+	}
+}
@@ -0,0 +1,540 @@
+#include "ShapeCache.h"
+#include "Shape.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+unsigned long long HashBytes(const void* data, const size_t size, const unsigned long long hash)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	unsigned long long result = hash;
+	for (size_t i = 0; i < size; i++) {
+		result = (result ^ bytes[i]) * 1099511628211ULL;
+	}
+	return result;
+}
+
+unsigned long long HashPoints(const Vec3* pts, const int num)
+{
+	// The count goes in too, so a prefix of the points hashes differently
+	const unsigned long long hash = HashBytes(pts, sizeof(Vec3) * num);
+	return (hash ^ (unsigned long long)num) * 1099511628211ULL;
+}
+
+unsigned long long HashHull(const Vec3* pts, const int num, const HullSimplification& simplification)
+{
+	// Full hulls keep the plain point hash
+	unsigned long long hash = HashPoints(pts, num);
+	if (simplification.maxPoints > 0 || simplification.maxError > 0.0f) {
+		hash = HashBytes(&simplification.maxPoints, sizeof(simplification.maxPoints), hash);
+		hash = HashBytes(&simplification.maxError, sizeof(simplification.maxError), hash);
+	}
+	return hash;
+}
+
+static unsigned int AlignRecordOffset(const unsigned int offset)
+{
+	return (offset + 7) & ~7u;
+}
+
+// For every directed edge a->b, the triangle holding b->a
+static void BuildHullAdjacency(const Tri* tris, const int numTris, int* adjacency)
+{
+	std::unordered_map<unsigned long long, int> edgeToTri;
+	edgeToTri.reserve(numTris * 3);
+	for (int i = 0; i < numTris; i++) {
+		const int v[3] = { tris[i].a, tris[i].b, tris[i].c };
+		for (int e = 0; e < 3; e++) {
+			const unsigned long long key = ((unsigned long long)v[e] << 32) | (unsigned int)v[(e + 1) % 3];
+			edgeToTri[key] = i;
+		}
+	}
+
+	for (int i = 0; i < numTris; i++) {
+		const int v[3] = { tris[i].a, tris[i].b, tris[i].c };
+		for (int e = 0; e < 3; e++) {
+			const unsigned long long key = ((unsigned long long)v[(e + 1) % 3] << 32) | (unsigned int)v[e];
+			const auto it = edgeToTri.find(key);
+			adjacency[i * 3 + e] = (it != edgeToTri.end()) ? it->second : -1;
+		}
+	}
+}
+
+ShapeCache::ShapeCache(const char* dir)
+{
+	snprintf(directory, sizeof(directory), "%s", dir);
+}
+
+ShapeCache::~ShapeCache()
+{
+	for (int i = 0; i < (int)mappedFiles.size(); i++) {
+		UnmapFileData(mappedFiles[i]);
+	}
+}
+
+void ShapeCache::RecordPath(const unsigned long long hash, const char* extension, char* path, const int maxLength) const
+{
+	snprintf(path, maxLength, "%s/%016llx.%s", directory, hash, extension);
+}
+
+// Reject anything written by another version or cut short
+static bool IsValidHull(const CookedHull* record, const unsigned int size, const unsigned long long hash)
+{
+	return
+		size >= sizeof(CookedHull) &&
+		record->recordMagic == CookedHull::magic &&
+		record->recordVersion == CookedHull::version &&
+		record->hash == hash &&
+		record->size <= size &&
+		record->numQuantized == PadQuantizedPointCount(record->numPoints) &&
+		record->quantizedOffset + sizeof(unsigned short) * 3 * record->numQuantized <= record->size &&
+		record->pointsOffset + sizeof(Vec3) * record->numPoints <= record->size &&
+		record->trisOffset + sizeof(Tri) * record->numTris <= record->size &&
+		record->adjacencyOffset + sizeof(int) * 3 * record->numTris <= record->size;
+}
+
+static bool IsValidCompound(const CookedCompound* record, const unsigned int size, const unsigned long long hash)
+{
+	const bool isValid =
+		size >= sizeof(CookedCompound) &&
+		record->recordMagic == CookedCompound::magic &&
+		record->recordVersion == CookedCompound::version &&
+		record->hash == hash &&
+		record->size == size &&
+		record->hullOffsetsOffset + sizeof(unsigned int) * record->numHulls <= size;
+	if (!isValid) {
+		return false;
+	}
+
+	const unsigned int* offsets = (const unsigned int*)((const unsigned char*)record + record->hullOffsetsOffset);
+	for (int i = 0; i < record->numHulls; i++) {
+		if (offsets[i] >= size || !IsValidHull(record->Hull(i), size - offsets[i], hash + i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool IsValidMesh(const CookedMesh* record, const unsigned int size, const unsigned long long hash)
+{
+	return
+		size >= sizeof(CookedMesh) &&
+		record->recordMagic == CookedMesh::magic &&
+		record->recordVersion == CookedMesh::version &&
+		record->hash == hash &&
+		record->size == size &&
+		record->nodesOffset + sizeof(MeshNode) * record->numNodes <= size &&
+		record->trisOffset + sizeof(Tri) * record->numTris <= size &&
+		record->vertsOffset + sizeof(Vec3) * record->numVerts <= size;
+}
+
+static bool IsValidSdf(const CookedSdf* record, const unsigned int size, const unsigned long long hash)
+{
+	if (size < sizeof(CookedSdf)) {
+		return false;
+	}
+	const size_t numBricks = (size_t)record->numBricks[0] * record->numBricks[1] * record->numBricks[2];
+	return
+		record->recordMagic == CookedSdf::magic &&
+		record->recordVersion == CookedSdf::version &&
+		record->hash == hash &&
+		record->size == size &&
+		record->slotsOffset + sizeof(int) * numBricks <= size &&
+		record->distancesOffset + sizeof(float) * numBricks <= size &&
+		record->samplesOffset + sizeof(short) * SdfGrid::samplesPerBrick * record->numStoredBricks <= size;
+}
+
+static unsigned int HullRecordSize(const ShapeConvex& convex)
+{
+	const unsigned int quantizedSize = AlignRecordOffset(sizeof(unsigned short) * 3 * PadQuantizedPointCount(convex.numPoints));
+	const unsigned int trisSize = AlignRecordOffset(sizeof(Tri) * convex.numTris);
+	const unsigned int adjacencySize = AlignRecordOffset(sizeof(int) * 3 * convex.numTris);
+	const unsigned int pointsSize = AlignRecordOffset(sizeof(Vec3) * convex.numPoints);
+	return AlignRecordOffset(sizeof(CookedHull)) + quantizedSize + trisSize + adjacencySize + pointsSize;
+}
+
+// Lays the hull record out at data, which has room for HullRecordSize bytes
+static void WriteHullRecord(const ShapeConvex& convex, const unsigned long long hash, unsigned char* data)
+{
+	CookedHull header;
+	memset(&header, 0, sizeof(header));
+	header.recordMagic = CookedHull::magic;
+	header.recordVersion = CookedHull::version;
+	header.hash = hash;
+	header.hullError = convex.hullError;
+	header.numPoints = convex.numPoints;
+	header.numQuantized = PadQuantizedPointCount(convex.numPoints);
+	header.numTris = convex.numTris;
+	header.quantizedOffset = AlignRecordOffset(sizeof(CookedHull));
+	header.trisOffset = AlignRecordOffset(header.quantizedOffset + sizeof(unsigned short) * 3 * header.numQuantized);
+	header.adjacencyOffset = AlignRecordOffset(header.trisOffset + sizeof(Tri) * convex.numTris);
+	header.pointsOffset = AlignRecordOffset(header.adjacencyOffset + sizeof(int) * 3 * convex.numTris);
+	header.size = AlignRecordOffset(header.pointsOffset + sizeof(Vec3) * convex.numPoints);
+	for (int i = 0; i < 3; i++) {
+		header.boundsMins[i] = convex.bounds.mins[i];
+		header.boundsMaxs[i] = convex.bounds.maxs[i];
+		header.quantizedStep[i] = (convex.bounds.maxs[i] - convex.bounds.mins[i]) / 65535.0f;
+		header.centerOfMass[i] = convex.GetCenterOfMass()[i];
+		for (int j = 0; j < 3; j++) {
+			header.inertiaTensor[i * 3 + j] = convex.inertiaTensor.rows[i][j];
+		}
+	}
+
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + header.pointsOffset, convex.points, sizeof(Vec3) * convex.numPoints);
+	QuantizePoints(convex.points, convex.numPoints, convex.bounds.mins, Vec3(header.quantizedStep), (unsigned short*)(data + header.quantizedOffset));
+	memcpy(data + header.trisOffset, convex.tris, sizeof(Tri) * convex.numTris);
+	BuildHullAdjacency(convex.tris, convex.numTris, (int*)(data + header.adjacencyOffset));
+}
+
+bool ShapeCache::Map(const unsigned long long hash, const char* extension, MappedFile& file)
+{
+	char path[512];
+	RecordPath(hash, extension, path, sizeof(path));
+	return MapFileData(path, file);
+}
+
+// Writes the record and maps it back, or keeps it in memory when the cache can't be written
+const unsigned char* ShapeCache::Store(const unsigned long long hash, const char* extension, std::vector<unsigned long long>& buffer, const unsigned int size)
+{
+	// Create the directory one level at a time
+	char path[512];
+	snprintf(path, sizeof(path), "%s", directory);
+	for (char* c = path; *c != '\0'; c++) {
+		if (*c == '/') {
+			*c = '\0';
+			MakeDirectory(path);
+			*c = '/';
+		}
+	}
+	MakeDirectory(path);
+
+	RecordPath(hash, extension, path, sizeof(path));
+	MappedFile file;
+	if (SaveFileData(path, buffer.data(), size) && Map(hash, extension, file)) {
+		if (file.size == size && memcmp(file.data, buffer.data(), size) == 0) {
+			mappedFiles.push_back(file);
+			return file.data;
+		}
+		UnmapFileData(file);
+	}
+
+	memoryRecords.push_back(std::move(buffer));
+	return (const unsigned char*)memoryRecords.back().data();
+}
+
+const CookedHull* ShapeCache::Cook(const Vec3* pts, const int num, const HullSimplification& simplification)
+{
+	const unsigned long long hash = HashHull(pts, num, simplification);
+
+	const auto it = records.find(hash);
+	if (it != records.end()) {
+		return it->second;
+	}
+
+	MappedFile file;
+	if (Map(hash, "hull", file)) {
+		const CookedHull* record = (const CookedHull*)file.data;
+		if (IsValidHull(record, file.size, hash) && record->size == file.size) {
+			mappedFiles.push_back(file);
+			records[hash] = record;
+			return record;
+		}
+		UnmapFileData(file);
+	}
+
+	// Not cooked yet, build the hull and its mass properties the slow way
+	const ShapeConvex convex(pts, num, simplification);
+
+	// 8 byte words keep the record aligned for the header
+	const unsigned int size = HullRecordSize(convex);
+	std::vector<unsigned long long> buffer(size / sizeof(unsigned long long), 0);
+	WriteHullRecord(convex, hash, (unsigned char*)buffer.data());
+
+	const CookedHull* record = (const CookedHull*)Store(hash, "hull", buffer, size);
+	records[hash] = record;
+	return record;
+}
+
+ShapeConvex* ShapeCache::CreateConvex(const Vec3* pts, const int num, const bool isCompact, const HullSimplification& simplification)
+{
+	return new ShapeConvex(*Cook(pts, num, simplification), isCompact);
+}
+
+const CookedCompound* ShapeCache::CookCompound(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, const DecompositionSettings& settings)
+{
+	unsigned long long hash = HashPoints(verts, numVerts);
+	hash = HashBytes(tris, sizeof(Tri) * numTris, hash);
+	hash = HashBytes(&settings, sizeof(settings), hash);
+
+	const auto it = compounds.find(hash);
+	if (it != compounds.end()) {
+		return it->second;
+	}
+
+	MappedFile file;
+	if (Map(hash, "compound", file)) {
+		const CookedCompound* record = (const CookedCompound*)file.data;
+		if (IsValidCompound(record, file.size, hash)) {
+			mappedFiles.push_back(file);
+			compounds[hash] = record;
+			return record;
+		}
+		UnmapFileData(file);
+	}
+
+	// Every piece is cooked like a hull of its own, simplified to the per hull budget
+	std::vector<std::vector<Vec3>> parts;
+	const float concavity = DecomposeMesh(verts, numVerts, tris, numTris, settings, parts);
+
+	HullSimplification simplification;
+	simplification.maxPoints = settings.maxPointsPerHull;
+
+	std::vector<ShapeConvex*> hulls;
+	for (int i = 0; i < (int)parts.size(); i++) {
+		ShapeConvex* convex = new ShapeConvex(parts[i].data(), (int)parts[i].size(), simplification);
+		if (convex->numPoints >= 4) {
+			hulls.push_back(convex);
+		} else {
+			delete convex;
+		}
+	}
+
+	CookedCompound header;
+	memset(&header, 0, sizeof(header));
+	header.recordMagic = CookedCompound::magic;
+	header.recordVersion = CookedCompound::version;
+	header.hash = hash;
+	header.numHulls = (int)hulls.size();
+	header.hullOffsetsOffset = AlignRecordOffset(sizeof(CookedCompound));
+	header.concavity = concavity;
+
+	Bounds bounds;
+	std::vector<unsigned int> offsets(hulls.size());
+	unsigned int offset = AlignRecordOffset(header.hullOffsetsOffset + sizeof(unsigned int) * header.numHulls);
+	for (int i = 0; i < (int)hulls.size(); i++) {
+		offsets[i] = offset;
+		offset += HullRecordSize(*hulls[i]);
+		bounds.Expand(hulls[i]->bounds);
+	}
+	header.size = offset;
+	for (int i = 0; i < 3; i++) {
+		header.boundsMins[i] = bounds.mins[i];
+		header.boundsMaxs[i] = bounds.maxs[i];
+	}
+
+	std::vector<unsigned long long> buffer(header.size / sizeof(unsigned long long), 0);
+	unsigned char* data = (unsigned char*)buffer.data();
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + header.hullOffsetsOffset, offsets.data(), sizeof(unsigned int) * header.numHulls);
+	for (int i = 0; i < (int)hulls.size(); i++) {
+		// Embedded hulls hash after their compound, they are only found through it
+		WriteHullRecord(*hulls[i], hash + i, data + offsets[i]);
+		delete hulls[i];
+	}
+
+	const CookedCompound* record = (const CookedCompound*)Store(hash, "compound", buffer, header.size);
+	compounds[hash] = record;
+	return record;
+}
+
+// Tree over the triangle bounds, median splits along the longest axis of their centers
+struct MeshTreeBuilder
+{
+	const std::vector<Bounds>& triBounds;
+	std::vector<int>& order;
+	std::vector<MeshNode>& nodes;
+	Vec3 origin;
+	Vec3 invStep;
+
+	void Quantize(const Bounds& bounds, MeshNode& node) const {
+		for (int i = 0; i < 3; i++) {
+			const float lo = floorf((bounds.mins[i] - origin[i]) * invStep[i]);
+			const float hi = ceilf((bounds.maxs[i] - origin[i]) * invStep[i]);
+			node.mins[i] = (unsigned short)std::min(std::max(lo, 0.0f), 65535.0f);
+			node.maxs[i] = (unsigned short)std::min(std::max(hi, 0.0f), 65535.0f);
+		}
+	}
+
+	void Build(const int first, const int count) {
+		Bounds nodeBounds;
+		Bounds centers;
+		for (int i = first; i < first + count; i++) {
+			const Bounds& b = triBounds[order[i]];
+			nodeBounds.Expand(b);
+			centers.Expand((b.mins + b.maxs) * 0.5f);
+		}
+
+		const int nodeIdx = (int)nodes.size();
+		nodes.push_back(MeshNode());
+		Quantize(nodeBounds, nodes[nodeIdx]);
+		if (count <= MeshNode::maxLeafTris) {
+			nodes[nodeIdx].data = MeshNode::leafBit | ((unsigned int)(count - 1) << MeshNode::countShift) | (unsigned int)first;
+			return;
+		}
+
+		const Vec3 extents = centers.maxs - centers.mins;
+		const int axis = (extents.x >= extents.y && extents.x >= extents.z) ? 0 : ((extents.y >= extents.z) ? 1 : 2);
+		const int mid = first + count / 2;
+		std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + first + count, [&](const int lhs, const int rhs) {
+			return (triBounds[lhs].mins[axis] + triBounds[lhs].maxs[axis]) < (triBounds[rhs].mins[axis] + triBounds[rhs].maxs[axis]);
+		});
+
+		// The left subtree follows its parent, the right one comes after it
+		Build(first, mid - first);
+		nodes[nodeIdx].data = (unsigned int)nodes.size();
+		Build(mid, first + count - mid);
+	}
+};
+
+const CookedMesh* ShapeCache::CookMesh(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris)
+{
+	unsigned long long hash = HashPoints(verts, numVerts);
+	hash = HashBytes(tris, sizeof(Tri) * numTris, hash);
+
+	const auto it = meshes.find(hash);
+	if (it != meshes.end()) {
+		return it->second;
+	}
+
+	MappedFile file;
+	if (Map(hash, "mesh", file)) {
+		const CookedMesh* record = (const CookedMesh*)file.data;
+		if (IsValidMesh(record, file.size, hash)) {
+			mappedFiles.push_back(file);
+			meshes[hash] = record;
+			return record;
+		}
+		UnmapFileData(file);
+	}
+
+	Bounds bounds;
+	std::vector<Bounds> triBounds(numTris);
+	std::vector<int> order(numTris);
+	for (int i = 0; i < numTris; i++) {
+		triBounds[i].Expand(verts[tris[i].a]);
+		triBounds[i].Expand(verts[tris[i].b]);
+		triBounds[i].Expand(verts[tris[i].c]);
+		bounds.Expand(triBounds[i]);
+		order[i] = i;
+	}
+	if (numTris == 0) {
+		bounds.mins = Vec3(0.0f);
+		bounds.maxs = Vec3(0.0f);
+	}
+
+	CookedMesh header;
+	memset(&header, 0, sizeof(header));
+	for (int i = 0; i < 3; i++) {
+		header.boundsMins[i] = bounds.mins[i];
+		header.boundsMaxs[i] = bounds.maxs[i];
+		header.quantizedStep[i] = (bounds.maxs[i] - bounds.mins[i]) / 65535.0f;
+	}
+
+	std::vector<MeshNode> nodes;
+	nodes.reserve(2 * (numTris / MeshNode::maxLeafTris + 1));
+	if (numTris > 0) {
+		Vec3 invStep;
+		for (int i = 0; i < 3; i++) {
+			invStep[i] = (header.quantizedStep[i] > 0.0f) ? 1.0f / header.quantizedStep[i] : 0.0f;
+		}
+		MeshTreeBuilder builder{ triBounds, order, nodes, bounds.mins, invStep };
+		builder.Build(0, numTris);
+	}
+
+	header.recordMagic = CookedMesh::magic;
+	header.recordVersion = CookedMesh::version;
+	header.hash = hash;
+	header.numVerts = numVerts;
+	header.numTris = numTris;
+	header.numNodes = (int)nodes.size();
+	header.nodesOffset = AlignRecordOffset(sizeof(CookedMesh));
+	header.trisOffset = AlignRecordOffset(header.nodesOffset + sizeof(MeshNode) * header.numNodes);
+	header.vertsOffset = AlignRecordOffset(header.trisOffset + sizeof(Tri) * numTris);
+	header.size = AlignRecordOffset(header.vertsOffset + sizeof(Vec3) * numVerts);
+
+	std::vector<unsigned long long> buffer(header.size / sizeof(unsigned long long), 0);
+	unsigned char* data = (unsigned char*)buffer.data();
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + header.nodesOffset, nodes.data(), sizeof(MeshNode) * header.numNodes);
+	Tri* sortedTris = (Tri*)(data + header.trisOffset);
+	for (int i = 0; i < numTris; i++) {
+		sortedTris[i] = tris[order[i]];
+	}
+	memcpy(data + header.vertsOffset, verts, sizeof(Vec3) * numVerts);
+
+	const CookedMesh* record = (const CookedMesh*)Store(hash, "mesh", buffer, header.size);
+	meshes[hash] = record;
+	return record;
+}
+
+const CookedSdf* ShapeCache::CookSdf(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, const SdfSettings& settings)
+{
+	unsigned long long hash = HashPoints(verts, numVerts);
+	hash = HashBytes(tris, sizeof(Tri) * numTris, hash);
+	hash = HashBytes(&settings, sizeof(settings), hash);
+
+	const auto it = sdfs.find(hash);
+	if (it != sdfs.end()) {
+		return it->second;
+	}
+
+	MappedFile file;
+	if (Map(hash, "sdf", file)) {
+		const CookedSdf* record = (const CookedSdf*)file.data;
+		if (IsValidSdf(record, file.size, hash)) {
+			mappedFiles.push_back(file);
+			sdfs[hash] = record;
+			return record;
+		}
+		UnmapFileData(file);
+	}
+
+	SdfGrid grid;
+	BakeSignedDistance(verts, numVerts, tris, numTris, settings, grid);
+
+	Bounds bounds;
+	bounds.Expand(verts, numVerts);
+	if (numVerts == 0) {
+		bounds.mins = Vec3(0.0f);
+		bounds.maxs = Vec3(0.0f);
+	}
+
+	const int numBricks = (int)grid.brickSlots.size();
+	CookedSdf header;
+	memset(&header, 0, sizeof(header));
+	header.recordMagic = CookedSdf::magic;
+	header.recordVersion = CookedSdf::version;
+	header.hash = hash;
+	header.numStoredBricks = (int)(grid.samples.size() / SdfGrid::samplesPerBrick);
+	header.cellSize = grid.cellSize;
+	header.band = grid.band;
+	for (int i = 0; i < 3; i++) {
+		header.numBricks[i] = grid.numBricks[i];
+		header.origin[i] = grid.origin[i];
+		header.boundsMins[i] = bounds.mins[i];
+		header.boundsMaxs[i] = bounds.maxs[i];
+	}
+	header.slotsOffset = AlignRecordOffset(sizeof(CookedSdf));
+	header.distancesOffset = AlignRecordOffset(header.slotsOffset + sizeof(int) * numBricks);
+	header.samplesOffset = AlignRecordOffset(header.distancesOffset + sizeof(float) * numBricks);
+	header.size = AlignRecordOffset(header.samplesOffset + sizeof(short) * (unsigned int)grid.samples.size());
+
+	std::vector<unsigned long long> buffer(header.size / sizeof(unsigned long long), 0);
+	unsigned char* data = (unsigned char*)buffer.data();
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + header.slotsOffset, grid.brickSlots.data(), sizeof(int) * numBricks);
+	memcpy(data + header.distancesOffset, grid.brickDistances.data(), sizeof(float) * numBricks);
+
+	// The samples are within the band, which maps to the whole 16 bit range
+	short* samples = (short*)(data + header.samplesOffset);
+	const float scale = 32767.0f / grid.band;
+	for (int i = 0; i < (int)grid.samples.size(); i++) {
+		samples[i] = (short)lroundf(grid.samples[i] * scale);
+	}
+
+	const CookedSdf* record = (const CookedSdf*)Store(hash, "sdf", buffer, header.size);
+	sdfs[hash] = record;
+	return record;
+}
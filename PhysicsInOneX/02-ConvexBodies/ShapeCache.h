@@ -0,0 +1,195 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include "code/Math/Vector.h"
+#include "code/Fileio.h"
+#include "ShapeUtils.h"
+#include "ConvexDecomposition.h"
+#include "SignedDistance.h"
+
+class ShapeConvex;
+
+// A convex hull cooked once and stored as a single flat record. The arrays follow the
+// header in the same block, so a record mapped from disk is used as it is, without
+// parsing or copying. Offsets are in bytes from the start of the record.
+// The compact points come first, next to the faces and adjacency, the full precision
+// points last since only the renderer and the contact manifolds read them.
+struct CookedHull
+{
+	static const unsigned int magic = 0x4c4c5548;	// "HULL"
+	static const unsigned int version = 3;
+
+	unsigned int recordMagic;
+	unsigned int recordVersion;
+	unsigned long long hash;		// Of the source points and the simplification
+	unsigned int size;				// Whole record, in bytes
+
+	int numPoints;
+	int numQuantized;				// Padded point count of the compact points
+	int numTris;
+	unsigned int quantizedOffset;
+	unsigned int pointsOffset;
+	unsigned int trisOffset;
+	unsigned int adjacencyOffset;
+
+	float boundsMins[3];
+	float boundsMaxs[3];
+	float centerOfMass[3];
+	float inertiaTensor[9];			// Per unit mass, row major
+	float quantizedStep[3];			// From the bounds mins
+	float hullError;				// Of the simplification
+
+	const unsigned short* Quantized() const { return (const unsigned short*)((const unsigned char*)this + quantizedOffset); }
+	const Vec3* Points() const { return (const Vec3*)((const unsigned char*)this + pointsOffset); }
+	const Tri* Tris() const { return (const Tri*)((const unsigned char*)this + trisOffset); }
+
+	// Three per triangle, the triangle across the edge starting at a, b and c
+	const int* Adjacency() const { return (const int*)((const unsigned char*)this + adjacencyOffset); }
+};
+
+// Convex pieces of a non-convex mesh, each a whole hull record embedded in this one
+struct CookedCompound
+{
+	static const unsigned int magic = 0x444d4f43;	// "COMD"
+	static const unsigned int version = 1;
+
+	unsigned int recordMagic;
+	unsigned int recordVersion;
+	unsigned long long hash;		// Of the mesh and the decomposition settings
+	unsigned int size;
+
+	int numHulls;
+	unsigned int hullOffsetsOffset;	// One record offset per hull
+
+	float boundsMins[3];
+	float boundsMaxs[3];
+	float concavity;				// Left by the decomposition
+
+	const CookedHull* Hull(const int i) const {
+		const unsigned int* offsets = (const unsigned int*)((const unsigned char*)this + hullOffsetsOffset);
+		return (const CookedHull*)((const unsigned char*)this + offsets[i]);
+	}
+};
+
+// Node of a mesh tree, bounds in 16 bit steps over the mesh bounds, rounded outwards.
+// Nodes are stored depth first, the left child of an inner node right after it, so a
+// descent walks forward through memory, four nodes to a cache line.
+struct MeshNode
+{
+	static const unsigned int leafBit = 0x80000000u;
+	static const int countShift = 29;
+	static const int maxLeafTris = 4;
+
+	unsigned short mins[3];
+	unsigned short maxs[3];
+	unsigned int data;		// Right child of an inner node, first triangle and count of a leaf
+
+	bool IsLeaf() const { return (data & leafBit) != 0; }
+	int RightChild() const { return (int)data; }
+	int FirstTri() const { return (int)(data & ((1u << countShift) - 1)); }
+	int NumTris() const { return (int)((data & ~leafBit) >> countShift) + 1; }
+};
+
+// Static triangle soup with its tree, cooked offline or on first use
+struct CookedMesh
+{
+	static const unsigned int magic = 0x4853454d;	// "MESH"
+	static const unsigned int version = 1;
+
+	unsigned int recordMagic;
+	unsigned int recordVersion;
+	unsigned long long hash;		// Of the vertices and triangles
+	unsigned int size;
+
+	int numVerts;
+	int numTris;
+	int numNodes;
+	unsigned int nodesOffset;
+	unsigned int trisOffset;		// In leaf order
+	unsigned int vertsOffset;
+
+	float boundsMins[3];
+	float boundsMaxs[3];
+	float quantizedStep[3];
+
+	const MeshNode* Nodes() const { return (const MeshNode*)((const unsigned char*)this + nodesOffset); }
+	const Tri* Tris() const { return (const Tri*)((const unsigned char*)this + trisOffset); }
+	const Vec3* Verts() const { return (const Vec3*)((const unsigned char*)this + vertsOffset); }
+};
+
+// Signed distance field baked from a closed mesh, the bricks of an SdfGrid with their
+// samples in 16 bits over the band
+struct CookedSdf
+{
+	static const unsigned int magic = 0x42464453;	// "SDFB"
+	static const unsigned int version = 1;
+
+	unsigned int recordMagic;
+	unsigned int recordVersion;
+	unsigned long long hash;		// Of the mesh and the settings
+	unsigned int size;
+
+	int numBricks[3];
+	int numStoredBricks;
+	unsigned int slotsOffset;		// One per brick, -1 away from the surface
+	unsigned int distancesOffset;	// One per brick
+	unsigned int samplesOffset;		// SdfGrid::samplesPerBrick per stored brick
+
+	float origin[3];
+	float cellSize;
+	float band;
+	float boundsMins[3];			// Of the mesh
+	float boundsMaxs[3];
+
+	const int* Slots() const { return (const int*)((const unsigned char*)this + slotsOffset); }
+	const float* BrickDistances() const { return (const float*)((const unsigned char*)this + distancesOffset); }
+	const short* Samples() const { return (const short*)((const unsigned char*)this + samplesOffset); }
+};
+
+// FNV-1a, pass a previous hash to chain several blocks
+static const unsigned long long hashSeed = 14695981039346656037ULL;
+unsigned long long HashBytes(const void* data, const size_t size, const unsigned long long hash = hashSeed);
+unsigned long long HashPoints(const Vec3* pts, const int num);
+unsigned long long HashHull(const Vec3* pts, const int num, const HullSimplification& simplification);
+
+// Cooks convex hulls, compounds, meshes and distance fields on first use and keeps them in the cache directory,
+// one file per source named after its hash. Later runs map the file instead of building
+// the hull again. Records stay valid until the cache is destroyed.
+class ShapeCache
+{
+public:
+	explicit ShapeCache(const char* directory = "cache/shapes");
+	~ShapeCache();
+
+	ShapeCache(const ShapeCache&) = delete;
+	ShapeCache& operator=(const ShapeCache&) = delete;
+
+	const CookedHull* Cook(const Vec3* pts, const int num, const HullSimplification& simplification = HullSimplification());
+
+	// Compact shapes run their support queries on the 16 bit points
+	ShapeConvex* CreateConvex(const Vec3* pts, const int num, const bool isCompact = false, const HullSimplification& simplification = HullSimplification());
+
+	// Decomposes a triangle mesh into convex hulls, up to the settings budget
+	const CookedCompound* CookCompound(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, const DecompositionSettings& settings = DecompositionSettings());
+
+	// Builds the tree over the triangles of static geometry
+	const CookedMesh* CookMesh(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris);
+
+	// Bakes the distance field of a closed mesh, slow enough to be done offline
+	const CookedSdf* CookSdf(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, const SdfSettings& settings = SdfSettings());
+
+private:
+	bool Map(const unsigned long long hash, const char* extension, MappedFile& file);
+	const unsigned char* Store(const unsigned long long hash, const char* extension, std::vector<unsigned long long>& buffer, const unsigned int size);
+	void RecordPath(const unsigned long long hash, const char* extension, char* path, const int maxLength) const;
+
+	char directory[256];
+	std::unordered_map<unsigned long long, const CookedHull*> records;
+	std::unordered_map<unsigned long long, const CookedCompound*> compounds;
+	std::unordered_map<unsigned long long, const CookedMesh*> meshes;
+	std::unordered_map<unsigned long long, const CookedSdf*> sdfs;
+	std::vector<MappedFile> mappedFiles;
+
+	// Cooked records that could not be written to disk
+	std::vector<std::vector<unsigned long long>> memoryRecords;
+};
@@ -0,0 +1,278 @@
+#include "ShapeRegistry.h"
+#include <assert.h>
+
+// Keys start from the shape type, so equal bytes of different shapes don't collide
+static unsigned long long ShapeKey(const Shape::ShapeType type)
+{
+	const int typeId = (int)type;
+	return HashBytes(&typeId, sizeof(typeId));
+}
+
+static void AddSource(std::vector<unsigned char>& source, const void* data, const size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	source.insert(source.end(), bytes, bytes + size);
+}
+
+ShapeRegistry::~ShapeRegistry()
+{
+	for (auto& entry : entries) {
+		delete entry.first;
+	}
+}
+
+Shape* ShapeRegistry::Find(const Shape::ShapeType type, const Source& source)
+{
+	const unsigned long long key = HashBytes(source.data(), source.size(), ShapeKey(type));
+	const auto range = shapesByKey.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it) {
+		Entry& entry = entries[it->second];
+		if (it->second->GetType() == type && entry.source == source) {
+			entry.refCount++;
+			return it->second;
+		}
+	}
+	return nullptr;
+}
+
+Shape* ShapeRegistry::Add(const Shape::ShapeType type, const Source& source, Shape* shape, const std::vector<const Shape*>& inner)
+{
+	const unsigned long long key = HashBytes(source.data(), source.size(), ShapeKey(type));
+	shapesByKey.insert(std::make_pair(key, shape));
+	entries[shape] = Entry{ key, source, inner, 1 };
+	return shape;
+}
+
+Shape* ShapeRegistry::AcquireSphere(const float radius)
+{
+	Source source;
+	AddSource(source, &radius, sizeof(radius));
+	Shape* shape = Find(Shape::ShapeType::SHAPE_SPHERE, source);
+	if (shape != nullptr) {
+		return shape;
+	}
+	return Add(Shape::ShapeType::SHAPE_SPHERE, source, new ShapeSphere(radius));
+}
+
+Shape* ShapeRegistry::AcquireBox(const Vec3* pts, const int num)
+{
+	// A box only keeps the bounds of its points
+	Bounds bounds;
+	bounds.Expand(pts, num);
+	const float extents[6] = { bounds.mins.x, bounds.mins.y, bounds.mins.z, bounds.maxs.x, bounds.maxs.y, bounds.maxs.z };
+
+	Source source;
+	AddSource(source, extents, sizeof(extents));
+	Shape* shape = Find(Shape::ShapeType::SHAPE_BOX, source);
+	if (shape != nullptr) {
+		return shape;
+	}
+	return Add(Shape::ShapeType::SHAPE_BOX, source, new ShapeBox(pts, num));
+}
+
+Shape* ShapeRegistry::AcquireCapsule(const float radius, const float halfHeight)
+{
+	const float dims[2] = { radius, halfHeight };
+	Source source;
+	AddSource(source, dims, sizeof(dims));
+	Shape* shape = Find(Shape::ShapeType::SHAPE_CAPSULE, source);
+	if (shape != nullptr) {
+		return shape;
+	}
+	return Add(Shape::ShapeType::SHAPE_CAPSULE, source, new ShapeCapsule(radius, halfHeight));
+}
+
+Shape* ShapeRegistry::AcquireCylinder(const float radius, const float halfHeight)
+{
+	const float dims[2] = { radius, halfHeight };
+	Source source;
+	AddSource(source, dims, sizeof(dims));
+	Shape* shape = Find(Shape::ShapeType::SHAPE_CYLINDER, source);
+	if (shape != nullptr) {
+		return shape;
+	}
+	return Add(Shape::ShapeType::SHAPE_CYLINDER, source, new ShapeCylinder(radius, halfHeight));
+}
+
+Shape* ShapeRegistry::AcquirePlane()
+{
+	const Source source;
+	Shape* shape = Find(Shape::ShapeType::SHAPE_PLANE, source);
+	if (shape != nullptr) {
+		return shape;
+	}
+	return Add(Shape::ShapeType::SHAPE_PLANE, source, new ShapePlane());
+}
+
+Shape* ShapeRegistry::AcquireConvex(const Vec3* pts, const int num, const bool isCompact, const HullSimplification& simplification)
+{
+	Source source;
+	AddSource(source, pts, sizeof(Vec3) * num);
+	AddSource(source, &simplification.maxPoints, sizeof(simplification.maxPoints));
+	AddSource(source, &simplification.maxError, sizeof(simplification.maxError));
+	AddSource(source, &isCompact, sizeof(isCompact));
+	Shape* shape = Find(Shape::ShapeType::SHAPE_CONVEX, source);
+	if (shape != nullptr) {
+		return shape;
+	}
+	return Add(Shape::ShapeType::SHAPE_CONVEX, source, hullCache.CreateConvex(pts, num, isCompact, simplification));
+}
+
+Shape* ShapeRegistry::AcquireScaled(Shape* inner, const Vec3& scale)
+{
+	assert(entries.find(inner) != entries.end());
+
+	// Inner shapes are interned already, their address stands for their content
+	Source source;
+	AddSource(source, &inner, sizeof(inner));
+	AddSource(source, scale.ToPtr(), sizeof(float) * 3);
+	Shape* shape = Find(Shape::ShapeType::SHAPE_SCALED, source);
+	if (shape != nullptr) {
+		return shape;
+	}
+
+	entries[inner].refCount++;
+	return Add(Shape::ShapeType::SHAPE_SCALED, source, new ShapeScaled(inner, scale), std::vector<const Shape*>(1, inner));
+}
+
+Shape* ShapeRegistry::AcquireCompound(const ShapeCompound::Child* children, const int num)
+{
+	Source source;
+	for (int i = 0; i < num; i++) {
+		assert(entries.find(children[i].shape) != entries.end());
+		AddSource(source, &children[i].shape, sizeof(children[i].shape));
+		AddSource(source, children[i].position.ToPtr(), sizeof(float) * 3);
+		AddSource(source, &children[i].orientation, sizeof(children[i].orientation));
+		AddSource(source, &children[i].mass, sizeof(children[i].mass));
+	}
+	Shape* shape = Find(Shape::ShapeType::SHAPE_COMPOUND, source);
+	if (shape != nullptr) {
+		return shape;
+	}
+
+	std::vector<const Shape*> inner(num);
+	for (int i = 0; i < num; i++) {
+		inner[i] = children[i].shape;
+		entries[inner[i]].refCount++;
+	}
+	return Add(Shape::ShapeType::SHAPE_COMPOUND, source, new ShapeCompound(children, num), inner);
+}
+
+Shape* ShapeRegistry::AcquireDecomposed(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, const DecompositionSettings& settings)
+{
+	const CookedCompound* compound = hullCache.CookCompound(verts, numVerts, tris, numTris, settings);
+
+	// The pieces are interned by the record they point into, the compound by its pieces
+	std::vector<ShapeCompound::Child> children(compound->numHulls);
+	for (int i = 0; i < compound->numHulls; i++) {
+		const CookedHull* hull = compound->Hull(i);
+		Source source;
+		AddSource(source, &hull, sizeof(hull));
+		Shape* piece = Find(Shape::ShapeType::SHAPE_CONVEX, source);
+		if (piece == nullptr) {
+			piece = Add(Shape::ShapeType::SHAPE_CONVEX, source, new ShapeConvex(*hull));
+		}
+
+		children[i].shape = piece;
+		children[i].position.Zero();
+		children[i].orientation = Quat(0, 0, 0, 1);
+		children[i].mass = 0.0f;
+	}
+
+	Shape* shape = AcquireCompound(children.data(), (int)children.size());
+
+	// The compound holds the pieces now
+	for (int i = 0; i < (int)children.size(); i++) {
+		Release(children[i].shape);
+	}
+	return shape;
+}
+
+Shape* ShapeRegistry::AcquireMesh(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, const float thickness)
+{
+	const CookedMesh* mesh = hullCache.CookMesh(verts, numVerts, tris, numTris);
+	Source source;
+	AddSource(source, &mesh, sizeof(mesh));
+	AddSource(source, &thickness, sizeof(thickness));
+	Shape* shape = Find(Shape::ShapeType::SHAPE_TRIANGLE_MESH, source);
+	if (shape != nullptr) {
+		return shape;
+	}
+	return Add(Shape::ShapeType::SHAPE_TRIANGLE_MESH, source, new ShapeTriangleMesh(*mesh, thickness));
+}
+
+Shape* ShapeRegistry::AcquireHeightfield(const float* heights, const int numX, const int numY, const float spacing, const bool isQuantized, const float thickness)
+{
+	const int dims[2] = { numX, numY };
+	Source source;
+	AddSource(source, dims, sizeof(dims));
+	AddSource(source, heights, sizeof(float) * numX * numY);
+	AddSource(source, &spacing, sizeof(spacing));
+	AddSource(source, &isQuantized, sizeof(isQuantized));
+	AddSource(source, &thickness, sizeof(thickness));
+	Shape* shape = Find(Shape::ShapeType::SHAPE_HEIGHTFIELD, source);
+	if (shape != nullptr) {
+		return shape;
+	}
+	return Add(Shape::ShapeType::SHAPE_HEIGHTFIELD, source, new ShapeHeightfield(heights, numX, numY, spacing, isQuantized, thickness));
+}
+
+Shape* ShapeRegistry::AcquireSdf(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, const SdfSettings& settings)
+{
+	const CookedSdf* sdf = hullCache.CookSdf(verts, numVerts, tris, numTris, settings);
+	Source source;
+	AddSource(source, &sdf, sizeof(sdf));
+	Shape* shape = Find(Shape::ShapeType::SHAPE_SDF, source);
+	if (shape != nullptr) {
+		return shape;
+	}
+	return Add(Shape::ShapeType::SHAPE_SDF, source, new ShapeSdf(*sdf));
+}
+
+void ShapeRegistry::Release(const Shape* shape)
+{
+	const auto it = entries.find(shape);
+	assert(it != entries.end() && it->second.refCount > 0);
+	if (it != entries.end() && it->second.refCount > 0) {
+		it->second.refCount--;
+	}
+}
+
+void ShapeRegistry::Prune()
+{
+	// Freeing a scaled or compound shape may leave its inner shapes unreferenced, go until nothing changes
+	bool isPruned = true;
+	while (isPruned) {
+		isPruned = false;
+
+		std::vector<const Shape*> unused;
+		for (const auto& entry : entries) {
+			if (entry.second.refCount == 0) {
+				unused.push_back(entry.first);
+			}
+		}
+
+		for (int i = 0; i < (int)unused.size(); i++) {
+			const auto it = entries.find(unused[i]);
+			for (int j = 0; j < (int)it->second.inner.size(); j++) {
+				Release(it->second.inner[j]);
+			}
+			const auto range = shapesByKey.equal_range(it->second.key);
+			for (auto byKey = range.first; byKey != range.second; ++byKey) {
+				if (byKey->second == it->first) {
+					shapesByKey.erase(byKey);
+					break;
+				}
+			}
+			delete it->first;
+			entries.erase(it);
+			isPruned = true;
+		}
+	}
+}
+
+int ShapeRegistry::RefCount(const Shape* shape) const
+{
+	const auto it = entries.find(shape);
+	return (it != entries.end()) ? it->second.refCount : 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include "Shape.h"
+#include "ShapeCache.h"
+
+// Shapes interned by content. Bodies built from the same geometry share one shape,
+// each Acquire adds a reference that Release gives back. Shapes nobody references are
+// kept around, so a scene reset finds them again, until Prune frees them.
+class ShapeRegistry
+{
+public:
+	ShapeRegistry() {}
+	~ShapeRegistry();
+
+	ShapeRegistry(const ShapeRegistry&) = delete;
+	ShapeRegistry& operator=(const ShapeRegistry&) = delete;
+
+	Shape* AcquireSphere(const float radius);
+	Shape* AcquireBox(const Vec3* pts, const int num);
+	Shape* AcquireCapsule(const float radius, const float halfHeight);
+	Shape* AcquireCylinder(const float radius, const float halfHeight);
+
+	// Ground under the xy plane of the body, for bodies without mass
+	Shape* AcquirePlane();
+	Shape* AcquireConvex(const Vec3* pts, const int num, const bool isCompact = false, const HullSimplification& simplification = HullSimplification());
+
+	// Holds a reference on the scaled shape for as long as it lives
+	Shape* AcquireScaled(Shape* shape, const Vec3& scale);
+
+	// Holds a reference on each child shape, which has to come from this registry
+	Shape* AcquireCompound(const ShapeCompound::Child* children, const int num);
+
+	// Convex pieces of a triangle mesh, decomposed once and cached like the hulls
+	Shape* AcquireDecomposed(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, const DecompositionSettings& settings = DecompositionSettings());
+
+	// Static level geometry, cooked with its tree like the hulls
+	Shape* AcquireMesh(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, const float thickness = 0.5f);
+
+	// Terrain, heights of numX by numY points spacing apart
+	Shape* AcquireHeightfield(const float* heights, const int numX, const int numY, const float spacing, const bool isQuantized = false, const float thickness = 0.5f);
+
+	// Static geometry sampled through its distance field, baked from a closed mesh like the hulls
+	Shape* AcquireSdf(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, const SdfSettings& settings = SdfSettings());
+
+	void Release(const Shape* shape);
+	void Prune();
+
+	int NumShapes() const { return (int)entries.size(); }
+	int RefCount(const Shape* shape) const;
+
+private:
+	// The bytes a shape is interned by, its key is their hash
+	typedef std::vector<unsigned char> Source;
+
+	struct Entry
+	{
+		unsigned long long key;
+		Source source;						// Compared on a key hit, keys can collide
+		std::vector<const Shape*> inner;	// Referenced by a scaled or compound shape
+		int refCount;
+	};
+
+	Shape* Find(const Shape::ShapeType type, const Source& source);
+	Shape* Add(const Shape::ShapeType type, const Source& source, Shape* shape, const std::vector<const Shape*>& inner = std::vector<const Shape*>());
+
+	std::unordered_multimap<unsigned long long, Shape*> shapesByKey;
+	std::unordered_map<const Shape*, Entry> entries;
+
+	// Convex, mesh and distance field shapes point into the cooked records
+	ShapeCache hullCache;
+};
@@ -1,5 +1,13 @@
 #pragma once
 #include "ShapeUtils.h"
+#include <cfloat>
+#include <algorithm>
+#include "code/Math/Bounds.h"
+#include "code/ThreadPool.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 int FindPointFurthestInDir(const Vec3* pts, const int num, const Vec3& dir)
 {
@@ -15,6 +23,93 @@ int FindPointFurthestInDir(const Vec3* pts, const int num, const Vec3& dir)
 	return maxIndex;
 }
 
+int PadQuantizedPointCount(const int num)
+{
+	return (num + quantizedPointPadding - 1) / quantizedPointPadding * quantizedPointPadding;
+}
+
+void QuantizePoints(const Vec3* pts, const int num, const Vec3& origin, const Vec3& step, unsigned short* quantized)
+{
+	// Padding repeats the first point, so it never wins over it
+	const int numPadded = PadQuantizedPointCount(num);
+	for (int i = 0; i < numPadded; i++) {
+		const Vec3& pt = pts[(i < num) ? i : 0];
+		for (int axis = 0; axis < 3; axis++) {
+			float q = (step[axis] > 0.0f) ? (pt[axis] - origin[axis]) / step[axis] : 0.0f;
+			q = std::min(std::max(q + 0.5f, 0.0f), 65535.0f);
+			quantized[axis * numPadded + i] = (unsigned short)q;
+		}
+	}
+}
+
+Vec3 SupportQuantized(const unsigned short* quantized, const int num, const Vec3& origin, const Vec3& step, const Vec3& dir)
+{
+	// dir . (origin + q * step) only depends on q through the step weighted direction
+	const Vec3 weights(dir.x * step.x, dir.y * step.y, dir.z * step.z);
+	const unsigned short* qx = quantized;
+	const unsigned short* qy = quantized + num;
+	const unsigned short* qz = quantized + num * 2;
+
+	int maxIndex = 0;
+#if defined(_M_X64) || defined(__SSE2__)
+	const __m128 wx = _mm_set1_ps(weights.x);
+	const __m128 wy = _mm_set1_ps(weights.y);
+	const __m128 wz = _mm_set1_ps(weights.z);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i four = _mm_set1_epi32(4);
+
+	__m128 maxDist = _mm_set1_ps(-FLT_MAX);
+	__m128i maxLane = _mm_setzero_si128();
+	__m128i index = _mm_setr_epi32(0, 1, 2, 3);
+	for (int i = 0; i < num; i += 8) {
+		const __m128i x = _mm_loadu_si128((const __m128i*)(qx + i));
+		const __m128i y = _mm_loadu_si128((const __m128i*)(qy + i));
+		const __m128i z = _mm_loadu_si128((const __m128i*)(qz + i));
+
+		// Widen the low then the high four coordinates to floats
+		for (int half = 0; half < 2; half++) {
+			const __m128i xi = half ? _mm_unpackhi_epi16(x, zero) : _mm_unpacklo_epi16(x, zero);
+			const __m128i yi = half ? _mm_unpackhi_epi16(y, zero) : _mm_unpacklo_epi16(y, zero);
+			const __m128i zi = half ? _mm_unpackhi_epi16(z, zero) : _mm_unpacklo_epi16(z, zero);
+			__m128 dist = _mm_mul_ps(_mm_cvtepi32_ps(xi), wx);
+			dist = _mm_add_ps(dist, _mm_mul_ps(_mm_cvtepi32_ps(yi), wy));
+			dist = _mm_add_ps(dist, _mm_mul_ps(_mm_cvtepi32_ps(zi), wz));
+
+			const __m128i isGreater = _mm_castps_si128(_mm_cmpgt_ps(dist, maxDist));
+			maxDist = _mm_max_ps(dist, maxDist);
+			maxLane = _mm_or_si128(_mm_and_si128(isGreater, index), _mm_andnot_si128(isGreater, maxLane));
+			index = _mm_add_epi32(index, four);
+		}
+	}
+
+	float dists[4];
+	int lanes[4];
+	_mm_storeu_ps(dists, maxDist);
+	_mm_storeu_si128((__m128i*)lanes, maxLane);
+	maxIndex = lanes[0];
+	for (int i = 1; i < 4; i++) {
+		if (dists[i] > dists[0] || (dists[i] == dists[0] && lanes[i] < maxIndex)) {
+			dists[0] = dists[i];
+			maxIndex = lanes[i];
+		}
+	}
+#else
+	float maxDist = -FLT_MAX;
+	for (int i = 0; i < num; i++) {
+		const float dist = weights.x * qx[i] + weights.y * qy[i] + weights.z * qz[i];
+		if (dist > maxDist) {
+			maxDist = dist;
+			maxIndex = i;
+		}
+	}
+#endif
+
+	return Vec3(
+		origin.x + qx[maxIndex] * step.x,
+		origin.y + qy[maxIndex] * step.y,
+		origin.z + qz[maxIndex] * step.z);
+}
+
 float DistanceFromLine(const Vec3& a, const Vec3& b, const Vec3& pt)
 {
 	Vec3 ab = b - a;
@@ -97,236 +192,722 @@ void BuildTetrahedron(const Vec3* verts, const int num, std::vector<Vec3>& hullP
 	hullTris.push_back(Tri{ 1, 0, 3 });
 }
 
-void RemoveInternalPoints(const std::vector<Vec3>& hullPoints, const std::vector<Tri>& hullTris, std::vector<Vec3>& checkPts)
+/*
+================================================================
+Quickhull
+
+Every face keeps the list of points in front of it (its conflict list) and
+its three neighbours, edge i going from v[i] to v[(i + 1) % 3].  The furthest
+point of a conflict list is added by removing the faces it can see and
+joining it to the horizon, the loop of edges between seen and unseen faces.
+Points that no new face can see are inside and are dropped for good, as are
+points within the plane tolerance, so flat input doesn't add vertices.
+================================================================
+*/
+
+struct HullFace {
+	int v[3];
+	int adj[3];
+	Vec3 normal;
+	float dist;
+	int firstConflict;
+	bool isDeleted;
+};
+
+struct HorizonEdge {
+	int a;
+	int b;
+	int outsideFace;
+};
+
+// Below this, distributing points to faces isn't worth waking the workers
+static const int minParallelHullPoints = 4096;
+
+// Flat, collinear or coincident input is given this thickness, a hull needs a volume
+static const float minHullThickness = 0.01f;
+
+static float HullFaceDistance(const HullFace& face, const Vec3& pt)
 {
-	for (int i = 0; i < checkPts.size(); i++) {
-		const Vec3& pt = checkPts[i];
-
-		bool isExternal = false;
-		for (int t = 0; t < hullTris.size(); t++) {
-			const Tri& tri = hullTris[t];
-			const Vec3& a = hullPoints[tri.a];
-			const Vec3& b = hullPoints[tri.b];
-			const Vec3& c = hullPoints[tri.c];
-
-			// If the point is in front of any triangle then it's external
-			float dist = DistanceFromTriangle(a, b, c, pt);
-			if (dist > 0.0f) {
-				isExternal = true;
-				break;
-			}
-		}
+	return face.normal.Dot(pt) - face.dist;
+}
 
-		// If it's not external, then it's inside the polyhedron and should be removed
-		if (!isExternal) {
-			checkPts.erase(checkPts.begin() + i);
-			i--;
+static int AddHullFace(std::vector<HullFace>& faces, const Vec3* verts, const int a, const int b, const int c)
+{
+	HullFace face;
+	face.v[0] = a;
+	face.v[1] = b;
+	face.v[2] = c;
+	face.adj[0] = -1;
+	face.adj[1] = -1;
+	face.adj[2] = -1;
+	face.normal = (verts[b] - verts[a]).Cross(verts[c] - verts[a]);
+	face.normal.Normalize();
+	face.dist = face.normal.Dot(verts[a]);
+	face.firstConflict = -1;
+	face.isDeleted = false;
+	faces.push_back(face);
+	return (int)faces.size() - 1;
+}
+
+// Index of the edge of the face that goes from a to b
+static int FindHullFaceEdge(const HullFace& face, const int a, const int b)
+{
+	for (int i = 0; i < 3; i++) {
+		if (face.v[i] == a && face.v[(i + 1) % 3] == b) {
+			return i;
 		}
 	}
+	return -1;
+}
 
-	// Also remove any points that are just a little too close to the hull points
-	for (int i = 0; i < checkPts.size(); i++) {
-		const Vec3& pt = checkPts[i];
-
-		bool isTooClose = false;
-		for (int j = 0; j < hullPoints.size(); j++) {
-			Vec3 hullPt = hullPoints[j];
-			Vec3 ray = hullPt - pt;
-			// 1cm is too close
-			if (ray.GetLengthSqr() < 0.01f * 0.01f) {
-				isTooClose = true;
-				break;
+// Puts each point on the conflict list of the face it is furthest in front of
+static void AssignConflicts(std::vector<HullFace>& faces, const Vec3* verts, const int* pts, const int numPts, const int* candidateFaces, const int numCandidates, const float epsilon, std::vector<int>& nextConflict)
+{
+	auto findFace = [&](const int pt) {
+		int best = -1;
+		float bestDist = epsilon;
+		for (int i = 0; i < numCandidates; i++) {
+			const float dist = HullFaceDistance(faces[candidateFaces[i]], verts[pt]);
+			if (dist > bestDist) {
+				bestDist = dist;
+				best = candidateFaces[i];
 			}
 		}
+		return best;
+	};
+
+	if (numPts < minParallelHullPoints) {
+		for (int i = 0; i < numPts; i++) {
+			const int face = findFace(pts[i]);
+			if (face >= 0) {
+				nextConflict[pts[i]] = faces[face].firstConflict;
+				faces[face].firstConflict = pts[i];
+			}
+		}
+		return;
+	}
 
-		if (isTooClose) {
-			checkPts.erase(checkPts.begin() + i);
-			i--;
+	// Faces are found in parallel, then linked in point order so the hull doesn't depend on the thread count
+	std::vector<int> pointFaces(numPts);
+	GetThreadPool().ParallelFor(numPts, 1024, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			pointFaces[i] = findFace(pts[i]);
+		}
+	});
+	for (int i = 0; i < numPts; i++) {
+		const int face = pointFaces[i];
+		if (face >= 0) {
+			nextConflict[pts[i]] = faces[face].firstConflict;
+			faces[face].firstConflict = pts[i];
 		}
 	}
 }
 
-bool IsEdgeUnique(const std::vector<Tri>& tris, const std::vector<int>& facingTris, const int ignoreTri, const Edge& edge)
+// Edges between a seen and an unseen face, chained end to start.
+// Anything but a single loop means the seen region isn't a disc.
+static bool BuildHorizon(const std::vector<HullFace>& faces, const std::vector<int>& visibleFaces, const std::vector<char>& visited, std::vector<HorizonEdge>& horizon, std::vector<int>& edgeFromVert)
 {
-	for (int i = 0; i < facingTris.size(); i++) {
-		const int triIdx = facingTris[i];
-		if (ignoreTri == triIdx) {
-			continue;
+	horizon.clear();
+	for (int i = 0; i < (int)visibleFaces.size(); i++) {
+		const HullFace& face = faces[visibleFaces[i]];
+		for (int e = 0; e < 3; e++) {
+			if (!visited[face.adj[e]]) {
+				horizon.push_back(HorizonEdge{ face.v[e], face.v[(e + 1) % 3], face.adj[e] });
+			}
 		}
+	}
 
-		const Tri& tri = tris[triIdx];
-
-		Edge edges[3];
-		edges[0].a = tri.a;
-		edges[0].b = tri.b;
+	bool isLoop = (horizon.size() >= 3);
+	for (int i = 0; i < (int)horizon.size(); i++) {
+		if (-1 != edgeFromVert[horizon[i].a]) {
+			isLoop = false;
+		}
+		edgeFromVert[horizon[i].a] = i;
+	}
+	for (int i = 0; isLoop && i + 1 < (int)horizon.size(); i++) {
+		const int next = edgeFromVert[horizon[i].b];
+		if (next <= i) {
+			isLoop = false;
+			break;
+		}
+		std::swap(horizon[i + 1], horizon[next]);
+		edgeFromVert[horizon[next].a] = next;
+		edgeFromVert[horizon[i + 1].a] = i + 1;
+	}
+	if (isLoop && horizon.back().b != horizon.front().a) {
+		isLoop = false;
+	}
 
-		edges[1].a = tri.b;
-		edges[1].b = tri.c;
+	for (int i = 0; i < (int)horizon.size(); i++) {
+		edgeFromVert[horizon[i].a] = -1;
+	}
+	return isLoop;
+}
 
-		edges[2].a = tri.c;
-		edges[2].b = tri.a;
+// Collects the faces seen from the eye and the horizon around them.
+// An unseen neighbour that would make a reflex edge with its new face is merged
+// into the seen faces, this happens when the eye is barely in front of the hull.
+// So is one on two horizon edges with the eye in its plane, its new faces would fold.
+static bool FindHorizon(const std::vector<HullFace>& faces, const Vec3* pts, const int eye, const int firstFace, const float epsilon, std::vector<int>& visibleFaces, std::vector<HorizonEdge>& horizon, std::vector<int>& stack, std::vector<char>& visited, std::vector<int>& edgeFromVert)
+{
+	// Flood through the adjacency from the face the eye was found for
+	visibleFaces.clear();
+	visited[firstFace] = 1;
+	visibleFaces.push_back(firstFace);
+	stack.clear();
+	stack.push_back(firstFace);
+	while (!stack.empty()) {
+		const int faceIdx = stack.back();
+		stack.pop_back();
 
 		for (int e = 0; e < 3; e++) {
-			if (edge == edges[e]) {
-				return false;
+			const int adj = faces[faceIdx].adj[e];
+			if (!visited[adj] && HullFaceDistance(faces[adj], pts[eye]) > epsilon) {
+				visited[adj] = 1;
+				visibleFaces.push_back(adj);
+				stack.push_back(adj);
 			}
 		}
 	}
-	return true;
-}
-
-void AddPoint(std::vector<Vec3>& hullPoints, std::vector<Tri>& hullTris, const Vec3& pt)
-{
-	// This point is outside
-	// Now we need to remove old triangles and build new ones
 
-	// Find all the triangles that face this point
-	std::vector< int > facingTris;
-	for (int i = (int)hullTris.size() - 1; i >= 0; i--) {
-		const Tri& tri = hullTris[i];
+	bool isLoop = BuildHorizon(faces, visibleFaces, visited, horizon, edgeFromVert);
+	while (isLoop) {
+		const int numVisible = (int)visibleFaces.size();
+		for (int i = 0; i < (int)horizon.size(); i++) {
+			const HorizonEdge& edge = horizon[i];
+			const HullFace& outside = faces[edge.outsideFace];
+			if (visited[edge.outsideFace]) {
+				continue;
+			}
 
-		const Vec3& a = hullPoints[tri.a];
-		const Vec3& b = hullPoints[tri.b];
-		const Vec3& c = hullPoints[tri.c];
+			Vec3 normal = (pts[edge.b] - pts[edge.a]).Cross(pts[eye] - pts[edge.a]);
+			normal.Normalize();
+			const int far = outside.v[(FindHullFaceEdge(outside, edge.b, edge.a) + 2) % 3];
+			bool isFolded = false;
+			if (HullFaceDistance(outside, pts[eye]) > -epsilon) {
+				for (int j = 0; j < (int)horizon.size() && !isFolded; j++) {
+					isFolded = (j != i && horizon[j].outsideFace == edge.outsideFace);
+				}
+			}
+			if (isFolded || normal.Dot(pts[far] - pts[edge.a]) > epsilon) {
+				visited[edge.outsideFace] = 1;
+				visibleFaces.push_back(edge.outsideFace);
+			}
+		}
+		if ((int)visibleFaces.size() == numVisible) {
+			break;
+		}
 
-		const float dist = DistanceFromTriangle(a, b, c, pt);
-		if (dist > 0.0f) {
-			facingTris.push_back(i);
+		// Keep the last good horizon when merging would pinch the seen region
+		if (!BuildHorizon(faces, visibleFaces, visited, horizon, edgeFromVert)) {
+			for (int i = numVisible; i < (int)visibleFaces.size(); i++) {
+				visited[visibleFaces[i]] = 0;
+			}
+			visibleFaces.resize(numVisible);
+			BuildHorizon(faces, visibleFaces, visited, horizon, edgeFromVert);
+			break;
 		}
 	}
 
-	// Now find all edges that are unique to the tris, these will be the edges that form the new triangles
-	std::vector<Edge> uniqueEdges;
-	for (int i = 0; i < facingTris.size(); i++) {
-		const int triIdx = facingTris[i];
-		const Tri& tri = hullTris[triIdx];
+	for (int i = 0; i < (int)visibleFaces.size(); i++) {
+		visited[visibleFaces[i]] = 0;
+	}
+	return isLoop;
+}
 
-		Edge edges[3];
-		edges[0].a = tri.a;
-		edges[0].b = tri.b;
+void BuildConvexHull(
+	const std::vector<Vec3>& verts,
+	std::vector<Vec3>& hullPts,
+	std::vector<Tri>& hullTris
+) {
+	hullPts.clear();
+	hullTris.clear();
+	if (verts.empty()) {
+		return;
+	}
 
-		edges[1].a = tri.b;
-		edges[1].b = tri.c;
+	const int numVerts = (int)verts.size();
 
-		edges[2].a = tri.c;
-		edges[2].b = tri.a;
+	// Work around the middle of the points, planes far from the origin lose their precision
+	Bounds bounds;
+	bounds.Expand(verts.data(), numVerts);
+	const Vec3 center = (bounds.mins + bounds.maxs) * 0.5f;
+	std::vector<Vec3> centered(numVerts);
+	for (int i = 0; i < numVerts; i++) {
+		centered[i] = verts[i] - center;
+	}
+	Vec3* pts = centered.data();
+
+	// Plane tolerance from the float precision at the size of the input
+	const Vec3 extents = (bounds.maxs - bounds.mins) * 0.5f;
+	const float epsilon = 3.0f * FLT_EPSILON * (extents.x + extents.y + extents.z);
+
+	// Initial tetrahedron, same picks as BuildTetrahedron but kept as indices
+	int tetra[4];
+	tetra[0] = FindPointFurthestInDir(pts, numVerts, Vec3(1, 0, 0));
+	tetra[1] = FindPointFurthestInDir(pts, numVerts, pts[tetra[0]] * -1.0f);
+	tetra[2] = 0;
+	tetra[3] = 0;
+	float lineDist = -1.0f;
+	for (int i = 0; i < numVerts; i++) {
+		const float dist = DistanceFromLine(pts[tetra[0]], pts[tetra[1]], pts[i]);
+		if (dist > lineDist) {
+			lineDist = dist;
+			tetra[2] = i;
+		}
+	}
+	float maxDist = 0.0f;
+	for (int i = 0; i < numVerts; i++) {
+		const float dist = DistanceFromTriangle(pts[tetra[0]], pts[tetra[1]], pts[tetra[2]], pts[i]);
+		if (dist * dist > maxDist * maxDist) {
+			maxDist = dist;
+			tetra[3] = i;
+		}
+	}
 
-		for (int e = 0; e < 3; e++) {
-			if (IsEdgeUnique(hullTris, facingTris, triIdx, edges[e])) {
-				uniqueEdges.push_back(edges[e]);
+	// No volume to grow, thicken the input across the directions it's missing and build that instead
+	Vec3 axes[3];
+	int numAxes = 0;
+	const Vec3 line = pts[tetra[1]] - pts[tetra[0]];
+	if (line.GetMagnitude() <= epsilon) {
+		axes[0] = Vec3(1, 0, 0);
+		axes[1] = Vec3(0, 1, 0);
+		axes[2] = Vec3(0, 0, 1);
+		numAxes = 3;
+	} else if (lineDist <= epsilon) {
+		line.GetOrtho(axes[0], axes[1]);
+		numAxes = 2;
+	} else if (fabsf(maxDist) <= epsilon) {
+		axes[0] = line.Cross(pts[tetra[2]] - pts[tetra[0]]);
+		axes[0].Normalize();
+		numAxes = 1;
+	}
+	if (numAxes > 0) {
+		const float halfThickness = 0.5f * std::max(minHullThickness, 64.0f * epsilon);
+		const int numCorners = 1 << numAxes;
+		std::vector<Vec3> thickened;
+		thickened.reserve(numVerts * numCorners);
+		for (int i = 0; i < numVerts; i++) {
+			for (int corner = 0; corner < numCorners; corner++) {
+				Vec3 pt = verts[i];
+				for (int k = 0; k < numAxes; k++) {
+					pt += axes[k] * (((corner >> k) & 1) ? halfThickness : -halfThickness);
+				}
+				thickened.push_back(pt);
 			}
 		}
+		BuildConvexHull(thickened, hullPts, hullTris);
+		return;
 	}
 
-	// now remove the old facing tris
-	for (int i = 0; i < facingTris.size(); i++) {
-		hullTris.erase(hullTris.begin() + facingTris[i]);
+	// This is important for making sure the ordering is CCW for all faces.
+	if (maxDist > 0.0f) {
+		std::swap(tetra[0], tetra[1]);
 	}
 
-	// Now add the new point
-	hullPoints.push_back(pt);
-	const int newPtIdx = (int)hullPoints.size() - 1;
-
-	// Now add triangles for each unique edge
-	for (int i = 0; i < uniqueEdges.size(); i++) {
-		const Edge& edge = uniqueEdges[i];
+	std::vector<HullFace> faces;
+	faces.reserve(4 * numVerts);
+	AddHullFace(faces, pts, tetra[0], tetra[1], tetra[2]);
+	AddHullFace(faces, pts, tetra[0], tetra[2], tetra[3]);
+	AddHullFace(faces, pts, tetra[2], tetra[1], tetra[3]);
+	AddHullFace(faces, pts, tetra[1], tetra[0], tetra[3]);
+	for (int f = 0; f < 4; f++) {
+		for (int e = 0; e < 3; e++) {
+			const int a = faces[f].v[e];
+			const int b = faces[f].v[(e + 1) % 3];
+			for (int g = 0; g < 4; g++) {
+				if (g != f && FindHullFaceEdge(faces[g], b, a) >= 0) {
+					faces[f].adj[e] = g;
+				}
+			}
+		}
+	}
 
-		Tri tri;
-		tri.a = edge.a;
-		tri.b = edge.b;
-		tri.c = newPtIdx;
-		hullTris.push_back(tri);
+	std::vector<int> nextConflict(numVerts, -1);
+	{
+		std::vector<int> remaining;
+		remaining.reserve(numVerts);
+		for (int i = 0; i < numVerts; i++) {
+			if (i != tetra[0] && i != tetra[1] && i != tetra[2] && i != tetra[3]) {
+				remaining.push_back(i);
+			}
+		}
+		const int initialFaces[4] = { 0, 1, 2, 3 };
+		AssignConflicts(faces, pts, remaining.data(), (int)remaining.size(), initialFaces, 4, epsilon, nextConflict);
 	}
-}
 
-void RemoveUnreferencedVerts(std::vector<Vec3>& hullPoints, std::vector<Tri>& hullTris)
-{
-	for (int i = 0; i < hullPoints.size(); i++) {
+	// New faces go to the back, so a single pass reaches every conflict list.
+	// Points the horizon failed for are deferred to another pass over the grown hull.
+	std::vector<int> visibleFaces;
+	std::vector<HorizonEdge> horizon;
+	std::vector<int> stack;
+	std::vector<char> visited;
+	std::vector<int> newFaces;
+	std::vector<int> orphans;
+	std::vector<int> edgeFromVert(numVerts, -1);
+	std::vector<int> deferred;
+	std::vector<int> deferredFaces;
+	std::vector<int> liveFaces;
+	while (true) {
+		int numAdded = 0;
+		for (int faceIdx = 0; faceIdx < (int)faces.size(); faceIdx++) {
+			while (!faces[faceIdx].isDeleted && -1 != faces[faceIdx].firstConflict) {
+				// The furthest point in front of the face is on the final hull
+				int eye = -1;
+				float eyeDist = -1.0f;
+				for (int pt = faces[faceIdx].firstConflict; pt != -1; pt = nextConflict[pt]) {
+					const float dist = HullFaceDistance(faces[faceIdx], pts[pt]);
+					if (dist > eyeDist) {
+						eyeDist = dist;
+						eye = pt;
+					}
+				}
+
+				visited.resize(faces.size(), 0);
+				if (!FindHorizon(faces, pts, eye, faceIdx, epsilon, visibleFaces, horizon, stack, visited, edgeFromVert)) {
+					// Numerically broken around this point, try it again once the hull has grown
+					int* link = &faces[faceIdx].firstConflict;
+					while (*link != eye) {
+						link = &nextConflict[*link];
+					}
+					*link = nextConflict[eye];
+					deferred.push_back(eye);
+					deferredFaces.push_back(faceIdx);
+					continue;
+				}
+
+				// Join the horizon to the eye
+				newFaces.clear();
+				for (int i = 0; i < (int)horizon.size(); i++) {
+					const HorizonEdge& edge = horizon[i];
+					const int newFace = AddHullFace(faces, pts, edge.a, edge.b, eye);
+					faces[newFace].adj[0] = edge.outsideFace;
+					HullFace& outside = faces[edge.outsideFace];
+					outside.adj[FindHullFaceEdge(outside, edge.b, edge.a)] = newFace;
+					newFaces.push_back(newFace);
+				}
+				const int numNew = (int)newFaces.size();
+				for (int i = 0; i < numNew; i++) {
+					faces[newFaces[i]].adj[1] = newFaces[(i + 1) % numNew];
+					faces[newFaces[i]].adj[2] = newFaces[(i + numNew - 1) % numNew];
+				}
+
+				// Hand the points of the removed faces over to the new ones
+				orphans.clear();
+				for (int i = 0; i < (int)visibleFaces.size(); i++) {
+					HullFace& face = faces[visibleFaces[i]];
+					face.isDeleted = true;
+					for (int pt = face.firstConflict; pt != -1; pt = nextConflict[pt]) {
+						if (pt != eye) {
+							orphans.push_back(pt);
+						}
+					}
+					face.firstConflict = -1;
+				}
+				AssignConflicts(faces, pts, orphans.data(), (int)orphans.size(), newFaces.data(), numNew, epsilon, nextConflict);
+				numAdded++;
+			}
+		}
 
-		bool isUsed = false;
-		for (int j = 0; j < hullTris.size(); j++) {
-			const Tri& tri = hullTris[j];
+		if (deferred.empty()) {
+			break;
+		}
 
-			if (tri.a == i || tri.b == i || tri.c == i) {
-				isUsed = true;
-				break;
+		// Nothing went in, so the same points would fail again. They're barely in front of
+		// the hull, lift them off their faces. Their height doubles every pass and far enough
+		// out the seen faces always make a disc. The hull grows by the lift, it still holds the input.
+		if (0 == numAdded) {
+			for (int i = 0; i < (int)deferred.size(); i++) {
+				const HullFace& face = faces[deferredFaces[i]];
+				pts[deferred[i]] += face.normal * std::max(HullFaceDistance(face, pts[deferred[i]]), epsilon);
 			}
 		}
 
-		if (isUsed) {
+		// Points the hull has grown over since are inside and dropped
+		liveFaces.clear();
+		for (int i = 0; i < (int)faces.size(); i++) {
+			if (!faces[i].isDeleted) {
+				liveFaces.push_back(i);
+			}
+		}
+		AssignConflicts(faces, pts, deferred.data(), (int)deferred.size(), liveFaces.data(), (int)liveFaces.size(), epsilon, nextConflict);
+		deferred.clear();
+		deferredFaces.clear();
+	}
+
+	// Keep only the points used by the faces
+	std::vector<int> remap(numVerts, -1);
+	for (int i = 0; i < (int)faces.size(); i++) {
+		const HullFace& face = faces[i];
+		if (face.isDeleted) {
 			continue;
 		}
 
-		for (int j = 0; j < hullTris.size(); j++) {
-			Tri& tri = hullTris[j];
-			if (tri.a > i) {
-				tri.a--;
-			}
-			if (tri.b > i) {
-				tri.b--;
-			}
-			if (tri.c > i) {
-				tri.c--;
+		int idx[3];
+		for (int k = 0; k < 3; k++) {
+			if (-1 == remap[face.v[k]]) {
+				remap[face.v[k]] = (int)hullPts.size();
+				hullPts.push_back(verts[face.v[k]] + (pts[face.v[k]] - (verts[face.v[k]] - center)));
 			}
+			idx[k] = remap[face.v[k]];
 		}
+		hullTris.push_back(Tri{ idx[0], idx[1], idx[2] });
+	}
+}
 
-		hullPoints.erase(hullPoints.begin() + i);
-		i--;
+bool IsExternal(const std::vector< Vec3 >& pts, const std::vector<Tri>& tris, const Vec3& pt)
+{
+	bool isExternal = false;
+	for (int t = 0; t < tris.size(); t++) {
+		const Tri& tri = tris[t];
+		const Vec3& a = pts[tri.a];
+		const Vec3& b = pts[tri.b];
+		const Vec3& c = pts[tri.c];
+
+		// If the point is in front of any triangle then it's external
+		float dist = DistanceFromTriangle(a, b, c, pt);
+		if (dist > 0.0f) {
+			isExternal = true;
+			break;
+		}
 	}
+
+	return isExternal;
 }
 
-void ExpandConvexHull(std::vector<Vec3>& hullPoints, std::vector<Tri>& hullTris, const std::vector<Vec3>& verts)
+/*
+ * Hull simplification
+ */
+
+// Supporting plane, normal . x <= dist around the hull center
+struct SimplifyPlane
 {
-	std::vector< Vec3 > externalVerts = verts;
-	RemoveInternalPoints(hullPoints, hullTris, externalVerts);
+	Vec3 normal;
+	float dist;
+};
 
-	while (externalVerts.size() > 0) {
-		int ptIdx = FindPointFurthestInDir(externalVerts.data(), (int)externalVerts.size(), externalVerts[0]);
+static Vec3 ClosestPointOnTriangle(const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& pt)
+{
+	// Voronoi regions of the vertices, then the edges, then the face
+	const Vec3 ab = b - a;
+	const Vec3 ac = c - a;
+	const Vec3 ap = pt - a;
+	const float d1 = ab.Dot(ap);
+	const float d2 = ac.Dot(ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		return a;
+	}
 
-		Vec3 pt = externalVerts[ptIdx];
+	const Vec3 bp = pt - b;
+	const float d3 = ab.Dot(bp);
+	const float d4 = ac.Dot(bp);
+	if (d3 >= 0.0f && d4 <= d3) {
+		return b;
+	}
 
-		// Remove this element
-		externalVerts.erase(externalVerts.begin() + ptIdx);
+	const float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		return a + ab * (d1 / (d1 - d3));
+	}
 
-		AddPoint(hullPoints, hullTris, pt);
+	const Vec3 cp = pt - c;
+	const float d5 = ab.Dot(cp);
+	const float d6 = ac.Dot(cp);
+	if (d6 >= 0.0f && d5 <= d6) {
+		return c;
+	}
+
+	const float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		return a + ac * (d2 / (d2 - d6));
+	}
 
-		RemoveInternalPoints(hullPoints, hullTris, externalVerts);
+	const float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
 	}
 
-	RemoveUnreferencedVerts(hullPoints, hullTris);
+	const float denom = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
 }
 
-void BuildConvexHull(
+// Distance from a point to the hull, zero inside
+static float DistanceToHull(const std::vector<Vec3>& pts, const std::vector<Tri>& tris, const std::vector<SimplifyPlane>& planes, const Vec3& pt)
+{
+	bool isInside = true;
+	for (int i = 0; i < (int)planes.size() && isInside; i++) {
+		isInside = planes[i].normal.Dot(pt) <= planes[i].dist;
+	}
+	if (isInside) {
+		return 0.0f;
+	}
+
+	// From outside the closest point is on the surface
+	float minDistSqr = FLT_MAX;
+	for (int i = 0; i < (int)tris.size(); i++) {
+		const Vec3 closest = ClosestPointOnTriangle(pts[tris[i].a], pts[tris[i].b], pts[tris[i].c], pt);
+		minDistSqr = std::min(minDistSqr, (closest - pt).GetLengthSqr());
+	}
+	return sqrtf(minDistSqr);
+}
+
+// Vertices of the intersection of the planes. They are the faces of the hull of the dual
+// points normal / dist, which needs the origin strictly inside every plane.
+static void IntersectPlanes(const std::vector<SimplifyPlane>& planes, const float mergeDist, std::vector<Vec3>& verts)
+{
+	std::vector<Vec3> dual(planes.size());
+	for (int i = 0; i < (int)planes.size(); i++) {
+		dual[i] = planes[i].normal / planes[i].dist;
+	}
+
+	std::vector<Vec3> dualPts;
+	std::vector<Tri> dualTris;
+	BuildConvexHull(dual, dualPts, dualTris);
+
+	// Coplanar dual faces give the same vertex, several planes meeting at a point
+	verts.clear();
+	for (int i = 0; i < (int)dualTris.size(); i++) {
+		const Vec3& a = dualPts[dualTris[i].a];
+		const Vec3& b = dualPts[dualTris[i].b];
+		const Vec3& c = dualPts[dualTris[i].c];
+		Vec3 normal = (b - a).Cross(c - a);
+		if (normal.GetLengthSqr() <= 0.0f) {
+			continue;
+		}
+		normal.Normalize();
+
+		const float dist = normal.Dot(a);
+		if (dist <= 0.0f) {
+			continue;
+		}
+
+		const Vec3 vert = normal / dist;
+		bool isMerged = false;
+		for (int v = 0; v < (int)verts.size() && !isMerged; v++) {
+			isMerged = (verts[v] - vert).GetLengthSqr() <= mergeDist * mergeDist;
+		}
+		if (!isMerged) {
+			verts.push_back(vert);
+		}
+	}
+}
+
+float SimplifyConvexHull(
 	const std::vector<Vec3>& verts,
+	const HullSimplification& simplification,
 	std::vector<Vec3>& hullPts,
 	std::vector<Tri>& hullTris
 ) {
-	if (verts.size() < 4) {
-		return;
+	BuildConvexHull(verts, hullPts, hullTris);
+
+	const int numHullPts = (int)hullPts.size();
+	const bool hasPointBudget = simplification.maxPoints > 0 && simplification.maxPoints < numHullPts;
+	const bool hasErrorBudget = simplification.maxError > 0.0f;
+	if (numHullPts < 4 || (!hasPointBudget && !hasErrorBudget)) {
+		return 0.0f;
 	}
 
-	// Build a tetrahedron
-	BuildTetrahedron(verts.data(), (int)verts.size(), hullPts, hullTris);
+	// Planes through the middle of the hull, so the origin is inside all of them
+	Vec3 center(0.0f);
+	for (int i = 0; i < numHullPts; i++) {
+		center += hullPts[i];
+	}
+	center /= (float)numHullPts;
 
-	ExpandConvexHull(hullPts, hullTris, verts);
-}
+	std::vector<Vec3> pts(numHullPts);
+	for (int i = 0; i < numHullPts; i++) {
+		pts[i] = hullPts[i] - center;
+	}
 
-bool IsExternal(const std::vector< Vec3 >& pts, const std::vector<Tri>& tris, const Vec3& pt)
-{
-	bool isExternal = false;
-	for (int t = 0; t < tris.size(); t++) {
-		const Tri& tri = tris[t];
-		const Vec3& a = pts[tri.a];
-		const Vec3& b = pts[tri.b];
-		const Vec3& c = pts[tri.c];
+	std::vector<SimplifyPlane> hullPlanes;
+	hullPlanes.reserve(hullTris.size());
+	for (int i = 0; i < (int)hullTris.size(); i++) {
+		const Vec3& a = pts[hullTris[i].a];
+		Vec3 normal = (pts[hullTris[i].b] - a).Cross(pts[hullTris[i].c] - a);
+		if (normal.GetLengthSqr() <= 0.0f) {
+			continue;
+		}
+		normal.Normalize();
+		hullPlanes.push_back(SimplifyPlane{ normal, normal.Dot(a) });
+	}
 
-		// If the point is in front of any triangle then it's external
-		float dist = DistanceFromTriangle(a, b, c, pt);
-		if (dist > 0.0f) {
-			isExternal = true;
+	Bounds bounds;
+	bounds.Expand(pts.data(), numHullPts);
+	const Vec3 extents = bounds.maxs - bounds.mins;
+	const float size = extents.x + extents.y + extents.z;
+	const float mergeDist = 1e-5f * size;
+	const float minError = 1e-5f * size;
+
+	// Planes move out a little, so rounding in the intersections can't cut into the hull
+	const float slack = mergeDist;
+
+	// Degenerate hulls have nothing to simplify
+	for (int axis = 0; axis < 3; axis++) {
+		if (bounds.mins[axis] >= 0.0f || bounds.maxs[axis] <= 0.0f) {
+			return 0.0f;
+		}
+	}
+
+	// Start from the bounds, the coarsest conservative hull
+	std::vector<SimplifyPlane> planes;
+	for (int axis = 0; axis < 3; axis++) {
+		Vec3 normal(0.0f);
+		normal[axis] = 1.0f;
+		planes.push_back(SimplifyPlane{ normal, bounds.maxs[axis] + slack });
+		planes.push_back(SimplifyPlane{ normal * -1.0f, -bounds.mins[axis] + slack });
+	}
+
+	std::vector<Vec3> simplified;
+	std::vector<Vec3> candidate;
+	float error = FLT_MAX;
+	while (true) {
+		IntersectPlanes(planes, mergeDist, candidate);
+		if (!simplified.empty() && hasPointBudget && (int)candidate.size() > simplification.maxPoints) {
+			break;
+		}
+
+		// The furthest vertex sets the error, distance to a convex set peaks at a vertex
+		int furthest = 0;
+		float candidateError = 0.0f;
+		for (int i = 0; i < (int)candidate.size(); i++) {
+			const float dist = DistanceToHull(pts, hullTris, hullPlanes, candidate[i]);
+			if (dist > candidateError) {
+				candidateError = dist;
+				furthest = i;
+			}
+		}
+
+		simplified.swap(candidate);
+		error = candidateError;
+		if (error <= minError || (hasErrorBudget && error <= simplification.maxError) || (int)simplified.size() >= numHullPts) {
+			break;
+		}
+
+		// Cut the furthest vertex with the hull plane it is the most outside of. Within
+		// twice the slack the plane is there already, rounding only put the vertex out.
+		int best = -1;
+		float bestDist = 2.0f * slack;
+		for (int i = 0; i < (int)hullPlanes.size(); i++) {
+			const float dist = hullPlanes[i].normal.Dot(simplified[furthest]) - hullPlanes[i].dist;
+			if (dist > bestDist) {
+				bestDist = dist;
+				best = i;
+			}
+		}
+		if (best < 0) {
 			break;
 		}
+		planes.push_back(SimplifyPlane{ hullPlanes[best].normal, hullPlanes[best].dist + slack });
 	}
 
-	return isExternal;
+	// Not worth it when the full hull is as small, it is still in the output
+	if ((int)simplified.size() >= numHullPts) {
+		return 0.0f;
+	}
+
+	for (int i = 0; i < (int)simplified.size(); i++) {
+		simplified[i] += center;
+	}
+	BuildConvexHull(simplified, hullPts, hullTris);
+	return error;
 }
\ No newline at end of file
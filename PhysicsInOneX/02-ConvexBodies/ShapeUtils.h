@@ -19,6 +19,15 @@ struct Edge {
 
 int FindPointFurthestInDir(const Vec3* pts, const int num, const Vec3& dir);
 
+// Compact hull points, 16 bit coordinates over the hull bounds: point = origin + q * step.
+// The x, y and z coordinates are each a block of num entries, num a multiple of the padding.
+static const int quantizedPointPadding = 8;
+int PadQuantizedPointCount(const int num);
+void QuantizePoints(const Vec3* pts, const int num, const Vec3& origin, const Vec3& step, unsigned short* quantized);
+
+// Furthest compact point along dir, dequantized
+Vec3 SupportQuantized(const unsigned short* quantized, const int num, const Vec3& origin, const Vec3& step, const Vec3& dir);
+
 float DistanceFromLine(const Vec3& a, const Vec3& b, const Vec3& pt);
 
 Vec3 FindPointFurthestFromLine(const Vec3* pts, const int num, const Vec3& ptA, const Vec3& ptB);
@@ -29,21 +38,30 @@ Vec3 FindPointFurthestFromTriangle(const Vec3* pts, const int num, const Vec3& p
 
 void BuildTetrahedron(const Vec3* verts, const int num, std::vector<Vec3>& hullPts, std::vector<Tri>& hullTris);
 
-void RemoveInternalPoints(const std::vector<Vec3>& hullPoints, const std::vector<Tri>& hullTris, std::vector<Vec3>& checkPts);
-
-bool IsEdgeUnique(const std::vector<Tri>& tris, const std::vector<int>& facingTris, const int ignoreTri, const Edge& edge);
-
-void AddPoint(std::vector<Vec3>& hullPoints, std::vector<Tri>& hullTris, const Vec3& pt);
-
-void RemoveUnreferencedVerts(std::vector<Vec3>& hullPoints, std::vector<Tri>& hullTris);
-
-void ExpandConvexHull(std::vector<Vec3>& hullPoints, std::vector<Tri>& hullTris, const std::vector<Vec3>& verts);
-
 bool IsExternal(const std::vector<Vec3>& pts, const std::vector<Tri>& tris, const Vec3& pt);
 
+// Quickhull, the faces come out counter clockwise seen from outside.
+// Flat, collinear or coincident input is thickened to a centimetre, the hull always has a volume.
 void BuildConvexHull(
 	const std::vector<Vec3>& verts,
 	std::vector<Vec3>& hullPts,
 	std::vector<Tri>& hullTris
 );
 
+// Budget for a collision hull. Zero leaves that limit off, both zero keeps the full hull.
+struct HullSimplification
+{
+	int maxPoints{ 0 };
+	float maxError{ 0.0f };	// Distance the simplified hull may reach outside the input
+};
+
+// Conservative simplification, the result always contains the input points. Supporting
+// planes of the full hull are added until the error is within budget, or until one more
+// would go over the point count. Never fewer than the 8 corners of the bounds.
+// Returns the error introduced, the furthest the result reaches outside the full hull.
+float SimplifyConvexHull(
+	const std::vector<Vec3>& verts,
+	const HullSimplification& simplification,
+	std::vector<Vec3>& hullPts,
+	std::vector<Tri>& hullTris
+);
\ No newline at end of file
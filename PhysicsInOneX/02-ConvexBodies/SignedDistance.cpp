@@ -0,0 +1,256 @@
+#include "SignedDistance.h"
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include <unordered_map>
+#include "code/Math/Bounds.h"
+
+// Part of a triangle a closest point lies on
+enum TriFeature
+{
+	FEATURE_VERTEX_A,
+	FEATURE_VERTEX_B,
+	FEATURE_VERTEX_C,
+	FEATURE_EDGE_AB,
+	FEATURE_EDGE_BC,
+	FEATURE_EDGE_CA,
+	FEATURE_FACE,
+	NUM_FEATURES
+};
+
+// Welded corners and the pseudo normal of each feature
+struct SdfTriangle
+{
+	Vec3 corners[3];
+	Vec3 normals[NUM_FEATURES];
+};
+
+// From Ericson's Real-Time Collision Detection, with the feature the point lies on
+static Vec3 ClosestPointOnTriangle(const Vec3& p, const Vec3& a, const Vec3& b, const Vec3& c, int& feature)
+{
+	const Vec3 ab = b - a;
+	const Vec3 ac = c - a;
+	const Vec3 ap = p - a;
+	const float d1 = ab.Dot(ap);
+	const float d2 = ac.Dot(ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		feature = FEATURE_VERTEX_A;
+		return a;
+	}
+
+	const Vec3 bp = p - b;
+	const float d3 = ab.Dot(bp);
+	const float d4 = ac.Dot(bp);
+	if (d3 >= 0.0f && d4 <= d3) {
+		feature = FEATURE_VERTEX_B;
+		return b;
+	}
+
+	const float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		feature = FEATURE_EDGE_AB;
+		return a + ab * (d1 / (d1 - d3));
+	}
+
+	const Vec3 cp = p - c;
+	const float d5 = ab.Dot(cp);
+	const float d6 = ac.Dot(cp);
+	if (d6 >= 0.0f && d5 <= d6) {
+		feature = FEATURE_VERTEX_C;
+		return c;
+	}
+
+	const float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		feature = FEATURE_EDGE_CA;
+		return a + ac * (d2 / (d2 - d6));
+	}
+
+	const float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+		feature = FEATURE_EDGE_BC;
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	}
+
+	const float denom = 1.0f / (va + vb + vc);
+	feature = FEATURE_FACE;
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+static Vec3 SafeNormalized(const Vec3& v)
+{
+	const float length = v.GetMagnitude();
+	return (length > 1e-12f) ? v / length : Vec3(0.0f);
+}
+
+// Pseudo normals of Baerentzen and Aanaes: the face normal, the sum of the two faces
+// along an edge, the faces around a vertex weighted by their angle there. The side of
+// any point is the sign along the pseudo normal of its closest feature.
+static void BuildSdfTriangles(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, std::vector<SdfTriangle>& sdfTris)
+{
+	// Split vertices would leave edges with a single face
+	std::vector<int> welded(numVerts);
+	std::unordered_map<unsigned long long, int> firstAt;
+	for (int i = 0; i < numVerts; i++) {
+		unsigned long long key = 14695981039346656037ULL;
+		const unsigned char* bytes = (const unsigned char*)&verts[i];
+		for (int b = 0; b < (int)sizeof(Vec3); b++) {
+			key = (key ^ bytes[b]) * 1099511628211ULL;
+		}
+		const auto it = firstAt.find(key);
+		if (it != firstAt.end() && memcmp(&verts[it->second], &verts[i], sizeof(Vec3)) == 0) {
+			welded[i] = it->second;
+		} else {
+			firstAt[key] = i;
+			welded[i] = i;
+		}
+	}
+
+	std::vector<Vec3> vertexNormals(numVerts, Vec3(0.0f));
+	std::unordered_map<unsigned long long, Vec3> edgeNormals;
+	sdfTris.clear();
+	sdfTris.reserve(numTris);
+	std::vector<int> triCorners;
+	triCorners.reserve(numTris * 3);
+	for (int i = 0; i < numTris; i++) {
+		const int v[3] = { welded[tris[i].a], welded[tris[i].b], welded[tris[i].c] };
+		const Vec3 faceNormal = SafeNormalized((verts[v[1]] - verts[v[0]]).Cross(verts[v[2]] - verts[v[0]]));
+		if (faceNormal.GetLengthSqr() == 0.0f) {
+			// Degenerate triangles are covered by their neighbours
+			continue;
+		}
+
+		SdfTriangle sdfTri;
+		for (int e = 0; e < 3; e++) {
+			sdfTri.corners[e] = verts[v[e]];
+
+			const Vec3 toNext = SafeNormalized(verts[v[(e + 1) % 3]] - verts[v[e]]);
+			const Vec3 toPrev = SafeNormalized(verts[v[(e + 2) % 3]] - verts[v[e]]);
+			const float angle = acosf(std::min(std::max(toNext.Dot(toPrev), -1.0f), 1.0f));
+			vertexNormals[v[e]] += faceNormal * angle;
+
+			const int lo = std::min(v[e], v[(e + 1) % 3]);
+			const int hi = std::max(v[e], v[(e + 1) % 3]);
+			edgeNormals[((unsigned long long)lo << 32) | (unsigned int)hi] += faceNormal;
+		}
+		sdfTri.normals[FEATURE_FACE] = faceNormal;
+		sdfTris.push_back(sdfTri);
+		triCorners.insert(triCorners.end(), v, v + 3);
+	}
+
+	for (int i = 0; i < (int)sdfTris.size(); i++) {
+		const int* v = &triCorners[i * 3];
+		for (int e = 0; e < 3; e++) {
+			sdfTris[i].normals[FEATURE_VERTEX_A + e] = vertexNormals[v[e]];
+
+			const int lo = std::min(v[e], v[(e + 1) % 3]);
+			const int hi = std::max(v[e], v[(e + 1) % 3]);
+			sdfTris[i].normals[FEATURE_EDGE_AB + e] = edgeNormals[((unsigned long long)lo << 32) | (unsigned int)hi];
+		}
+	}
+}
+
+// Signed distance to the closest of the given triangles
+static float SignedDistanceTo(const std::vector<SdfTriangle>& sdfTris, const int* candidates, const int numCandidates, const Vec3& pt)
+{
+	float minDistSqr = 1e30f;
+	float sign = 1.0f;
+	for (int i = 0; i < numCandidates; i++) {
+		const SdfTriangle& tri = sdfTris[candidates[i]];
+		int feature;
+		const Vec3 closest = ClosestPointOnTriangle(pt, tri.corners[0], tri.corners[1], tri.corners[2], feature);
+		const Vec3 delta = pt - closest;
+		const float distSqr = delta.GetLengthSqr();
+		if (distSqr < minDistSqr) {
+			minDistSqr = distSqr;
+			sign = (delta.Dot(tri.normals[feature]) < 0.0f) ? -1.0f : 1.0f;
+		}
+	}
+	return sign * sqrtf(minDistSqr);
+}
+
+void BakeSignedDistance(const Vec3* verts, const int numVerts, const Tri* tris, const int numTris, const SdfSettings& settings, SdfGrid& grid)
+{
+	std::vector<SdfTriangle> sdfTris;
+	BuildSdfTriangles(verts, numVerts, tris, numTris, sdfTris);
+
+	Bounds bounds;
+	bounds.Expand(verts, numVerts);
+	if (numVerts == 0) {
+		bounds.mins = Vec3(0.0f);
+		bounds.maxs = Vec3(0.0f);
+	}
+
+	// Padded so the samples on the border of the grid are out of the band
+	grid.cellSize = std::max(settings.cellSize, 1e-4f);
+	grid.band = std::max(settings.band, grid.cellSize);
+	const float padding = grid.band + grid.cellSize;
+	grid.origin = bounds.mins - Vec3(padding);
+	const float brickSize = SdfGrid::brickCells * grid.cellSize;
+	for (int axis = 0; axis < 3; axis++) {
+		const float extent = bounds.maxs[axis] - bounds.mins[axis] + 2.0f * padding;
+		grid.numBricks[axis] = std::max((int)ceilf(extent / brickSize), 1);
+	}
+
+	const int numBricks = grid.numBricks[0] * grid.numBricks[1] * grid.numBricks[2];
+	grid.brickSlots.assign(numBricks, -1);
+	grid.brickDistances.assign(numBricks, 0.0f);
+	grid.samples.clear();
+
+	if (sdfTris.empty()) {
+		grid.brickDistances.assign(numBricks, grid.band);
+		return;
+	}
+
+	const float halfDiagonal = 0.5f * sqrtf(3.0f) * brickSize;
+	std::vector<float> triDistances(sdfTris.size());
+	std::vector<int> candidates;
+	for (int bz = 0; bz < grid.numBricks[2]; bz++) {
+		for (int by = 0; by < grid.numBricks[1]; by++) {
+			for (int bx = 0; bx < grid.numBricks[0]; bx++) {
+				const int brick = (bz * grid.numBricks[1] + by) * grid.numBricks[0] + bx;
+				const Vec3 corner = grid.origin + Vec3((float)bx, (float)by, (float)bz) * brickSize;
+				const Vec3 center = corner + Vec3(0.5f * brickSize);
+
+				// One pass over the triangles for the distance of the center, kept to pick the candidates
+				float minDistSqr = 1e30f;
+				float sign = 1.0f;
+				for (int i = 0; i < (int)sdfTris.size(); i++) {
+					int feature;
+					const SdfTriangle& tri = sdfTris[i];
+					const Vec3 delta = center - ClosestPointOnTriangle(center, tri.corners[0], tri.corners[1], tri.corners[2], feature);
+					triDistances[i] = delta.GetLengthSqr();
+					if (triDistances[i] < minDistSqr) {
+						minDistSqr = triDistances[i];
+						sign = (delta.Dot(tri.normals[feature]) < 0.0f) ? -1.0f : 1.0f;
+					}
+				}
+				const float centerDistance = sqrtf(minDistSqr);
+				grid.brickDistances[brick] = sign * (centerDistance - halfDiagonal);
+				if (centerDistance > halfDiagonal + grid.band) {
+					continue;
+				}
+
+				// The closest triangle of any sample is no further than this from the center
+				const float reach = centerDistance + 2.0f * halfDiagonal;
+				candidates.clear();
+				for (int i = 0; i < (int)sdfTris.size(); i++) {
+					if (triDistances[i] <= reach * reach) {
+						candidates.push_back(i);
+					}
+				}
+
+				grid.brickSlots[brick] = (int)(grid.samples.size() / SdfGrid::samplesPerBrick);
+				for (int z = 0; z < SdfGrid::brickSamples; z++) {
+					for (int y = 0; y < SdfGrid::brickSamples; y++) {
+						for (int x = 0; x < SdfGrid::brickSamples; x++) {
+							const Vec3 pt = corner + Vec3((float)x, (float)y, (float)z) * grid.cellSize;
+							const float distance = SignedDistanceTo(sdfTris, candidates.data(), (int)candidates.size(), pt);
+							grid.samples.push_back(std::min(std::max(distance, -grid.band), grid.band));
+						}
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include "code/Math/Vector.h"
+#include "ShapeUtils.h"
+
+// Sparse signed distance to a closed triangle mesh, negative inside. The grid is cut into
+// bricks of brickCells cells a side. The bricks the surface passes near keep all their
+// samples, the others only a bound on the distance over the whole brick.
+struct SdfSettings
+{
+	float cellSize{ 0.1f };
+	float band{ 0.5f };		// Samples are clamped to it, keep it past the radius of the spheres and capsules
+};
+
+struct SdfGrid
+{
+	static const int brickCells = 7;
+	static const int brickSamples = brickCells + 1;	// Neighbouring bricks share their border samples
+	static const int samplesPerBrick = brickSamples * brickSamples * brickSamples;
+
+	Vec3 origin;						// Corner of the first brick
+	float cellSize;
+	float band;
+	int numBricks[3];
+	std::vector<int> brickSlots;		// Into the stored bricks, -1 for the bricks away from the surface
+	std::vector<float> brickDistances;	// Signed distance at the center, less the half diagonal of the brick
+	std::vector<float> samples;			// samplesPerBrick for each stored brick, x first
+};
+
+// Runs offline, every brick is checked against every triangle. The sign comes from the
+// angle weighted pseudo normal of the closest feature, so the mesh has to be closed,
+// vertices at the same position are welded first.
+void BakeSignedDistance(
+	const Vec3* verts,
+	const int numVerts,
+	const Tri* tris,
+	const int numTris,
+	const SdfSettings& settings,
+	SdfGrid& grid
+);
@@ -0,0 +1,930 @@
+#include "XPBD.h"
+#include <algorithm>
+#include <vector>
+#include "Integrator.h"
+#include "Intersections.h"
+#include "code/FrameArena.h"
+#include "Shape.h"
+
+// Coordinates of a manifold point along the tangents and the normal
+struct ManifoldPoint
+{
+	float u;
+	float v;
+	float s;
+};
+
+static const int maxFacePoints = 16;
+static const int maxClipPoints = 2 * maxFacePoints + 2;
+static const float faceTolerance = 0.04f;
+
+// Vertices of the body within tolerance of its furthest point along dir.
+// Spheres have no vertices, their contact stays the closest points. Capsules use the
+// ends of their segment pushed out by the radius, cylinders points around their caps.
+static int GatherFace(const Body& body, const Vec3& dir, const Vec3& t1, const Vec3& t2, const Vec3& n, const float tolerance, ManifoldPoint* face)
+{
+	const Shape* shape = body.shape;
+	Vec3 scale(1.0f);
+	if (shape->GetType() == Shape::ShapeType::SHAPE_SCALED) {
+		const ShapeScaled* scaled = static_cast<const ShapeScaled*>(shape);
+		shape = scaled->shape;
+		scale = scaled->scale;
+	}
+
+	const Vec3* points = nullptr;
+	int numPoints = 0;
+	float radius = 0.0f;
+	Vec3 curvePoints[maxFacePoints];
+	if (shape->GetType() == Shape::ShapeType::SHAPE_CAPSULE) {
+		const ShapeCapsule* capsule = static_cast<const ShapeCapsule*>(shape);
+		curvePoints[0] = Vec3(0.0f, 0.0f, -capsule->halfHeight);
+		curvePoints[1] = Vec3(0.0f, 0.0f, capsule->halfHeight);
+		points = curvePoints;
+		numPoints = 2;
+		radius = capsule->radius;
+	} else if (shape->GetType() == Shape::ShapeType::SHAPE_CYLINDER) {
+		// Points around the rims, starting from the one furthest along dir
+		const ShapeCylinder* cylinder = static_cast<const ShapeCylinder*>(shape);
+		const Vec3 localDir = body.orientation.Inverse().RotatePoint(dir);
+		const float startAngle = atan2f(localDir.y, localDir.x);
+		const int numSamples = maxFacePoints / 2;
+		for (int cap = 0; cap < 2; cap++) {
+			const float z = cap ? cylinder->halfHeight : -cylinder->halfHeight;
+			for (int i = 0; i < numSamples; i++) {
+				const float angle = startAngle + 6.2831853f * i / numSamples;
+				curvePoints[cap * numSamples + i] = Vec3(cosf(angle) * cylinder->radius, sinf(angle) * cylinder->radius, z);
+			}
+		}
+		points = curvePoints;
+		numPoints = 2 * numSamples;
+	} else if (shape->GetType() == Shape::ShapeType::SHAPE_BOX) {
+		const ShapeBox* box = static_cast<const ShapeBox*>(shape);
+		points = box->points;
+		numPoints = ShapeBox::numPoints;
+	} else if (shape->GetType() == Shape::ShapeType::SHAPE_CONVEX) {
+		const ShapeConvex* convex = static_cast<const ShapeConvex*>(shape);
+		points = convex->points;
+		numPoints = convex->numPoints;
+	} else if (shape->GetType() == Shape::ShapeType::SHAPE_TRIANGLE) {
+		const ShapeTriangle* triangle = static_cast<const ShapeTriangle*>(shape);
+		points = triangle->points;
+		numPoints = 6;
+	} else {
+		return 0;
+	}
+
+	float maxDist = -1e30f;
+	for (int i = 0; i < numPoints; i++) {
+		const Vec3 localPt(points[i].x * scale.x, points[i].y * scale.y, points[i].z * scale.z);
+		const float dist = dir.Dot(body.orientation.RotatePoint(localPt));
+		if (dist > maxDist) {
+			maxDist = dist;
+		}
+	}
+
+	int num = 0;
+	for (int i = 0; i < numPoints && num < maxFacePoints; i++) {
+		const Vec3 localPt(points[i].x * scale.x, points[i].y * scale.y, points[i].z * scale.z);
+		const Vec3 pt = body.orientation.RotatePoint(localPt);
+		if (dir.Dot(pt) < maxDist - tolerance) {
+			continue;
+		}
+
+		const Vec3 worldPt = pt + body.position + dir * radius;
+		face[num].u = t1.Dot(worldPt);
+		face[num].v = t2.Dot(worldPt);
+		face[num].s = n.Dot(worldPt);
+		num++;
+	}
+	return num;
+}
+
+// Scaling a box along its axes keeps it a box
+static bool IsBox(const Shape* shape)
+{
+	if (shape->GetType() == Shape::ShapeType::SHAPE_SCALED) {
+		shape = static_cast<const ShapeScaled*>(shape)->shape;
+	}
+	return shape->GetType() == Shape::ShapeType::SHAPE_BOX;
+}
+
+// Face axis of the box closest to dir, with how well it lines up
+static float ClosestBoxAxis(const Body& body, const Vec3& dir, Vec3& axis)
+{
+	float bestAlignment = -1.0f;
+	for (int i = 0; i < 3; i++) {
+		Vec3 localAxis(0.0f);
+		localAxis[i] = 1.0f;
+		Vec3 worldAxis = body.orientation.RotatePoint(localAxis);
+
+		float alignment = worldAxis.Dot(dir);
+		if (alignment < 0.0f) {
+			worldAxis *= -1.0f;
+			alignment = -alignment;
+		}
+		if (alignment > bestAlignment) {
+			bestAlignment = alignment;
+			axis = worldAxis;
+		}
+	}
+	return bestAlignment;
+}
+
+// EPA normals are a little noisy, which is enough to lose the face of a large box.
+// Snaps the normal to the closest face axis of a box of the pair, or to the face of a
+// triangle, when there is one.
+static Vec3 SnapNormal(const Body& a, const Body& b, const Vec3& n)
+{
+	const float minAlignment = 0.98f;
+	float bestAlignment = minAlignment;
+	Vec3 snapped = n;
+	const Body* bodies[2] = { &a, &b };
+	for (int i = 0; i < 2; i++) {
+		Vec3 axis;
+		float alignment;
+		if (IsBox(bodies[i]->shape)) {
+			alignment = ClosestBoxAxis(*bodies[i], n, axis);
+		} else if (bodies[i]->shape->GetType() == Shape::ShapeType::SHAPE_TRIANGLE) {
+			// Only the face of a triangle, its sides are inside the mesh
+			axis = bodies[i]->orientation.RotatePoint(static_cast<const ShapeTriangle*>(bodies[i]->shape)->normal);
+			alignment = fabsf(axis.Dot(n));
+			axis = (axis.Dot(n) < 0.0f) ? axis * -1.0f : axis;
+		} else {
+			continue;
+		}
+
+		if (alignment > bestAlignment) {
+			bestAlignment = alignment;
+			snapped = axis;
+		}
+	}
+	return snapped;
+}
+
+static float Cross2D(const ManifoldPoint& o, const ManifoldPoint& a, const ManifoldPoint& b)
+{
+	return (a.u - o.u) * (b.v - o.v) - (a.v - o.v) * (b.u - o.u);
+}
+
+// Counter clockwise hull of the face in the tangent plane, monotone chain
+static int Hull2D(ManifoldPoint* pts, const int num)
+{
+	if (num < 3) {
+		return num;
+	}
+
+	std::sort(pts, pts + num, [](const ManifoldPoint& lhs, const ManifoldPoint& rhs) {
+		return (lhs.u < rhs.u) || (lhs.u == rhs.u && lhs.v < rhs.v);
+	});
+
+	ManifoldPoint hull[2 * maxFacePoints];
+	int k = 0;
+	for (int i = 0; i < num; i++) {
+		while (k >= 2 && Cross2D(hull[k - 2], hull[k - 1], pts[i]) <= 0.0f) {
+			k--;
+		}
+		hull[k++] = pts[i];
+	}
+	for (int i = num - 2, lower = k + 1; i >= 0; i--) {
+		while (k >= lower && Cross2D(hull[k - 2], hull[k - 1], pts[i]) <= 0.0f) {
+			k--;
+		}
+		hull[k++] = pts[i];
+	}
+
+	// The last point repeats the first
+	k--;
+	for (int i = 0; i < k; i++) {
+		pts[i] = hull[i];
+	}
+	return k;
+}
+
+static float Area2D(const ManifoldPoint* pts, const int num)
+{
+	float area = 0.0f;
+	for (int i = 2; i < num; i++) {
+		area += Cross2D(pts[0], pts[i - 1], pts[i]);
+	}
+	return 0.5f * area;
+}
+
+// Plane through a face, as s = s0 + du * u + dv * v.
+// Faces are gathered with a tolerance and the normal may be slightly tilted,
+// so the height of the face has to be taken under each point.
+struct FacePlane
+{
+	float s0;
+	float du;
+	float dv;
+};
+
+static FacePlane FitFacePlane(const ManifoldPoint* pts, const int num)
+{
+	// Newell's normal, through the centroid
+	float nu = 0.0f;
+	float nv = 0.0f;
+	float ns = 0.0f;
+	float cu = 0.0f;
+	float cv = 0.0f;
+	float cs = 0.0f;
+	for (int i = 0; i < num; i++) {
+		const ManifoldPoint& p = pts[i];
+		const ManifoldPoint& q = pts[(i + 1) % num];
+		nu += (p.v - q.v) * (p.s + q.s);
+		nv += (p.s - q.s) * (p.u + q.u);
+		ns += (p.u - q.u) * (p.v + q.v);
+		cu += p.u;
+		cv += p.v;
+		cs += p.s;
+	}
+	cu /= (float)num;
+	cv /= (float)num;
+	cs /= (float)num;
+
+	FacePlane plane;
+	plane.du = (fabsf(ns) > 1e-6f) ? -nu / ns : 0.0f;
+	plane.dv = (fabsf(ns) > 1e-6f) ? -nv / ns : 0.0f;
+	plane.s0 = cs - plane.du * cu - plane.dv * cv;
+	return plane;
+}
+
+// Sutherland-Hodgman, keeps the part of the incident polygon inside the reference one
+static int ClipPolygon(const ManifoldPoint* reference, const int numReference, ManifoldPoint* incident, int numIncident)
+{
+	ManifoldPoint clipped[maxClipPoints];
+	for (int e = 0; e < numReference && numIncident > 0; e++) {
+		const ManifoldPoint& edgeA = reference[e];
+		const ManifoldPoint& edgeB = reference[(e + 1) % numReference];
+
+		int numClipped = 0;
+		for (int i = 0; i < numIncident; i++) {
+			const ManifoldPoint& p = incident[i];
+			const ManifoldPoint& q = incident[(i + 1) % numIncident];
+			const float distP = Cross2D(edgeA, edgeB, p);
+			const float distQ = Cross2D(edgeA, edgeB, q);
+
+			if (distP >= 0.0f && numClipped < maxClipPoints) {
+				clipped[numClipped++] = p;
+			}
+			if ((distP < 0.0f) != (distQ < 0.0f) && numClipped < maxClipPoints) {
+				const float t = distP / (distP - distQ);
+				ManifoldPoint crossing;
+				crossing.u = p.u + (q.u - p.u) * t;
+				crossing.v = p.v + (q.v - p.v) * t;
+				crossing.s = p.s + (q.s - p.s) * t;
+				clipped[numClipped++] = crossing;
+			}
+		}
+
+		numIncident = numClipped;
+		for (int i = 0; i < numClipped; i++) {
+			incident[i] = clipped[i];
+		}
+	}
+	return numIncident;
+}
+
+// Keeps the deepest point, then the points that span the largest area
+static int ReduceManifold(ManifoldPoint* pts, const float* depths, const int num, int* kept)
+{
+	if (num <= maxManifoldPoints) {
+		for (int i = 0; i < num; i++) {
+			kept[i] = i;
+		}
+		return num;
+	}
+
+	kept[0] = 0;
+	for (int i = 1; i < num; i++) {
+		if (depths[i] < depths[kept[0]]) {
+			kept[0] = i;
+		}
+	}
+
+	float best = -1.0f;
+	for (int i = 0; i < num; i++) {
+		const float du = pts[i].u - pts[kept[0]].u;
+		const float dv = pts[i].v - pts[kept[0]].v;
+		if (du * du + dv * dv > best) {
+			best = du * du + dv * dv;
+			kept[1] = i;
+		}
+	}
+
+	best = -1.0f;
+	for (int i = 0; i < num; i++) {
+		const float area = fabsf(Cross2D(pts[kept[0]], pts[kept[1]], pts[i]));
+		if (area > best) {
+			best = area;
+			kept[2] = i;
+		}
+	}
+
+	// The fourth point adds the most area outside the triangle
+	best = -1.0f;
+	for (int i = 0; i < num; i++) {
+		float area = 0.0f;
+		for (int e = 0; e < 3; e++) {
+			const float edgeArea = fabsf(Cross2D(pts[kept[e]], pts[kept[(e + 1) % 3]], pts[i]));
+			area = (edgeArea > area) ? edgeArea : area;
+		}
+		if (area > best && i != kept[0] && i != kept[1] && i != kept[2]) {
+			best = area;
+			kept[3] = i;
+		}
+	}
+	return maxManifoldPoints;
+}
+
+// Furthest the pair can close along the normal within the step, bounded like conservative
+// advancement does, gravity included. Points of the manifold within it may touch before the
+// next step and are kept, or a body turning onto a face sinks in before it has a contact there.
+static float SpeculativeDistance(const Body& a, const Body& b, const Vec3& normal, const float dt_sec, const Vec3& gravity)
+{
+	const Vec3 relativeVelocity = a.linearVelocity - b.linearVelocity;
+	float closingSpeed = -relativeVelocity.Dot(normal);
+	closingSpeed += VisitShape(a.shape, [&](const auto& shape) { return shape.FastestLinearSpeed(a.angularVelocity, normal * -1.0f); });
+	closingSpeed += VisitShape(b.shape, [&](const auto& shape) { return shape.FastestLinearSpeed(b.angularVelocity, normal); });
+	closingSpeed += gravity.GetMagnitude() * dt_sec;
+
+	const float slop = 0.01f;
+	return closingSpeed * dt_sec + slop;
+}
+
+// Nothing to clip against a plane, the points of the other face near it are the contacts,
+// each at its own depth
+static int FindPlaneContacts(Body* a, Body* b, const float speculativeDistance, Contact* contacts)
+{
+	const bool isPlaneA = (a->shape->GetType() == Shape::ShapeType::SHAPE_PLANE);
+	const Body& plane = isPlaneA ? *a : *b;
+	const Body& other = isPlaneA ? *b : *a;
+	const Vec3 planeNormal = plane.orientation.RotatePoint(Vec3(0.0f, 0.0f, 1.0f));
+	const float planeOffset = planeNormal.Dot(plane.position);
+
+	Vec3 t1;
+	Vec3 t2;
+	planeNormal.GetOrtho(t1, t2);
+	ManifoldPoint face[maxClipPoints];
+	const int numFace = GatherFace(other, planeNormal * -1.0f, t1, t2, planeNormal, std::max(faceTolerance, speculativeDistance), face);
+
+	const float maxSeparation = std::max(std::max(contacts[0].separationDistance, 0.0f) + 0.02f, speculativeDistance);
+	ManifoldPoint candidates[maxClipPoints];
+	float depths[maxClipPoints];
+	int numCandidates = 0;
+	for (int i = 0; i < numFace; i++) {
+		const float separation = face[i].s - planeOffset;
+		if (separation > maxSeparation) {
+			continue;
+		}
+		candidates[numCandidates] = face[i];
+		depths[numCandidates] = separation;
+		numCandidates++;
+	}
+	if (0 == numCandidates) {
+		return 1;
+	}
+
+	int kept[maxManifoldPoints];
+	const int numKept = ReduceManifold(candidates, depths, numCandidates, kept);
+	const Contact closest = contacts[0];
+	for (int i = 0; i < numKept; i++) {
+		const ManifoldPoint& pt = candidates[kept[i]];
+		const Vec3 otherPt = t1 * pt.u + t2 * pt.v + planeNormal * pt.s;
+		const Vec3 planePt = otherPt - planeNormal * depths[kept[i]];
+
+		Contact& manifoldContact = contacts[i];
+		manifoldContact = closest;
+		manifoldContact.normal = isPlaneA ? planeNormal * -1.0f : planeNormal;
+		manifoldContact.ptOnAWorldSpace = isPlaneA ? planePt : otherPt;
+		manifoldContact.ptOnBWorldSpace = isPlaneA ? otherPt : planePt;
+		manifoldContact.ptOnALocalSpace = a->WorldSpaceToBodySpace(manifoldContact.ptOnAWorldSpace);
+		manifoldContact.ptOnBLocalSpace = b->WorldSpaceToBodySpace(manifoldContact.ptOnBWorldSpace);
+		manifoldContact.separationDistance = depths[kept[i]];
+	}
+	return numKept;
+}
+
+// Each sample of the other body near a distance field is a contact with its own normal,
+// spread over the tangent plane of the deepest like the clipped faces
+static int FindSdfContacts(Body* a, Body* b, const float speculativeDistance, Contact* contacts)
+{
+	const bool isSdfA = (a->shape->GetType() == Shape::ShapeType::SHAPE_SDF);
+	Intersections::SdfPoint points[maxClipPoints];
+	const int numPoints = Intersections::SampleSdf(isSdfA ? *a : *b, isSdfA ? *b : *a, points, maxClipPoints);
+	if (0 == numPoints) {
+		return 1;
+	}
+
+	int deepest = 0;
+	for (int i = 1; i < numPoints; i++) {
+		if (points[i].separation < points[deepest].separation) {
+			deepest = i;
+		}
+	}
+	const Vec3 n = points[deepest].normal;
+	Vec3 t1;
+	Vec3 t2;
+	n.GetOrtho(t1, t2);
+
+	const float maxSeparation = std::max(std::max(points[deepest].separation, 0.0f) + 0.02f, speculativeDistance);
+	ManifoldPoint candidates[maxClipPoints];
+	float depths[maxClipPoints];
+	int nearby[maxClipPoints];
+	int numCandidates = 0;
+	for (int i = 0; i < numPoints; i++) {
+		if (points[i].separation > maxSeparation) {
+			continue;
+		}
+		candidates[numCandidates].u = t1.Dot(points[i].ptOnOther);
+		candidates[numCandidates].v = t2.Dot(points[i].ptOnOther);
+		candidates[numCandidates].s = n.Dot(points[i].ptOnOther);
+		depths[numCandidates] = points[i].separation;
+		nearby[numCandidates] = i;
+		numCandidates++;
+	}
+
+	int kept[maxManifoldPoints];
+	const int numKept = ReduceManifold(candidates, depths, numCandidates, kept);
+	const Contact closest = contacts[0];
+	for (int i = 0; i < numKept; i++) {
+		const Intersections::SdfPoint& pt = points[nearby[kept[i]]];
+
+		Contact& manifoldContact = contacts[i];
+		manifoldContact = closest;
+		manifoldContact.normal = isSdfA ? pt.normal * -1.0f : pt.normal;
+		manifoldContact.ptOnAWorldSpace = isSdfA ? pt.ptOnSdf : pt.ptOnOther;
+		manifoldContact.ptOnBWorldSpace = isSdfA ? pt.ptOnOther : pt.ptOnSdf;
+		manifoldContact.ptOnALocalSpace = a->WorldSpaceToBodySpace(manifoldContact.ptOnAWorldSpace);
+		manifoldContact.ptOnBLocalSpace = b->WorldSpaceToBodySpace(manifoldContact.ptOnBWorldSpace);
+		manifoldContact.separationDistance = pt.separation;
+	}
+	return numKept;
+}
+
+// Manifolds of the child pairs near each other, reduced to a single one for the bodies
+static int FindChildContacts(Body* a, Body* b, const float dt_sec, const Vec3& gravity, Contact* contacts)
+{
+	FrameArenaScope scope;
+
+	FrameVector<ChildPair> pairs;
+	Intersections::FindChildPairs(*a, *b, dt_sec, pairs);
+
+	FrameVector<Contact> found;
+	Contact childContacts[maxManifoldPoints];
+	ShapeTriangle triangleA;
+	ShapeTriangle triangleB;
+	for (int i = 0; i < (int)pairs.size(); i++) {
+		Body childA = Intersections::ChildBody(*a, pairs[i].a, triangleA);
+		Body childB = Intersections::ChildBody(*b, pairs[i].b, triangleB);
+		const int num = FindSpeculativeContacts(&childA, &childB, dt_sec, gravity, childContacts);
+		for (int j = 0; j < num; j++) {
+			Contact contact = childContacts[j];
+			contact.ptOnALocalSpace = a->WorldSpaceToBodySpace(contact.ptOnAWorldSpace);
+			contact.ptOnBLocalSpace = b->WorldSpaceToBodySpace(contact.ptOnBWorldSpace);
+			found.push_back(contact);
+		}
+	}
+	if (found.empty()) {
+		return 0;
+	}
+
+	// Spread over the tangent plane of the deepest contact
+	int deepest = 0;
+	for (int i = 1; i < (int)found.size(); i++) {
+		if (found[i].separationDistance < found[deepest].separationDistance) {
+			deepest = i;
+		}
+	}
+	const Vec3 n = found[deepest].normal;
+	Vec3 t1;
+	Vec3 t2;
+	n.GetOrtho(t1, t2);
+
+	// Like the clipped faces, points much further apart than the deepest are left out,
+	// the spread would favour them over the ones about to touch
+	const float speculativeDistance = SpeculativeDistance(*a, *b, n, dt_sec, gravity);
+	const float maxSeparation = std::max(std::max(found[deepest].separationDistance, 0.0f) + 0.02f, speculativeDistance);
+	FrameVector<int> nearby;
+	FrameVector<ManifoldPoint> candidates;
+	FrameVector<float> depths;
+	for (int i = 0; i < (int)found.size(); i++) {
+		if (found[i].separationDistance > maxSeparation) {
+			continue;
+		}
+		ManifoldPoint pt;
+		pt.u = t1.Dot(found[i].ptOnBWorldSpace);
+		pt.v = t2.Dot(found[i].ptOnBWorldSpace);
+		pt.s = n.Dot(found[i].ptOnBWorldSpace);
+		nearby.push_back(i);
+		candidates.push_back(pt);
+		depths.push_back(found[i].separationDistance);
+	}
+
+	int kept[maxManifoldPoints];
+	const int numKept = ReduceManifold(candidates.data(), depths.data(), (int)candidates.size(), kept);
+	for (int i = 0; i < numKept; i++) {
+		contacts[i] = found[nearby[kept[i]]];
+	}
+	return numKept;
+}
+
+int FindSpeculativeContacts(Body* a, Body* b, const float dt_sec, const Vec3& gravity, Contact* contacts)
+{
+	if (Intersections::HasChildren(a->shape) || Intersections::HasChildren(b->shape)) {
+		return FindChildContacts(a, b, dt_sec, gravity, contacts);
+	}
+
+	Contact& contact = contacts[0];
+	const bool isIntersecting = Intersections::Intersect(a, b, contact);
+	if (!isIntersecting) {
+		// Separated, the closest points are still filled in
+		contact.normal = contact.ptOnAWorldSpace - contact.ptOnBWorldSpace;
+		contact.separationDistance = contact.normal.GetMagnitude();
+		contact.normal.Normalize();
+	}
+	const float speculativeDistance = SpeculativeDistance(*a, *b, contact.normal, dt_sec, gravity);
+	if (!isIntersecting && contact.separationDistance > speculativeDistance) {
+		return 0;
+	}
+
+	if (a->shape->GetType() == Shape::ShapeType::SHAPE_PLANE || b->shape->GetType() == Shape::ShapeType::SHAPE_PLANE) {
+		return FindPlaneContacts(a, b, speculativeDistance, contacts);
+	}
+	if (a->shape->GetType() == Shape::ShapeType::SHAPE_SDF || b->shape->GetType() == Shape::ShapeType::SHAPE_SDF) {
+		return FindSdfContacts(a, b, speculativeDistance, contacts);
+	}
+
+	// Faces of A and B facing each other
+	const Vec3 n = SnapNormal(*a, *b, contact.normal);
+	Vec3 t1;
+	Vec3 t2;
+	n.GetOrtho(t1, t2);
+
+	ManifoldPoint faceA[maxClipPoints];
+	ManifoldPoint faceB[maxClipPoints];
+	int numA = GatherFace(*a, n * -1.0f, t1, t2, n, faceTolerance, faceA);
+	int numB = GatherFace(*b, n, t1, t2, n, faceTolerance, faceB);
+	if (0 == numA || 0 == numB) {
+		// A sphere against a face, it touches under its center and the face point lies on the face
+		// plane, without the margin GJK leaves on both points
+		contact.normal = n;
+		if (numA > 0 && b->shape->GetType() == Shape::ShapeType::SHAPE_SPHERE) {
+			float faceS = faceA[0].s;
+			for (int i = 1; i < numA; i++) {
+				faceS = std::min(faceS, faceA[i].s);
+			}
+			const float radius = static_cast<const ShapeSphere*>(b->shape)->radius;
+			contact.ptOnBWorldSpace = b->GetCenterOfMassWorldSpace() + n * radius;
+			contact.ptOnAWorldSpace = contact.ptOnBWorldSpace + n * (faceS - contact.ptOnBWorldSpace.Dot(n));
+		} else if (numB > 0 && a->shape->GetType() == Shape::ShapeType::SHAPE_SPHERE) {
+			float faceS = faceB[0].s;
+			for (int i = 1; i < numB; i++) {
+				faceS = std::max(faceS, faceB[i].s);
+			}
+			const float radius = static_cast<const ShapeSphere*>(a->shape)->radius;
+			contact.ptOnAWorldSpace = a->GetCenterOfMassWorldSpace() - n * radius;
+			contact.ptOnBWorldSpace = contact.ptOnAWorldSpace + n * (faceS - contact.ptOnAWorldSpace.Dot(n));
+		} else {
+			return 1;
+		}
+		contact.ptOnALocalSpace = a->WorldSpaceToBodySpace(contact.ptOnAWorldSpace);
+		contact.ptOnBLocalSpace = b->WorldSpaceToBodySpace(contact.ptOnBWorldSpace);
+		contact.separationDistance = (contact.ptOnAWorldSpace - contact.ptOnBWorldSpace).Dot(n);
+		return 1;
+	}
+	numA = Hull2D(faceA, numA);
+	numB = Hull2D(faceB, numB);
+
+	// The reference face is the larger one, edge on edge contacts keep the closest points
+	const float areaA = (numA >= 3) ? Area2D(faceA, numA) : 0.0f;
+	const float areaB = (numB >= 3) ? Area2D(faceB, numB) : 0.0f;
+	const float minArea = 1e-4f;
+	if (areaA < minArea && areaB < minArea) {
+		return 1;
+	}
+	const bool isReferenceA = (areaA >= areaB);
+
+	// The incident face takes every point that may reach the reference face within the step
+	if (speculativeDistance > faceTolerance) {
+		if (isReferenceA) {
+			numB = Hull2D(faceB, GatherFace(*b, n, t1, t2, n, speculativeDistance, faceB));
+		} else {
+			numA = Hull2D(faceA, GatherFace(*a, n * -1.0f, t1, t2, n, speculativeDistance, faceA));
+		}
+	}
+	const ManifoldPoint* reference = isReferenceA ? faceA : faceB;
+	const int numReference = isReferenceA ? numA : numB;
+	ManifoldPoint* incident = isReferenceA ? faceB : faceA;
+	const int numClipped = ClipPolygon(reference, numReference, incident, isReferenceA ? numB : numA);
+
+	// Separation of each clipped point from the reference face, positive when apart
+	const FacePlane plane = FitFacePlane(reference, numReference);
+	const float maxSeparation = std::max(((contact.separationDistance > 0.0f) ? contact.separationDistance : 0.0f) + 0.02f, speculativeDistance);
+	ManifoldPoint candidates[maxClipPoints];
+	float depths[maxClipPoints];
+	int numCandidates = 0;
+	for (int i = 0; i < numClipped; i++) {
+		const float referenceS = plane.s0 + plane.du * incident[i].u + plane.dv * incident[i].v;
+		const float separation = isReferenceA ? (referenceS - incident[i].s) : (incident[i].s - referenceS);
+		if (separation > maxSeparation) {
+			continue;
+		}
+		candidates[numCandidates] = incident[i];
+		depths[numCandidates] = separation;
+		numCandidates++;
+	}
+	if (0 == numCandidates) {
+		return 1;
+	}
+
+	int kept[maxManifoldPoints];
+	const int numKept = ReduceManifold(candidates, depths, numCandidates, kept);
+	const Contact closest = contact;
+	for (int i = 0; i < numKept; i++) {
+		const ManifoldPoint& pt = candidates[kept[i]];
+		const Vec3 incidentPt = t1 * pt.u + t2 * pt.v + n * pt.s;
+		const Vec3 referencePt = t1 * pt.u + t2 * pt.v + n * (plane.s0 + plane.du * pt.u + plane.dv * pt.v);
+
+		Contact& manifoldContact = contacts[i];
+		manifoldContact = closest;
+		manifoldContact.normal = n;
+		manifoldContact.ptOnAWorldSpace = isReferenceA ? referencePt : incidentPt;
+		manifoldContact.ptOnBWorldSpace = isReferenceA ? incidentPt : referencePt;
+		manifoldContact.ptOnALocalSpace = a->WorldSpaceToBodySpace(manifoldContact.ptOnAWorldSpace);
+		manifoldContact.ptOnBLocalSpace = b->WorldSpaceToBodySpace(manifoldContact.ptOnBWorldSpace);
+		manifoldContact.separationDistance = depths[kept[i]];
+	}
+	return numKept;
+}
+
+struct SubstepBody
+{
+	Vec3 prevCenterOfMass;
+	Quat prevOrientation;
+};
+
+// Indexed by body, kept per thread rather than drawn for every island of the world size
+static thread_local std::vector<SubstepBody> substepBodies;
+
+void ReserveSubstepBodies(const int numBodies)
+{
+	if ((int)substepBodies.size() < numBodies) {
+		substepBodies.resize(numBodies);
+	}
+}
+
+// Inverse mass of the body seen along dir at the offset r from its center of mass
+static float GeneralizedInverseMass(const BodyStore& bodies, const int body, const Vec3& r, const Vec3& dir)
+{
+	if (!IsActive(bodies, body)) {
+		return 0.0f;
+	}
+
+	const Vec3 rn = r.Cross(dir);
+	return bodies.InverseMass(body) + rn.Dot(bodies.InverseInertiaWorldSpace(body) * rn);
+}
+
+static void ApplyPositionCorrection(BodyStore& bodies, const int body, const Vec3& r, const Vec3& correction)
+{
+	if (!IsActive(bodies, body)) {
+		return;
+	}
+
+	const Vec3 centerOfMass = bodies.CenterOfMassWorldSpace(body) + correction * bodies.InverseMass(body);
+
+	const Vec3 dAngle = bodies.InverseInertiaWorldSpace(body) * r.Cross(correction);
+	const Quat dq = Quat(dAngle, dAngle.GetMagnitude());
+	Quat& orientation = bodies.Orientation(body);
+	orientation = dq * orientation;
+	orientation.Normalize();
+
+	// The rotation is around the center of mass
+	bodies.Position(body) = centerOfMass - orientation.RotatePoint(bodies.CenterOfMassBodySpace(body));
+	bodies.UpdateDerivedState(body);
+}
+
+// Rounded shapes touch along the normal out of their core, the center of a sphere, the segment
+// of a capsule or the axis of a cylinder lying on its side. The point carried with the body rolls
+// off the contact, and corrections through it would spin the body up. Other shapes keep it.
+static Vec3 ContactPoint(const BodyStore& bodies, const int body, const Vec3& ptLocal, const Vec3& dir)
+{
+	float radius = 0.0f;
+	float halfHeight = 0.0f;
+	const Shape* shape = bodies.ColdState(body).shape;
+	const Shape::ShapeType type = shape->GetType();
+	if (type == Shape::ShapeType::SHAPE_SPHERE) {
+		radius = static_cast<const ShapeSphere*>(shape)->radius;
+	} else if (type == Shape::ShapeType::SHAPE_CAPSULE) {
+		const ShapeCapsule* capsule = static_cast<const ShapeCapsule*>(shape);
+		radius = capsule->radius;
+		halfHeight = capsule->halfHeight;
+	} else if (type == Shape::ShapeType::SHAPE_CYLINDER) {
+		const float maxTilt = 0.05f;
+		const Vec3 axis = bodies.Orientation(body).RotatePoint(Vec3(0.0f, 0.0f, 1.0f));
+		if (fabsf(axis.Dot(dir)) > maxTilt) {
+			return bodies.BodySpaceToWorldSpace(body, ptLocal);
+		}
+		const ShapeCylinder* cylinder = static_cast<const ShapeCylinder*>(shape);
+		radius = cylinder->radius;
+		halfHeight = cylinder->halfHeight;
+	} else {
+		return bodies.BodySpaceToWorldSpace(body, ptLocal);
+	}
+
+	// The core point the carried point was pushed out of, kept on the segment
+	const Vec3 dirLocal = bodies.Orientation(body).Inverse().RotatePoint(dir);
+	const float z = ptLocal.z - dirLocal.z * radius;
+	const Vec3 core(0.0f, 0.0f, std::min(std::max(z, -halfHeight), halfHeight));
+	return bodies.BodySpaceToWorldSpace(body, core) + dir * radius;
+}
+
+static Vec3 ContactPointOnA(const BodyStore& bodies, const Contact& contact)
+{
+	return ContactPoint(bodies, contact.a, contact.ptOnALocalSpace, contact.normal * -1.0f);
+}
+
+static Vec3 ContactPointOnB(const BodyStore& bodies, const Contact& contact)
+{
+	return ContactPoint(bodies, contact.b, contact.ptOnBLocalSpace, contact.normal);
+}
+
+// Velocity of the point of A relative to the point of B, at the offsets from their centers of mass
+static Vec3 RelativeVelocity(const BodyStore& bodies, const int a, const int b, const Vec3& rA, const Vec3& rB)
+{
+	const Vec3 velA = bodies.LinearVelocity(a) + bodies.AngularVelocity(a).Cross(rA);
+	const Vec3 velB = bodies.LinearVelocity(b) + bodies.AngularVelocity(b).Cross(rB);
+	return velA - velB;
+}
+
+// Impulse at the contact points changing their relative velocity by dv.
+// Sleeping partners act as static, they are only woken once the step is done.
+static void ApplyVelocityChange(BodyStore& bodies, const int a, const int b, const Vec3& ptOnA, const Vec3& ptOnB, const Vec3& dv)
+{
+	const float dvLength = dv.GetMagnitude();
+	if (dvLength < 1e-6f) {
+		return;
+	}
+	const Vec3 dir = dv * (1.0f / dvLength);
+	const float w = GeneralizedInverseMass(bodies, a, ptOnA - bodies.CenterOfMassWorldSpace(a), dir) + GeneralizedInverseMass(bodies, b, ptOnB - bodies.CenterOfMassWorldSpace(b), dir);
+	if (w == 0.0f) {
+		return;
+	}
+
+	const Vec3 impulse = dv * (1.0f / w);
+	if (IsActive(bodies, a)) {
+		bodies.ApplyImpulse(a, ptOnA, impulse);
+	}
+	if (IsActive(bodies, b)) {
+		bodies.ApplyImpulse(b, ptOnB, impulse * -1.0f);
+	}
+}
+
+void SolveIslandSubstepped(BodyStore& bodies, const Island& island, const int* islandBodies, Contact* contacts, const float dt_sec, const int numSubsteps, const Vec3& gravity, const bool isDeterministic)
+{
+	const int* indices = islandBodies + island.firstBody;
+	Contact* islandContacts = contacts + island.firstContact;
+
+	ReserveSubstepBodies(bodies.Size());
+
+	FrameArenaScope scope;
+	SubstepContact* substepContacts = GetFrameArena().Allocate<SubstepContact>(island.numContacts);
+
+	for (int i = 0; i < island.numContacts; i++) {
+		islandContacts[i].separationDistance = 0.0f;
+	}
+
+	const float h = dt_sec / (float)numSubsteps;
+	const float restingSpeed = 2.0f * gravity.GetMagnitude() * h;
+	for (int substep = 0; substep < numSubsteps; substep++) {
+		// Predict
+		for (int i = 0; i < island.numBodies; i++) {
+			const int body = indices[i];
+			substepBodies[body].prevCenterOfMass = bodies.CenterOfMassWorldSpace(body);
+			substepBodies[body].prevOrientation = bodies.Orientation(body);
+
+			bodies.LinearVelocity(body) += gravity * h;
+		}
+		// Contact points at the start of the substep, carried with the bodies from there
+		for (int i = 0; i < island.numContacts; i++) {
+			Contact& contact = islandContacts[i];
+			substepContacts[i].prevPtOnA = ContactPointOnA(bodies, contact);
+			substepContacts[i].prevPtOnB = ContactPointOnB(bodies, contact);
+			contact.ptOnALocalSpace = bodies.WorldSpaceToBodySpace(contact.a, substepContacts[i].prevPtOnA);
+			contact.ptOnBLocalSpace = bodies.WorldSpaceToBodySpace(contact.b, substepContacts[i].prevPtOnB);
+		}
+		IntegrateBodies(bodies, indices, island.numBodies, h, isDeterministic);
+
+		// Non-penetration and static friction
+		for (int i = 0; i < island.numContacts; i++) {
+			Contact& contact = islandContacts[i];
+			SubstepContact& state = substepContacts[i];
+			const int a = contact.a;
+			const int b = contact.b;
+			const Vec3& n = contact.normal;
+
+			Vec3 ptOnA = ContactPointOnA(bodies, contact);
+			Vec3 ptOnB = ContactPointOnB(bodies, contact);
+			const float depth = (ptOnA - ptOnB).Dot(n);
+			state.isTouching = (depth < 0.0f);
+			state.lambdaNormal = 0.0f;
+			if (!state.isTouching) {
+				continue;
+			}
+			if (depth < contact.separationDistance) {
+				contact.separationDistance = depth;
+			}
+
+			Vec3 rA = ptOnA - bodies.CenterOfMassWorldSpace(a);
+			Vec3 rB = ptOnB - bodies.CenterOfMassWorldSpace(b);
+			state.relativeNormalSpeed = RelativeVelocity(bodies, a, b, rA, rB).Dot(n);
+
+			const float w = GeneralizedInverseMass(bodies, a, rA, n) + GeneralizedInverseMass(bodies, b, rB, n);
+			if (w == 0.0f) {
+				continue;
+			}
+			state.lambdaNormal = -depth / w;
+			ApplyPositionCorrection(bodies, a, rA, n * state.lambdaNormal);
+			ApplyPositionCorrection(bodies, b, rB, n * -state.lambdaNormal);
+
+			// Static friction, undo the tangential slide of the material points that touched at the
+			// start of this substep, pushing at the points that touch now
+			const Vec3 slide = (bodies.BodySpaceToWorldSpace(a, contact.ptOnALocalSpace) - state.prevPtOnA) - (bodies.BodySpaceToWorldSpace(b, contact.ptOnBLocalSpace) - state.prevPtOnB);
+			Vec3 slideTangent = slide - n * slide.Dot(n);
+			const float slideLength = slideTangent.GetMagnitude();
+			if (slideLength < 1e-6f) {
+				continue;
+			}
+			slideTangent *= 1.0f / slideLength;
+
+			rA = ContactPointOnA(bodies, contact) - bodies.CenterOfMassWorldSpace(a);
+			rB = ContactPointOnB(bodies, contact) - bodies.CenterOfMassWorldSpace(b);
+			const float wTangent = GeneralizedInverseMass(bodies, a, rA, slideTangent) + GeneralizedInverseMass(bodies, b, rB, slideTangent);
+			const float lambdaTangent = slideLength / wTangent;
+			const float friction = bodies.ColdState(a).friction * bodies.ColdState(b).friction;
+			if (lambdaTangent < friction * state.lambdaNormal) {
+				ApplyPositionCorrection(bodies, a, rA, slideTangent * -lambdaTangent);
+				ApplyPositionCorrection(bodies, b, rB, slideTangent * lambdaTangent);
+			}
+		}
+
+		// Velocities from the change of pose
+		const float invH = 1.0f / h;
+		for (int i = 0; i < island.numBodies; i++) {
+			const int body = indices[i];
+			const SubstepBody& prev = substepBodies[body];
+
+			bodies.LinearVelocity(body) = (bodies.CenterOfMassWorldSpace(body) - prev.prevCenterOfMass) * invH;
+
+			const Quat dq = bodies.Orientation(body) * prev.prevOrientation.Inverse();
+			Vec3& angularVelocity = bodies.AngularVelocity(body);
+			angularVelocity = dq.xyz() * (2.0f * invH);
+			if (dq.w < 0.0f) {
+				angularVelocity *= -1.0f;
+			}
+		}
+
+		// Restitution and dynamic friction
+		for (int i = 0; i < island.numContacts; i++) {
+			Contact& contact = islandContacts[i];
+			const SubstepContact& state = substepContacts[i];
+			if (!state.isTouching) {
+				continue;
+			}
+
+			const int a = contact.a;
+			const int b = contact.b;
+			const BodyColdState& coldA = bodies.ColdState(a);
+			const BodyColdState& coldB = bodies.ColdState(b);
+			const Vec3& n = contact.normal;
+
+			const Vec3 ptOnA = ContactPointOnA(bodies, contact);
+			const Vec3 ptOnB = ContactPointOnB(bodies, contact);
+			const Vec3 rA = ptOnA - bodies.CenterOfMassWorldSpace(a);
+			const Vec3 rB = ptOnB - bodies.CenterOfMassWorldSpace(b);
+
+			// Restitution first, the friction bound doesn't depend on it
+			const float velNormal = RelativeVelocity(bodies, a, b, rA, rB).Dot(n);
+
+			// No bounce for slow contacts, or resting bodies would jitter
+			const float elasticity = (fabsf(velNormal) > restingSpeed) ? coldA.elasticity * coldB.elasticity : 0.0f;
+			const float targetSpeed = -elasticity * state.relativeNormalSpeed;
+			ApplyVelocityChange(bodies, a, b, ptOnA, ptOnB, n * (-velNormal + (targetSpeed > 0.0f ? targetSpeed : 0.0f)));
+
+			// Friction force is the normal force lambda / h^2, scaled by the friction. Its impulse over
+			// the substep changes the slide by the inverse mass along the tangent, applied on its own
+			// so it only ever slows the slide.
+			const Vec3 velAb = RelativeVelocity(bodies, a, b, rA, rB);
+			const Vec3 velTangent = velAb - n * velAb.Dot(n);
+			const float speedTangent = velTangent.GetMagnitude();
+			if (speedTangent > 1e-6f) {
+				const Vec3 dirTangent = velTangent * (1.0f / speedTangent);
+				const float wTangent = GeneralizedInverseMass(bodies, a, rA, dirTangent) + GeneralizedInverseMass(bodies, b, rB, dirTangent);
+				const float friction = coldA.friction * coldB.friction;
+				const float normalForce = state.lambdaNormal * invH * invH;
+				const float maxDv = h * friction * normalForce * wTangent;
+				ApplyVelocityChange(bodies, a, b, ptOnA, ptOnB, dirTangent * -((maxDv < speedTangent) ? maxDv : speedTangent));
+			}
+		}
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "Body.h"
+#include "Contact.h"
+#include "Island.h"
+
+// Substepped extended position based dynamics, after Muller et al. 2020,
+// "Detailed Rigid Body Simulation with Extended Position Based Dynamics".
+// Contacts are found once per step. Each substep then predicts the bodies,
+// moves the contact points with them and solves one iteration of non-penetration
+// and static friction as position constraints, before deriving the velocities
+// and applying restitution and dynamic friction.
+
+static const int maxManifoldPoints = 4;
+
+// Solver state of a contact through the substeps, drawn from the frame arena per island
+struct SubstepContact
+{
+	Vec3 prevPtOnA;				// World contact points at the start of the substep, for static friction
+	Vec3 prevPtOnB;
+	float lambdaNormal;
+	float relativeNormalSpeed;	// Before the position solve, for restitution
+	bool isTouching;
+};
+
+// Contacts of the pair at the start of the step, normal from B to A like the other contacts.
+// Facing polytope features are clipped against each other so that resting bodies get a full
+// manifold instead of a single point. Returns how many contacts were written, none when the
+// bodies can't close the gap during the step. The caller sets the store indices of the contacts.
+int FindSpeculativeContacts(Body* a, Body* b, const float dt_sec, const Vec3& gravity, Contact* contacts);
+
+// Steps the island bodies through numSubsteps substeps. Static and sleeping partners don't move.
+// The contact separationDistance is left at the deepest penetration met.
+void SolveIslandSubstepped(BodyStore& bodies, const Island& island, const int* islandBodies, Contact* contacts, const float dt_sec, const int numSubsteps, const Vec3& gravity, const bool isDeterministic);
+
+// Most SolveIslandSubstepped draws from the frame arena for an island of numContacts contacts
+constexpr size_t SolveIslandSubsteppedArenaBytes(const int numContacts) {
+	return (size_t)numContacts * sizeof(SubstepContact);
+}
+
+// Sizes the state the calling thread keeps per body, otherwise grown by the first island
+// that needs it
+void ReserveSubstepBodies(const int numBodies);
@@ -6,9 +6,21 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <errno.h>
 
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
 #include <direct.h>
 #define GetCurrentDir _getcwd
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define GetCurrentDir getcwd
+#endif
 
 static char g_ApplicationDirectory[ FILENAME_MAX ];
 static bool g_WasInitialized = false;
@@ -139,4 +151,115 @@ bool SaveFileData( const char * fileNameLocal, const void * data, unsigned int s
 	fclose( file );
 	printf( "Write file was success %s\n", fileName );
 	return true;
+}
+
+/*
+====================================================
+MapFileData
+====================================================
+*/
+bool MapFileData( const char * fileNameLocal, MappedFile & file ) {
+	InitializeFileSystem();
+
+	char fileName[ 2048 ];
+	sprintf( fileName, "%s/%s", g_ApplicationDirectory, fileNameLocal );
+
+	file.data = NULL;
+	file.size = 0;
+	file.handle = NULL;
+	file.mapping = NULL;
+
+#if defined( _WIN32 )
+	HANDLE handle = CreateFileA( fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( INVALID_HANDLE_VALUE == handle ) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if ( !GetFileSizeEx( handle, &size ) || 0 == size.QuadPart ) {
+		CloseHandle( handle );
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA( handle, NULL, PAGE_READONLY, 0, 0, NULL );
+	if ( NULL == mapping ) {
+		CloseHandle( handle );
+		return false;
+	}
+
+	void * data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+	if ( NULL == data ) {
+		CloseHandle( mapping );
+		CloseHandle( handle );
+		return false;
+	}
+
+	file.data = (const unsigned char *)data;
+	file.size = (unsigned int)size.QuadPart;
+	file.handle = handle;
+	file.mapping = mapping;
+#else
+	const int fd = open( fileName, O_RDONLY );
+	if ( fd < 0 ) {
+		return false;
+	}
+
+	struct stat info;
+	if ( fstat( fd, &info ) != 0 || 0 == info.st_size ) {
+		close( fd );
+		return false;
+	}
+
+	void * data = mmap( NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( MAP_FAILED == data ) {
+		return false;
+	}
+
+	file.data = (const unsigned char *)data;
+	file.size = (unsigned int)info.st_size;
+#endif
+	return true;
+}
+
+/*
+====================================================
+UnmapFileData
+====================================================
+*/
+void UnmapFileData( MappedFile & file ) {
+	if ( NULL == file.data ) {
+		return;
+	}
+
+#if defined( _WIN32 )
+	UnmapViewOfFile( file.data );
+	CloseHandle( (HANDLE)file.mapping );
+	CloseHandle( (HANDLE)file.handle );
+#else
+	munmap( (void *)file.data, file.size );
+#endif
+	file.data = NULL;
+	file.size = 0;
+	file.handle = NULL;
+	file.mapping = NULL;
+}
+
+/*
+====================================================
+MakeDirectory
+====================================================
+*/
+bool MakeDirectory( const char * dirNameLocal ) {
+	InitializeFileSystem();
+
+	char dirName[ 2048 ];
+	sprintf( dirName, "%s/%s", g_ApplicationDirectory, dirNameLocal );
+
+#if defined( _WIN32 )
+	const int result = _mkdir( dirName );
+#else
+	const int result = mkdir( dirName, 0755 );
+#endif
+	return ( 0 == result || EEXIST == errno );
 }
\ No newline at end of file
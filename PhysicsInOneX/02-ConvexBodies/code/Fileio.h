@@ -4,4 +4,22 @@
 #pragma once
 
 bool GetFileData( const char * fileName, unsigned char ** data, unsigned int & size );
-bool SaveFileData( const char * fileName, const void * data, unsigned int size );
\ No newline at end of file
+bool SaveFileData( const char * fileName, const void * data, unsigned int size );
+
+/*
+====================================================
+MappedFile
+
+Read only view of a whole file, the pages are loaded by the OS on first touch
+====================================================
+*/
+struct MappedFile {
+	const unsigned char * data;
+	unsigned int size;
+	void * handle;
+	void * mapping;
+};
+
+bool MapFileData( const char * fileName, MappedFile & file );
+void UnmapFileData( MappedFile & file );
+bool MakeDirectory( const char * dirName );
\ No newline at end of file
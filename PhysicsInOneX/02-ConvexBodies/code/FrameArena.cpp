@@ -0,0 +1,159 @@
+//
+//  FrameArena.cpp
+//
+#include "FrameArena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <mutex>
+
+/*
+====================================================
+FrameArena::FrameArena
+====================================================
+*/
+FrameArena::FrameArena() :
+m_memory( nullptr ),
+m_capacity( initialCapacity ),
+m_used( 0 ),
+m_peak( 0 ),
+m_stepOverflowBytes( 0 ),
+m_highWater( 0 ),
+m_numOverflows( 0 ),
+m_overflowBytes( 0 ) {
+	m_memory = (char *)malloc( m_capacity );
+}
+
+/*
+====================================================
+FrameArena::~FrameArena
+====================================================
+*/
+FrameArena::~FrameArena() {
+	for ( int i = 0; i < (int)m_overflow.size(); i++ ) {
+		free( m_overflow[ i ] );
+	}
+	free( m_memory );
+}
+
+/*
+====================================================
+FrameArena::Allocate
+====================================================
+*/
+void * FrameArena::Allocate( const size_t size, const size_t alignment ) {
+	const uintptr_t base = (uintptr_t)m_memory;
+	const uintptr_t ptr = ( base + m_used + alignment - 1 ) & ~( (uintptr_t)alignment - 1 );
+	const size_t end = (size_t)( ptr - base ) + size;
+	if ( end <= m_capacity ) {
+		m_used = end;
+		m_peak = std::max( m_peak, end );
+		return (void *)ptr;
+	}
+
+	// Full, the heap covers until the next reset
+	char * block = (char *)malloc( size + alignment );
+	m_overflow.push_back( block );
+	m_numOverflows++;
+	m_overflowBytes += size;
+	m_stepOverflowBytes += size + alignment;
+	return (void *)( ( (uintptr_t)block + alignment - 1 ) & ~( (uintptr_t)alignment - 1 ) );
+}
+
+/*
+====================================================
+FrameArena::Reset
+====================================================
+*/
+void FrameArena::Reset() {
+	for ( int i = 0; i < (int)m_overflow.size(); i++ ) {
+		free( m_overflow[ i ] );
+	}
+	m_overflow.clear();
+
+	const size_t stepBytes = StepBytes();
+	m_highWater = std::max( m_highWater, stepBytes );
+	if ( stepBytes > m_capacity && m_capacity < maxCapacity ) {
+		// At least double, so a slowly growing scene doesn't reallocate every step
+		m_capacity = std::min( std::max( stepBytes, m_capacity * 2 ), (size_t)maxCapacity );
+		free( m_memory );
+		m_memory = (char *)malloc( m_capacity );
+	}
+
+	m_used = 0;
+	m_peak = 0;
+	m_stepOverflowBytes = 0;
+}
+
+/*
+====================================================
+FrameArena::Reserve
+====================================================
+*/
+void FrameArena::Reserve( const size_t capacity ) {
+	if ( capacity <= m_capacity ) {
+		return;
+	}
+
+	m_capacity = capacity;
+	free( m_memory );
+	m_memory = (char *)malloc( m_capacity );
+	m_used = 0;
+}
+
+/*
+====================================================
+FrameArena::AddStats
+====================================================
+*/
+void FrameArena::AddStats( FrameArenaStats & stats ) const {
+	stats.capacity += m_capacity;
+	stats.highWater = std::max( stats.highWater, std::max( m_highWater, StepBytes() ) );
+	stats.numOverflows += m_numOverflows;
+	stats.overflowBytes += m_overflowBytes;
+}
+
+/*
+====================================================
+Per thread arenas
+====================================================
+*/
+static std::mutex s_arenasMutex;
+static std::vector< FrameArena * > s_arenas;
+
+// Registers the arena of the thread for the resets, until the thread exits
+class ThreadFrameArena {
+public:
+	ThreadFrameArena() {
+		std::lock_guard< std::mutex > lock( s_arenasMutex );
+		s_arenas.push_back( &m_arena );
+	}
+	~ThreadFrameArena() {
+		std::lock_guard< std::mutex > lock( s_arenasMutex );
+		s_arenas.erase( std::find( s_arenas.begin(), s_arenas.end(), &m_arena ) );
+	}
+
+	FrameArena m_arena;
+};
+
+FrameArena & GetFrameArena() {
+	static thread_local ThreadFrameArena s_threadArena;
+	return s_threadArena.m_arena;
+}
+
+void ResetFrameArenas() {
+	std::lock_guard< std::mutex > lock( s_arenasMutex );
+	for ( int i = 0; i < (int)s_arenas.size(); i++ ) {
+		s_arenas[ i ]->Reset();
+	}
+}
+
+FrameArenaStats GetFrameArenaStats() {
+	FrameArenaStats stats = { 0, 0, 0, 0 };
+
+	std::lock_guard< std::mutex > lock( s_arenasMutex );
+	for ( int i = 0; i < (int)s_arenas.size(); i++ ) {
+		s_arenas[ i ]->AddStats( stats );
+	}
+	return stats;
+}
@@ -0,0 +1,132 @@
+//
+//  FrameArena.h
+//
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+/*
+====================================================
+FrameArena
+
+Bump allocator for the data that only lives through one physics step.  Each
+thread draws from its own arena, and all of them are reset together at the
+start of the next step, so nothing is freed piece by piece.
+
+A step needing more than the arena holds gets the rest from the heap, counted
+as overflow.  The reset after it grows the arena to what the step needed, up to
+maxCapacity, so steady steps don't touch the heap.
+====================================================
+*/
+struct FrameArenaStats {
+	size_t capacity;		// All the arenas together
+	size_t highWater;		// Most a single arena needed in one step
+	int numOverflows;		// Allocations that went to the heap since the start
+	size_t overflowBytes;
+};
+
+class FrameArena {
+public:
+	static const size_t initialCapacity = 256 * 1024;
+	static const size_t maxCapacity = 64 * 1024 * 1024;
+
+	FrameArena();
+	~FrameArena();
+
+	void * Allocate( const size_t size, const size_t alignment );
+
+	// Room for num items, left uninitialized
+	template< typename T >
+	T * Allocate( const int num ) { return (T *)Allocate( sizeof( T ) * num, alignof( T ) ); }
+
+	// Gives back everything, frees the overflow and grows to cover the last step
+	void Reset();
+
+	// Grows to at least capacity up front, so the steps don't have to.  Only
+	// between steps, what was allocated is lost.
+	void Reserve( const size_t capacity );
+
+	// Allocations made after the mark are given back by the rewind, for scratch
+	// memory that doesn't outlive a function
+	size_t GetMark() const { return m_used; }
+	void Rewind( const size_t mark ) { m_used = mark; }
+
+	void AddStats( FrameArenaStats & stats ) const;
+
+private:
+	// What the arena would have needed to hold the whole step
+	size_t StepBytes() const { return m_peak + m_stepOverflowBytes; }
+
+	FrameArena( const FrameArena & rhs );
+	const FrameArena & operator = ( const FrameArena & rhs );
+
+	char * m_memory;
+	size_t m_capacity;
+	size_t m_used;
+	size_t m_peak;				// Furthest used during this step
+	size_t m_stepOverflowBytes;	// What didn't fit during this step
+
+	std::vector< char * > m_overflow;
+
+	size_t m_highWater;
+	int m_numOverflows;
+	size_t m_overflowBytes;
+};
+
+// Arena of the calling thread
+FrameArena & GetFrameArena();
+
+// Resets the arenas of every thread, only while no job is running
+void ResetFrameArenas();
+
+FrameArenaStats GetFrameArenaStats();
+
+/*
+====================================================
+FrameArenaScope
+
+Rewinds the arena of the thread when leaving the scope.  Nothing allocated
+inside may be used after it.
+====================================================
+*/
+class FrameArenaScope {
+public:
+	FrameArenaScope() : m_arena( GetFrameArena() ), m_mark( m_arena.GetMark() ) {}
+	~FrameArenaScope() { m_arena.Rewind( m_mark ); }
+
+private:
+	FrameArenaScope( const FrameArenaScope & rhs );
+	const FrameArenaScope & operator = ( const FrameArenaScope & rhs );
+
+	FrameArena & m_arena;
+	const size_t m_mark;
+};
+
+/*
+====================================================
+FrameAllocator
+
+Standard allocator over the arena of the calling thread, deallocation does
+nothing.  Containers using it must not outlive the step.
+====================================================
+*/
+template< typename T >
+class FrameAllocator {
+public:
+	typedef T value_type;
+
+	FrameAllocator() {}
+	template< typename U >
+	FrameAllocator( const FrameAllocator< U > & ) {}
+
+	T * allocate( const size_t num ) { return (T *)GetFrameArena().Allocate( sizeof( T ) * num, alignof( T ) ); }
+	void deallocate( T *, const size_t ) {}
+};
+
+template< typename T, typename U >
+bool operator == ( const FrameAllocator< T > &, const FrameAllocator< U > & ) { return true; }
+template< typename T, typename U >
+bool operator != ( const FrameAllocator< T > &, const FrameAllocator< U > & ) { return false; }
+
+template< typename T >
+using FrameVector = std::vector< T, FrameAllocator< T > >;
@@ -0,0 +1,107 @@
+//
+//	Dense.cpp
+//
+#include "Dense.h"
+#include "Lanes.h"
+
+/*
+====================================================
+LaneSum
+====================================================
+*/
+static inline float LaneSum( const lane_t v ) {
+	alignas( 32 ) float lanes[ numLanes ];
+	LaneStore( lanes, v );
+
+	float sum = 0.0f;
+	for ( int i = 0; i < numLanes; i++ ) {
+		sum += lanes[ i ];
+	}
+	return sum;
+}
+
+/*
+====================================================
+DenseDot
+====================================================
+*/
+float DenseDot( const float * a, const float * b, const int num ) {
+	lane_t sum = LaneSet( 0.0f );
+	int i = 0;
+	for ( ; i + numLanes <= num; i += numLanes ) {
+		sum = LaneAdd( sum, LaneMul( LaneLoadUnaligned( a + i ), LaneLoadUnaligned( b + i ) ) );
+	}
+
+	float tail = 0.0f;
+	for ( ; i < num; i++ ) {
+		tail += a[ i ] * b[ i ];
+	}
+	return LaneSum( sum ) + tail;
+}
+
+/*
+====================================================
+DenseAxpy
+====================================================
+*/
+void DenseAxpy( float * y, const float alpha, const float * x, const int num ) {
+	const lane_t scale = LaneSet( alpha );
+	int i = 0;
+	for ( ; i + numLanes <= num; i += numLanes ) {
+		const lane_t yi = LaneAdd( LaneLoadUnaligned( y + i ), LaneMul( scale, LaneLoadUnaligned( x + i ) ) );
+		LaneStoreUnaligned( y + i, yi );
+	}
+
+	for ( ; i < num; i++ ) {
+		y[ i ] += alpha * x[ i ];
+	}
+}
+
+/*
+====================================================
+DenseMulVec
+====================================================
+*/
+void DenseMulVec( float * y, const float * A, const float * x, const int numRows, const int numCols ) {
+	// Four rows at a time, so each load of x serves all of them
+	int row = 0;
+	for ( ; row + 4 <= numRows; row += 4 ) {
+		const float * a0 = A + ( row + 0 ) * numCols;
+		const float * a1 = A + ( row + 1 ) * numCols;
+		const float * a2 = A + ( row + 2 ) * numCols;
+		const float * a3 = A + ( row + 3 ) * numCols;
+
+		lane_t sum0 = LaneSet( 0.0f );
+		lane_t sum1 = LaneSet( 0.0f );
+		lane_t sum2 = LaneSet( 0.0f );
+		lane_t sum3 = LaneSet( 0.0f );
+		int i = 0;
+		for ( ; i + numLanes <= numCols; i += numLanes ) {
+			const lane_t xi = LaneLoadUnaligned( x + i );
+			sum0 = LaneAdd( sum0, LaneMul( LaneLoadUnaligned( a0 + i ), xi ) );
+			sum1 = LaneAdd( sum1, LaneMul( LaneLoadUnaligned( a1 + i ), xi ) );
+			sum2 = LaneAdd( sum2, LaneMul( LaneLoadUnaligned( a2 + i ), xi ) );
+			sum3 = LaneAdd( sum3, LaneMul( LaneLoadUnaligned( a3 + i ), xi ) );
+		}
+
+		float tail0 = 0.0f;
+		float tail1 = 0.0f;
+		float tail2 = 0.0f;
+		float tail3 = 0.0f;
+		for ( ; i < numCols; i++ ) {
+			tail0 += a0[ i ] * x[ i ];
+			tail1 += a1[ i ] * x[ i ];
+			tail2 += a2[ i ] * x[ i ];
+			tail3 += a3[ i ] * x[ i ];
+		}
+
+		y[ row + 0 ] = LaneSum( sum0 ) + tail0;
+		y[ row + 1 ] = LaneSum( sum1 ) + tail1;
+		y[ row + 2 ] = LaneSum( sum2 ) + tail2;
+		y[ row + 3 ] = LaneSum( sum3 ) + tail3;
+	}
+
+	for ( ; row < numRows; row++ ) {
+		y[ row ] = DenseDot( A + row * numCols, x, numCols );
+	}
+}
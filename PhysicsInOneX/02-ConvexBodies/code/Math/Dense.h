@@ -0,0 +1,90 @@
+//
+//	Dense.h
+//
+#pragma once
+#include <string.h>
+#include "../FrameArena.h"
+
+/*
+====================================================
+Dense kernels
+
+Row major float arrays of any length, numLanes floats at a time.  The pointers
+don't need to be aligned.
+====================================================
+*/
+float DenseDot( const float * a, const float * b, const int num );
+
+// y += alpha * x
+void DenseAxpy( float * y, const float alpha, const float * x, const int num );
+
+// y = A * x, with A numRows by numCols.  y must not overlap x.
+void DenseMulVec( float * y, const float * A, const float * x, const int numRows, const int numCols );
+
+/*
+====================================================
+DenseStorage
+
+Floats of a VecN or a matrix.  Up to inlineSize of them live in the object
+itself, more come from the arena when there is one, and from the heap otherwise.
+Arena memory is never given back, so storage drawn from it must not outlive the
+arena's step.
+====================================================
+*/
+template< int inlineSize >
+class DenseStorage {
+public:
+	DenseStorage() : m_data( m_inline ), m_capacity( inlineSize ), m_arena( nullptr ) {}
+	explicit DenseStorage( FrameArena * arena ) : m_data( m_inline ), m_capacity( inlineSize ), m_arena( arena ) {}
+	~DenseStorage() { Free(); }
+
+	float * Data() const { return m_data; }
+	FrameArena * Arena() const { return m_arena; }
+
+	// Room for num floats, the contents are lost when it has to grow
+	void Reserve( const int num ) {
+		if ( num <= m_capacity ) {
+			return;
+		}
+		Free();
+		if ( nullptr != m_arena ) {
+			m_data = (float *)m_arena->Allocate( sizeof( float ) * num, 32 );
+		} else {
+			m_data = new float[ num ];
+		}
+		m_capacity = num;
+	}
+
+	// Takes the memory of rhs, only its first num floats are copied when they are inline
+	void Take( DenseStorage & rhs, const int num ) {
+		if ( rhs.m_data == rhs.m_inline ) {
+			Reserve( num );
+			memcpy( m_data, rhs.m_data, sizeof( float ) * num );
+			return;
+		}
+
+		Free();
+		m_data = rhs.m_data;
+		m_capacity = rhs.m_capacity;
+		m_arena = rhs.m_arena;
+		rhs.m_data = rhs.m_inline;
+		rhs.m_capacity = inlineSize;
+	}
+
+private:
+	DenseStorage( const DenseStorage & rhs );
+	const DenseStorage & operator = ( const DenseStorage & rhs );
+
+	void Free() {
+		if ( m_data != m_inline && nullptr == m_arena ) {
+			delete[] m_data;
+		}
+		m_data = m_inline;
+		m_capacity = inlineSize;
+	}
+
+	float *			m_data;
+	int				m_capacity;
+	FrameArena *	m_arena;
+	alignas( 32 ) float m_inline[ inlineSize ];
+};
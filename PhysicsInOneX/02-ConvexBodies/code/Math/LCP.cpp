@@ -15,11 +15,134 @@ VecN LCP_GaussSeidel( const MatN & A, const VecN & b ) {
 
 	for ( int iter = 0; iter < N; iter++ ) {
 		for ( int i = 0; i < N; i++ ) {
-			float dx = ( b[ i ] - A.rows[ i ].Dot( x ) ) / A.rows[ i ][ i ];
+			float dx = ( b[ i ] - DenseDot( A.Row( i ), x.data, N ) ) / A( i, i );
 			if ( dx * 0.0f == dx * 0.0f ) {
 				x[ i ] = x[ i ] + dx;
 			}
 		}
 	}
 	return x;
+}
+
+/*
+====================================================
+LCP_Lemke
+====================================================
+*/
+bool LCP_Lemke( const MatN & A, const VecN & b, VecN & x ) {
+	const int N = b.N;
+	if ( N > LCP_MAX_DIRECT || A.numDimensions != N ) {
+		return false;
+	}
+
+	x = VecN( N, x.Arena() );
+	x.Zero();
+
+	// With q = -b, the trivial solution x = 0 holds when q is non-negative
+	int enteringRow = -1;
+	float minQ = 0.0f;
+	for ( int i = 0; i < N; i++ ) {
+		if ( -b[ i ] < minQ ) {
+			minQ = -b[ i ];
+			enteringRow = i;
+		}
+	}
+	if ( -1 == enteringRow ) {
+		return true;
+	}
+
+	// Tableau for:  I * w - A * x - e * z0 = q
+	// Columns [0, N) are w, [N, 2N) are x, 2N is the artificial z0 and 2N+1 is q
+	const int colZ0 = 2 * N;
+	const int colQ = 2 * N + 1;
+	float tableau[ LCP_MAX_DIRECT ][ 2 * LCP_MAX_DIRECT + 2 ];
+	int basis[ LCP_MAX_DIRECT ];
+	for ( int i = 0; i < N; i++ ) {
+		for ( int j = 0; j < N; j++ ) {
+			tableau[ i ][ j ] = ( i == j ) ? 1.0f : 0.0f;
+			tableau[ i ][ N + j ] = -A( i, j );
+		}
+		tableau[ i ][ colZ0 ] = -1.0f;
+		tableau[ i ][ colQ ] = -b[ i ];
+		basis[ i ] = i;
+	}
+
+	const float epsilon = 1e-7f;
+	const int maxPivots = 50 * N;
+
+	int pivotRow = enteringRow;
+	int pivotCol = colZ0;
+	for ( int iter = 0; iter < maxPivots; iter++ ) {
+		// Pivot the entering column into the basis
+		const float invPivot = 1.0f / tableau[ pivotRow ][ pivotCol ];
+		for ( int j = 0; j <= colQ; j++ ) {
+			tableau[ pivotRow ][ j ] *= invPivot;
+		}
+		for ( int i = 0; i < N; i++ ) {
+			if ( i == pivotRow ) {
+				continue;
+			}
+			const float factor = tableau[ i ][ pivotCol ];
+			if ( 0.0f == factor ) {
+				continue;
+			}
+			for ( int j = 0; j <= colQ; j++ ) {
+				tableau[ i ][ j ] -= factor * tableau[ pivotRow ][ j ];
+			}
+		}
+
+		const int leaving = basis[ pivotRow ];
+		basis[ pivotRow ] = pivotCol;
+
+		// Once the artificial variable leaves, the basis is a complementary solution
+		if ( colZ0 == leaving ) {
+			for ( int i = 0; i < N; i++ ) {
+				if ( basis[ i ] >= N && basis[ i ] < colZ0 ) {
+					x[ basis[ i ] - N ] = tableau[ i ][ colQ ];
+				}
+			}
+			return true;
+		}
+
+		// The complement of the leaving variable enters next
+		pivotCol = ( leaving < N ) ? ( leaving + N ) : ( leaving - N );
+
+		// Minimum ratio test, ties go to the artificial variable so that we terminate early
+		pivotRow = -1;
+		float minRatio = 1e30f;
+		for ( int i = 0; i < N; i++ ) {
+			const float coeff = tableau[ i ][ pivotCol ];
+			if ( coeff <= epsilon ) {
+				continue;
+			}
+			const float ratio = tableau[ i ][ colQ ] / coeff;
+			if ( ratio < minRatio - epsilon || ( ratio < minRatio + epsilon && colZ0 == basis[ i ] ) ) {
+				minRatio = ratio;
+				pivotRow = i;
+			}
+		}
+
+		// Unbounded ray, Lemke can't find a solution for this matrix
+		if ( -1 == pivotRow ) {
+			return false;
+		}
+	}
+
+	return false;
+}
+
+/*
+====================================================
+LCP_Solve
+====================================================
+*/
+VecN LCP_Solve( const MatN & A, const VecN & b ) {
+	if ( b.N <= LCP_MAX_DIRECT ) {
+		VecN x;
+		if ( LCP_Lemke( A, b, x ) ) {
+			return x;
+		}
+	}
+
+	return LCP_GaussSeidel( A, b );
 }
\ No newline at end of file
@@ -5,10 +5,32 @@
 #include "Vector.h"
 #include "Matrix.h"
 
+// Largest system that is solved by pivoting.  Bigger systems go to Gauss-Seidel.
+static const int LCP_MAX_DIRECT = 32;
 
 /*
 ====================================================
 LCP_GaussSeidel
 ====================================================
 */
-VecN LCP_GaussSeidel( const MatN & A, const VecN & b );
\ No newline at end of file
+VecN LCP_GaussSeidel( const MatN & A, const VecN & b );
+
+/*
+====================================================
+LCP_Lemke
+
+Solves the complementarity problem A * x - b = w, with x >= 0, w >= 0 and x.w = 0
+using Lemke's pivoting method on a fixed size tableau.  Returns false when the
+system is too large or when the pivoting does not terminate.
+====================================================
+*/
+bool LCP_Lemke( const MatN & A, const VecN & b, VecN & x );
+
+/*
+====================================================
+LCP_Solve
+
+Exact solve for small systems, iterative solve otherwise.
+====================================================
+*/
+VecN LCP_Solve( const MatN & A, const VecN & b );
\ No newline at end of file
@@ -0,0 +1,185 @@
+//
+//	Lanes.h
+//
+#pragma once
+#include <math.h>
+#include "Vector.h"
+#include "Matrix.h"
+
+/*
+ * SIMD lanes, 8 wide with AVX, 4 wide with SSE, scalar otherwise
+ */
+#if defined(__AVX__)
+#include <immintrin.h>
+typedef __m256 lane_t;
+static const int numLanes = 8;
+static inline lane_t LaneLoad(const float* p) { return _mm256_load_ps(p); }
+static inline void LaneStore(float* p, const lane_t v) { _mm256_store_ps(p, v); }
+static inline lane_t LaneLoadUnaligned(const float* p) { return _mm256_loadu_ps(p); }
+static inline void LaneStoreUnaligned(float* p, const lane_t v) { _mm256_storeu_ps(p, v); }
+static inline lane_t LaneSet(const float f) { return _mm256_set1_ps(f); }
+static inline lane_t LaneAdd(const lane_t a, const lane_t b) { return _mm256_add_ps(a, b); }
+static inline lane_t LaneSub(const lane_t a, const lane_t b) { return _mm256_sub_ps(a, b); }
+static inline lane_t LaneMul(const lane_t a, const lane_t b) { return _mm256_mul_ps(a, b); }
+static inline lane_t LaneDiv(const lane_t a, const lane_t b) { return _mm256_div_ps(a, b); }
+static inline lane_t LaneSqrt(const lane_t a) { return _mm256_sqrt_ps(a); }
+static inline lane_t LaneIfFinite(const lane_t x, const lane_t v) {
+	const lane_t zero = _mm256_mul_ps(x, _mm256_setzero_ps());
+	return _mm256_and_ps(_mm256_cmp_ps(zero, zero, _CMP_EQ_OQ), v);
+}
+static inline lane_t LaneSelectFinite(const lane_t x, const lane_t ifFinite, const lane_t otherwise) {
+	const lane_t zero = _mm256_mul_ps(x, _mm256_setzero_ps());
+	return _mm256_blendv_ps(otherwise, ifFinite, _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ));
+}
+#elif defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+typedef __m128 lane_t;
+static const int numLanes = 4;
+static inline lane_t LaneLoad(const float* p) { return _mm_load_ps(p); }
+static inline void LaneStore(float* p, const lane_t v) { _mm_store_ps(p, v); }
+static inline lane_t LaneLoadUnaligned(const float* p) { return _mm_loadu_ps(p); }
+static inline void LaneStoreUnaligned(float* p, const lane_t v) { _mm_storeu_ps(p, v); }
+static inline lane_t LaneSet(const float f) { return _mm_set1_ps(f); }
+static inline lane_t LaneAdd(const lane_t a, const lane_t b) { return _mm_add_ps(a, b); }
+static inline lane_t LaneSub(const lane_t a, const lane_t b) { return _mm_sub_ps(a, b); }
+static inline lane_t LaneMul(const lane_t a, const lane_t b) { return _mm_mul_ps(a, b); }
+static inline lane_t LaneDiv(const lane_t a, const lane_t b) { return _mm_div_ps(a, b); }
+static inline lane_t LaneSqrt(const lane_t a) { return _mm_sqrt_ps(a); }
+static inline lane_t LaneIfFinite(const lane_t x, const lane_t v) {
+	const lane_t zero = _mm_mul_ps(x, _mm_setzero_ps());
+	return _mm_and_ps(_mm_cmpeq_ps(zero, zero), v);
+}
+static inline lane_t LaneSelectFinite(const lane_t x, const lane_t ifFinite, const lane_t otherwise) {
+	const lane_t zero = _mm_mul_ps(x, _mm_setzero_ps());
+	const lane_t mask = _mm_cmpeq_ps(zero, zero);
+	return _mm_or_ps(_mm_and_ps(mask, ifFinite), _mm_andnot_ps(mask, otherwise));
+}
+#else
+typedef float lane_t;
+static const int numLanes = 1;
+static inline lane_t LaneLoad(const float* p) { return *p; }
+static inline void LaneStore(float* p, const lane_t v) { *p = v; }
+static inline lane_t LaneLoadUnaligned(const float* p) { return *p; }
+static inline void LaneStoreUnaligned(float* p, const lane_t v) { *p = v; }
+static inline lane_t LaneSet(const float f) { return f; }
+static inline lane_t LaneAdd(const lane_t a, const lane_t b) { return a + b; }
+static inline lane_t LaneSub(const lane_t a, const lane_t b) { return a - b; }
+static inline lane_t LaneMul(const lane_t a, const lane_t b) { return a * b; }
+static inline lane_t LaneDiv(const lane_t a, const lane_t b) { return a / b; }
+static inline lane_t LaneSqrt(const lane_t a) { return sqrtf(a); }
+static inline lane_t LaneIfFinite(const lane_t x, const lane_t v) { return (x * 0.0f == x * 0.0f) ? v : 0.0f; }
+static inline lane_t LaneSelectFinite(const lane_t x, const lane_t ifFinite, const lane_t otherwise) { return (x * 0.0f == x * 0.0f) ? ifFinite : otherwise; }
+#endif
+
+struct Vec3Lanes
+{
+	lane_t x;
+	lane_t y;
+	lane_t z;
+};
+
+static inline Vec3Lanes Add(const Vec3Lanes& a, const Vec3Lanes& b) {
+	return Vec3Lanes{ LaneAdd(a.x, b.x), LaneAdd(a.y, b.y), LaneAdd(a.z, b.z) };
+}
+
+static inline Vec3Lanes Sub(const Vec3Lanes& a, const Vec3Lanes& b) {
+	return Vec3Lanes{ LaneSub(a.x, b.x), LaneSub(a.y, b.y), LaneSub(a.z, b.z) };
+}
+
+static inline Vec3Lanes Scale(const Vec3Lanes& a, const lane_t s) {
+	return Vec3Lanes{ LaneMul(a.x, s), LaneMul(a.y, s), LaneMul(a.z, s) };
+}
+
+static inline lane_t Dot(const Vec3Lanes& a, const Vec3Lanes& b) {
+	return LaneAdd(LaneAdd(LaneMul(a.x, b.x), LaneMul(a.y, b.y)), LaneMul(a.z, b.z));
+}
+
+static inline Vec3Lanes Cross(const Vec3Lanes& a, const Vec3Lanes& b) {
+	return Vec3Lanes{
+		LaneSub(LaneMul(a.y, b.z), LaneMul(a.z, b.y)),
+		LaneSub(LaneMul(a.z, b.x), LaneMul(a.x, b.z)),
+		LaneSub(LaneMul(a.x, b.y), LaneMul(a.y, b.x))
+	};
+}
+
+struct Mat3Lanes
+{
+	Vec3Lanes rows[3];
+};
+
+static inline Vec3Lanes Mul(const Mat3Lanes& m, const Vec3Lanes& v) {
+	return Vec3Lanes{ Dot(m.rows[0], v), Dot(m.rows[1], v), Dot(m.rows[2], v) };
+}
+
+// Mat3 * Mat3, summed in the same order
+static inline Mat3Lanes Mul(const Mat3Lanes& a, const Mat3Lanes& b) {
+	const Vec3Lanes columns[3] = {
+		Vec3Lanes{ b.rows[0].x, b.rows[1].x, b.rows[2].x },
+		Vec3Lanes{ b.rows[0].y, b.rows[1].y, b.rows[2].y },
+		Vec3Lanes{ b.rows[0].z, b.rows[1].z, b.rows[2].z }
+	};
+	Mat3Lanes m;
+	for (int i = 0; i < 3; i++) {
+		m.rows[i] = Vec3Lanes{ Dot(a.rows[i], columns[0]), Dot(a.rows[i], columns[1]), Dot(a.rows[i], columns[2]) };
+	}
+	return m;
+}
+
+static inline Mat3Lanes Transpose(const Mat3Lanes& m) {
+	Mat3Lanes t;
+	t.rows[0] = Vec3Lanes{ m.rows[0].x, m.rows[1].x, m.rows[2].x };
+	t.rows[1] = Vec3Lanes{ m.rows[0].y, m.rows[1].y, m.rows[2].y };
+	t.rows[2] = Vec3Lanes{ m.rows[0].z, m.rows[1].z, m.rows[2].z };
+	return t;
+}
+
+static inline Mat3Lanes Scale(const Mat3Lanes& m, const lane_t s) {
+	return Mat3Lanes{ { Scale(m.rows[0], s), Scale(m.rows[1], s), Scale(m.rows[2], s) } };
+}
+
+/*
+ * Rows in structure of arrays layout, one lane per item
+ */
+static inline void StoreVec3(float dst[3][numLanes], const int lane, const Vec3& v) {
+	dst[0][lane] = v.x;
+	dst[1][lane] = v.y;
+	dst[2][lane] = v.z;
+}
+
+static inline void StoreMat3(float dst[9][numLanes], const int lane, const Mat3& m) {
+	for (int i = 0; i < 3; i++) {
+		StoreVec3(dst + i * 3, lane, m.rows[i]);
+	}
+}
+
+static inline Vec3 GetVec3(const float src[3][numLanes], const int lane) {
+	return Vec3(src[0][lane], src[1][lane], src[2][lane]);
+}
+
+static inline Mat3 GetMat3(const float src[9][numLanes], const int lane) {
+	return Mat3(GetVec3(src, lane), GetVec3(src + 3, lane), GetVec3(src + 6, lane));
+}
+
+static inline Vec3Lanes LoadVec3(const float src[3][numLanes]) {
+	return Vec3Lanes{ LaneLoad(src[0]), LaneLoad(src[1]), LaneLoad(src[2]) };
+}
+
+static inline Mat3Lanes LoadMat3(const float src[9][numLanes]) {
+	Mat3Lanes m;
+	for (int i = 0; i < 3; i++) {
+		m.rows[i] = LoadVec3(src + i * 3);
+	}
+	return m;
+}
+
+static inline void StoreVec3Lanes(float dst[3][numLanes], const Vec3Lanes& v) {
+	LaneStore(dst[0], v.x);
+	LaneStore(dst[1], v.y);
+	LaneStore(dst[2], v.z);
+}
+
+static inline void StoreMat3Lanes(float dst[9][numLanes], const Mat3Lanes& m) {
+	for (int i = 0; i < 3; i++) {
+		StoreVec3Lanes(dst + i * 3, m.rows[i]);
+	}
+}
@@ -541,54 +541,103 @@ inline Mat4 Mat4::operator * ( const Mat4 & rhs ) const {
 /*
 ====================================================
 MatMN
+
+Row major, the M rows of N floats follow each other in data.  Small matrices are
+stored inline, larger ones on the heap or in the arena given at construction.
+Copies and products draw from the same arena as the left hand side.
 ====================================================
 */
 class MatMN {
 public:
-	MatMN() : M( 0 ), N( 0 ) {}
-	MatMN( int M, int N );
-	MatMN( const MatMN & rhs ) {
-		*this = rhs;
-	}
-	~MatMN() { delete[] rows; }
+	static const int inlineSize = 64;
+
+	MatMN() : M( 0 ), N( 0 ), data( m_storage.Data() ) {}
+	MatMN( int M, int N, FrameArena * arena = nullptr );
+	MatMN( const MatMN & rhs );
+	MatMN( MatMN && rhs );
 
 	const MatMN & operator = ( const MatMN & rhs );
+	const MatMN & operator = ( MatMN && rhs );
 	const MatMN & operator *= ( float rhs );
 	VecN operator * ( const VecN & rhs ) const;
 	MatMN operator * ( const MatMN & rhs ) const;
 	MatMN operator * ( const float rhs ) const;
 
+	float			operator () ( const int m, const int n ) const { return data[ m * N + n ]; }
+	float &			operator () ( const int m, const int n ) { return data[ m * N + n ]; }
+	const float *	Row( const int m ) const { return data + m * N; }
+	float *			Row( const int m ) { return data + m * N; }
+
 	void Zero();
 	MatMN Transpose() const;
 
+	FrameArena * Arena() const { return m_storage.Arena(); }
+
+private:
+	DenseStorage< inlineSize > m_storage;
+
 public:
 	int		M;	// M rows
 	int		N;	// N columns
-	VecN *	rows;
+	float *	data;
 };
 
-inline MatMN::MatMN( int _M, int _N ) {
+inline MatMN::MatMN( int _M, int _N, FrameArena * arena ) : m_storage( arena ) {
+	m_storage.Reserve( _M * _N );
 	M = _M;
 	N = _N;
-	rows = new VecN[ M ];
-	for ( int m = 0; m < M; m++ ) {
-		rows[ m ] = VecN( N );
-	}
+	data = m_storage.Data();
+}
+
+inline MatMN::MatMN( const MatMN & rhs ) : m_storage( rhs.Arena() ) {
+	m_storage.Reserve( rhs.M * rhs.N );
+	M = rhs.M;
+	N = rhs.N;
+	data = m_storage.Data();
+	memcpy( data, rhs.data, sizeof( float ) * M * N );
+}
+
+inline MatMN::MatMN( MatMN && rhs ) {
+	m_storage.Take( rhs.m_storage, rhs.M * rhs.N );
+	M = rhs.M;
+	N = rhs.N;
+	data = m_storage.Data();
+	rhs.M = 0;
+	rhs.N = 0;
+	rhs.data = rhs.m_storage.Data();
 }
 
 inline const MatMN & MatMN::operator = ( const MatMN & rhs ) {
+	if ( this == &rhs ) {
+		return *this;
+	}
+
+	m_storage.Reserve( rhs.M * rhs.N );
 	M = rhs.M;
 	N = rhs.N;
-	rows = new VecN[ M ];
-	for ( int m = 0; m < M; m++ ) {
-		rows[ m ] = rhs.rows[ m ];
+	data = m_storage.Data();
+	memcpy( data, rhs.data, sizeof( float ) * M * N );
+	return *this;
+}
+
+inline const MatMN & MatMN::operator = ( MatMN && rhs ) {
+	if ( this == &rhs ) {
+		return *this;
 	}
+
+	m_storage.Take( rhs.m_storage, rhs.M * rhs.N );
+	M = rhs.M;
+	N = rhs.N;
+	data = m_storage.Data();
+	rhs.M = 0;
+	rhs.N = 0;
+	rhs.data = rhs.m_storage.Data();
 	return *this;
 }
 
 inline const MatMN & MatMN::operator *= ( float rhs ) {
-	for ( int m = 0; m < M; m++ ) {
-		rows[ m ] *= rhs;
+	for ( int i = 0; i < M * N; i++ ) {
+		data[ i ] *= rhs;
 	}
 	return *this;
 }
@@ -599,25 +648,23 @@ inline VecN MatMN::operator * ( const VecN & rhs ) const {
 		return rhs;
 	}
 
-	VecN tmp( M );
-	for ( int m = 0; m < M; m++ ) {
-		tmp[ m ] = rhs.Dot( rows[ m ] );
-	}
+	VecN tmp( M, Arena() );
+	DenseMulVec( tmp.data, data, rhs.data, M, N );
 	return tmp;
 }
 
 inline MatMN MatMN::operator * ( const MatMN & rhs ) const {
 	// Check that the incoming matrix of the correct dimension
-	if ( rhs.M != N && rhs.N != M ) {
+	if ( rhs.M != N ) {
 		return rhs;
 	}
 
-	MatMN tranposedRHS = rhs.Transpose();
-
-	MatMN tmp( M, rhs.N );
+	// Each row of the product sums the rows of rhs, so everything is read in order
+	MatMN tmp( M, rhs.N, Arena() );
+	tmp.Zero();
 	for ( int m = 0; m < M; m++ ) {
-		for ( int n = 0; n < rhs.N; n++ ) {
-			tmp.rows[ m ][ n ] = rows[ m ].Dot( tranposedRHS.rows[ n ] );
+		for ( int n = 0; n < N; n++ ) {
+			DenseAxpy( tmp.Row( m ), ( *this )( m, n ), rhs.Row( n ), rhs.N );
 		}
 	}
 	return tmp;
@@ -625,25 +672,19 @@ inline MatMN MatMN::operator * ( const MatMN & rhs ) const {
 
 inline MatMN MatMN::operator * ( const float rhs ) const {
 	MatMN tmp = *this;
-	for ( int m = 0; m < M; m++ ) {
-		for ( int n = 0; n < N; n++ ) {
-			tmp.rows[ m ][ n ] *= rhs;
-		}
-	}
+	tmp *= rhs;
 	return tmp;
 }
 
 inline void MatMN::Zero() {
-	for ( int m = 0; m < M; m++ ) {
-		rows[ m ].Zero();
-	}
+	memset( data, 0, sizeof( float ) * M * N );
 }
 
 inline MatMN MatMN::Transpose() const {
-	MatMN tmp( N, M );
+	MatMN tmp( N, M, Arena() );
 	for ( int m = 0; m < M; m++ ) {
 		for ( int n = 0; n < N; n++ ) {
-			tmp.rows[ n ][ m ] = rows[ m ][ n ];
+			tmp( n, m ) = ( *this )( m, n );
 		}		
 	}
 	return tmp;
@@ -652,50 +693,98 @@ inline MatMN MatMN::Transpose() const {
 /*
 ====================================================
 MatN
+
+Square MatMN, stored the same way.
 ====================================================
 */
 class MatN {
 public:
-	MatN() : numDimensions( 0 ) {}
-	MatN( int N );
-	MatN( const MatN & rhs ) {
-		*this = rhs;
-	}
-	MatN( const MatMN & rhs ) {
-		*this = rhs;
-	}
-	~MatN() { delete[] rows; }
+	static const int inlineSize = 64;
+
+	MatN() : numDimensions( 0 ), data( m_storage.Data() ) {}
+	MatN( int N, FrameArena * arena = nullptr );
+	MatN( const MatN & rhs );
+	MatN( MatN && rhs );
+	MatN( const MatMN & rhs );
 
 	const MatN & operator = ( const MatN & rhs );
+	const MatN & operator = ( MatN && rhs );
 	const MatN & operator = ( const MatMN & rhs );
 
+	float			operator () ( const int i, const int j ) const { return data[ i * numDimensions + j ]; }
+	float &			operator () ( const int i, const int j ) { return data[ i * numDimensions + j ]; }
+	const float *	Row( const int i ) const { return data + i * numDimensions; }
+	float *			Row( const int i ) { return data + i * numDimensions; }
+
 	void Identity();
 	void Zero();
 	void Transpose();
 
 	void operator *= ( float rhs );
-	VecN operator * ( const VecN & rhs );
-	MatN operator * ( const MatN & rhs );
+	VecN operator * ( const VecN & rhs ) const;
+	MatN operator * ( const MatN & rhs ) const;
+
+	FrameArena * Arena() const { return m_storage.Arena(); }
+
+private:
+	DenseStorage< inlineSize > m_storage;
 
 public:
 	int		numDimensions;
-	VecN *	rows;
+	float *	data;
+
+private:
+	void Assign( const float * rhs, int N );
 };
 
-inline MatN::MatN( int N ) {
+inline MatN::MatN( int N, FrameArena * arena ) : m_storage( arena ) {
+	m_storage.Reserve( N * N );
 	numDimensions = N;
-	rows = new VecN[ N ];
-	for ( int i = 0; i < N; i++ ) {
-		rows[ i ] = VecN( N );
-	}
+	data = m_storage.Data();
 }
 
-inline const MatN & MatN::operator = ( const MatN & rhs ) {
+inline MatN::MatN( const MatN & rhs ) : m_storage( rhs.Arena() ) {
+	Assign( rhs.data, rhs.numDimensions );
+}
+
+inline MatN::MatN( MatN && rhs ) {
+	m_storage.Take( rhs.m_storage, rhs.numDimensions * rhs.numDimensions );
 	numDimensions = rhs.numDimensions;
-	rows = new VecN[ numDimensions ];
-	for ( int i = 0; i < numDimensions; i++ ) {
-		rows[ i ] = rhs.rows[ i ];
+	data = m_storage.Data();
+	rhs.numDimensions = 0;
+	rhs.data = rhs.m_storage.Data();
+}
+
+inline MatN::MatN( const MatMN & rhs ) : m_storage( rhs.Arena() ) {
+	numDimensions = 0;
+	data = m_storage.Data();
+	*this = rhs;
+}
+
+inline void MatN::Assign( const float * rhs, int N ) {
+	m_storage.Reserve( N * N );
+	numDimensions = N;
+	data = m_storage.Data();
+	memcpy( data, rhs, sizeof( float ) * N * N );
+}
+
+inline const MatN & MatN::operator = ( const MatN & rhs ) {
+	if ( this != &rhs ) {
+		Assign( rhs.data, rhs.numDimensions );
+	}
+	return *this;
+}
+
+inline const MatN & MatN::operator = ( MatN && rhs ) {
+	if ( this == &rhs ) {
+		return *this;
 	}
+
+	m_storage.Take( rhs.m_storage, rhs.numDimensions * rhs.numDimensions );
+	numDimensions = rhs.numDimensions;
+	data = m_storage.Data();
+	rhs.numDimensions = 0;
+	rhs.data = rhs.m_storage.Data();
 	return *this;
 }
 
@@ -704,62 +793,50 @@ inline const MatN & MatN::operator = ( const MatMN & rhs ) {
 		return *this;
 	}
 
-	numDimensions = rhs.N;
-	rows = new VecN[ numDimensions ];
-	for ( int i = 0; i < numDimensions; i++ ) {
-		rows[ i ] = rhs.rows[ i ];
-	}
+	Assign( rhs.data, rhs.N );
 	return *this;
 }
 
 inline void MatN::Zero() {
-	for ( int i = 0; i < numDimensions; i++ ) {
-		rows[ i ].Zero();
-	}
+	memset( data, 0, sizeof( float ) * numDimensions * numDimensions );
 }
 
 inline void MatN::Identity() {
+	Zero();
 	for ( int i = 0; i < numDimensions; i++ ) {
-		rows[ i ].Zero();
-		rows[ i ][ i ] = 1.0f;
+		( *this )( i, i ) = 1.0f;
 	}
 }
 
 inline void MatN::Transpose() {
-	MatN tmp( numDimensions );
-
 	for ( int i = 0; i < numDimensions; i++ ) {
-		for ( int j = 0; j < numDimensions; j++ ) {
-			tmp.rows[ i ][ j ] = rows[ j ][ i ];
+		for ( int j = i + 1; j < numDimensions; j++ ) {
+			const float tmp = ( *this )( i, j );
+			( *this )( i, j ) = ( *this )( j, i );
+			( *this )( j, i ) = tmp;
 		}
 	}
-
-	*this = tmp;
 }
 
 inline void MatN::operator *= ( float rhs ) {
-	for ( int i = 0; i < numDimensions; i++ ) {
-		rows[ i ] *= rhs;
+	for ( int i = 0; i < numDimensions * numDimensions; i++ ) {
+		data[ i ] *= rhs;
 	}
 }
 
-inline VecN MatN::operator * ( const VecN & rhs ) {
-	VecN tmp( numDimensions );
-
-	for ( int i = 0; i < numDimensions; i++ ) {
-		tmp[ i ] = rows[ i ].Dot( rhs );
-	}
-
+inline VecN MatN::operator * ( const VecN & rhs ) const {
+	VecN tmp( numDimensions, Arena() );
+	DenseMulVec( tmp.data, data, rhs.data, numDimensions, numDimensions );
 	return tmp;
 }
 
-inline MatN MatN::operator * ( const MatN & rhs ) {
-	MatN tmp( numDimensions );
+inline MatN MatN::operator * ( const MatN & rhs ) const {
+	MatN tmp( numDimensions, Arena() );
 	tmp.Zero();
 
 	for ( int i = 0; i < numDimensions; i++ ) {
 		for ( int j = 0; j < numDimensions; j++ ) {
-			tmp.rows[ i ][ j ] += rows[ i ][ j ] * rhs.rows[ j ][ i ];
+			DenseAxpy( tmp.Row( i ), ( *this )( i, j ), rhs.Row( j ), numDimensions );
 		}
 	}
 
@@ -5,6 +5,7 @@
 #include <math.h>
 #include <assert.h>
 #include <stdio.h>
+#include "Dense.h"
 
 /*
  ================================
@@ -667,15 +668,21 @@ inline bool Vec4::IsValid() const {
 /*
  ================================
  VecN
+
+ Small vectors are stored inline, larger ones on the heap or in the arena given
+ at construction.  Copies draw from the same arena as the original.
  ================================
  */
 class VecN {
 public:
-	VecN() : N( 0 ), data( NULL ) {}
-	VecN( int _N );
+	static const int inlineSize = 16;
+
+	VecN() : N( 0 ), data( m_storage.Data() ) {}
+	VecN( int _N, FrameArena * arena = nullptr );
 	VecN( const VecN & rhs );
+	VecN( VecN && rhs );
 	VecN & operator = ( const VecN & rhs );
-	~VecN() { delete[] data; }
+	VecN & operator = ( VecN && rhs );
 
 	float			operator[] ( const int idx ) const { return data[ idx ]; }
 	float &			operator[] ( const int idx ) { return data[ idx ]; }
@@ -688,33 +695,61 @@ public:
 
 	float Dot( const VecN & rhs ) const;
 	void Zero();
+
+	FrameArena * Arena() const { return m_storage.Arena(); }
 	
+private:
+	// Constructed before data, which points into it
+	DenseStorage< inlineSize > m_storage;
+
 public:
 	int		N;
 	float *	data;
 };
 
-inline VecN::VecN( int _N ) {
+inline VecN::VecN( int _N, FrameArena * arena ) : m_storage( arena ) {
+	m_storage.Reserve( _N );
 	N = _N;
-	data = new float[ _N ];
+	data = m_storage.Data();
 }
 
-inline VecN::VecN( const VecN & rhs ) {
+inline VecN::VecN( const VecN & rhs ) : m_storage( rhs.Arena() ) {
+	m_storage.Reserve( rhs.N );
 	N = rhs.N;
-	data = new float[ N ];
-	for ( int i = 0; i < N; i++ ) {
-		data[ i ] = rhs.data[ i ];
-	}
+	data = m_storage.Data();
+	memcpy( data, rhs.data, sizeof( float ) * N );
+}
+
+inline VecN::VecN( VecN && rhs ) {
+	m_storage.Take( rhs.m_storage, rhs.N );
+	N = rhs.N;
+	data = m_storage.Data();
+	rhs.N = 0;
+	rhs.data = rhs.m_storage.Data();
 }
 
 inline VecN & VecN::operator = ( const VecN & rhs ) {
-	delete[] data;
+	if ( this == &rhs ) {
+		return *this;
+	}
 
+	m_storage.Reserve( rhs.N );
 	N = rhs.N;
-	data = new float[ N ];
-	for ( int i = 0; i < N; i++ ) {
-		data[ i ] = rhs.data[ i ];
+	data = m_storage.Data();
+	memcpy( data, rhs.data, sizeof( float ) * N );
+	return *this;
+}
+
+inline VecN & VecN::operator = ( VecN && rhs ) {
+	if ( this == &rhs ) {
+		return *this;
 	}
+
+	m_storage.Take( rhs.m_storage, rhs.N );
+	N = rhs.N;
+	data = m_storage.Data();
+	rhs.N = 0;
+	rhs.data = rhs.m_storage.Data();
 	return *this;
 }
 
@@ -733,44 +768,30 @@ inline VecN VecN::operator * ( float rhs ) const {
 
 inline VecN VecN::operator + ( const VecN & rhs ) const {
 	VecN tmp = *this;
-	for ( int i = 0; i < N; i++ ) {
-		tmp.data[ i ] += rhs.data[ i ];
-	}
+	tmp += rhs;
 	return tmp;
 }
 
 inline VecN VecN::operator - ( const VecN & rhs ) const {
 	VecN tmp = *this;
-	for ( int i = 0; i < N; i++ ) {
-		tmp.data[ i ] -= rhs.data[ i ];
-	}
+	tmp -= rhs;
 	return tmp;
 }
 
 inline const VecN & VecN::operator += ( const VecN & rhs ) {
-	for ( int i = 0; i < N; i++ ) {
-		data[ i ] += rhs.data[ i ];
-	}
+	DenseAxpy( data, 1.0f, rhs.data, N );
 	return *this;
 }
 
 inline const VecN & VecN::operator -= ( const VecN & rhs ) {
-	for ( int i = 0; i < N; i++ ) {
-		data[ i ] -= rhs.data[ i ];
-	}
+	DenseAxpy( data, -1.0f, rhs.data, N );
 	return *this;
 }
 
 inline float VecN::Dot( const VecN & rhs ) const {
-	float sum = 0;
-	for ( int i = 0; i < N; i++ ) {
-		sum += data[ i ] * rhs.data[ i ];
-	}
-	return sum;
+	return DenseDot( data, rhs.data, N );
 }
 
 inline void VecN::Zero() {
-	for ( int i = 0; i < N; i++ ) {
-		data[ i ] = 0.0f;
-	}
+	memset( data, 0, sizeof( float ) * N );
 }
\ No newline at end of file
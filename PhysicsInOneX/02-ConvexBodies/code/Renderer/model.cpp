@@ -8,6 +8,7 @@
 #include <algorithm>
 #include "../../Shape.h"
 #include "../../ShapeUtils.h"
+#include "../../ShapeCache.h"
 
 #pragma warning( disable : 4996 )
 
@@ -424,16 +425,103 @@ bool Model::BuildFromShape(const Shape* shape) {
 			}
 		}
 	}
+	else if (shape->GetType() == Shape::ShapeType::SHAPE_CAPSULE) {
+		const ShapeCapsule* shapeCapsule = (const ShapeCapsule*)shape;
+
+		m_vertices.clear();
+		m_indices.clear();
+
+		// A sphere pulled apart at its equator, the stretched band is the side
+		FillSphere(*this, shapeCapsule->radius);
+		for (int v = 0; v < (int)m_vertices.size(); v++) {
+			const float offset = (m_vertices[v].xyz[2] >= 0.0f) ? shapeCapsule->halfHeight : -shapeCapsule->halfHeight;
+			for (int i = 0; i < 3; i++) {
+				m_vertices[v].xyz[i] *= shapeCapsule->radius;
+			}
+			m_vertices[v].xyz[2] += offset;
+		}
+	}
+	else if (shape->GetType() == Shape::ShapeType::SHAPE_CYLINDER) {
+		const ShapeCylinder* shapeCylinder = (const ShapeCylinder*)shape;
+
+		m_vertices.clear();
+		m_indices.clear();
+
+		// Side and caps don't share vertices, their normals differ
+		const int numSegments = 32;
+		auto addVert = [&](const Vec3& pos, const Vec3& norm) {
+			vert_t vert;
+			memset(&vert, 0, sizeof(vert_t));
+
+			vert.xyz[0] = pos.x;
+			vert.xyz[1] = pos.y;
+			vert.xyz[2] = pos.z;
+
+			vert.norm[0] = FloatToByte_n11(norm[0]);
+			vert.norm[1] = FloatToByte_n11(norm[1]);
+			vert.norm[2] = FloatToByte_n11(norm[2]);
+			vert.norm[3] = FloatToByte_n11(0.0f);
+
+			m_vertices.push_back(vert);
+			return (unsigned int)m_vertices.size() - 1;
+		};
+
+		const float r = shapeCylinder->radius;
+		const float h = shapeCylinder->halfHeight;
+		const unsigned int top = addVert(Vec3(0.0f, 0.0f, h), Vec3(0.0f, 0.0f, 1.0f));
+		const unsigned int bottom = addVert(Vec3(0.0f, 0.0f, -h), Vec3(0.0f, 0.0f, -1.0f));
+		for (int i = 0; i < numSegments; i++) {
+			const float angle0 = 6.2831853f * i / numSegments;
+			const float angle1 = 6.2831853f * (i + 1) / numSegments;
+			const Vec3 dir0(cosf(angle0), sinf(angle0), 0.0f);
+			const Vec3 dir1(cosf(angle1), sinf(angle1), 0.0f);
+
+			const unsigned int s00 = addVert(dir0 * r + Vec3(0.0f, 0.0f, -h), dir0);
+			const unsigned int s10 = addVert(dir1 * r + Vec3(0.0f, 0.0f, -h), dir1);
+			const unsigned int s01 = addVert(dir0 * r + Vec3(0.0f, 0.0f, h), dir0);
+			const unsigned int s11 = addVert(dir1 * r + Vec3(0.0f, 0.0f, h), dir1);
+			const unsigned int t0 = addVert(dir0 * r + Vec3(0.0f, 0.0f, h), Vec3(0.0f, 0.0f, 1.0f));
+			const unsigned int t1 = addVert(dir1 * r + Vec3(0.0f, 0.0f, h), Vec3(0.0f, 0.0f, 1.0f));
+			const unsigned int b0 = addVert(dir0 * r + Vec3(0.0f, 0.0f, -h), Vec3(0.0f, 0.0f, -1.0f));
+			const unsigned int b1 = addVert(dir1 * r + Vec3(0.0f, 0.0f, -h), Vec3(0.0f, 0.0f, -1.0f));
+
+			const unsigned int tris[12] = { s00, s10, s11, s00, s11, s01, top, t0, t1, bottom, b1, b0 };
+			m_indices.insert(m_indices.end(), tris, tris + 12);
+		}
+	}
+	else if (shape->GetType() == Shape::ShapeType::SHAPE_PLANE) {
+		m_vertices.clear();
+		m_indices.clear();
+
+		// Only a patch around the body, the plane itself has no end
+		const float halfSize = 100.0f;
+		for (int i = 0; i < 4; i++) {
+			vert_t vert;
+			memset(&vert, 0, sizeof(vert_t));
+
+			vert.xyz[0] = (i & 1) ? halfSize : -halfSize;
+			vert.xyz[1] = (i & 2) ? halfSize : -halfSize;
+			vert.xyz[2] = 0.0f;
+
+			vert.norm[0] = FloatToByte_n11(0.0f);
+			vert.norm[1] = FloatToByte_n11(0.0f);
+			vert.norm[2] = FloatToByte_n11(1.0f);
+			vert.norm[3] = FloatToByte_n11(0.0f);
+
+			m_vertices.push_back(vert);
+		}
+		const unsigned int quad[6] = { 0, 1, 3, 0, 3, 2 };
+		m_indices.insert(m_indices.end(), quad, quad + 6);
+	}
 	else if (shape->GetType() == Shape::ShapeType::SHAPE_CONVEX) {
 		const ShapeConvex* shapeConvex = (const ShapeConvex*)shape;
 
 		m_vertices.clear();
 		m_indices.clear();
 
-		// Build the connected convex hull from the points
-		std::vector<Vec3> hullPts;
-		std::vector<Tri> hullTris;
-		BuildConvexHull(shapeConvex->points, hullPts, hullTris);
+		// The shape already keeps its connected convex hull
+		const std::vector<Vec3> hullPts(shapeConvex->points, shapeConvex->points + shapeConvex->numPoints);
+		const std::vector<Tri> hullTris(shapeConvex->tris, shapeConvex->tris + shapeConvex->numTris);
 
 		// Calculate smoothed normals
 		std::vector< Vec3 > normals;
@@ -487,6 +575,260 @@ bool Model::BuildFromShape(const Shape* shape) {
 			m_indices.push_back(hullTris[i].c);
 		}
 	}
+	else if (shape->GetType() == Shape::ShapeType::SHAPE_SCALED) {
+		const ShapeScaled* shapeScaled = (const ShapeScaled*)shape;
+		if (!BuildFromShape(shapeScaled->shape)) {
+			return false;
+		}
+
+		// Tangents follow the surface, normals go through the inverse scale
+		const Vec3& scale = shapeScaled->scale;
+		for (int v = 0; v < (int)m_vertices.size(); v++) {
+			for (int i = 0; i < 3; i++) {
+				m_vertices[v].xyz[i] *= scale[i];
+			}
+
+			Vec3 norm = Byte4ToVec3(m_vertices[v].norm);
+			norm = Vec3(norm.x / scale.x, norm.y / scale.y, norm.z / scale.z);
+			Vec3ToByte4(norm, m_vertices[v].norm);
+
+			Vec3 tang = Byte4ToVec3(m_vertices[v].tang);
+			tang = Vec3(tang.x * scale.x, tang.y * scale.y, tang.z * scale.z);
+			Vec3ToByte4(tang, m_vertices[v].tang);
+		}
+	}
+	else if (shape->GetType() == Shape::ShapeType::SHAPE_COMPOUND) {
+		const ShapeCompound* shapeCompound = (const ShapeCompound*)shape;
+
+		// One mesh for all the children, each moved to its place in the compound
+		std::vector< vert_t > vertices;
+		std::vector< unsigned int > indices;
+		for (int c = 0; c < (int)shapeCompound->children.size(); c++) {
+			const ShapeCompound::Child& child = shapeCompound->children[c];
+			if (!BuildFromShape(child.shape)) {
+				return false;
+			}
+
+			const unsigned int firstVertex = (unsigned int)vertices.size();
+			for (int v = 0; v < (int)m_vertices.size(); v++) {
+				vert_t vert = m_vertices[v];
+				const Vec3 xyz = child.orientation.RotatePoint(Vec3(vert.xyz[0], vert.xyz[1], vert.xyz[2])) + child.position;
+				for (int i = 0; i < 3; i++) {
+					vert.xyz[i] = xyz[i];
+				}
+				Vec3ToByte4(child.orientation.RotatePoint(Byte4ToVec3(vert.norm)), vert.norm);
+				Vec3ToByte4(child.orientation.RotatePoint(Byte4ToVec3(vert.tang)), vert.tang);
+				vertices.push_back(vert);
+			}
+			for (int i = 0; i < (int)m_indices.size(); i++) {
+				indices.push_back(firstVertex + m_indices[i]);
+			}
+		}
+
+		m_vertices.swap(vertices);
+		m_indices.swap(indices);
+	}
+	else if (shape->GetType() == Shape::ShapeType::SHAPE_TRIANGLE_MESH) {
+		const ShapeTriangleMesh* shapeMesh = (const ShapeTriangleMesh*)shape;
+		const Vec3* verts = shapeMesh->mesh.Verts();
+		const Tri* tris = shapeMesh->mesh.Tris();
+
+		m_vertices.clear();
+		m_indices.clear();
+
+		// Flat faces, level geometry has hard edges
+		m_vertices.reserve(shapeMesh->mesh.numTris * 3);
+		m_indices.reserve(shapeMesh->mesh.numTris * 3);
+		for (int t = 0; t < shapeMesh->mesh.numTris; t++) {
+			const int corners[3] = { tris[t].a, tris[t].b, tris[t].c };
+			Vec3 norm = (verts[corners[1]] - verts[corners[0]]).Cross(verts[corners[2]] - verts[corners[0]]);
+			norm.Normalize();
+
+			for (int i = 0; i < 3; i++) {
+				vert_t vert;
+				memset(&vert, 0, sizeof(vert_t));
+
+				vert.xyz[0] = verts[corners[i]].x;
+				vert.xyz[1] = verts[corners[i]].y;
+				vert.xyz[2] = verts[corners[i]].z;
+
+				vert.norm[0] = FloatToByte_n11(norm[0]);
+				vert.norm[1] = FloatToByte_n11(norm[1]);
+				vert.norm[2] = FloatToByte_n11(norm[2]);
+				vert.norm[3] = FloatToByte_n11(0.0f);
+
+				m_indices.push_back((unsigned int)m_vertices.size());
+				m_vertices.push_back(vert);
+			}
+		}
+	}
+	else if (shape->GetType() == Shape::ShapeType::SHAPE_HEIGHTFIELD) {
+		const ShapeHeightfield* shapeField = (const ShapeHeightfield*)shape;
+
+		m_vertices.clear();
+		m_indices.clear();
+
+		// Shared points, normals from the neighbouring heights
+		m_vertices.reserve(shapeField->numX * shapeField->numY);
+		for (int y = 0; y < shapeField->numY; y++) {
+			for (int x = 0; x < shapeField->numX; x++) {
+				const Vec3 pt = shapeField->Point(x, y);
+				const int x0 = std::max(x - 1, 0);
+				const int x1 = std::min(x + 1, shapeField->numX - 1);
+				const int y0 = std::max(y - 1, 0);
+				const int y1 = std::min(y + 1, shapeField->numY - 1);
+				const Vec3 dx = shapeField->Point(x1, y) - shapeField->Point(x0, y);
+				const Vec3 dy = shapeField->Point(x, y1) - shapeField->Point(x, y0);
+				Vec3 norm = dx.Cross(dy);
+				norm.Normalize();
+
+				vert_t vert;
+				memset(&vert, 0, sizeof(vert_t));
+
+				vert.xyz[0] = pt.x;
+				vert.xyz[1] = pt.y;
+				vert.xyz[2] = pt.z;
+
+				vert.norm[0] = FloatToByte_n11(norm[0]);
+				vert.norm[1] = FloatToByte_n11(norm[1]);
+				vert.norm[2] = FloatToByte_n11(norm[2]);
+				vert.norm[3] = FloatToByte_n11(0.0f);
+
+				m_vertices.push_back(vert);
+			}
+		}
+
+		// The same two triangles per cell as the collision
+		const int numCells = shapeField->NumCellsX() * shapeField->NumCellsY();
+		m_indices.reserve(std::max(numCells, 0) * 6);
+		for (int y = 0; y < shapeField->NumCellsY(); y++) {
+			for (int x = 0; x < shapeField->NumCellsX(); x++) {
+				const unsigned int i00 = y * shapeField->numX + x;
+				const unsigned int i10 = i00 + 1;
+				const unsigned int i01 = i00 + shapeField->numX;
+				const unsigned int i11 = i01 + 1;
+				const unsigned int cell[6] = { i00, i10, i11, i00, i11, i01 };
+				m_indices.insert(m_indices.end(), cell, cell + 6);
+			}
+		}
+	}
+	else if (shape->GetType() == Shape::ShapeType::SHAPE_SDF) {
+		const ShapeSdf* shapeSdf = (const ShapeSdf*)shape;
+		const CookedSdf& sdf = shapeSdf->sdf;
+
+		m_vertices.clear();
+		m_indices.clear();
+
+		// Surface nets over the grid of the field, so what shows is what the contacts see:
+		// a vertex in each cell the surface crosses, a quad across each crossed edge
+		int dims[3];
+		for (int i = 0; i < 3; i++) {
+			dims[i] = sdf.numBricks[i] * SdfGrid::brickCells + 1;
+		}
+		const Vec3 origin(sdf.origin);
+		Vec3 gradient;
+		std::vector<float> distances(dims[0] * dims[1] * dims[2]);
+		for (int z = 0; z < dims[2]; z++) {
+			for (int y = 0; y < dims[1]; y++) {
+				for (int x = 0; x < dims[0]; x++) {
+					const Vec3 pt = origin + Vec3((float)x, (float)y, (float)z) * sdf.cellSize;
+					distances[(z * dims[1] + y) * dims[0] + x] = shapeSdf->Distance(pt, gradient);
+				}
+			}
+		}
+
+		const int cellDims[3] = { dims[0] - 1, dims[1] - 1, dims[2] - 1 };
+		std::vector<int> cellVertices(cellDims[0] * cellDims[1] * cellDims[2], -1);
+		for (int z = 0; z < cellDims[2]; z++) {
+			for (int y = 0; y < cellDims[1]; y++) {
+				for (int x = 0; x < cellDims[0]; x++) {
+					// The crossings along the 12 edges, corner k has x, y and z in its bits
+					float d[8];
+					for (int k = 0; k < 8; k++) {
+						d[k] = distances[((z + ((k >> 2) & 1)) * dims[1] + y + ((k >> 1) & 1)) * dims[0] + x + (k & 1)];
+					}
+					Vec3 sum(0.0f);
+					int numCrossings = 0;
+					for (int k = 0; k < 8; k++) {
+						for (int bit = 1; bit < 8; bit <<= 1) {
+							if ((k & bit) != 0 || (d[k] < 0.0f) == (d[k | bit] < 0.0f)) {
+								continue;
+							}
+							const float t = d[k] / (d[k] - d[k | bit]);
+							const Vec3 from((float)(k & 1), (float)((k >> 1) & 1), (float)((k >> 2) & 1));
+							const Vec3 to((float)((k | bit) & 1), (float)(((k | bit) >> 1) & 1), (float)(((k | bit) >> 2) & 1));
+							sum += from + (to - from) * t;
+							numCrossings++;
+						}
+					}
+					if (numCrossings == 0) {
+						continue;
+					}
+
+					const Vec3 pt = origin + (Vec3((float)x, (float)y, (float)z) + sum / (float)numCrossings) * sdf.cellSize;
+					shapeSdf->Distance(pt, gradient);
+					Vec3 norm = gradient;
+					if (norm.GetLengthSqr() > 1e-12f) {
+						norm.Normalize();
+					}
+
+					vert_t vert;
+					memset(&vert, 0, sizeof(vert_t));
+
+					vert.xyz[0] = pt.x;
+					vert.xyz[1] = pt.y;
+					vert.xyz[2] = pt.z;
+
+					vert.norm[0] = FloatToByte_n11(norm[0]);
+					vert.norm[1] = FloatToByte_n11(norm[1]);
+					vert.norm[2] = FloatToByte_n11(norm[2]);
+					vert.norm[3] = FloatToByte_n11(0.0f);
+
+					cellVertices[(z * cellDims[1] + y) * cellDims[0] + x] = (int)m_vertices.size();
+					m_vertices.push_back(vert);
+				}
+			}
+		}
+
+		// The four cells around a crossed edge, counter clockwise seen from outside
+		for (int z = 0; z < dims[2]; z++) {
+			for (int y = 0; y < dims[1]; y++) {
+				for (int x = 0; x < dims[0]; x++) {
+					const int p[3] = { x, y, z };
+					const float d0 = distances[(z * dims[1] + y) * dims[0] + x];
+					for (int axis = 0; axis < 3; axis++) {
+						const int u = (axis + 1) % 3;
+						const int v = (axis + 2) % 3;
+						if (p[axis] >= cellDims[axis] || p[u] < 1 || p[u] >= cellDims[u] || p[v] < 1 || p[v] >= cellDims[v]) {
+							continue;
+						}
+						int next[3] = { x, y, z };
+						next[axis]++;
+						const float d1 = distances[(next[2] * dims[1] + next[1]) * dims[0] + next[0]];
+						if ((d0 < 0.0f) == (d1 < 0.0f)) {
+							continue;
+						}
+
+						int quad[4];
+						for (int corner = 0; corner < 4; corner++) {
+							int c[3] = { x, y, z };
+							c[u] -= (corner == 0 || corner == 3) ? 1 : 0;
+							c[v] -= (corner == 0 || corner == 1) ? 1 : 0;
+							quad[corner] = cellVertices[(c[2] * cellDims[1] + c[1]) * cellDims[0] + c[0]];
+						}
+						if (d0 >= 0.0f) {
+							// Outside first, the surface faces back down the axis
+							std::swap(quad[1], quad[3]);
+						}
+						const unsigned int tris[6] = {
+							(unsigned int)quad[0], (unsigned int)quad[1], (unsigned int)quad[2],
+							(unsigned int)quad[0], (unsigned int)quad[2], (unsigned int)quad[3] };
+						m_indices.insert(m_indices.end(), tris, tris + 6);
+					}
+				}
+			}
+		}
+	}
 		
 	return true;
 
@@ -2,9 +2,13 @@
 //  Scene.cpp
 //
 #include "Scene.h"
+#include <algorithm>
 #include "../Shape.h"
 #include "../Intersections.h"
 #include "../Broadphase.h"
+#include "../XPBD.h"
+#include "FrameArena.h"
+#include "ThreadPool.h"
 
 /*
 ========================================================================================================
@@ -143,58 +147,94 @@ Vec3 g_boxHead[] = {
 	Vec3(h2, h2, h2),
 };
 
-void AddStandardSandBox(std::vector<Body>& bodies) {
+// A posed ragdoll as a single rigid body, without joints the limbs keep their pose
+Shape* AcquireRagdollShape(ShapeRegistry& shapes) {
+	const float pi = acosf(-1.0f);
+	const Quat alongY(Vec3(0, 0, 1), 0.5f * pi);
+	const Quat alongZ(Vec3(0, 1, 0), 0.5f * pi);
+
+	ShapeCompound::Child children[6];
+	children[0].shape = shapes.AcquireBox(g_boxBody, sizeof(g_boxBody) / sizeof(Vec3));
+	children[0].position = Vec3(0, 0, 0);
+	children[1].shape = shapes.AcquireBox(g_boxHead, sizeof(g_boxHead) / sizeof(Vec3));
+	children[1].position = Vec3(0, 0, h3 + h2);
+	for (int i = 0; i < 4; i++) {
+		const float side = (i & 1) ? 1.0f : -1.0f;
+		children[2 + i].shape = shapes.AcquireBox(g_boxLimb, sizeof(g_boxLimb) / sizeof(Vec3));
+		if (i < 2) {
+			children[2 + i].position = Vec3(0, side * (w2 + h3), h3 - h2);
+			children[2 + i].orientation = alongY;
+		} else {
+			children[2 + i].position = Vec3(0, side * h2, -2.0f * h3);
+			children[2 + i].orientation = alongZ;
+		}
+	}
+
+	Shape* ragdoll = shapes.AcquireCompound(children, 6);
+	for (int i = 0; i < 6; i++) {
+		shapes.Release(children[i].shape);
+	}
+	return ragdoll;
+}
+
+void AddStandardSandBox(BodyStore& bodies, ShapeRegistry& shapes) {
+	// Every wall is the same unit box, scaled and moved to where its old box stood
+	Shape* unitBox = shapes.AcquireBox(g_boxUnit, sizeof(g_boxUnit) / sizeof(Vec3));
+
 	Body body;
 
-	body.position = Vec3(0, 0, 0);
+	body.position = Vec3(0, 0, -0.5f);
 	body.orientation = Quat(0, 0, 0, 1);
 	body.linearVelocity.Zero();
 	body.angularVelocity.Zero();
 	body.inverseMass = 0.0f;
 	body.elasticity = 0.5f;
 	body.friction = 0.5f;
-	body.shape = new ShapeBox(g_boxGround, sizeof(g_boxGround) / sizeof(Vec3));
-	bodies.push_back(body);
+	body.shape = shapes.AcquireScaled(unitBox, Vec3(w, h, 0.5f));
+	bodies.Add(body);
 
-	body.position = Vec3(50, 0, 0);
+	body.position = Vec3(50, 0, 2.5f);
 	body.orientation = Quat(0, 0, 0, 1);
 	body.linearVelocity.Zero();
 	body.angularVelocity.Zero();
 	body.inverseMass = 0.0f;
 	body.elasticity = 0.5f;
 	body.friction = 0.0f;
-	body.shape = new ShapeBox(g_boxWall0, sizeof(g_boxWall0) / sizeof(Vec3));
-	bodies.push_back(body);
+	body.shape = shapes.AcquireScaled(unitBox, Vec3(1, h, 2.5f));
+	bodies.Add(body);
 
-	body.position = Vec3(-50, 0, 0);
+	body.position = Vec3(-50, 0, 2.5f);
 	body.orientation = Quat(0, 0, 0, 1);
 	body.linearVelocity.Zero();
 	body.angularVelocity.Zero();
 	body.inverseMass = 0.0f;
 	body.elasticity = 0.5f;
 	body.friction = 0.0f;
-	body.shape = new ShapeBox(g_boxWall0, sizeof(g_boxWall0) / sizeof(Vec3));
-	bodies.push_back(body);
+	body.shape = shapes.AcquireScaled(unitBox, Vec3(1, h, 2.5f));
+	bodies.Add(body);
 
-	body.position = Vec3(0, 25, 0);
+	body.position = Vec3(0, 25, 2.5f);
 	body.orientation = Quat(0, 0, 0, 1);
 	body.linearVelocity.Zero();
 	body.angularVelocity.Zero();
 	body.inverseMass = 0.0f;
 	body.elasticity = 0.5f;
 	body.friction = 0.0f;
-	body.shape = new ShapeBox(g_boxWall1, sizeof(g_boxWall1) / sizeof(Vec3));
-	bodies.push_back(body);
+	body.shape = shapes.AcquireScaled(unitBox, Vec3(w, 1, 2.5f));
+	bodies.Add(body);
 
-	body.position = Vec3(0, -25, 0);
+	body.position = Vec3(0, -25, 2.5f);
 	body.orientation = Quat(0, 0, 0, 1);
 	body.linearVelocity.Zero();
 	body.angularVelocity.Zero();
 	body.inverseMass = 0.0f;
 	body.elasticity = 0.5f;
 	body.friction = 0.0f;
-	body.shape = new ShapeBox(g_boxWall1, sizeof(g_boxWall1) / sizeof(Vec3));
-	bodies.push_back(body);
+	body.shape = shapes.AcquireScaled(unitBox, Vec3(w, 1, 2.5f));
+	bodies.Add(body);
+
+	// The scaled shapes hold on to the box
+	shapes.Release(unitBox);
 }
 
 Vec3 g_diamond[7 * 8];
@@ -244,10 +284,10 @@ Scene::~Scene
 ====================================================
 */
 Scene::~Scene() {
-	for (int i = 0; i < bodies.size(); i++) {
-		delete bodies[i].shape;
+	for (int i = 0; i < bodies.Size(); i++) {
+		shapes.Release(bodies.ColdState(i).shape);
 	}
-	bodies.clear();
+	bodies.Clear();
 }
 
 /*
@@ -256,10 +296,11 @@ Scene::Reset
 ====================================================
 */
 void Scene::Reset() {
-	for (int i = 0; i < bodies.size(); i++) {
-		delete bodies[i].shape;
+	// The shapes stay in the registry, initializing again only takes references
+	for (int i = 0; i < bodies.Size(); i++) {
+		shapes.Release(bodies.ColdState(i).shape);
 	}
-	bodies.clear();
+	bodies.Clear();
 
 	Initialize();
 }
@@ -279,8 +320,8 @@ void Scene::Initialize() {
 	body.inverseMass = 1.0f;
 	body.elasticity = 0.5f;
 	body.friction = 0.5f;
-	body.shape = new ShapeSphere(0.5f);
-	bodies.push_back(body);
+	body.shape = shapes.AcquireSphere(0.5f);
+	bodies.Add(body);
 
 	body.position = Vec3(-10, 0, 3);
 	body.orientation = Quat(0, 0, 0, 1);
@@ -289,10 +330,108 @@ void Scene::Initialize() {
 	body.inverseMass = 1.0f;
 	body.elasticity = 0.5f;
 	body.friction = 0.5f;
-	body.shape = new ShapeConvex(g_diamond, sizeof(g_diamond) / sizeof(Vec3));
-	bodies.push_back(body);
+	body.shape = shapes.AcquireConvex(g_diamond, sizeof(g_diamond) / sizeof(Vec3));
+	bodies.Add(body);
 	
-	AddStandardSandBox(bodies);
+	AddStandardSandBox(bodies, shapes);
+}
+
+/*
+====================================================
+Scene::Reserve
+====================================================
+*/
+void Scene::Reserve(const int maxBodies, const int maxIslands) {
+	bodies.Reserve(maxBodies);
+	islands.reserve(maxIslands);
+	islandBodies.reserve(maxBodies);
+}
+
+/*
+====================================================
+Scene::RemoveBody
+====================================================
+*/
+void Scene::RemoveBody(const BodyHandle handle) {
+	const int index = bodies.IndexOf(handle);
+	if (index == -1) {
+		return;
+	}
+
+	// Whatever slept on it has to fall. A sleeping body takes its own island along, static
+	// bodies have none and wake the sleeping islands their bounds touch.
+	FrameArenaScope scope;
+	FrameVector<int> islandIds;
+	const BodyColdState& coldState = bodies.ColdState(index);
+	if (coldState.isSleeping) {
+		islandIds.push_back(coldState.islandId);
+	} else if (bodies.InverseMass(index) == 0.0f) {
+		const float epsilon = 0.01f;
+		Bounds bounds = VisitShape(coldState.shape, [&](const auto& shape) { return shape.GetBounds(bodies.Position(index), bodies.Orientation(index)); });
+		bounds.Expand(bounds.mins + Vec3(-1, -1, -1) * epsilon);
+		bounds.Expand(bounds.maxs + Vec3(1, 1, 1) * epsilon);
+
+		for (int i = 0; i < bodies.Size(); i++) {
+			const BodyColdState& other = bodies.ColdState(i);
+			if (!other.isSleeping) continue;
+
+			const Bounds otherBounds = VisitShape(other.shape, [&](const auto& shape) { return shape.GetBounds(bodies.Position(i), bodies.Orientation(i)); });
+			if (bounds.DoesIntersect(otherBounds)) {
+				islandIds.push_back(other.islandId);
+			}
+		}
+	}
+	WakeIslands(bodies, islandIds.data(), (int)islandIds.size());
+
+	shapes.Release(coldState.shape);
+	bodies.Remove(handle);
+}
+
+/*
+====================================================
+Scene::ReorderBodies
+====================================================
+*/
+// Spreads the 10 low bits of x to every third bit
+static unsigned int SpreadBits(unsigned int x) {
+	x &= 0x3ff;
+	x = (x | (x << 16)) & 0x030000ff;
+	x = (x | (x << 8)) & 0x0300f00f;
+	x = (x | (x << 4)) & 0x030c30c3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+static unsigned int MortonKey(const Vec3& pos, const Bounds& bounds) {
+	unsigned int cells[3];
+	for (int i = 0; i < 3; i++) {
+		const float width = bounds.maxs[i] - bounds.mins[i];
+		const float t = (width > 0.0f) ? (pos[i] - bounds.mins[i]) / width : 0.0f;
+		cells[i] = (unsigned int)(t * 1023.0f);
+	}
+	return SpreadBits(cells[0]) | (SpreadBits(cells[1]) << 1) | (SpreadBits(cells[2]) << 2);
+}
+
+void Scene::ReorderBodies() {
+	const int numBodies = bodies.Size();
+
+	Bounds bounds;
+	for (int i = 0; i < numBodies; i++) {
+		bounds.Expand(bodies.Position(i));
+	}
+
+	// The index breaks ties, so equal keys keep their order
+	FrameVector<unsigned long long> keys(numBodies);
+	for (int i = 0; i < numBodies; i++) {
+		keys[i] = ((unsigned long long)MortonKey(bodies.Position(i), bounds) << 32) | (unsigned int)i;
+	}
+	std::sort(keys.begin(), keys.end());
+
+	FrameVector<int> order(numBodies);
+	for (int i = 0; i < numBodies; i++) {
+		order[i] = (int)(keys[i] & 0xffffffff);
+	}
+	bodies.Reorder(order.data());
 }
 
 /*
@@ -300,71 +439,184 @@ void Scene::Initialize() {
 Scene::Update
 ====================================================
 */
+static const Vec3 gravity = Vec3(0, 0, -10);
+
 void Scene::Update(const float dt_sec) 
 {
+	// What the last step drew from the frame arenas is gone
+	ResetFrameArenas();
+
+	// Bodies pushed from outside since the last step take their island with them
+	WakePendingIslands(bodies);
+
+	// Nothing points into the bodies between steps, they are free to move
+	if (reorderInterval > 0 && ++updatesSinceReorder >= reorderInterval) {
+		ReorderBodies();
+		updatesSinceReorder = 0;
+	}
+
+	if (solverMode == SolverMode::SOLVER_XPBD) {
+		UpdateSubstepped(dt_sec);
+		return;
+	}
+
 	// Gravity
-	for (int i = 0; i < bodies.size(); ++i) 
+	for (int i = 0; i < bodies.Size(); ++i) 
 	{
-		Body& body = bodies[i];
-		float mass = 1.0f / body.inverseMass;
+		if (bodies.ColdState(i).isSleeping) continue;
+
+		float mass = 1.0f / bodies.InverseMass(i);
 		// Gravity needs to be an impulse I
 		// I == dp, so F == dp/dt <=> dp = F * dt <=> I = F * dt <=> I = m * g * dt
-		Vec3 impulseGravity = Vec3(0, 0, -10) * mass * dt_sec;
-		body.ApplyImpulseLinear(impulseGravity);
+		Vec3 impulseGravity = gravity * mass * dt_sec;
+		bodies.ApplyImpulseLinear(i, impulseGravity);
 	}
 
 	// Broadphase
-	std::vector<CollisionPair> collisionPairs;
-	BroadPhase(bodies.data(), bodies.size(), collisionPairs, dt_sec);
+	FrameVector<CollisionPair> collisionPairs;
+	BroadPhase(bodies, collisionPairs, dt_sec);
 
 	// Collision checks (Narrow phase)
-	int numContacts = 0;
-	const int maxContacts = bodies.size() * bodies.size();
-	Contact* contacts = (Contact*)alloca(sizeof(Contact) * maxContacts);
-	for (int i = 0; i < collisionPairs.size(); ++i)
+	// Pairs are independent, but Intersect moves the bodies to the time of impact and back,
+	// so each pair works on copies. Results are written per pair, then packed in pair order.
+	const int numPairs = collisionPairs.size();
+	FrameVector<Contact> contacts(numPairs);
+	FrameVector<char> isColliding(numPairs, 0);
+	FrameVector<char> isTested(numPairs, 0);
+	const auto intersectPairs = [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			if (isTested[i]) continue;
+			const CollisionPair& pair = collisionPairs[i];
+
+			// Static and sleeping bodies don't move, no need to test them against each other
+			if (!IsActive(bodies, pair.a) && !IsActive(bodies, pair.b)) continue;
+			isTested[i] = 1;
+
+			Body bodyA = bodies.GetBody(pair.a);
+			Body bodyB = bodies.GetBody(pair.b);
+			if (Intersections::Intersect(bodyA, bodyB, dt_sec, contacts[i]))
+			{
+				contacts[i].a = pair.a;
+				contacts[i].b = pair.b;
+				isColliding[i] = 1;
+			}
+		}
+	};
+	GetThreadPool().ParallelFor(numPairs, 16, intersectPairs);
+
+	// Something touched a sleeping island. It wakes whole, and the pairs inside it are tested
+	// now that they can move, or its bodies would sink into each other for a step. They rested
+	// until now and take gravity from the next step. Sleeping islands met by those pairs only
+	// wake on the next step.
+	FrameVector<int> wakeIslandIds;
+	for (int i = 0; i < numPairs; ++i)
 	{
-		const CollisionPair& pair = collisionPairs[i];
-		Body& bodyA = bodies[pair.a];
-		Body& bodyB = bodies[pair.b];
+		if (!isColliding[i]) continue;
 
-		if (bodyA.inverseMass == 0.0f && bodyB.inverseMass == 0.0f) continue;
+		const BodyColdState& a = bodies.ColdState(collisionPairs[i].a);
+		const BodyColdState& b = bodies.ColdState(collisionPairs[i].b);
+		if (a.isSleeping) wakeIslandIds.push_back(a.islandId);
+		if (b.isSleeping) wakeIslandIds.push_back(b.islandId);
+	}
+	if (!wakeIslandIds.empty()) {
+		WakeIslands(bodies, wakeIslandIds.data(), (int)wakeIslandIds.size());
+		GetThreadPool().ParallelFor(numPairs, 16, intersectPairs);
+	}
 
-		Contact contact;
-		if (Intersections::Intersect(bodyA, bodyB, dt_sec, contact))
-		{
-			contacts[numContacts] = contact;
-			++numContacts;
-		}
+	int numContacts = 0;
+	for (int i = 0; i < numPairs; ++i)
+	{
+		if (!isColliding[i]) continue;
+
+		contacts[numContacts] = contacts[i];
+		++numContacts;
 	}
 
-	// Sort times of impact
-	if (numContacts > 1) {
-		qsort(contacts, numContacts, sizeof(Contact), Contact::CompareContact);
+	// Islands don't interact, each one is solved on its own
+	BuildIslands(bodies, contacts.data(), numContacts, islands, islandBodies, nextIslandId);
+
+	// Islands with enough contacts come first and are split over all threads
+	int numSplitIslands = 0;
+	while (numSplitIslands < (int)islands.size() && islands[numSplitIslands].numContacts >= minSplitIslandContacts) {
+		SolveIsland(bodies, islands[numSplitIslands], islandBodies.data(), contacts.data(), dt_sec, isDeterministic);
+		UpdateSleeping(bodies, islands[numSplitIslands], islandBodies.data(), dt_sec, sleepSettings);
+		++numSplitIslands;
 	}
 
-	// Contact resolve in order
-	float accumulatedTime = 0.0f;
-	for (int i = 0; i < numContacts; ++i) 
-	{
-		Contact& contact = contacts[i];
-		const float dt = contact.timeOfImpact - accumulatedTime;
+	// The others are one task each, picked up largest first
+	GetThreadPool().ParallelFor(islands.size() - numSplitIslands, 1, [&](int begin, int end) {
+		for (int i = numSplitIslands + begin; i < numSplitIslands + end; ++i)
+		{
+			SolveIsland(bodies, islands[i], islandBodies.data(), contacts.data(), dt_sec, isDeterministic);
+			UpdateSleeping(bodies, islands[i], islandBodies.data(), dt_sec, sleepSettings);
+		}
+	});
+}
 
-		// Position update
-		for (int j = 0; j < bodies.size(); ++j) {
-			bodies[j].Update(dt);
+/*
+====================================================
+Scene::UpdateSubstepped
+====================================================
+*/
+void Scene::UpdateSubstepped(const float dt_sec)
+{
+	// Broadphase, its pairs are kept for all the substeps
+	FrameVector<CollisionPair> collisionPairs;
+	BroadPhase(bodies, collisionPairs, dt_sec);
+
+	// Contact points are found once, then followed by the substeps
+	const int numPairs = collisionPairs.size();
+	FrameVector<Contact> contacts(numPairs * maxManifoldPoints);
+	FrameVector<int> numPairContacts(numPairs, 0);
+	GetThreadPool().ParallelFor(numPairs, 16, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			const CollisionPair& pair = collisionPairs[i];
+			if (!IsActive(bodies, pair.a) && !IsActive(bodies, pair.b)) continue;
+
+			Body bodyA = bodies.GetBody(pair.a);
+			Body bodyB = bodies.GetBody(pair.b);
+			Contact* pairContacts = &contacts[i * maxManifoldPoints];
+			numPairContacts[i] = FindSpeculativeContacts(&bodyA, &bodyB, dt_sec, gravity, pairContacts);
+			for (int j = 0; j < numPairContacts[i]; ++j) {
+				pairContacts[j].a = pair.a;
+				pairContacts[j].b = pair.b;
+			}
 		}
+	});
 
-		Contact::ResolveContact(contact);
-		accumulatedTime += dt;
+	int numContacts = 0;
+	for (int i = 0; i < numPairs; ++i)
+	{
+		for (int j = 0; j < numPairContacts[i]; ++j) {
+			contacts[numContacts] = contacts[i * maxManifoldPoints + j];
+			++numContacts;
+		}
 	}
 
-	// Other physics behavirous, outside collisions. 
-	// Update the positions for the rest of this frame's time.
-	const float timeRemaining = dt_sec - accumulatedTime;
-	if (timeRemaining > 0.0f)
-	{
-		for (int i = 0; i < bodies.size(); ++i) {
-			bodies[i].Update(timeRemaining);
+	// Sleeping bodies act as static during the step
+	BuildIslands(bodies, contacts.data(), numContacts, islands, islandBodies, nextIslandId);
+
+	GetThreadPool().ParallelFor(islands.size(), 1, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			SolveIslandSubstepped(bodies, islands[i], islandBodies.data(), contacts.data(), dt_sec, numSubsteps, gravity, isDeterministic);
+			UpdateSleeping(bodies, islands[i], islandBodies.data(), dt_sec, sleepSettings);
 		}
+	});
+
+	// Something pushed into a sleeping island, it wakes for the next step
+	FrameVector<int> wakeIslandIds;
+	for (int i = 0; i < numContacts; ++i)
+	{
+		const Contact& contact = contacts[i];
+		if (contact.separationDistance >= 0.0f) continue;
+
+		const BodyColdState& a = bodies.ColdState(contact.a);
+		const BodyColdState& b = bodies.ColdState(contact.b);
+		if (a.isSleeping && IsActive(bodies, contact.b)) wakeIslandIds.push_back(a.islandId);
+		if (b.isSleeping && IsActive(bodies, contact.a)) wakeIslandIds.push_back(b.islandId);
 	}
+	WakeIslands(bodies, wakeIslandIds.data(), (int)wakeIslandIds.size());
 }
\ No newline at end of file
@@ -4,7 +4,9 @@
 #pragma once
 #include <vector>
 
-#include "../Body.h"
+#include "../BodyStore.h"
+#include "../Island.h"
+#include "../ShapeRegistry.h"
 
 /*
 ====================================================
@@ -13,13 +15,58 @@ Scene
 */
 class Scene {
 public:
-	Scene() { bodies.reserve( 128 ); }
+	// Impulses resolved in time of impact order, or substepped position based dynamics.
+	// The substepped solver is meant for large steps, one update per 30Hz frame.
+	enum class SolverMode {
+		SOLVER_IMPULSE,
+		SOLVER_XPBD,
+	};
+
+	Scene() { bodies.Reserve( 128 ); }
 	~Scene();
 
 	void Reset();
 	void Initialize();
+
+	// Room for this many bodies and awake islands, so the updates don't grow them
+	void Reserve(const int maxBodies, const int maxIslands);
 	void Update( const float dt_sec );	
 
-	std::vector<Body> bodies;
+	// Bodies are added to and removed from the store between updates. Removing through the
+	// scene gives back the reference the body held on its shape and wakes what rested on it.
+	void RemoveBody( const BodyHandle handle );
+
+	// Declared first, the shapes have to outlive the bodies using them
+	ShapeRegistry shapes;
+
+	BodyStore bodies;
+	SleepSettings sleepSettings;
+
+	SolverMode solverMode{ SolverMode::SOLVER_IMPULSE };
+	int numSubsteps{ 20 };
+
+	// Integrates bodies exactly like Body::Update. Off, rotations take a cheaper first order
+	// step that drifts from it.
+	bool isDeterministic{ true };
+
+	// Every reorderInterval updates, the bodies are sorted along a Morton curve of their
+	// position so that bodies close in space are close in memory. 0 never sorts.
+	int reorderInterval{ 0 };
+
+private:
+	void UpdateSubstepped( const float dt_sec );
+	void ReorderBodies();
+
+	int updatesSinceReorder{ 0 };
+
+	// Id of the next island built, sleeping islands keep theirs while bodies move or go
+	int nextIslandId{ 0 };
+
+	// Rebuilt every step, kept to reuse their memory
+	std::vector<Island> islands;
+	std::vector<int> islandBodies;
 };
 
+// A posed ragdoll as a single compound shape, released like any other
+Shape* AcquireRagdollShape(ShapeRegistry& shapes);
+
@@ -0,0 +1,176 @@
+//
+//  ThreadPool.cpp
+//
+#include "ThreadPool.h"
+
+// Set on worker threads, and on the caller while it helps with a job
+static thread_local bool s_insideJob = false;
+
+/*
+====================================================
+ThreadPool::ThreadPool
+====================================================
+*/
+ThreadPool::ThreadPool( int numWorkers ) :
+m_quit( false ),
+m_jobId( 0 ),
+m_activeWorkers( 0 ),
+m_func( nullptr ),
+m_context( nullptr ),
+m_num( 0 ),
+m_grain( 1 ),
+m_numChunks( 0 ),
+m_nextChunk( 0 ),
+m_chunksDone( 0 ) {
+	if ( numWorkers < 0 ) {
+		numWorkers = (int)std::thread::hardware_concurrency() - 1;
+	}
+
+	for ( int i = 0; i < numWorkers; i++ ) {
+		m_workers.emplace_back( &ThreadPool::WorkerLoop, this );
+	}
+}
+
+/*
+====================================================
+ThreadPool::~ThreadPool
+====================================================
+*/
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_quit = true;
+	}
+	m_wakeWorkers.notify_all();
+
+	for ( int i = 0; i < (int)m_workers.size(); i++ ) {
+		m_workers[ i ].join();
+	}
+}
+
+/*
+====================================================
+ThreadPool::WorkerLoop
+====================================================
+*/
+void ThreadPool::WorkerLoop() {
+	s_insideJob = true;
+
+	int lastJobId = 0;
+	while ( true ) {
+		{
+			std::unique_lock< std::mutex > lock( m_mutex );
+			m_wakeWorkers.wait( lock, [ & ] { return m_quit || m_jobId != lastJobId; } );
+			if ( m_quit ) {
+				return;
+			}
+			lastJobId = m_jobId;
+			m_activeWorkers++;
+		}
+
+		RunChunks();
+
+		{
+			std::lock_guard< std::mutex > lock( m_mutex );
+			m_activeWorkers--;
+		}
+		m_jobDone.notify_all();
+	}
+}
+
+/*
+====================================================
+ThreadPool::RunChunks
+====================================================
+*/
+void ThreadPool::RunChunks() {
+	while ( true ) {
+		const int chunk = m_nextChunk.fetch_add( 1 );
+		if ( chunk >= m_numChunks ) {
+			break;
+		}
+
+		const int begin = chunk * m_grain;
+		const int end = ( begin + m_grain < m_num ) ? ( begin + m_grain ) : m_num;
+		m_func( m_context, begin, end );
+
+		m_chunksDone.fetch_add( 1 );
+	}
+}
+
+/*
+====================================================
+ThreadPool::ParallelForChunks
+====================================================
+*/
+void ThreadPool::ParallelForChunks( const int num, const int grain, const ChunkFunc func, const void * context ) {
+	if ( num <= 0 ) {
+		return;
+	}
+	const int chunkSize = ( grain < 1 ) ? 1 : grain;
+
+	if ( m_workers.empty() || num <= chunkSize || s_insideJob ) {
+		for ( int begin = 0; begin < num; begin += chunkSize ) {
+			const int end = ( begin + chunkSize < num ) ? ( begin + chunkSize ) : num;
+			func( context, begin, end );
+		}
+		return;
+	}
+
+	{
+		// Workers still draining the previous job must leave before it is replaced
+		std::unique_lock< std::mutex > lock( m_mutex );
+		m_jobDone.wait( lock, [ & ] { return 0 == m_activeWorkers; } );
+
+		m_func = func;
+		m_context = context;
+		m_num = num;
+		m_grain = chunkSize;
+		m_numChunks = ( num + chunkSize - 1 ) / chunkSize;
+		m_chunksDone = 0;
+		m_nextChunk = 0;
+		m_jobId++;
+	}
+	m_wakeWorkers.notify_all();
+
+	s_insideJob = true;
+	RunChunks();
+	s_insideJob = false;
+
+	std::unique_lock< std::mutex > lock( m_mutex );
+	m_jobDone.wait( lock, [ & ] { return m_chunksDone.load() == m_numChunks; } );
+}
+
+/*
+====================================================
+ThreadPool::RunOnEveryThreadOnce
+====================================================
+*/
+void ThreadPool::RunOnEveryThreadOnce( const ChunkFunc func, const void * context ) {
+	if ( m_workers.empty() || s_insideJob ) {
+		func( context, 0, 1 );
+		return;
+	}
+
+	// One chunk per thread.  Each chunk waits for all of them to start, so no thread can
+	// finish its chunk early and take a second one.
+	const int numThreads = NumThreads();
+	std::atomic< int > numStarted( 0 );
+	ParallelFor( numThreads, 1, [ & ]( int, int ) {
+		func( context, 0, 1 );
+		numStarted.fetch_add( 1 );
+		while ( numStarted.load() < numThreads ) {
+			std::this_thread::yield();
+		}
+	} );
+}
+
+/*
+====================================================
+GetThreadPool
+====================================================
+*/
+ThreadPool & GetThreadPool() {
+	static ThreadPool pool;
+	return pool;
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+//
+//  ThreadPool.h
+//
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+====================================================
+ThreadPool
+
+Persistent worker threads.  The calling thread takes part in the work,
+so NumThreads() counts the workers plus the caller.
+====================================================
+*/
+class ThreadPool {
+public:
+	ThreadPool( int numWorkers = -1 );
+	~ThreadPool();
+
+	int NumThreads() const { return (int)m_workers.size() + 1; }
+
+	// Calls func( begin, end ) over [0, num) in chunks of at most grain items.
+	// Only one thread may issue jobs; nested calls from inside a job run serially.
+	// The workers call func where it is, so issuing a job allocates nothing.
+	template< typename Func >
+	void ParallelFor( const int num, const int grain, const Func & func ) {
+		ParallelForChunks( num, grain, &CallChunk< Func >, &func );
+	}
+
+	// Calls func() once on every thread of the pool, the caller included, for per
+	// thread setup.  From inside a job, only the calling thread runs it.
+	template< typename Func >
+	void RunOnEveryThread( const Func & func ) {
+		RunOnEveryThreadOnce( &CallOnce< Func >, &func );
+	}
+
+private:
+	typedef void ( *ChunkFunc )( const void * context, int begin, int end );
+
+	template< typename Func >
+	static void CallChunk( const void * context, int begin, int end ) {
+		( *(const Func *)context )( begin, end );
+	}
+
+	template< typename Func >
+	static void CallOnce( const void * context, int, int ) {
+		( *(const Func *)context )();
+	}
+
+	void ParallelForChunks( const int num, const int grain, const ChunkFunc func, const void * context );
+	void RunOnEveryThreadOnce( const ChunkFunc func, const void * context );
+	void WorkerLoop();
+	void RunChunks();
+
+	std::vector< std::thread > m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_wakeWorkers;
+	std::condition_variable m_jobDone;
+	bool m_quit;
+	int m_jobId;
+	int m_activeWorkers;
+
+	ChunkFunc m_func;
+	const void * m_context;
+	int m_num;
+	int m_grain;
+	int m_numChunks;
+	std::atomic< int > m_nextChunk;
+	std::atomic< int > m_chunksDone;
+};
+
+ThreadPool & GetThreadPool();
\ No newline at end of file
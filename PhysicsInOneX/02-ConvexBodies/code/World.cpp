@@ -0,0 +1,7 @@
+//
+//  World.cpp
+//
+#include "World.h"
+
+// The default config is compiled here, with the checks on its capacities
+template class World< WorldConfig >;
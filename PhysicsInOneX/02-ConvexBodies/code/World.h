@@ -0,0 +1,128 @@
+//
+//  World.h
+//
+#pragma once
+#include <assert.h>
+#include <algorithm>
+
+#include "Scene.h"
+#include "FrameArena.h"
+#include "ThreadPool.h"
+#include "../Broadphase.h"
+#include "../ContactGraph.h"
+#include "../GJK.h"
+#include "../XPBD.h"
+
+/*
+====================================================
+WorldConfig
+
+Capacities of a World, fixed at compile time.  A deployment derives its own
+config and hides what it needs to change.
+====================================================
+*/
+struct WorldConfig {
+	static constexpr int maxBodies = 1024;
+	static constexpr int maxPairs = 4096;		// Broadphase pairs in one step
+	static constexpr int maxContacts = 4096;	// Contacts of one step, all islands together
+	static constexpr int maxIslands = 512;		// Awake islands
+
+	// Narrowphase scratch of compound, mesh and heightfield shapes for one pair.  It
+	// follows the shapes rather than the counts above.
+	static constexpr size_t pairScratchBytes = 64 * 1024;
+};
+
+/*
+====================================================
+World
+
+Scene whose storage is all set aside at construction, from the capacities of
+Config.  The body store and islands are reserved, and the frame arena of every
+thread is grown to what a full step of that size draws from it, so updates
+don't touch the heap.  Bodies and shapes are still added between updates.
+
+A step going over the capacities still runs, the arenas fall back to the heap
+for it, and IsWithinCapacity() tells.  Debug builds assert on it after every
+update.
+====================================================
+*/
+template< typename Config = WorldConfig >
+class World {
+public:
+	// Drawn by the thread calling Update, around the jobs
+	static constexpr size_t stepArenaBytes =
+		(size_t)Config::maxBodies * ( sizeof( unsigned long long ) + sizeof( int ) ) +	// Morton reorder
+		BroadPhaseArenaBytes( Config::maxBodies, Config::maxPairs ) +
+		(size_t)Config::maxPairs * ( maxManifoldPoints * sizeof( Contact ) + sizeof( int ) ) +	// Narrowphase results
+		(size_t)Config::maxContacts * 2 * 4 * sizeof( int ) +	// Islands woken by the contacts, grown by doubling
+		BuildIslandsArenaBytes( Config::maxBodies, Config::maxContacts, Config::maxIslands );
+
+	// Drawn by any thread running a job, one at a time
+	static constexpr size_t jobArenaBytes = std::max(
+		EPA_ARENA_BYTES + Config::pairScratchBytes,
+		std::max( ColorContactsArenaBytes( Config::maxContacts ), SolveIslandSubsteppedArenaBytes( Config::maxContacts ) ) );
+
+	// Allocations aligned past the size of their items
+	static constexpr size_t alignmentSlackBytes = 4 * 1024;
+
+	static_assert( Config::maxBodies > 0, "A world holds at least one body" );
+	static_assert( Config::maxIslands <= Config::maxBodies, "An island holds at least one body" );
+	static_assert( (long long)Config::maxPairs <= (long long)Config::maxBodies * ( Config::maxBodies - 1 ) / 2, "More pairs than the bodies can make" );
+	static_assert( (long long)Config::maxContacts <= (long long)Config::maxPairs * maxManifoldPoints, "More contacts than the pairs can make" );
+	static_assert( stepArenaBytes + jobArenaBytes + alignmentSlackBytes <= FrameArena::maxCapacity, "A step doesn't fit in a frame arena" );
+
+	World();
+
+	// Invalid handle once the world holds maxBodies
+	BodyHandle AddBody( const Body & body );
+	void RemoveBody( const BodyHandle handle ) { scene.RemoveBody( handle ); }
+
+	void Update( const float dt_sec ) {
+		scene.Update( dt_sec );
+		assert( IsWithinCapacity() );
+	}
+
+	// False once a step needed more than the capacities
+	bool IsWithinCapacity() const { return GetFrameArenaStats().numOverflows == m_numOverflowsAtStart; }
+
+	Scene scene;
+
+private:
+	World( const World & rhs );
+	const World & operator = ( const World & rhs );
+
+	int m_numOverflowsAtStart;
+};
+
+/*
+====================================================
+World::World
+====================================================
+*/
+template< typename Config >
+World< Config >::World() {
+	scene.Reserve( Config::maxBodies, Config::maxIslands );
+
+	// Every worker may run any job, so each one gets the room of the largest
+	GetThreadPool().RunOnEveryThread( [] {
+		GetFrameArena().Reserve( jobArenaBytes + alignmentSlackBytes );
+		ReserveColorContacts( Config::maxBodies );
+		ReserveSubstepBodies( Config::maxBodies );
+	} );
+	GetFrameArena().Reserve( stepArenaBytes + jobArenaBytes + alignmentSlackBytes );
+
+	m_numOverflowsAtStart = GetFrameArenaStats().numOverflows;
+}
+
+/*
+====================================================
+World::AddBody
+====================================================
+*/
+template< typename Config >
+BodyHandle World< Config >::AddBody( const Body & body ) {
+	if ( scene.bodies.Size() >= Config::maxBodies ) {
+		return BodyHandle();
+	}
+	return scene.bodies.Add( body );
+}
@@ -75,13 +75,14 @@ void Application::Initialize() {
 	scene->Initialize();
 	scene->Reset();
 
-	m_models.reserve( scene->bodies.size() );
-	for ( int i = 0; i < scene->bodies.size(); i++ ) {
+	m_models.reserve( scene->bodies.Size() );
+	for ( int i = 0; i < scene->bodies.Size(); i++ ) {
 		Model * model = new Model();
-		model->BuildFromShape( scene->bodies[ i ].shape );
+		model->BuildFromShape( scene->bodies.ColdState( i ).shape );
 		model->MakeVBO( &deviceContext );
 
 		m_models.push_back( model );
+		m_modelBodies.push_back( scene->bodies.HandleAt( i ) );
 	}
 
 	m_mousePosition = Vec2( 0, 0 );
@@ -294,6 +295,7 @@ void Application::Cleanup() {
 		delete m_models[ i ];
 	}
 	m_models.clear();
+	m_modelBodies.clear();
 
 	// Delete Uniform Buffer Memory
 	m_uniformBuffer.Cleanup( &deviceContext );
@@ -429,6 +431,11 @@ Application::Keyboard
 void Application::Keyboard( int key, int scancode, int action, int modifiers ) {
 	if ( GLFW_KEY_R == key && GLFW_RELEASE == action ) {
 		scene->Reset();
+
+		// The bodies come back in the order they had when the models were built
+		for ( int i = 0; i < (int)m_modelBodies.size(); i++ ) {
+			m_modelBodies[ i ] = scene->bodies.HandleAt( i );
+		}
 	}
 	if ( GLFW_KEY_T == key && GLFW_RELEASE == action ) {
 		m_isPaused = !m_isPaused;
@@ -488,8 +495,13 @@ void Application::MainLoop() {
 		// Run Update
 		if ( runPhysics ) {
 			int startTime = GetTimeMicroseconds();
-			for ( int i = 0; i < 2; i++ ) {
-				scene->Update( dt_sec * 0.5f );
+			if ( Scene::SolverMode::SOLVER_XPBD == scene->solverMode ) {
+				// Substeps are taken inside the scene
+				scene->Update( dt_sec );
+			} else {
+				for ( int i = 0; i < 2; i++ ) {
+					scene->Update( dt_sec * 0.5f );
+				}
 			}
 			int endTime = GetTimeMicroseconds();
 
@@ -615,14 +627,18 @@ void Application::UpdateUniforms() {
 		//
 		//	Update the uniform buffer with the body positions/orientations
 		//
-		for ( int i = 0; i < scene->bodies.size(); i++ ) {
-			Body & body = scene->bodies[ i ];
+		for ( int i = 0; i < (int)m_models.size(); i++ ) {
+			const int index = scene->bodies.IndexOf( m_modelBodies[ i ] );
+			if ( index == -1 ) {
+				continue;
+			}
+			const Quat & orientation = scene->bodies.Orientation( index );
 
-			Vec3 fwd = body.orientation.RotatePoint( Vec3( 1, 0, 0 ) );
-			Vec3 up = body.orientation.RotatePoint( Vec3( 0, 0, 1 ) );
+			Vec3 fwd = orientation.RotatePoint( Vec3( 1, 0, 0 ) );
+			Vec3 up = orientation.RotatePoint( Vec3( 0, 0, 1 ) );
 
 			Mat4 matOrient;
-			matOrient.Orient( body.position, fwd, up );
+			matOrient.Orient( scene->bodies.Position( index ), fwd, up );
 			matOrient = matOrient.Transpose();
 
 			// Update the uniform buffer with the orientation of this body
@@ -13,6 +13,7 @@
 #include "Math/Quat.h"
 #include "../Shape.h"
 #include "../Body.h"
+#include "../BodyStore.h"
 
 #include "Renderer/DeviceContext.h"
 #include "Renderer/model.h"
@@ -67,6 +68,7 @@ private:
 	//
 	Model m_modelFullScreen;
 	std::vector< Model * > m_models;	// models for the bodies
+	std::vector< BodyHandle > m_modelBodies;	// body of each model, the scene can move bodies around
 
 	//
 	//	Pipeline for copying the offscreen framebuffer to the swapchain